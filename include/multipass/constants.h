@@ -44,6 +44,10 @@ constexpr auto autostart_key = "client.gui.autostart"; // idem
 constexpr auto winterm_key = "client.apps.windows-terminal.profiles"; // idem
 constexpr auto hotkey_key = "client.gui.hotkey";                      // idem
 constexpr auto hotkey_default = "Ctrl+Alt+U";                         // idem; translates to Cmd+Opt+U on macOS
+constexpr auto prefetch_images_key = "local.images.prefetch";         // idem
+constexpr auto prefetch_rate_key = "local.images.prefetch-rate";      // idem
+constexpr auto mount_cache_attributes_key = "local.mounts.cache-attributes"; // idem
+constexpr auto image_decoder_threads_key = "local.images.decoder-threads";   // idem
 } // namespace multipass
 
 #endif // MULTIPASS_CONSTANTS_H
@@ -64,6 +64,8 @@ std::unique_ptr<Process> make_process(std::unique_ptr<ProcessSpec>&& process_spe
 int chown(const char* path, unsigned int uid, unsigned int gid);
 bool symlink(const char* target, const char* link, bool is_dir);
 bool link(const char* target, const char* link);
+// Copies the file the cheapest way its filesystem allows, leaving holes unfilled; false if it could not be copied
+bool copy_file(const Path& source, const Path& destination);
 int utime(const char* path, int atime, int mtime);
 int symlink_attr_from(const char* path, sftp_attributes_struct* attr);
 bool is_alias_supported(const std::string& alias, const std::string& remote);
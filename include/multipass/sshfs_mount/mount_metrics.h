@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_MOUNT_METRICS_H
+#define MULTIPASS_MOUNT_METRICS_H
+
+#include <QJsonObject>
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace multipass
+{
+// What sshfs_server reports to multipassd about the requests served for a mount
+struct MountMetrics
+{
+    // Upper bounds of the latency histogram buckets, the last bucket has none
+    static constexpr std::array<uint64_t, 7> latency_bucket_bounds_us{16, 64, 256, 1024, 4096, 16384, 65536};
+    static constexpr auto num_latency_buckets = latency_bucket_bounds_us.size() + 1;
+
+    struct Operation
+    {
+        uint64_t count{0};
+        uint64_t total_latency_us{0};
+        std::array<uint64_t, num_latency_buckets> latency_histogram{};
+    };
+
+    uint64_t bytes_read{0};
+    uint64_t bytes_written{0};
+    uint64_t attr_cache_hits{0};
+    uint64_t attr_cache_misses{0};
+    std::map<std::string, Operation> operations; // keyed by "open", "read", "write", "stat", "readdir" or "other"
+};
+
+QJsonObject to_json(const MountMetrics& metrics);
+MountMetrics mount_metrics_from(const QJsonObject& json);
+} // namespace multipass
+#endif // MULTIPASS_MOUNT_METRICS_H
@@ -22,36 +22,85 @@
 
 #include <libssh/sftp.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
-#include <QFile>
 #include <QFileInfo>
 
+#include <sys/stat.h>
+
 namespace multipass
 {
 class SSHSession;
 class SSHProcess;
+class SftpAttrCache;
+class SftpBufferPool;
+class SftpMetrics;
+class SftpOpenDir;
+class SftpOpenFile;
+class SftpWorkerPool;
 
 class SftpServer
 {
 public:
     SftpServer(SSHSession&& ssh_session, const std::string& source, const std::string& target,
                const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map,
-               int default_uid, int default_gid, const std::string& sshfs_exec_line);
+               int default_uid, int default_gid, const std::string& sshfs_exec_line, int worker_threads,
+               bool cache_attributes);
+    // For serving several mounts over one session. The worker pool may be null to serve requests inline.
+    SftpServer(std::shared_ptr<SSHSession> ssh_session, std::shared_ptr<SftpWorkerPool> worker_pool,
+               std::shared_ptr<SftpBufferPool> read_buffers, const std::string& source, const std::string& target,
+               const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map,
+               int default_uid, int default_gid, const std::string& sshfs_exec_line, bool cache_attributes);
     SftpServer(SftpServer&& other);
     ~SftpServer();
 
     void run();
     void stop();
 
+    // Used instead of run() when the session is shared: serves what the client has already sent, without blocking,
+    // and returns false once this server is done
+    bool serve_ready_messages();
+    ssh_channel channel() const;
+    std::shared_ptr<const SftpMetrics> metrics() const;
+    // Stops serving this mount alone, leaving the shared session up; called from the thread serving it
+    void close();
+
     using SSHSessionUptr = std::unique_ptr<ssh_session_struct, decltype(ssh_free)*>;
     using SftpSessionUptr = std::unique_ptr<sftp_session_struct, decltype(sftp_free)*>;
     using SSHFSProcUptr = std::unique_ptr<SSHProcess>;
+    using MsgUPtr = std::unique_ptr<sftp_client_message_struct, decltype(sftp_client_message_free)*>;
 
 private:
+    // Deferred reply to a request whose work was already done, possibly on a worker thread
+    using Reply = std::function<int()>;
+    struct CompletedReply
+    {
+        sftp_client_message msg;
+        Reply reply;
+        std::chrono::steady_clock::time_point received;
+    };
+
+    bool serve_next_message();
+    void finish();
     void process_message(sftp_client_message msg);
+    void dispatch(MsgUPtr client_msg);
+    bool client_message_ready();
+    void send_completed_replies();
+    void wait_for_pending_replies();
+    void discard_pending_replies();
+    std::size_t ordering_key_for(sftp_client_message msg);
+    void flush_pending_writes();
+    void flush_pending_writes_to(std::string_view path);
     sftp_attributes_struct attr_from(const QFileInfo& file_info);
+    sftp_attributes_struct attr_from(const struct stat& st);
     int mapped_uid_for(const int uid);
     int mapped_gid_for(const int gid);
 
@@ -72,20 +121,42 @@ private:
     int handle_symlink(sftp_client_message msg);
     int handle_write(sftp_client_message msg);
     int handle_extended(sftp_client_message msg);
+    int handle_fsync(sftp_client_message msg);
+    int handle_copy_data(sftp_client_message msg);
+    int handle_statvfs(sftp_client_message msg);
+    SftpOpenFile* open_file_from(const std::string& handle);
 
-    SSHSession ssh_session;
+    Reply prepare_pipelined(sftp_client_message msg);
+    Reply prepare_fstat(sftp_client_message msg);
+    Reply prepare_read(sftp_client_message msg);
+    Reply prepare_stat(sftp_client_message msg, bool follow);
+    Reply prepare_write(sftp_client_message msg);
+
+    std::shared_ptr<SSHSession> ssh_session;
     SSHFSProcUptr sshfs_process;
     SftpSessionUptr sftp_server_session;
     const std::string source_path;
     const std::string target_path;
-    std::unordered_map<void*, std::unique_ptr<QFileInfoList>> open_dir_handles;
-    std::unordered_map<void*, std::unique_ptr<QFile>> open_file_handles;
+    std::unordered_map<void*, std::unique_ptr<SftpOpenDir>> open_dir_handles;
+    std::unordered_map<void*, std::unique_ptr<SftpOpenFile>> open_file_handles;
     const std::unordered_map<int, int> gid_map;
     const std::unordered_map<int, int> uid_map;
     const int default_uid;
     const int default_gid;
     const std::string sshfs_exec_line;
     bool stop_invoked{false};
+    std::shared_ptr<SftpBufferPool> read_buffers;
+    std::unique_ptr<SftpAttrCache> attr_cache;
+
+    std::shared_ptr<SftpMetrics> request_metrics;
+
+    // Only set when requests are to be served by worker threads
+    std::shared_ptr<SftpWorkerPool> worker_pool;
+    std::mutex replies_mutex;
+    std::condition_variable replies_cv;
+    std::vector<CompletedReply> completed_replies;
+    std::vector<CompletedReply> sending_replies;
+    std::size_t pending_replies{0};
 };
 } // namespace multipass
 #endif // MULTIPASS_SFTP_SERVER_H
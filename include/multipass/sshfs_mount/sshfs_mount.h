@@ -18,29 +18,69 @@
 #ifndef MULTIPASS_SSHFS_MOUNT
 #define MULTIPASS_SSHFS_MOUNT
 
+#include <multipass/vm_mount.h>
+
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 namespace multipass
 {
 class SSHSession;
+class SftpMetrics;
 class SftpServer;
+class SftpWorkerPool;
 class SshfsMount
 {
 public:
+    struct Target
+    {
+        std::string source;
+        std::string target;
+        std::unordered_map<int, int> gid_map;
+        std::unordered_map<int, int> uid_map;
+        VMMount::MountProfile profile{VMMount::MountProfile::Default};
+    };
+
     SshfsMount(SSHSession&& session, const std::string& source, const std::string& target,
-               const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map);
+               const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map,
+               int worker_threads, bool cache_attributes);
+    // Serves all the targets over the one session, from a single thread
+    SshfsMount(SSHSession&& session, const std::vector<Target>& targets, int worker_threads, bool cache_attributes);
     SshfsMount(SshfsMount&& other);
     ~SshfsMount();
 
     void stop();
+    // Stops serving one target, leaving the others mounted
+    void stop(const std::string& target);
 
 private:
-    // sftp_server Doesn't need to be a pointer, but done for now to avoid bringing sftp.h
+    void serve();
+    void wait_for_ready_channels();
+    void close_stopped_targets();
+    void report_metrics();
+    void print_line(const std::string& line);
+
+    std::shared_ptr<SSHSession> ssh_session;
+    std::shared_ptr<SftpWorkerPool> worker_pool; // shared by all the servers, when requests are served by workers
+    // The servers don't need to be pointers, but done for now to avoid bringing sftp.h
     // which has an error with -pedantic.
-    std::unique_ptr<SftpServer> sftp_server;
+    std::unordered_map<std::string, std::unique_ptr<SftpServer>> sftp_servers;
+    const bool single_target;
+    std::atomic<bool> stop_invoked{false};
+    std::mutex stopped_targets_mutex;
+    std::vector<std::string> stopped_targets;
+    std::mutex metrics_mutex;
+    std::condition_variable metrics_cv;
+    std::unordered_map<std::string, std::shared_ptr<const SftpMetrics>> target_metrics;
+    std::mutex output_mutex;
     std::thread sftp_thread;
+    std::thread metrics_thread;
 };
 } // namespace multipass
 #endif // MULTIPASS_SSHFS_MOUNT
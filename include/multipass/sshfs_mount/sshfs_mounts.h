@@ -19,12 +19,17 @@
 #define MULTIPASS_SSHFSMOUNTS_H
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 
+#include <multipass/optional.h>
 #include <multipass/process/process.h>
 #include <multipass/qt_delete_later_unique_ptr.h>
 #include <multipass/ssh/ssh_key_provider.h>
+#include <multipass/sshfs_mount/mount_metrics.h>
+#include <multipass/sshfs_server_config.h>
+#include <multipass/vm_mount.h>
 
 namespace multipass
 {
@@ -37,17 +42,28 @@ public:
     explicit SSHFSMounts(const SSHKeyProvider& ssh_key_provider);
 
     void start_mount(VirtualMachine* vm, const std::string& source_path, const std::string& target_path,
-                     const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map);
+                     const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map,
+                     VMMount::MountProfile mount_profile = VMMount::MountProfile::Default);
+    // Serves all the given mounts, keyed by target path, from a single sshfs_server process
+    void start_mounts(VirtualMachine* vm, const std::unordered_map<std::string, VMMount>& mounts);
 
     bool stop_mount(const std::string& instance, const std::string& path);
     void stop_all_mounts_for_instance(const std::string& instance);
 
     bool has_instance_already_mounted(const std::string& instance, const std::string& path) const;
+    // The latest metrics reported by the sshfs_server serving the mount, if any
+    optional<MountMetrics> metrics_for(const std::string& instance, const std::string& path) const;
 
 private:
+    SSHFSServerConfig server_config_for(VirtualMachine* vm) const;
+    void start_server(VirtualMachine* vm, const SSHFSServerConfig& config);
+    void collect_metrics(const std::string& instance, Process* process);
+
     const std::string key;
-    std::unordered_map<std::string, std::unordered_map<std::string, qt_delete_later_unique_ptr<Process>>>
-        mount_processes;
+    // Targets served by the same sshfs_server share its process
+    std::unordered_map<std::string, std::unordered_map<std::string, std::shared_ptr<Process>>> mount_processes;
+    mutable std::mutex metrics_mutex; // metrics are read from RPC threads
+    std::unordered_map<std::string, std::unordered_map<std::string, MountMetrics>> mount_metrics;
 };
 
 } // namespace multipass
@@ -18,12 +18,24 @@
 #ifndef MULTIPASS_SSHFS_SERVER_CONFIG_H
 #define MULTIPASS_SSHFS_SERVER_CONFIG_H
 
+#include <multipass/vm_mount.h>
+
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace multipass
 {
 
+struct SSHFSMountConfig
+{
+    std::string source_path;
+    std::string target_path;
+    std::unordered_map<int, int> gid_map;
+    std::unordered_map<int, int> uid_map;
+    VMMount::MountProfile mount_profile{VMMount::MountProfile::Default};
+};
+
 struct SSHFSServerConfig
 {
     std::string host;
@@ -35,6 +47,10 @@ struct SSHFSServerConfig
     std::string target_path;
     std::unordered_map<int, int> gid_map;
     std::unordered_map<int, int> uid_map;
+    int worker_threads{0}; // 0 serves every request inline, in the order received
+    bool cache_attributes{false};
+    VMMount::MountProfile mount_profile{VMMount::MountProfile::Default};
+    std::vector<SSHFSMountConfig> additional_mounts; // served by the same process, over the same session
 };
 
 } // namespace multipass
@@ -23,35 +23,75 @@
 
 #include <QByteArray>
 #include <QDateTime>
+#include <QObject>
+#include <QString>
+#include <QThread>
 
 #include <atomic>
 #include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
 
+class QCryptographicHash;
+class QNetworkAccessManager;
 class QUrl;
-class QString;
 namespace multipass
 {
 class URLDownloader
 {
 public:
+    // Given each chunk of data as it arrives, throwing to abort the download
+    using DataConsumer = std::function<void(const QByteArray& data)>;
+
     URLDownloader(std::chrono::milliseconds timeout);
-    URLDownloader(const Path& cache_dir, std::chrono::milliseconds timeout);
-    virtual ~URLDownloader() = default;
-    virtual void download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
-                             const ProgressMonitor& monitor);
+    // Large downloads are split across up to download_connections connections, when the server accepts ranges
+    URLDownloader(const Path& cache_dir, std::chrono::milliseconds timeout, int download_connections = 1);
+    virtual ~URLDownloader();
+    // Returns the SHA-256 of the downloaded data, in hex. Data is received into file_name.part, which a later call
+    // resumes from if this one fails.
+    virtual QString download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
+                                const ProgressMonitor& monitor);
+    // Like download_to(), but hands the data over instead of saving it
+    virtual QString stream_to(const QUrl& url, const DataConsumer& consumer, int64_t size, const int download_type,
+                              const ProgressMonitor& monitor);
     virtual QByteArray download(const QUrl& url);
     virtual QDateTime last_modified(const QUrl& url);
     virtual void abort_all_downloads();
+    // Downloads of the url that start from now on are kept to the given rate, or no longer limited when it is 0
+    void limit_rate(const QUrl& url, qint64 max_bytes_per_second);
 
 protected:
+    qint64 rate_limit_for(const QUrl& url);
+
     std::atomic_bool abort_download{false};
 
 private:
+    // Receives the bytes from offset to end, which is the end of the data when negative, asking for the rest again
+    // when the connection drops. Should the server send everything regardless, restart is called before starting
+    // over, or the download fails when there is no way to restart. A validator is sent along with any range asked
+    // for, so that the server sends everything should the data have changed, and updated from every response.
+    QString download_to_consumer(const QUrl& url, const DataConsumer& consumer, const std::function<void()>& restart,
+                                 QCryptographicHash* hash, QByteArray* validator, qint64 offset, qint64 end,
+                                 int64_t size, const int download_type, const ProgressMonitor& monitor);
+    QString download_ranges_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
+                               const ProgressMonitor& monitor);
+    bool accepts_ranges(const QUrl& url);
+    QNetworkAccessManager* network_manager();
+
     URLDownloader(const URLDownloader&) = delete;
     URLDownloader& operator=(const URLDownloader&) = delete;
 
     const Path cache_dir_path;
     std::chrono::milliseconds timeout;
+    const int download_connections;
+    // All requests go through the one manager, on a thread of its own, so that they share its connections
+    std::once_flag network_thread_started;
+    QThread network_thread;
+    QObject network_context;
+    QNetworkAccessManager* manager{nullptr};
+    std::mutex rate_limits_mutex;
+    std::map<QString, qint64> rate_limits;
 };
 }
 #endif // MULTIPASS_URL_DOWNLOADER_H
@@ -68,6 +68,7 @@ QString backend_directory_path(const Path& path, const QString& subdirectory);
 std::string filename_for(const std::string& path);
 std::string contents_of(const multipass::Path& file_path);
 bool invalid_target_path(const QString& target_path);
+std::string native_mount_tag(const std::string& target_path);
 qint64 filesystem_bytes_available(const QString& data_directory);
 
 // special-file helpers
@@ -18,8 +18,10 @@
 #ifndef MULTIPASS_VIRTUAL_MACHINE_H
 #define MULTIPASS_VIRTUAL_MACHINE_H
 
+#include <multipass/exceptions/not_implemented_on_this_backend_exception.h>
 #include <multipass/ip_address.h>
 #include <multipass/optional.h>
+#include <multipass/vm_mount.h>
 
 #include <chrono>
 #include <condition_variable>
@@ -71,6 +73,16 @@ public:
     virtual void ensure_vm_is_running() = 0;
     virtual void update_state() = 0;
 
+    // Native mounts are exported by the hypervisor. Adding one to a running instance plugs it in where the hypervisor
+    // can, returning whether the instance sees it now rather than after it restarts.
+    virtual bool add_native_mount(const std::string& /* target_path */, const VMMount& /* mount */)
+    {
+        throw NotImplementedOnThisBackendException("native mounts");
+    }
+    virtual void remove_native_mount(const std::string& /* target_path */)
+    {
+    }
+
     VirtualMachine::State state;
     const std::string vm_name;
     std::condition_variable state_wait;
@@ -29,6 +29,7 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace multipass
 {
@@ -39,7 +40,13 @@ QString filename_for(const Path& path);
 void delete_file(const Path& path);
 QString compute_image_hash(const Path& image_path);
 void verify_image_download(const Path& image_path, const QString& image_hash);
+void verify_image_hash(const QString& computed_hash, const QString& image_hash);
 QString extract_image(const Path& image_path, const ProgressMonitor& monitor, const bool delete_file = false);
+bool is_qcow2_image(const Path& image_path);
+// The image a qcow2 overlay is backed by, or an empty path for anything else
+Path backing_image_of(const Path& image_path);
+// The virtual size in a qcow2 header, or 0 for anything else
+qint64 qcow2_virtual_size(const Path& image_path);
 
 class DeleteOnException
 {
@@ -77,6 +84,11 @@ public:
     virtual void prune_expired_images() = 0;
     virtual void update_images(const FetchType& fetch_type, const PrepareAction& prepare,
                                const ProgressMonitor& monitor) = 0;
+    // Fetches and prepares the images for those queries that are not already, downloading at up to max_download_rate
+    // bytes per second when it is not 0
+    virtual void prefetch_images(const FetchType& fetch_type, const std::vector<Query>& queries,
+                                 const PrepareAction& prepare, const ProgressMonitor& monitor,
+                                 const MemorySize& max_download_rate) = 0;
     virtual MemorySize minimum_image_size_for(const std::string& id) = 0;
 
 protected:
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef MULTIPASS_VM_MOUNT_H
+#define MULTIPASS_VM_MOUNT_H
+
+#include <string>
+#include <unordered_map>
+
+namespace multipass
+{
+struct VMMount
+{
+    enum class MountType : int
+    {
+        Classic = 0, // SSHFS, served by sshfs_server over an SSH channel
+        Native = 1   // exported by the hypervisor itself
+    };
+
+    // How much SSHFS may cache, trading freshness of what the host changes for speed
+    enum class MountProfile : int
+    {
+        Default = 0,
+        ReadonlyCached = 1, // read-only, for data that rarely changes on the host
+        Strict = 2          // every access goes to the host
+    };
+
+    std::string source_path;
+    std::unordered_map<int, int> gid_map;
+    std::unordered_map<int, int> uid_map;
+    MountType mount_type{MountType::Classic};
+    MountProfile mount_profile{MountProfile::Default};
+};
+} // namespace multipass
+#endif // MULTIPASS_VM_MOUNT_H
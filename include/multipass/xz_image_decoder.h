@@ -22,7 +22,9 @@
 #include <multipass/progress_monitor.h>
 
 #include <memory>
+#include <vector>
 
+#include <QCryptographicHash>
 #include <QFile>
 
 #include <xz.h>
@@ -32,15 +34,33 @@ namespace multipass
 class XzImageDecoder
 {
 public:
-    XzImageDecoder(const Path& xz_file_path);
+    // Multi-block files are decoded with up to decoder_threads threads, or one per core when it is 0
+    XzImageDecoder(const Path& xz_file_path, int decoder_threads = 0);
+    // For decoding a stream as it arrives, without a compressed file to read it from
+    XzImageDecoder();
 
-    void decode_to(const Path& decoded_file_path, const ProgressMonitor& monitor);
+    // Returns the SHA-256 of the decoded image
+    QString decode_to(const Path& decoded_file_path, const ProgressMonitor& monitor);
+
+    void start_decoding_to(const Path& decoded_file_path);
+    // Returns false once the end of the stream was decoded; anything after it is ignored
+    bool decode(const QByteArray& xz_data);
+    // Throws if the stream ended early, otherwise returns the SHA-256 of what was decoded
+    QString finish_decoding();
 
     using XzDecoderUPtr = std::unique_ptr<xz_dec, decltype(xz_dec_end)*>;
 
 private:
+    void write_decoded(qint64 size);
+    bool decode_blocks_to(const Path& decoded_file_path, const ProgressMonitor& monitor);
+
     QFile xz_file;
+    const int decoder_threads;
     XzDecoderUPtr xz_decoder;
+    QFile decoded_file;
+    std::vector<uint8_t> decoded_data;
+    QCryptographicHash decoded_hash{QCryptographicHash::Sha256};
+    bool stream_ended{false};
 };
 } // namespace multipass
 #endif // MULTIPASS_XZ_IMAGE_DECODER_H
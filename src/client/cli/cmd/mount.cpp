@@ -112,7 +112,18 @@ mp::ParseCode cmd::Mount::parse_args(mp::ArgParser* parser)
                                                  "File and folder ownership will be mapped from "
                                                  "<host> to <instance> inside the instance. Can be "
                                                  "used multiple times.", "host>:<instance");
-    parser->addOptions({gid_map, uid_map});
+    QCommandLineOption mount_type({"t", "type"}, "Specify the type of mount to use. Classic mounts go "
+                                                 "through SSHFS. Native mounts are exported by the "
+                                                 "hypervisor, when supported, and appear in the instance "
+                                                 "the next time it starts. Valid types are: 'classic' "
+                                                 "(default) and 'native'.", "type", "classic");
+    QCommandLineOption mount_profile("mount-profile",
+                                     "Specify how much a classic mount may cache. 'readonly-cached' mounts "
+                                     "read-only and caches aggressively, for data that rarely changes on the "
+                                     "host. 'strict' caches nothing, so that changes on the host show up right "
+                                     "away. Valid profiles are: 'default', 'readonly-cached' and 'strict'.",
+                                     "profile", "default");
+    parser->addOptions({gid_map, uid_map, mount_type, mount_profile});
 
     auto status = parser->commandParse(this);
     if (status != ParseCode::Ok)
@@ -166,6 +177,47 @@ mp::ParseCode cmd::Mount::parse_args(mp::ArgParser* parser)
         }
     }
 
+    const auto type = parser->value(mount_type);
+    if (type == "classic")
+    {
+        request.set_mount_type(MountRequest::CLASSIC);
+    }
+    else if (type == "native")
+    {
+        request.set_mount_type(MountRequest::NATIVE);
+    }
+    else
+    {
+        cerr << "Bad mount type '" << type.toStdString() << "' specified, please use 'classic' or 'native'\n";
+        return ParseCode::CommandLineError;
+    }
+
+    const auto profile = parser->value(mount_profile);
+    if (profile == "default")
+    {
+        request.set_mount_profile(MountRequest::PROFILE_DEFAULT);
+    }
+    else if (profile == "readonly-cached")
+    {
+        request.set_mount_profile(MountRequest::PROFILE_READONLY_CACHED);
+    }
+    else if (profile == "strict")
+    {
+        request.set_mount_profile(MountRequest::PROFILE_STRICT);
+    }
+    else
+    {
+        cerr << "Bad mount profile '" << profile.toStdString()
+             << "' specified, please use 'default', 'readonly-cached' or 'strict'\n";
+        return ParseCode::CommandLineError;
+    }
+
+    if (request.mount_type() == MountRequest::NATIVE && request.mount_profile() != MountRequest::PROFILE_DEFAULT)
+    {
+        cerr << "Mount profiles only apply to classic mounts\n";
+        return ParseCode::CommandLineError;
+    }
+
     QRegExp map_matcher("^([0-9]+[:][0-9]+)$");
 
     if (parser->isSet(uid_map))
@@ -26,6 +26,39 @@
 
 namespace mp = multipass;
 
+namespace
+{
+QJsonObject metrics_json(const mp::MountMetricsInfo& metrics)
+{
+    QJsonArray bucket_bounds;
+    for (const auto& bound : metrics.latency_bucket_bounds_us())
+        bucket_bounds.append(static_cast<double>(bound));
+
+    QJsonObject operations;
+    for (const auto& operation : metrics.operations())
+    {
+        QJsonArray histogram;
+        for (const auto& bucket : operation.latency_histogram())
+            histogram.append(static_cast<double>(bucket));
+
+        QJsonObject entry;
+        entry.insert("count", static_cast<double>(operation.count()));
+        entry.insert("total_latency_us", static_cast<double>(operation.total_latency_us()));
+        entry.insert("latency_histogram", histogram);
+        operations.insert(QString::fromStdString(operation.name()), entry);
+    }
+
+    QJsonObject json;
+    json.insert("bytes_read", static_cast<double>(metrics.bytes_read()));
+    json.insert("bytes_written", static_cast<double>(metrics.bytes_written()));
+    json.insert("attr_cache_hits", static_cast<double>(metrics.attr_cache_hits()));
+    json.insert("attr_cache_misses", static_cast<double>(metrics.attr_cache_misses()));
+    json.insert("latency_bucket_bounds_us", bucket_bounds);
+    json.insert("operations", operations);
+    return json;
+}
+} // namespace
+
 std::string mp::JsonFormatter::format(const InfoReply& reply) const
 {
     QJsonObject info_json;
@@ -97,6 +130,8 @@ std::string mp::JsonFormatter::format(const InfoReply& reply) const
             entry.insert("uid_mappings", mount_uids);
             entry.insert("gid_mappings", mount_gids);
             entry.insert("source_path", QString::fromStdString(mount.source_path()));
+            if (mount.has_metrics())
+                entry.insert("metrics", metrics_json(mount.metrics()));
 
             mounts.insert(QString::fromStdString(mount.target_path()), entry);
         }
@@ -49,6 +49,27 @@ std::string to_usage(const std::string& usage, const std::string& total)
     return fmt::format("{} out of {}", human_readable_size(usage), human_readable_size(total));
 }
 
+std::string to_io_summary(const mp::MountMetricsInfo& metrics)
+{
+    uint64_t requests{0}, total_latency_us{0};
+    for (const auto& operation : metrics.operations())
+    {
+        requests += operation.count();
+        total_latency_us += operation.total_latency_us();
+    }
+
+    auto summary = fmt::format("{} read, {} written, {} requests ({}us avg)",
+                               human_readable_size(std::to_string(metrics.bytes_read())),
+                               human_readable_size(std::to_string(metrics.bytes_written())), requests,
+                               requests ? total_latency_us / requests : 0);
+
+    if (metrics.attr_cache_hits() || metrics.attr_cache_misses())
+        summary += fmt::format(", {} attribute cache hits, {} misses", metrics.attr_cache_hits(),
+                               metrics.attr_cache_misses());
+
+    return summary;
+}
+
 // Computes the column width needed to display all the elements of a range [begin, end). get_width is a function
 // which takes as input the element in the range and returns its width in columns.
 auto column_width = [](const auto begin, const auto end, const auto get_width, int minimum_width = 0) {
@@ -118,6 +139,8 @@ std::string mp::TableFormatter::format(const InfoReply& reply) const
                     (std::next(gid_map) != mount->mount_maps().gid_map().cend()) ? ", " : "",
                     (std::next(gid_map) == mount->mount_maps().gid_map().cend()) ? "\n" : "");
             }
+            if (mount->has_metrics())
+                fmt::format_to(buf, "{:>29}{}\n", "I/O: ", to_io_summary(mount->metrics()));
         }
 
         fmt::format_to(buf, "\n");
@@ -28,6 +28,33 @@
 namespace mp = multipass;
 namespace mpu = multipass::utils;
 
+namespace
+{
+YAML::Node metrics_node(const mp::MountMetricsInfo& metrics)
+{
+    YAML::Node node;
+    node["bytes_read"] = metrics.bytes_read();
+    node["bytes_written"] = metrics.bytes_written();
+    node["attr_cache_hits"] = metrics.attr_cache_hits();
+    node["attr_cache_misses"] = metrics.attr_cache_misses();
+    for (const auto& bound : metrics.latency_bucket_bounds_us())
+        node["latency_bucket_bounds_us"].push_back(bound);
+
+    for (const auto& operation : metrics.operations())
+    {
+        YAML::Node operation_node;
+        operation_node["count"] = operation.count();
+        operation_node["total_latency_us"] = operation.total_latency_us();
+        for (const auto& bucket : operation.latency_histogram())
+            operation_node["latency_histogram"].push_back(bucket);
+
+        node["operations"][operation.name()] = operation_node;
+    }
+
+    return node;
+}
+} // namespace
+
 std::string mp::YamlFormatter::format(const InfoReply& reply) const
 {
     YAML::Node info_node;
@@ -103,6 +130,8 @@ std::string mp::YamlFormatter::format(const InfoReply& reply) const
             }
 
             mount_node["source_path"] = mount.source_path();
+            if (mount.has_metrics())
+                mount_node["metrics"] = metrics_node(mount.metrics());
             mounts[mount.target_path()] = mount_node;
         }
         instance_node["mounts"] = mounts;
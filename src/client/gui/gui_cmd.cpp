@@ -171,7 +171,11 @@ void cmd::GuiCmd::update_menu()
 {
     std::vector<std::string> instances_to_remove;
 
-    auto reply = list_future.result();
+    ListReply reply;
+    {
+        std::lock_guard<decltype(watch_mutex)> lock{watch_mutex};
+        reply = watched_instances;
+    }
 
     handle_petenv_instance(reply.instances());
 
@@ -270,12 +274,14 @@ void cmd::GuiCmd::create_menu()
 
     tray_icon.setIcon(QIcon{":images/multipass-icon.png"});
 
-    QObject::connect(&list_watcher, &QFutureWatcher<ListReply>::finished, this, &GuiCmd::update_menu);
+    QObject::connect(this, &GuiCmd::instances_changed, this, &GuiCmd::update_menu, Qt::QueuedConnection);
 
+    // Only reconnects when the daemon ends the stream, e.g. on restart; changes are pushed while it is up
     QObject::connect(&menu_update_timer, &QTimer::timeout, this, [this] { initiate_menu_layout(); });
 
     // Use a singleShot here to make sure the event loop is running before the quit() runs
     QObject::connect(quit_action, &QAction::triggered, [this] {
+        stop_watching_instances();
         future_synchronizer.waitForFinished();
         QTimer::singleShot(0, [] { QCoreApplication::quit(); });
     });
@@ -315,11 +321,10 @@ void cmd::GuiCmd::initiate_menu_layout()
         tray_icon_menu.removeAction(&failure_action);
     }
 
-    if (!list_future.isRunning())
+    if (!watch_future.isRunning())
     {
-        list_future = QtConcurrent::run(this, &GuiCmd::retrieve_all_instances);
-        future_synchronizer.addFuture(list_future);
-        list_watcher.setFuture(list_future);
+        watch_future = QtConcurrent::run(this, &GuiCmd::watch_instances);
+        future_synchronizer.addFuture(watch_future);
     }
 }
 
@@ -333,25 +338,68 @@ void cmd::GuiCmd::initiate_about_menu_layout()
     }
 }
 
-mp::ListReply cmd::GuiCmd::retrieve_all_instances()
+void cmd::GuiCmd::watch_instances()
 {
-    ListReply list_reply;
-    auto on_success = [&list_reply](ListReply& reply) {
-        list_reply = reply;
+    grpc::ClientContext* context;
+    {
+        std::lock_guard<decltype(watch_mutex)> lock{watch_mutex};
+        watch_context = std::make_unique<grpc::ClientContext>();
+        context = watch_context.get();
+    }
 
-        return ReturnCode::Ok;
-    };
+    WatchRequest request;
+    auto reader = stub->watch(context, request);
 
-    auto on_failure = [this](grpc::Status& status) {
-        tray_icon_menu.insertAction(about_separator, &failure_action);
+    WatchReply reply;
+    while (reader->Read(&reply))
+    {
+        {
+            std::lock_guard<decltype(watch_mutex)> lock{watch_mutex};
+            if (reply.has_snapshot())
+                watched_instances = reply.snapshot();
 
-        return standard_failure_handler_for(name(), cerr, status);
-    };
+            auto instances = watched_instances.mutable_instances();
+            for (const auto& changed : reply.changed_instances())
+            {
+                auto it = std::find_if(instances->begin(), instances->end(),
+                                       [&changed](const ListVMInstance& instance) {
+                                           return instance.name() == changed.name();
+                                       });
+                if (it != instances->end())
+                    *it = changed;
+                else
+                    *instances->Add() = changed;
+            }
 
-    ListRequest request;
-    dispatch(&RpcMethod::list, request, on_success, on_failure);
+            for (const auto& removed : reply.removed_instances())
+            {
+                auto it = std::find_if(instances->begin(), instances->end(),
+                                       [&removed](const ListVMInstance& instance) { return instance.name() == removed; });
+                if (it != instances->end())
+                    instances->erase(it);
+            }
+        }
+
+        emit instances_changed();
+    }
+
+    // A daemon that dropped us for falling behind is simply watched again on the next menu update
+    auto status = reader->Finish();
+    if (!status.ok() && status.error_code() != grpc::StatusCode::CANCELLED &&
+        status.error_code() != grpc::StatusCode::RESOURCE_EXHAUSTED)
+    {
+        tray_icon_menu.insertAction(about_separator, &failure_action);
+        standard_failure_handler_for(name(), cerr, status);
+    }
+}
+
+void cmd::GuiCmd::stop_watching_instances()
+{
+    menu_update_timer.stop();
 
-    return list_reply;
+    std::lock_guard<decltype(watch_mutex)> lock{watch_mutex};
+    if (watch_context)
+        watch_context->TryCancel();
 }
 
 void cmd::GuiCmd::create_menu_actions_for(const std::string& instance_name, const mp::InstanceStatus& state)
@@ -31,6 +31,7 @@
 #include <QHotkey>
 
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -62,6 +63,9 @@ public:
         return "";
     };
 
+signals:
+    void instances_changed();
+
 private:
     ParseCode parse_args(ArgParser* parser) override
     {
@@ -74,7 +78,8 @@ private:
     void update_about_menu();
     void initiate_menu_layout();
     void initiate_about_menu_layout();
-    ListReply retrieve_all_instances();
+    void watch_instances();
+    void stop_watching_instances();
     void create_menu_actions_for(const std::string& instance_name, const InstanceStatus& state);
     void handle_petenv_instance(const google::protobuf::RepeatedPtrField<ListVMInstance>&);
     void start_instance_for(const std::string& instance_name);
@@ -111,8 +116,10 @@ private:
     };
     std::unordered_map<std::string, InstanceEntry> instances_entries;
 
-    QFuture<ListReply> list_future;
-    QFutureWatcher<ListReply> list_watcher;
+    QFuture<void> watch_future;
+    std::mutex watch_mutex;
+    std::unique_ptr<grpc::ClientContext> watch_context;
+    ListReply watched_instances; // the daemon's snapshot with every change since applied
 
     QFuture<VersionReply> version_future;
     QFutureWatcher<VersionReply> version_watcher;
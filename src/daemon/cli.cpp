@@ -46,6 +46,16 @@ multipass::logging::Level to_logging_level(const QString& value)
 
     throw std::runtime_error("invalid logging verbosity: " + value.toStdString());
 }
+
+int to_count(const QString& value, const std::string& what)
+{
+    bool ok;
+    auto count = value.toInt(&ok);
+    if (!ok || count < 1)
+        throw std::runtime_error(fmt::format("invalid number of {} '{}'", what, value));
+
+    return count;
+}
 } // namespace
 
 mp::DaemonConfigBuilder mp::cli::parse(const QCoreApplication& app)
@@ -62,10 +72,20 @@ mp::DaemonConfigBuilder mp::cli::parse(const QCoreApplication& app)
                                       "specifies which address to use for the multipassd service;"
                                       " a socket can be specified using unix:<socket_file>",
                                       "server_name:port"};
+    QCommandLineOption rpc_requests_option{"rpc-requests",
+                                           "specifies the maximum number of requests served at once;"
+                                           " further requests wait their turn, instance watches are not counted",
+                                           "count"};
+    QCommandLineOption rpc_pollers_option{"rpc-pollers",
+                                          "specifies the number of threads taking calls and replies through gRPC;"
+                                          " they never wait on the requests themselves",
+                                          "count"};
 
     parser.addOption(logger_option);
     parser.addOption(verbosity_option);
     parser.addOption(address_option);
+    parser.addOption(rpc_requests_option);
+    parser.addOption(rpc_pollers_option);
 
     parser.process(app);
 
@@ -92,5 +112,11 @@ mp::DaemonConfigBuilder mp::cli::parse(const QCoreApplication& app)
         builder.server_address = address;
     }
 
+    if (parser.isSet(rpc_requests_option))
+        builder.max_rpc_requests = to_count(parser.value(rpc_requests_option), "rpc requests");
+
+    if (parser.isSet(rpc_pollers_option))
+        builder.rpc_pollers = to_count(parser.value(rpc_pollers_option), "rpc pollers");
+
     return builder;
 }
@@ -51,6 +51,7 @@ mp::CommonVMImageHost::CommonVMImageHost(std::chrono::seconds manifest_time_to_l
 
 void mp::CommonVMImageHost::for_each_entry_do(const Action& action)
 {
+    std::lock_guard<decltype(manifest_mutex)> lock{manifest_mutex};
     update_manifests();
 
     for_each_entry_do_impl(action);
@@ -58,6 +59,7 @@ void mp::CommonVMImageHost::for_each_entry_do(const Action& action)
 
 auto mp::CommonVMImageHost::info_for_full_hash(const std::string& full_hash) -> VMImageInfo
 {
+    std::lock_guard<decltype(manifest_mutex)> lock{manifest_mutex};
     update_manifests();
 
     return info_for_full_hash_impl(full_hash);
@@ -65,6 +67,7 @@ auto mp::CommonVMImageHost::info_for_full_hash(const std::string& full_hash) ->
 
 void mp::CommonVMImageHost::update_manifests()
 {
+    std::lock_guard<decltype(manifest_mutex)> lock{manifest_mutex};
     const auto now = std::chrono::steady_clock::now();
     if ((now - last_update) > manifest_time_to_live || need_extra_update)
     {
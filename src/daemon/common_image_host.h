@@ -23,6 +23,7 @@
 #include <QTimer>
 
 #include <chrono>
+#include <mutex>
 
 namespace multipass
 {
@@ -48,6 +49,7 @@ private:
     std::chrono::seconds manifest_time_to_live;
     std::chrono::steady_clock::time_point last_update;
     bool need_extra_update = true;
+    std::recursive_mutex manifest_mutex; // manifests are refreshed and read from RPC threads too
     QTimer manifest_single_shot;
 };
 
@@ -19,6 +19,7 @@
 #include "base_cloud_init_config.h"
 #include "json_writer.h"
 
+#include <multipass/cli/client_platform.h>
 #include <multipass/cloud_init_iso.h>
 #include <multipass/constants.h>
 #include <multipass/exceptions/create_image_exception.h>
@@ -34,6 +35,7 @@
 #include <multipass/network_interface.h>
 #include <multipass/platform.h>
 #include <multipass/query.h>
+#include <multipass/settings.h>
 #include <multipass/ssh/ssh_session.h>
 #include <multipass/utils.h>
 #include <multipass/version.h>
@@ -57,6 +59,7 @@
 #include <QRegularExpression>
 #include <QString>
 #include <QSysInfo>
+#include <QThreadPool>
 #include <QtConcurrent/QtConcurrent>
 
 #include <algorithm>
@@ -84,6 +87,9 @@ constexpr auto metrics_opt_in_file = "multipassd-send-metrics.yaml";
 constexpr auto reboot_cmd = "sudo reboot";
 constexpr auto up_timeout = 2min; // This may be tweaked as appropriate and used in places that wait for ssh to be up
 constexpr auto cloud_init_timeout = 5min;
+constexpr auto guest_probe_timeout = 5s; // info reports whatever a guest has not answered by then as unknown
+constexpr auto guest_addresses_refresh_interval = 1min; // how stale the addresses list reports can get
+constexpr auto listing_refresh_interval = 5s; // how long list and info can miss what backends do not report
 constexpr auto stop_ssh_cmd = "sudo systemctl stop ssh";
 const std::string sshfs_error_template = "Error enabling mount support in '{}'"
                                          "\n\nPlease install the 'multipass-sshfs' snap manually inside the instance.";
@@ -112,6 +118,88 @@ mp::Query query_from(const mp::LaunchRequest* request, const std::string& name)
     return {name, image, false, request->remote_name(), query_type, true};
 }
 
+// Gathers what info reports from inside a guest in a single round-trip: one line per value, then the addresses
+constexpr auto guest_probe_cmd = R"sh(printf '%s\n' "$(cut -d ' ' -f1-3 /proc/loadavg)" \
+"$(free -b | sed '1d;3d' | awk '{printf $3}')" "$(free -b | sed '1d;3d' | awk '{printf $2}')" \
+"$(df --output=used `awk '$2 == "/" { print $1 }' /proc/mounts` -B1 | sed 1d)" \
+"$(df --output=size `awk '$2 == "/" { print $1 }' /proc/mounts` -B1 | sed 1d)" \
+"$(lsb_release -ds 2>/dev/null)"; ip -brief -family inet address show scope global)sh";
+
+struct GuestProbe
+{
+    std::string load;
+    std::string memory_usage;
+    std::string memory_total;
+    std::string disk_usage;
+    std::string disk_total;
+    std::string current_release;
+    std::vector<std::string> all_ipv4;
+    bool answered{false};
+};
+
+std::chrono::milliseconds time_left_until(std::chrono::steady_clock::time_point deadline)
+{
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    if (left <= 0ms)
+        throw std::runtime_error("timed out");
+
+    return left;
+}
+
+GuestProbe probe_guest(mp::VirtualMachine& vm, const std::string& ssh_username,
+                       const mp::SSHKeyProvider& key_provider) // clang-format off
+try // clang-format on
+{
+    const auto deadline = std::chrono::steady_clock::now() + guest_probe_timeout;
+
+    const auto hostname = vm.ssh_hostname(time_left_until(deadline));
+    mp::SSHSession session{hostname, vm.ssh_port(), ssh_username, key_provider, time_left_until(deadline)};
+    auto proc = session.exec(guest_probe_cmd);
+    proc.exit_code(time_left_until(deadline));
+
+    const auto output = QString::fromStdString(proc.read_std_output()).split('\n');
+    if (output.size() < 6)
+        throw std::runtime_error("unexpected output");
+
+    GuestProbe probe;
+    probe.load = output[0].toStdString();
+    probe.memory_usage = output[1].toStdString();
+    probe.memory_total = output[2].toStdString();
+    probe.disk_usage = output[3].toStdString();
+    probe.disk_total = output[4].toStdString();
+    probe.current_release = output[5].toStdString();
+
+    const QRegularExpression ipv4_re{QStringLiteral("([\\d\\.]+)\\/\\d+\\s*$")};
+    for (auto line = output.cbegin() + 6; line != output.cend(); ++line)
+    {
+        auto ip_match = ipv4_re.match(*line);
+        if (ip_match.hasMatch())
+            probe.all_ipv4.push_back(ip_match.captured(1).toStdString());
+    }
+
+    probe.answered = true;
+    return probe;
+}
+catch (const std::exception& e)
+{
+    mpl::log(mpl::Level::warning, category, fmt::format("Cannot probe {}: {}", vm.vm_name, e.what()));
+    return GuestProbe{};
+}
+
+// Images to keep warm in the vault, listed as comma-separated [remote:]alias entries
+std::vector<mp::Query> prefetch_queries()
+{
+    std::vector<mp::Query> queries;
+    for (const auto& entry : MP_SETTINGS.get(mp::prefetch_images_key).split(',', QString::SkipEmptyParts))
+    {
+        const auto remote = entry.contains(':') ? entry.section(':', 0, 0) : QString{};
+        const auto alias = entry.section(':', -1);
+        queries.push_back({"", alias.toStdString(), false, remote.toStdString(), mp::Query::Type::Alias, false});
+    }
+
+    return queries;
+}
+
 auto make_cloud_init_vendor_config(const mp::SSHKeyProvider& key_provider, const std::string& time_zone,
                                    const std::string& username, const std::string& backend_version_string)
 {
@@ -347,7 +435,10 @@ std::unordered_map<std::string, mp::VMSpecs> load_db(const mp::Path& data_path,
                 gid_map[gid_entry.toObject()["host_gid"].toInt()] = gid_entry.toObject()["instance_gid"].toInt();
             }
 
-            mp::VMMount mount{source_path, gid_map, uid_map};
+            auto mount_type = static_cast<mp::VMMount::MountType>(entry.toObject()["mount_type"].toInt());
+            auto mount_profile = static_cast<mp::VMMount::MountProfile>(entry.toObject()["mount_profile"].toInt());
+
+            mp::VMMount mount{source_path, gid_map, uid_map, mount_type, mount_profile};
             mounts[target_path] = mount;
         }
 
@@ -586,19 +677,24 @@ auto connect_rpc(mp::DaemonRpc& rpc, mp::Daemon& daemon)
     QObject::connect(&rpc, &mp::DaemonRpc::on_launch, &daemon, &mp::Daemon::launch);
     QObject::connect(&rpc, &mp::DaemonRpc::on_purge, &daemon, &mp::Daemon::purge);
     QObject::connect(&rpc, &mp::DaemonRpc::on_find, &daemon, &mp::Daemon::find);
-    QObject::connect(&rpc, &mp::DaemonRpc::on_info, &daemon, &mp::Daemon::info);
-    QObject::connect(&rpc, &mp::DaemonRpc::on_list, &daemon, &mp::Daemon::list);
     QObject::connect(&rpc, &mp::DaemonRpc::on_networks, &daemon, &mp::Daemon::networks);
     QObject::connect(&rpc, &mp::DaemonRpc::on_mount, &daemon, &mp::Daemon::mount);
     QObject::connect(&rpc, &mp::DaemonRpc::on_recover, &daemon, &mp::Daemon::recover);
-    QObject::connect(&rpc, &mp::DaemonRpc::on_ssh_info, &daemon, &mp::Daemon::ssh_info);
     QObject::connect(&rpc, &mp::DaemonRpc::on_start, &daemon, &mp::Daemon::start);
     QObject::connect(&rpc, &mp::DaemonRpc::on_stop, &daemon, &mp::Daemon::stop);
     QObject::connect(&rpc, &mp::DaemonRpc::on_suspend, &daemon, &mp::Daemon::suspend);
     QObject::connect(&rpc, &mp::DaemonRpc::on_restart, &daemon, &mp::Daemon::restart);
     QObject::connect(&rpc, &mp::DaemonRpc::on_delete, &daemon, &mp::Daemon::delet);
     QObject::connect(&rpc, &mp::DaemonRpc::on_umount, &daemon, &mp::Daemon::umount);
-    QObject::connect(&rpc, &mp::DaemonRpc::on_version, &daemon, &mp::Daemon::version);
+    // Finding the host to connect to is a question for the backend, so it is asked on the event loop
+    QObject::connect(&rpc, &mp::DaemonRpc::on_ssh_info, &daemon, &mp::Daemon::ssh_info);
+
+    // Read-only requests run on the RPC threads, against the locked instance table and what the event loop last
+    // learned from the backends, so that they neither wait for nor hold up the operations serialized there
+    QObject::connect(&rpc, &mp::DaemonRpc::on_info, &daemon, &mp::Daemon::info, Qt::DirectConnection);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_list, &daemon, &mp::Daemon::list, Qt::DirectConnection);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_version, &daemon, &mp::Daemon::version, Qt::DirectConnection);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_watch, &daemon, &mp::Daemon::watch, Qt::DirectConnection);
 }
 
 template <typename Instances, typename InstanceMap, typename InstanceCheck>
@@ -848,6 +944,62 @@ bool is_ipv4_valid(const std::string& ipv4)
     return true;
 }
 
+// Like sshfs_server, native mounts map the default ID to the one of the default user of the instance
+mp::VMMount with_instance_ids(mp::VMMount mount, mp::SSHSession& session)
+{
+    const auto uid = std::stoi(mp::utils::run_in_ssh_session(session, "id -u"));
+    const auto gid = std::stoi(mp::utils::run_in_ssh_session(session, "id -g"));
+
+    for (auto& ids : mount.uid_map)
+        if (ids.second == mp::default_id)
+            ids.second = uid;
+
+    for (auto& ids : mount.gid_map)
+        if (ids.second == mp::default_id)
+            ids.second = gid;
+
+    return mount;
+}
+
+// Plugs a native mount into a running instance and mounts it there, unless it has to wait for the instance to restart
+bool start_native_mount(mp::VirtualMachine& vm, mp::SSHSession& session, const std::string& target_path,
+                        const mp::VMMount& mount)
+{
+    if (!vm.add_native_mount(target_path, with_instance_ids(mount, session)))
+        return false;
+
+    // Whatever is still mounted there is stale, its device went away when the instance was suspended. The new device
+    // shows up in the guest a little after it is plugged in.
+    mp::utils::run_in_ssh_session(
+        session, fmt::format("sudo mkdir -p \"{0}\" && (! mountpoint -q \"{0}\" || sudo umount -l \"{0}\") && "
+                             "{{ i=0; until sudo mount -t virtiofs {1} \"{0}\" 2>/dev/null; do "
+                             "[ $((i+=1)) -lt 50 ] || exit 1; sleep 0.2; done; }}",
+                             target_path, mp::utils::native_mount_tag(target_path)));
+    return true;
+}
+
+void to_reply_metrics(const mp::MountMetrics& metrics, mp::MountMetricsInfo* reply_metrics)
+{
+    reply_metrics->set_bytes_read(metrics.bytes_read);
+    reply_metrics->set_bytes_written(metrics.bytes_written);
+    reply_metrics->set_attr_cache_hits(metrics.attr_cache_hits);
+    reply_metrics->set_attr_cache_misses(metrics.attr_cache_misses);
+
+    for (const auto& bound : mp::MountMetrics::latency_bucket_bounds_us)
+        reply_metrics->add_latency_bucket_bounds_us(bound);
+
+    for (const auto& entry : metrics.operations)
+    {
+        auto operation = reply_metrics->add_operations();
+        operation->set_name(entry.first);
+        operation->set_count(entry.second.count);
+        operation->set_total_latency_us(entry.second.total_latency_us);
+
+        for (const auto& bucket : entry.second.latency_histogram)
+            operation->add_latency_histogram(bucket);
+    }
+}
+
 } // namespace
 
 mp::Daemon::Daemon(std::unique_ptr<const DaemonConfig> the_config)
@@ -855,12 +1007,15 @@ mp::Daemon::Daemon(std::unique_ptr<const DaemonConfig> the_config)
       vm_instance_specs{load_db(
           mp::utils::backend_directory_path(config->data_directory, config->factory->get_backend_directory_name()),
           mp::utils::backend_directory_path(config->cache_directory, config->factory->get_backend_directory_name()))},
-      daemon_rpc{config->server_address, config->connection_type, *config->cert_provider, *config->client_cert_store},
+      daemon_rpc{config->server_address, config->connection_type, *config->cert_provider, *config->client_cert_store,
+                 config->max_rpc_requests, config->rpc_pollers},
       metrics_provider{"https://api.jujucharms.com/omnibus/v4/multipass/metrics", get_unique_id(config->data_directory),
                        config->data_directory},
       metrics_opt_in{get_metrics_opt_in(config->data_directory)},
       instance_mounts{*config->ssh_key_provider}
 {
+    // Read-only requests are served as soon as the RPCs are connected, so they wait for the instances to be loaded
+    std::unique_lock<decltype(instances_mutex)> instances_lock{instances_mutex};
     connect_rpc(daemon_rpc, *this);
     std::vector<std::string> invalid_specs;
 
@@ -909,6 +1064,7 @@ mp::Daemon::Daemon(std::unique_ptr<const DaemonConfig> the_config)
         {
             auto& instance_record = spec.deleted ? deleted_instances : vm_instances;
             instance_record[name] = config->factory->create_virtual_machine(vm_desc, *this);
+            refresh_listing_for(name, *instance_record[name]);
         }
         catch (const std::exception& e)
         {
@@ -920,12 +1076,15 @@ mp::Daemon::Daemon(std::unique_ptr<const DaemonConfig> the_config)
 
         allocated_mac_addrs = std::move(new_macs); // Add the new macs to the daemon's list only if we got this far
 
+        register_native_mounts_for(name, spec);
+
         // FIXME: somehow we're writing contradictory state to disk.
         if (spec.deleted && spec.state != VirtualMachine::State::stopped)
         {
             mpl::log(mpl::Level::warning, category,
                      fmt::format("{} is deleted but has incompatible state {}, resetting state to 0 (stopped)", name,
                                  static_cast<int>(spec.state)));
+            std::lock_guard<decltype(specs_mutex)> specs_lock{specs_mutex};
             spec.state = VirtualMachine::State::stopped;
         }
 
@@ -941,14 +1100,17 @@ mp::Daemon::Daemon(std::unique_ptr<const DaemonConfig> the_config)
         }
     }
 
-    for (const auto& bad_spec : invalid_specs)
     {
-        vm_instance_specs.erase(bad_spec);
+        std::lock_guard<decltype(specs_mutex)> specs_lock{specs_mutex};
+        for (const auto& bad_spec : invalid_specs)
+            vm_instance_specs.erase(bad_spec);
     }
 
     if (!invalid_specs.empty())
         persist_instances();
 
+    instances_lock.unlock();
+
     for (const auto& image_host : config->image_hosts)
     {
         for (const auto& remote : image_host->supported_remotes())
@@ -997,13 +1159,46 @@ mp::Daemon::Daemon(std::unique_ptr<const DaemonConfig> the_config)
                 {
                     mpl::log(mpl::Level::error, category, fmt::format("Error updating images: {}", e.what()));
                 }
+
+                try
+                {
+                    config->vault->prefetch_images(
+                        config->factory->fetch_type(), prefetch_queries(), prepare_action, download_monitor,
+                        mp::MemorySize{MP_SETTINGS.get(mp::prefetch_rate_key).toStdString()});
+                }
+                catch (const std::exception& e)
+                {
+                    mpl::log(mpl::Level::error, category, fmt::format("Error prefetching images: {}", e.what()));
+                }
             });
         }
     });
     source_images_maintenance_task.start(config->image_refresh_timer);
+
+    // Instances found running have had nothing ask their guests for addresses yet, so the first refresh is right away
+    connect(&guest_addresses_refresh_task, &QTimer::timeout, this, &Daemon::refresh_guest_addresses);
+    guest_addresses_refresh_task.start(guest_addresses_refresh_interval);
+    QTimer::singleShot(0, this, &Daemon::refresh_guest_addresses);
+
+    connect(&listing_refresh_task, &QTimer::timeout, this, &Daemon::refresh_listing);
+    listing_refresh_task.start(listing_refresh_interval);
 }
 
-void mp::Daemon::create(const CreateRequest* request, grpc::ServerWriter<CreateReply>* server,
+mp::Daemon::~Daemon()
+{
+    guest_addresses_refresh_stopped = true;
+    guest_addresses_refresh_future.waitForFinished();
+
+    // Watches are answered right away, whatever their clients have yet to read. Those that do not take the answer
+    // are cancelled as the server goes away
+    std::lock_guard<decltype(watchers_mutex)> lock{watchers_mutex};
+    watching_stopped = true;
+    for (auto& watcher : watchers)
+        watcher->finish(grpc::Status::OK);
+    watchers.clear();
+}
+
+void mp::Daemon::create(const CreateRequest* request, grpc::ServerWriterInterface<CreateReply>* server,
                         std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
@@ -1015,7 +1210,7 @@ catch (const std::exception& e)
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::launch(const LaunchRequest* request, grpc::ServerWriter<LaunchReply>* server,
+void mp::Daemon::launch(const LaunchRequest* request, grpc::ServerWriterInterface<LaunchReply>* server,
                         std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
@@ -1057,8 +1252,11 @@ catch (const mp::StartException& e)
 {
     auto name = e.name();
 
-    release_resources(name);
-    vm_instances.erase(name);
+    {
+        std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+        release_resources(name);
+        vm_instances.erase(name);
+    }
     persist_instances();
 
     status_promise->set_value(grpc::Status(grpc::StatusCode::ABORTED, e.what(), ""));
@@ -1068,14 +1266,17 @@ catch (const std::exception& e)
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::purge(const PurgeRequest* request, grpc::ServerWriter<PurgeReply>* server,
+void mp::Daemon::purge(const PurgeRequest* request, grpc::ServerWriterInterface<PurgeReply>* server,
                        std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
-    for (const auto& del : deleted_instances)
-        release_resources(del.first);
+    {
+        std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+        for (const auto& del : deleted_instances)
+            release_resources(del.first);
 
-    deleted_instances.clear();
+        deleted_instances.clear();
+    }
     persist_instances();
 
     status_promise->set_value(grpc::Status::OK);
@@ -1085,7 +1286,7 @@ catch (const std::exception& e)
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::find(const FindRequest* request, grpc::ServerWriter<FindReply>* server,
+void mp::Daemon::find(const FindRequest* request, grpc::ServerWriterInterface<FindReply>* server,
                       std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
@@ -1248,7 +1449,7 @@ catch (const std::exception& e)
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::info(const InfoRequest* request, grpc::ServerWriter<InfoReply>* server,
+void mp::Daemon::info(const InfoRequest* request, grpc::ServerWriterInterface<InfoReply>* server,
                       std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
@@ -1258,6 +1459,18 @@ try // clang-format on
     fmt::memory_buffer errors;
     std::vector<decltype(vm_instances)::key_type> instances_for_info;
 
+    struct RunningProbe
+    {
+        std::string name;
+        InfoReply::Info* info;
+        std::string original_release;
+        std::string management_ipv4;
+        QFuture<GuestProbe> future;
+    };
+    std::vector<RunningProbe> probes;
+    QThreadPool probe_pool;
+
+    std::shared_lock<decltype(instances_mutex)> instances_lock{instances_mutex};
     if (request->instance_names().instance_name().empty())
     {
         for (auto& pair : vm_instances)
@@ -1269,6 +1482,9 @@ try // clang-format on
             instances_for_info.push_back(name);
     }
 
+    // The probes mostly wait on the guests, so each gets its own thread
+    probe_pool.setMaxThreadCount(std::max(1, static_cast<int>(instances_for_info.size())));
+
     for (const auto& name : instances_for_info)
     {
         auto it = vm_instances.find(name);
@@ -1286,7 +1502,7 @@ try // clang-format on
 
         auto info = response.add_info();
         auto& vm = it->second;
-        auto present_state = vm->current_state();
+        const auto listed = listed_instance(name);
         info->set_name(name);
         if (deleted)
         {
@@ -1294,29 +1510,13 @@ try // clang-format on
         }
         else
         {
-            info->mutable_instance_status()->set_status(grpc_instance_status_for(present_state));
-        }
-
-        auto vm_image = fetch_image_for(name, config->factory->fetch_type(), *config->vault);
-        auto original_release = vm_image.original_release;
-
-        if (!vm_image.id.empty() && original_release.empty())
-        {
-            try
-            {
-                auto vm_image_info = config->image_hosts.back()->info_for_full_hash(vm_image.id);
-                original_release = vm_image_info.release_title.toStdString();
-            }
-            catch (const std::exception& e)
-            {
-                mpl::log(mpl::Level::warning, category, fmt::format("Cannot fetch image information: {}", e.what()));
-            }
+            info->mutable_instance_status()->set_status(grpc_instance_status_for(listed.state));
         }
 
-        info->set_image_release(original_release);
-        info->set_id(vm_image.id);
+        info->set_image_release(listed.image_release);
+        info->set_id(listed.image_id);
 
-        auto vm_specs = vm_instance_specs[name];
+        auto vm_specs = specs_for(name);
 
         auto mount_info = info->mutable_mount_info();
 
@@ -1341,36 +1541,49 @@ try // clang-format on
             {
                 (*entry->mutable_mount_maps()->mutable_gid_map())[gid_map.first] = gid_map.second;
             }
+
+            if (auto metrics = instance_mounts.metrics_for(name, mount.first))
+                to_reply_metrics(*metrics, entry->mutable_metrics());
         }
 
-        if (mp::utils::is_running(present_state))
+        if (mp::utils::is_running(listed.state))
         {
-            mp::SSHSession session{vm->ssh_hostname(), vm->ssh_port(), vm_specs.ssh_username,
-                                   *config->ssh_key_provider};
+            // Guests are probed all at once, so that the slowest of them sets the pace rather than their sum
+            auto probe = QtConcurrent::run(&probe_pool, [this, vm, ssh_username = vm_specs.ssh_username] {
+                return probe_guest(*vm, ssh_username, *config->ssh_key_provider);
+            });
+            probes.push_back({name, info, listed.image_release, listed.management_ipv4, probe});
+        }
+    }
+
+    // The probes hold on to their instances, so the table is free for others while they wait on the guests
+    instances_lock.unlock();
 
-            info->set_load(mpu::run_in_ssh_session(session, "cat /proc/loadavg | cut -d ' ' -f1-3"));
-            info->set_memory_usage(mpu::run_in_ssh_session(session, "free -b | sed '1d;3d' | awk '{printf $3}'"));
-            info->set_memory_total(mpu::run_in_ssh_session(session, "free -b | sed '1d;3d' | awk '{printf $2}'"));
-            info->set_disk_usage(mpu::run_in_ssh_session(
-                session, "df --output=used `awk '$2 == \"/\" { print $1 }' /proc/mounts` -B1 | sed 1d"));
-            info->set_disk_total(mpu::run_in_ssh_session(
-                session, "df --output=size `awk '$2 == \"/\" { print $1 }' /proc/mounts` -B1 | sed 1d"));
+    for (auto& running : probes)
+    {
+        const auto probe = running.future.result();
+        auto info = running.info;
 
-            std::string management_ip = vm->management_ipv4();
-            auto all_ipv4 = vm->get_all_ipv4(*config->ssh_key_provider);
+        info->set_load(probe.load);
+        info->set_memory_usage(probe.memory_usage);
+        info->set_memory_total(probe.memory_total);
+        info->set_disk_usage(probe.disk_usage);
+        info->set_disk_total(probe.disk_total);
 
-            if (is_ipv4_valid(management_ip))
-                info->add_ipv4(management_ip);
-            else if (all_ipv4.empty())
-                info->add_ipv4("N/A");
+        const auto& management_ip = running.management_ipv4;
+        if (probe.answered)
+            remember_ipv4_for(running.name, probe.all_ipv4);
 
-            for (const auto& extra_ipv4 : all_ipv4)
-                if (extra_ipv4 != management_ip)
-                    info->add_ipv4(extra_ipv4);
+        if (is_ipv4_valid(management_ip))
+            info->add_ipv4(management_ip);
+        else if (probe.all_ipv4.empty())
+            info->add_ipv4("N/A");
 
-            auto current_release = mpu::run_in_ssh_session(session, "lsb_release -ds");
-            info->set_current_release(!current_release.empty() ? current_release : original_release);
-        }
+        for (const auto& extra_ipv4 : probe.all_ipv4)
+            if (extra_ipv4 != management_ip)
+                info->add_ipv4(extra_ipv4);
+
+        info->set_current_release(!probe.current_release.empty() ? probe.current_release : running.original_release);
     }
 
     auto status = grpc_status_for(errors);
@@ -1384,7 +1597,7 @@ catch (const std::exception& e)
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::list(const ListRequest* request, grpc::ServerWriter<ListReply>* server,
+void mp::Daemon::list(const ListRequest* request, grpc::ServerWriterInterface<ListReply>* server,
                       std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
@@ -1392,53 +1605,9 @@ try // clang-format on
     ListReply response;
     config->update_prompt->populate_if_time_to_show(response.mutable_update_info());
 
+    std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
     for (const auto& instance : vm_instances)
-    {
-        const auto& name = instance.first;
-        const auto& vm = instance.second;
-        auto present_state = vm->current_state();
-        auto entry = response.add_instances();
-        entry->set_name(name);
-        entry->mutable_instance_status()->set_status(grpc_instance_status_for(present_state));
-
-        // FIXME: Set the release to the cached current version when supported
-        auto vm_image = fetch_image_for(name, config->factory->fetch_type(), *config->vault);
-        auto current_release = vm_image.original_release;
-
-        if (!vm_image.id.empty() && current_release.empty())
-        {
-            try
-            {
-                auto vm_image_info = config->image_hosts.back()->info_for_full_hash(vm_image.id);
-                current_release = vm_image_info.release_title.toStdString();
-            }
-            catch (const std::exception& e)
-            {
-                mpl::log(mpl::Level::warning, category, fmt::format("Cannot fetch image information: {}", e.what()));
-            }
-        }
-
-        entry->set_current_release(current_release);
-
-        if (mp::utils::is_running(present_state))
-        {
-            auto vm_specs = vm_instance_specs[name];
-            mp::SSHSession session{vm->ssh_hostname(), vm->ssh_port(), vm_specs.ssh_username,
-                                   *config->ssh_key_provider};
-
-            std::string management_ip = vm->management_ipv4();
-            auto all_ipv4 = vm->get_all_ipv4(*config->ssh_key_provider);
-
-            if (is_ipv4_valid(management_ip))
-                entry->add_ipv4(management_ip);
-            else if (all_ipv4.empty())
-                entry->add_ipv4("N/A");
-
-            for (const auto& extra_ipv4 : all_ipv4)
-                if (extra_ipv4 != management_ip)
-                    entry->add_ipv4(extra_ipv4);
-        }
-    }
+        list_instance(instance.first, response.add_instances());
 
     for (const auto& instance : deleted_instances)
     {
@@ -1456,7 +1625,7 @@ catch (const std::exception& e)
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::networks(const NetworksRequest* request, grpc::ServerWriter<NetworksReply>* server,
+void mp::Daemon::networks(const NetworksRequest* request, grpc::ServerWriterInterface<NetworksReply>* server,
                           std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
@@ -1482,7 +1651,7 @@ catch (const std::exception& e)
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::mount(const MountRequest* request, grpc::ServerWriter<MountReply>* server,
+void mp::Daemon::mount(const MountRequest* request, grpc::ServerWriterInterface<MountReply>* server,
                        std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
@@ -1514,6 +1683,7 @@ try // clang-format on
                                          request->mount_maps().uid_map().end()};
     std::unordered_map<int, int> gid_map{request->mount_maps().gid_map().begin(),
                                          request->mount_maps().gid_map().end()};
+    const auto mount_profile = static_cast<VMMount::MountProfile>(request->mount_profile());
 
     fmt::memory_buffer errors;
     for (const auto& path_entry : request->target_paths())
@@ -1540,13 +1710,70 @@ try // clang-format on
         }
 
         auto& vm = it->second;
-        auto& vm_specs = vm_instance_specs[name];
+        auto& vm_specs = specs_of(name);
+
+        if (request->mount_type() == MountRequest::NATIVE)
+        {
+            if (vm_specs.mounts.find(target_path) != vm_specs.mounts.end())
+            {
+                fmt::format_to(errors, "There is already a mount defined for \"{}:{}\"\n", name, target_path);
+                continue;
+            }
+
+            // Profiles tune what SSHFS caches, the hypervisor decides that for native mounts
+            if (mount_profile != VMMount::MountProfile::Default)
+            {
+                fmt::format_to(errors, "error mounting \"{}\": mount profiles only apply to classic mounts\n",
+                               target_path);
+                continue;
+            }
+
+            VMMount mount{request->source_path(), gid_map, uid_map, VMMount::MountType::Native, mount_profile};
+            const auto running = vm->current_state() == mp::VirtualMachine::State::running;
+            auto plugged = false;
+            try
+            {
+                if (running)
+                {
+                    mp::SSHSession session{vm->ssh_hostname(), vm->ssh_port(), vm_specs.ssh_username,
+                                           *config->ssh_key_provider};
+                    plugged = start_native_mount(*vm, session, target_path, mount);
+                }
+                else
+                {
+                    vm->add_native_mount(target_path, mount);
+                }
+            }
+            catch (const std::exception& e)
+            {
+                vm->remove_native_mount(target_path);
+                fmt::format_to(errors, "error mounting \"{}\": {}\n", target_path, e.what());
+                continue;
+            }
+
+            {
+                std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+                std::lock_guard<decltype(specs_mutex)> specs_lock{specs_mutex};
+                vm_specs.mounts[target_path] = mount;
+            }
+
+            // Instances that booted without native mounts cannot take devices until they boot again
+            if (running && !plugged)
+            {
+                MountReply mount_reply;
+                mount_reply.set_mount_message(
+                    fmt::format("\"{}:{}\" will be available after the instance restarts", name, target_path));
+                server->Write(mount_reply);
+            }
+            continue;
+        }
 
         if (vm->current_state() == mp::VirtualMachine::State::running)
         {
             try
             {
-                instance_mounts.start_mount(vm.get(), request->source_path(), target_path, gid_map, uid_map);
+                instance_mounts.start_mount(vm.get(), request->source_path(), target_path, gid_map, uid_map,
+                                            mount_profile);
             }
             catch (const mp::SSHFSMissingError&)
             {
@@ -1563,7 +1790,8 @@ try // clang-format on
                     mp::SSHSession session{vm->ssh_hostname(), vm->ssh_port(), vm_specs.ssh_username,
                                            *config->ssh_key_provider};
                     mp::utils::install_sshfs_for(name, session);
-                    instance_mounts.start_mount(vm.get(), request->source_path(), target_path, gid_map, uid_map);
+                    instance_mounts.start_mount(vm.get(), request->source_path(), target_path, gid_map, uid_map,
+                                                mount_profile);
                 }
                 catch (const mp::SSHFSMissingError&)
                 {
@@ -1583,7 +1811,10 @@ try // clang-format on
             continue;
         }
 
-        VMMount mount{request->source_path(), gid_map, uid_map};
+        VMMount mount{request->source_path(), gid_map, uid_map, VMMount::MountType::Classic, mount_profile};
+
+        std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+        std::lock_guard<decltype(specs_mutex)> specs_lock{specs_mutex};
         vm_specs.mounts[target_path] = mount;
     }
 
@@ -1596,7 +1827,7 @@ catch (const std::exception& e)
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::recover(const RecoverRequest* request, grpc::ServerWriter<RecoverReply>* server,
+void mp::Daemon::recover(const RecoverRequest* request, grpc::ServerWriterInterface<RecoverReply>* server,
                          std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
@@ -1613,10 +1844,18 @@ try // clang-format on
             auto it = deleted_instances.find(name);
             if (it != std::end(deleted_instances))
             {
-                assert(vm_instance_specs[name].deleted);
-                vm_instance_specs[name].deleted = false;
+                std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+                VirtualMachine::State state;
+                {
+                    std::lock_guard<decltype(specs_mutex)> specs_lock{specs_mutex};
+                    auto& specs = vm_instance_specs[name];
+                    assert(specs.deleted);
+                    specs.deleted = false;
+                    state = specs.state;
+                }
                 vm_instances[name] = std::move(it->second);
                 deleted_instances.erase(it);
+                notify_watchers_of(name, state);
             }
             else
             {
@@ -1635,13 +1874,15 @@ catch (const std::exception& e)
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::ssh_info(const SSHInfoRequest* request, grpc::ServerWriter<SSHInfoReply>* server,
+void mp::Daemon::ssh_info(const SSHInfoRequest* request, grpc::ServerWriterInterface<SSHInfoReply>* server,
                           std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
     mpl::ClientLogger<SSHInfoReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
     SSHInfoReply response;
+    std::vector<VirtualMachine::ShPtr> vms;
 
+    std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
     for (const auto& name : request->instance_name())
     {
         auto it = vm_instances.find(name);
@@ -1667,7 +1908,9 @@ try // clang-format on
 
         if (vm->state == VirtualMachine::State::delayed_shutdown)
         {
-            if (delayed_shutdown_instances[name]->get_time_remaining() <= std::chrono::minutes(1))
+            auto shutdown_it = delayed_shutdown_instances.find(name);
+            if (shutdown_it != delayed_shutdown_instances.end() &&
+                shutdown_it->second->get_time_remaining() <= std::chrono::minutes(1))
             {
                 return status_promise->set_value(
                     grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
@@ -1678,12 +1921,20 @@ try // clang-format on
             }
         }
 
+        vms.push_back(vm);
+    }
+
+    // Finding the host may wait on the instance, which is no reason to keep the table locked
+    lock.unlock();
+
+    for (const auto& vm : vms)
+    {
         mp::SSHInfo ssh_info;
         ssh_info.set_host(vm->ssh_hostname());
         ssh_info.set_port(vm->ssh_port());
         ssh_info.set_priv_key_base64(config->ssh_key_provider->private_key_as_base64());
         ssh_info.set_username(vm->ssh_username());
-        (*response.mutable_ssh_info())[name] = ssh_info;
+        (*response.mutable_ssh_info())[vm->vm_name] = ssh_info;
     }
 
     server->Write(response);
@@ -1694,7 +1945,7 @@ catch (const std::exception& e)
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::start(const StartRequest* request, grpc::ServerWriter<StartReply>* server,
+void mp::Daemon::start(const StartRequest* request, grpc::ServerWriterInterface<StartReply>* server,
                        std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
@@ -1715,7 +1966,7 @@ try // clang-format on
                                       ? mp::StartError::DOES_NOT_EXIST
                                       : mp::StartError::INSTANCE_DELETED});
         else if (it->second->current_state() == VirtualMachine::State::delayed_shutdown)
-            delayed_shutdown_instances.erase(name);
+            drop_delayed_shutdown_for(name);
         else if (it->second->current_state() != VirtualMachine::State::running)
             vms.push_back(name);
     }
@@ -1751,7 +2002,7 @@ catch (const std::exception& e)
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::stop(const StopRequest* request, grpc::ServerWriter<StopReply>* server,
+void mp::Daemon::stop(const StopRequest* request, grpc::ServerWriterInterface<StopReply>* server,
                       std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
@@ -1780,7 +2031,7 @@ catch (const std::exception& e)
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::suspend(const SuspendRequest* request, grpc::ServerWriter<SuspendReply>* server,
+void mp::Daemon::suspend(const SuspendRequest* request, grpc::ServerWriterInterface<SuspendReply>* server,
                          std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
@@ -1826,7 +2077,7 @@ catch (const std::exception& e)
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::restart(const RestartRequest* request, grpc::ServerWriter<RestartReply>* server,
+void mp::Daemon::restart(const RestartRequest* request, grpc::ServerWriterInterface<RestartReply>* server,
                          std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
@@ -1858,7 +2109,7 @@ catch (const std::exception& e)
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::delet(const DeleteRequest* request, grpc::ServerWriter<DeleteReply>* server,
+void mp::Daemon::delet(const DeleteRequest* request, grpc::ServerWriterInterface<DeleteReply>* server,
                        std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
@@ -1873,22 +2124,30 @@ try // clang-format on
 
         for (const auto& name : operational_instances_to_delete)
         {
-            assert(!vm_instance_specs[name].deleted);
+            assert(!specs_of(name).deleted);
 
             auto& instance = vm_instances[name];
 
             if (instance->current_state() == VirtualMachine::State::delayed_shutdown)
-                delayed_shutdown_instances.erase(name);
+                drop_delayed_shutdown_for(name);
 
             instance_mounts.stop_all_mounts_for_instance(name);
             instance->shutdown();
 
+            std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
             if (purge)
                 release_resources(name);
             else
             {
                 deleted_instances[name] = std::move(instance);
-                vm_instance_specs[name].deleted = true;
+                VirtualMachine::State state;
+                {
+                    std::lock_guard<decltype(specs_mutex)> specs_lock{specs_mutex};
+                    auto& specs = vm_instance_specs[name];
+                    specs.deleted = true;
+                    state = specs.state;
+                }
+                notify_watchers_of(name, state);
             }
 
             vm_instances.erase(name);
@@ -1896,9 +2155,10 @@ try // clang-format on
 
         if (purge)
         {
+            std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
             for (const auto& name : trashed_instances_to_delete)
             {
-                assert(vm_instance_specs[name].deleted);
+                assert(specs_of(name).deleted);
                 release_resources(name);
                 deleted_instances.erase(name);
             }
@@ -1914,7 +2174,7 @@ catch (const std::exception& e)
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::umount(const UmountRequest* request, grpc::ServerWriter<UmountReply>* server,
+void mp::Daemon::umount(const UmountRequest* request, grpc::ServerWriterInterface<UmountReply>* server,
                         std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
@@ -1932,18 +2192,33 @@ try // clang-format on
         }
 
         auto target_path = path_entry.target_path();
-        auto& mounts = vm_instance_specs[name].mounts;
+        auto& specs = specs_of(name);
+        auto& mounts = specs.mounts;
         auto& vm = it->second;
 
         // Empty target path indicates removing all mounts for the VM instance
         if (target_path.empty())
         {
+            for (const auto& mount : mounts)
+            {
+                if (mount.second.mount_type == VMMount::MountType::Native)
+                    stop_native_mount(vm.get(), specs, mount.first);
+            }
+
             instance_mounts.stop_all_mounts_for_instance(name);
+
+            std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+            std::lock_guard<decltype(specs_mutex)> specs_lock{specs_mutex};
             mounts.clear();
         }
         else
         {
-            if (vm->current_state() == mp::VirtualMachine::State::running)
+            auto mount_it = mounts.find(target_path);
+            if (mount_it != mounts.end() && mount_it->second.mount_type == VMMount::MountType::Native)
+            {
+                stop_native_mount(vm.get(), specs, target_path);
+            }
+            else if (vm->current_state() == mp::VirtualMachine::State::running)
             {
                 if (!instance_mounts.stop_mount(name, target_path))
                 {
@@ -1951,6 +2226,8 @@ try // clang-format on
                 }
             }
 
+            std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+            std::lock_guard<decltype(specs_mutex)> specs_lock{specs_mutex};
             auto erased = mounts.erase(target_path);
             if (!erased)
             {
@@ -1968,7 +2245,7 @@ catch (const std::exception& e)
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::version(const VersionRequest* request, grpc::ServerWriter<VersionReply>* server,
+void mp::Daemon::version(const VersionRequest* request, grpc::ServerWriterInterface<VersionReply>* server,
                          std::promise<grpc::Status>* status_promise)
 {
     mpl::ClientLogger<VersionReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
@@ -1980,6 +2257,29 @@ void mp::Daemon::version(const VersionRequest* request, grpc::ServerWriter<Versi
     status_promise->set_value(grpc::Status::OK);
 }
 
+void mp::Daemon::watch(const WatchRequest* request, std::shared_ptr<WatchStream> stream)
+{
+    // No client logger here: log lines would race with the changes written to this stream
+    {
+        std::lock_guard<decltype(watchers_mutex)> lock{watchers_mutex};
+        if (watching_stopped)
+            return stream->finish(grpc::Status::OK);
+
+        forget_closed_watchers();
+        watchers.push_back(stream);
+    }
+
+    // Changes made while the snapshot is taken are queued already, and follow it
+    try
+    {
+        stream->write_snapshot(instances_snapshot());
+    }
+    catch (const std::exception& e)
+    {
+        stream->finish(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+    }
+}
+
 void mp::Daemon::on_shutdown()
 {
 }
@@ -2005,22 +2305,80 @@ void mp::Daemon::on_restart(const std::string& name)
 
 void mp::Daemon::persist_state_for(const std::string& name, const VirtualMachine::State& state)
 {
-    vm_instance_specs[name].state = state;
+    {
+        std::lock_guard<decltype(listing_mutex)> lock{listing_mutex};
+        auto listed_it = listed_instances.find(name);
+        if (listed_it != listed_instances.end())
+            listed_it->second.state = state;
+
+        if (!mp::utils::is_running(state))
+        {
+            if (listed_it != listed_instances.end())
+                listed_it->second.management_ipv4.clear();
+            listed_ipv4.erase(name);
+        }
+    }
+
+    bool changed;
+    {
+        std::lock_guard<decltype(specs_mutex)> lock{specs_mutex};
+        auto& specs = vm_instance_specs[name];
+
+        // Some backends report their state every time they are asked for it
+        changed = specs.state != state;
+        specs.state = state;
+    }
     persist_instances();
+
+    if (changed)
+    {
+        // The address may well have changed along, which the backend is asked about on the event loop
+        QTimer::singleShot(0, this, [this, name] {
+            VirtualMachine::ShPtr vm;
+            {
+                std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+                auto it = vm_instances.find(name);
+                if (it != vm_instances.end())
+                    vm = it->second;
+            }
+
+            if (vm)
+                refresh_listing_for(name, *vm);
+        });
+
+        notify_watchers_of(name, state);
+    }
 }
 
 void mp::Daemon::update_metadata_for(const std::string& name, const QJsonObject& metadata)
 {
-    vm_instance_specs[name].metadata = metadata;
+    {
+        std::lock_guard<decltype(specs_mutex)> lock{specs_mutex};
+        vm_instance_specs[name].metadata = metadata;
+    }
 
     persist_instances();
 }
 
 QJsonObject mp::Daemon::retrieve_metadata_for(const std::string& name)
 {
+    std::lock_guard<decltype(specs_mutex)> lock{specs_mutex};
     return vm_instance_specs[name].metadata;
 }
 
+mp::VMSpecs mp::Daemon::specs_for(const std::string& name)
+{
+    std::lock_guard<decltype(specs_mutex)> lock{specs_mutex};
+    return vm_instance_specs.at(name);
+}
+
+// Entries stay put while others come and go, but finding one must not race with backends adding theirs
+mp::VMSpecs& mp::Daemon::specs_of(const std::string& name)
+{
+    std::lock_guard<decltype(specs_mutex)> lock{specs_mutex};
+    return vm_instance_specs[name];
+}
+
 QJsonArray to_json_array(const std::vector<mp::NetworkInterface>& extra_interfaces)
 {
     QJsonArray json;
@@ -2084,12 +2442,16 @@ void mp::Daemon::persist_instances()
             }
 
             entry.insert("gid_mappings", gid_map);
+            entry.insert("mount_type", static_cast<int>(mount.second.mount_type));
+            entry.insert("mount_profile", static_cast<int>(mount.second.mount_profile));
             mounts.append(entry);
         }
 
         json.insert("mounts", mounts);
         return json;
     };
+
+    std::lock_guard<decltype(specs_mutex)> lock{specs_mutex};
     QJsonObject instance_records_json;
     for (const auto& record : vm_instance_specs)
     {
@@ -2106,14 +2468,250 @@ void mp::Daemon::release_resources(const std::string& instance)
     config->factory->remove_resources_for(instance);
     config->vault->remove(instance);
 
-    auto spec_it = vm_instance_specs.find(instance);
-    if (spec_it != cend(vm_instance_specs))
     {
-        for (const auto& mac : mac_set_from(spec_it->second))
-            allocated_mac_addrs.erase(mac);
+        std::lock_guard<decltype(specs_mutex)> lock{specs_mutex};
+        auto spec_it = vm_instance_specs.find(instance);
+        if (spec_it != cend(vm_instance_specs))
+        {
+            for (const auto& mac : mac_set_from(spec_it->second))
+                allocated_mac_addrs.erase(mac);
+
+            vm_instance_specs.erase(spec_it);
+        }
+    }
+
+    {
+        std::lock_guard<decltype(listing_mutex)> lock{listing_mutex};
+        listed_instances.erase(instance);
+        listed_ipv4.erase(instance);
+    }
+
+    WatchReply change;
+    change.add_removed_instances(instance);
+    notify_watchers(change);
+}
+
+void mp::Daemon::list_instance(const std::string& name, ListVMInstance* entry)
+{
+    const auto listed = listed_instance(name);
+    entry->set_name(name);
+    entry->mutable_instance_status()->set_status(grpc_instance_status_for(listed.state));
+    entry->set_current_release(listed.image_release);
+
+    // Only what the backend knew and what was last seen in the guest, so that listing never waits on either
+    if (mp::utils::is_running(listed.state))
+    {
+        std::vector<std::string> all_ipv4;
+        {
+            std::lock_guard<decltype(listing_mutex)> lock{listing_mutex};
+            auto ipv4_it = listed_ipv4.find(name);
+            if (ipv4_it != listed_ipv4.end())
+                all_ipv4 = ipv4_it->second;
+        }
+
+        if (is_ipv4_valid(listed.management_ipv4))
+            entry->add_ipv4(listed.management_ipv4);
+        else if (all_ipv4.empty())
+            entry->add_ipv4("N/A");
+
+        for (const auto& extra_ipv4 : all_ipv4)
+            if (extra_ipv4 != listed.management_ipv4)
+                entry->add_ipv4(extra_ipv4);
+    }
+}
+
+void mp::Daemon::refresh_listing()
+{
+    std::vector<std::pair<std::string, VirtualMachine::ShPtr>> instances;
+    {
+        std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+        instances.insert(instances.end(), vm_instances.cbegin(), vm_instances.cend());
+        instances.insert(instances.end(), deleted_instances.cbegin(), deleted_instances.cend());
+    }
+
+    for (const auto& instance : instances)
+        refresh_listing_for(instance.first, *instance.second);
+}
+
+// Only ever called on the event loop, which is where backends expect to be asked
+void mp::Daemon::refresh_listing_for(const std::string& name, VirtualMachine& vm)
+{
+    ListedInstance listed;
+    {
+        std::lock_guard<decltype(listing_mutex)> lock{listing_mutex};
+        auto listed_it = listed_instances.find(name);
+        if (listed_it != listed_instances.end())
+            listed = listed_it->second;
+    }
+
+    try
+    {
+        listed.state = vm.current_state();
+        listed.management_ipv4 = mp::utils::is_running(listed.state) ? vm.management_ipv4() : std::string{};
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::warning, category, fmt::format("Cannot get the state of {}: {}", name, e.what()));
+        listed.state = VirtualMachine::State::unknown;
+        listed.management_ipv4.clear();
+    }
+
+    // The image of an instance does not change
+    if (!listed.image_found)
+    {
+        try
+        {
+            auto vm_image = fetch_image_for(name, config->factory->fetch_type(), *config->vault);
+            listed.image_id = vm_image.id;
+            listed.image_release = vm_image.original_release;
+
+            if (!vm_image.id.empty() && listed.image_release.empty())
+            {
+                auto vm_image_info = config->image_hosts.back()->info_for_full_hash(vm_image.id);
+                listed.image_release = vm_image_info.release_title.toStdString();
+            }
+
+            listed.image_found = true;
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::warning, category, fmt::format("Cannot fetch image information: {}", e.what()));
+        }
+    }
+
+    std::lock_guard<decltype(listing_mutex)> lock{listing_mutex};
+    listed_instances[name] = listed;
+}
+
+mp::Daemon::ListedInstance mp::Daemon::listed_instance(const std::string& name)
+{
+    std::lock_guard<decltype(listing_mutex)> lock{listing_mutex};
+    auto listed_it = listed_instances.find(name);
+
+    return listed_it != listed_instances.end() ? listed_it->second : ListedInstance{};
+}
+
+void mp::Daemon::remember_ipv4_for(const std::string& name, const std::vector<std::string>& all_ipv4)
+{
+    {
+        std::lock_guard<decltype(listing_mutex)> lock{listing_mutex};
+        auto& listed = listed_ipv4[name];
+        if (listed == all_ipv4)
+            return;
+
+        listed = all_ipv4;
+    }
+
+    mp::optional<VirtualMachine::State> state;
+    {
+        std::shared_lock<decltype(instances_mutex)> instances_lock{instances_mutex};
+        std::lock_guard<decltype(specs_mutex)> specs_lock{specs_mutex};
+        auto spec_it = vm_instance_specs.find(name);
+        if (spec_it != vm_instance_specs.end())
+            state = spec_it->second.state;
+    }
 
-        vm_instance_specs.erase(spec_it);
+    if (state)
+        notify_watchers_of(name, *state);
+}
+
+void mp::Daemon::refresh_guest_addresses()
+{
+    if (guest_addresses_refresh_future.isRunning())
+        return;
+
+    std::vector<std::pair<std::string, VirtualMachine::ShPtr>> running_instances;
+    {
+        std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+        for (const auto& instance : vm_instances)
+            if (mp::utils::is_running(instance.second->current_state()))
+                running_instances.emplace_back(instance);
     }
+
+    // Guests are asked one after the other, away from the event loop, as nothing is waiting on them
+    guest_addresses_refresh_future = QtConcurrent::run([this, running_instances = std::move(running_instances)] {
+        for (const auto& instance : running_instances)
+        {
+            if (guest_addresses_refresh_stopped)
+                return;
+
+            try
+            {
+                remember_ipv4_for(instance.first, instance.second->get_all_ipv4(*config->ssh_key_provider));
+            }
+            catch (const std::exception& e)
+            {
+                mpl::log(mpl::Level::debug, category,
+                         fmt::format("Cannot get the addresses of {}: {}", instance.first, e.what()));
+            }
+        }
+    });
+}
+
+// Only queues the change for each watcher, so that a client that is slow to read holds up no one but itself
+void mp::Daemon::notify_watchers(const WatchReply& change)
+{
+    std::lock_guard<decltype(watchers_mutex)> lock{watchers_mutex};
+    forget_closed_watchers();
+    for (auto& watcher : watchers)
+        watcher->write_change(change);
+}
+
+void mp::Daemon::forget_closed_watchers()
+{
+    watchers.erase(std::remove_if(watchers.begin(), watchers.end(),
+                                  [](const std::shared_ptr<WatchStream>& watcher) { return !watcher->is_open(); }),
+                   watchers.end());
+}
+
+mp::WatchReply mp::Daemon::instances_snapshot()
+{
+    WatchReply reply;
+    auto snapshot = reply.mutable_snapshot();
+
+    std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+    for (const auto& instance : vm_instances)
+        list_instance(instance.first, snapshot->add_instances());
+
+    for (const auto& instance : deleted_instances)
+    {
+        auto entry = snapshot->add_instances();
+        entry->set_name(instance.first);
+        entry->mutable_instance_status()->set_status(mp::InstanceStatus::DELETED);
+    }
+
+    return reply;
+}
+
+// Changes only carry the state and the addresses last reported by the guest, so that they can be sent from any thread
+void mp::Daemon::notify_watchers_of(const std::string& name, const VirtualMachine::State& state)
+{
+    bool deleted;
+    {
+        std::lock_guard<decltype(specs_mutex)> lock{specs_mutex};
+        auto spec_it = vm_instance_specs.find(name);
+        deleted = spec_it != vm_instance_specs.end() && spec_it->second.deleted;
+    }
+
+    WatchReply change;
+    auto entry = change.add_changed_instances();
+    entry->set_name(name);
+    entry->mutable_instance_status()->set_status(deleted ? mp::InstanceStatus::DELETED
+                                                         : grpc_instance_status_for(state));
+
+    {
+        std::lock_guard<decltype(listing_mutex)> lock{listing_mutex};
+        auto listed_it = listed_instances.find(name);
+        if (listed_it != listed_instances.end())
+            entry->set_current_release(listed_it->second.image_release);
+
+        auto ipv4_it = listed_ipv4.find(name);
+        if (!deleted && mp::utils::is_running(state) && ipv4_it != listed_ipv4.end())
+            for (const auto& ipv4 : ipv4_it->second)
+                entry->add_ipv4(ipv4);
+    }
+
+    notify_watchers(change);
 }
 
 std::string mp::Daemon::check_instance_operational(const std::string& instance_name) const
@@ -2138,7 +2736,7 @@ std::string mp::Daemon::check_instance_exists(const std::string& instance_name)
     return {};
 }
 
-void mp::Daemon::create_vm(const CreateRequest* request, grpc::ServerWriter<CreateReply>* server,
+void mp::Daemon::create_vm(const CreateRequest* request, grpc::ServerWriterInterface<CreateReply>* server,
                            std::promise<grpc::Status>* status_promise, bool start)
 {
     auto checked_args = validate_create_arguments(request, *config->factory);
@@ -2185,18 +2783,27 @@ void mp::Daemon::create_vm(const CreateRequest* request, grpc::ServerWriter<Crea
             {
                 auto vm_desc = prepare_future_watcher->future().result();
 
-                vm_instance_specs[name] = {vm_desc.num_cores,
-                                           vm_desc.mem_size,
-                                           vm_desc.disk_space,
-                                           vm_desc.default_mac_address,
-                                           vm_desc.extra_interfaces,
-                                           config->ssh_username,
-                                           VirtualMachine::State::off,
-                                           {},
-                                           false,
-                                           QJsonObject()};
-                vm_instances[name] = config->factory->create_virtual_machine(vm_desc, *this);
+                {
+                    std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+                    {
+                        // Backends may ask for their metadata while being created, so this is let go of first
+                        std::lock_guard<decltype(specs_mutex)> specs_lock{specs_mutex};
+                        vm_instance_specs[name] = {vm_desc.num_cores,
+                                                   vm_desc.mem_size,
+                                                   vm_desc.disk_space,
+                                                   vm_desc.default_mac_address,
+                                                   vm_desc.extra_interfaces,
+                                                   config->ssh_username,
+                                                   VirtualMachine::State::off,
+                                                   {},
+                                                   false,
+                                                   QJsonObject()};
+                    }
+                    vm_instances[name] = config->factory->create_virtual_machine(vm_desc, *this);
+                }
+                refresh_listing_for(name, *vm_instances[name]);
                 preparing_instances.erase(name);
+                notify_watchers_of(name, VirtualMachine::State::off);
 
                 persist_instances();
 
@@ -2227,8 +2834,11 @@ void mp::Daemon::create_vm(const CreateRequest* request, grpc::ServerWriter<Crea
             catch (const std::exception& e)
             {
                 preparing_instances.erase(name);
-                release_resources(name);
-                vm_instances.erase(name);
+                {
+                    std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+                    release_resources(name);
+                    vm_instances.erase(name);
+                }
                 persist_instances();
                 status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
             }
@@ -2317,7 +2927,7 @@ void mp::Daemon::create_vm(const CreateRequest* request, grpc::ServerWriter<Crea
 grpc::Status mp::Daemon::reboot_vm(VirtualMachine& vm)
 {
     if (vm.state == VirtualMachine::State::delayed_shutdown)
-        delayed_shutdown_instances.erase(vm.vm_name);
+        drop_delayed_shutdown_for(vm.vm_name);
 
     if (!mp::utils::is_running(vm.current_state()))
         return grpc::Status{grpc::StatusCode::INVALID_ARGUMENT,
@@ -2337,7 +2947,7 @@ grpc::Status mp::Daemon::shutdown_vm(VirtualMachine& vm, const std::chrono::mill
 
     if (std::none_of(cbegin(skip_states), cend(skip_states), [&state](const auto& st) { return state == st; }))
     {
-        delayed_shutdown_instances.erase(name);
+        drop_delayed_shutdown_for(name);
 
         mp::optional<mp::SSHSession> session;
         try
@@ -2350,12 +2960,18 @@ grpc::Status mp::Daemon::shutdown_vm(VirtualMachine& vm, const std::chrono::mill
                      fmt::format("Cannot open ssh session on \"{}\" shutdown: {}", name, e.what()));
         }
 
-        auto& shutdown_timer = delayed_shutdown_instances[name] = std::make_unique<DelayedShutdownTimer>(
+        auto timer = std::make_unique<DelayedShutdownTimer>(
             &vm, std::move(session),
             std::bind(&SSHFSMounts::stop_all_mounts_for_instance, &instance_mounts, std::placeholders::_1));
+        auto shutdown_timer = timer.get();
+
+        QObject::connect(shutdown_timer, &DelayedShutdownTimer::finished,
+                         [this, name]() { drop_delayed_shutdown_for(name); });
 
-        QObject::connect(shutdown_timer.get(), &DelayedShutdownTimer::finished,
-                         [this, name]() { delayed_shutdown_instances.erase(name); });
+        {
+            std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+            delayed_shutdown_instances[name] = std::move(timer);
+        }
 
         shutdown_timer->start(delay);
     }
@@ -2367,16 +2983,31 @@ grpc::Status mp::Daemon::shutdown_vm(VirtualMachine& vm, const std::chrono::mill
 
 grpc::Status mp::Daemon::cancel_vm_shutdown(const VirtualMachine& vm)
 {
-    auto it = delayed_shutdown_instances.find(vm.vm_name);
-    if (it != delayed_shutdown_instances.end())
-        delayed_shutdown_instances.erase(it);
-    else
+    if (!drop_delayed_shutdown_for(vm.vm_name))
         mpl::log(mpl::Level::debug, category,
                  fmt::format("no delayed shutdown to cancel on instance \"{}\"", vm.vm_name));
 
     return grpc::Status::OK;
 }
 
+bool mp::Daemon::drop_delayed_shutdown_for(const std::string& name)
+{
+    std::unique_ptr<DelayedShutdownTimer> shutdown_timer;
+    {
+        std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+        auto it = delayed_shutdown_instances.find(name);
+        if (it == delayed_shutdown_instances.end())
+            return false;
+
+        shutdown_timer = std::move(it->second);
+        delayed_shutdown_instances.erase(it);
+    }
+
+    // Cancelling a pending shutdown tells the guest about it, so that happens without holding up readers
+    shutdown_timer.reset();
+    return true;
+}
+
 grpc::Status mp::Daemon::cmd_vms(const std::vector<std::string>& tgts, std::function<grpc::Status(VirtualMachine&)> cmd)
 { /* TODO: use this in commands, rather than repeating the same logic.
   std::function involves some overhead, but it should be negligible here and
@@ -2406,15 +3037,59 @@ mp::Daemon::create_future_watcher(std::function<void()> const& finished_op)
     return future_watcher;
 }
 
+void mp::Daemon::register_native_mounts_for(const std::string& name, const VMSpecs& specs)
+{
+    auto& vm = specs.deleted ? deleted_instances[name] : vm_instances[name];
+    for (const auto& mount : specs.mounts)
+    {
+        if (mount.second.mount_type != VMMount::MountType::Native)
+            continue;
+
+        try
+        {
+            vm->add_native_mount(mount.first, mount.second);
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::warning, category,
+                     fmt::format("Cannot restore native mount \"{}\" in {}: {}", mount.first, name, e.what()));
+        }
+    }
+}
+
+void mp::Daemon::stop_native_mount(VirtualMachine* vm, const VMSpecs& specs, const std::string& target_path)
+{
+    if (vm->current_state() == mp::VirtualMachine::State::running)
+    {
+        try
+        {
+            mp::SSHSession session{vm->ssh_hostname(), vm->ssh_port(), specs.ssh_username, *config->ssh_key_provider};
+            mp::utils::run_in_ssh_session(session, fmt::format("sudo umount \"{}\"", target_path));
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::warning, category,
+                     fmt::format("Cannot unmount \"{}\" in {}: {}", target_path, vm->vm_name, e.what()));
+        }
+    }
+
+    vm->remove_native_mount(target_path);
+}
+
 template <typename Reply>
 error_string mp::Daemon::async_wait_for_ssh_and_start_mounts_for(const std::string& name,
-                                                                 grpc::ServerWriter<Reply>* server)
+                                                                 grpc::ServerWriterInterface<Reply>* server)
 {
     fmt::memory_buffer errors;
     try
     {
-        auto it = vm_instances.find(name);
-        auto vm = it->second;
+        VirtualMachine::ShPtr vm;
+        VMSpecs vm_specs;
+        {
+            std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+            vm = vm_instances.at(name);
+            vm_specs = specs_for(name);
+        }
         vm->wait_until_ssh_up(up_timeout);
 
         if (std::is_same<Reply, LaunchReply>::value)
@@ -2429,19 +3104,50 @@ error_string mp::Daemon::async_wait_for_ssh_and_start_mounts_for(const std::stri
             mp::utils::wait_for_cloud_init(vm.get(), cloud_init_timeout, *config->ssh_key_provider);
         }
 
+        try
+        {
+            remember_ipv4_for(name, vm->get_all_ipv4(*config->ssh_key_provider));
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::debug, category, fmt::format("Cannot get the addresses of {}: {}", name, e.what()));
+        }
+
         std::vector<std::string> invalid_mounts;
-        auto& mounts = vm_instance_specs[name].mounts;
-        auto& vm_specs = vm_instance_specs[name];
+        const auto& mounts = vm_specs.mounts;
+        std::unordered_map<std::string, VMMount> sshfs_mounts;
         for (const auto& mount_entry : mounts)
         {
             auto& target_path = mount_entry.first;
-            auto& source_path = mount_entry.second.source_path;
-            auto& uid_map = mount_entry.second.uid_map;
-            auto& gid_map = mount_entry.second.gid_map;
 
+            if (mount_entry.second.mount_type != VMMount::MountType::Native)
+            {
+                sshfs_mounts.insert(mount_entry);
+                continue;
+            }
+
+            try
+            {
+                mp::SSHSession session{vm->ssh_hostname(), vm->ssh_port(), vm_specs.ssh_username,
+                                       *config->ssh_key_provider};
+                if (!start_native_mount(*vm, session, target_path, mount_entry.second))
+                    mpl::log(mpl::Level::info, category,
+                             fmt::format("Native mount \"{}\" in {} will be available after the instance restarts",
+                                         target_path, name));
+            }
+            catch (const std::exception& e)
+            {
+                fmt::format_to(errors, "Removing \"{}\": {}\n", target_path, e.what());
+                invalid_mounts.push_back(target_path);
+            }
+        }
+
+        // All the sshfs mounts of the instance are served by one sshfs_server, over one SSH session
+        if (!sshfs_mounts.empty())
+        {
             try
             {
-                instance_mounts.start_mount(vm.get(), source_path, target_path, gid_map, uid_map);
+                instance_mounts.start_mounts(vm.get(), sshfs_mounts);
             }
             catch (const mp::SSHFSMissingError&)
             {
@@ -2457,21 +3163,39 @@ error_string mp::Daemon::async_wait_for_ssh_and_start_mounts_for(const std::stri
                     mp::SSHSession session{vm->ssh_hostname(), vm->ssh_port(), vm_specs.ssh_username,
                                            *config->ssh_key_provider};
                     mp::utils::install_sshfs_for(name, session);
-                    instance_mounts.start_mount(vm.get(), source_path, target_path, gid_map, uid_map);
+                    instance_mounts.start_mounts(vm.get(), sshfs_mounts);
                 }
                 catch (const mp::SSHFSMissingError&)
                 {
                     fmt::format_to(errors, sshfs_error_template + "\n", name);
-                    break;
                 }
             }
             catch (const std::exception& e)
             {
-                fmt::format_to(errors, "Removing \"{}\": {}\n", target_path, e.what());
-                invalid_mounts.push_back(target_path);
+                mpl::log(mpl::Level::warning, category,
+                         fmt::format("Cannot serve the mounts of {} together, starting them one by one: {}", name,
+                                     e.what()));
+
+                // Serving them separately tells which of them are at fault
+                for (const auto& mount_entry : sshfs_mounts)
+                {
+                    auto& target_path = mount_entry.first;
+                    auto& mount = mount_entry.second;
+                    try
+                    {
+                        instance_mounts.start_mount(vm.get(), mount.source_path, target_path, mount.gid_map,
+                                                    mount.uid_map, mount.mount_profile);
+                    }
+                    catch (const std::exception& e)
+                    {
+                        fmt::format_to(errors, "Removing \"{}\": {}\n", target_path, e.what());
+                        invalid_mounts.push_back(target_path);
+                    }
+                }
             }
-            persist_instances();
         }
+
+        persist_instances();
     }
     catch (const std::exception& e)
     {
@@ -2482,7 +3206,7 @@ error_string mp::Daemon::async_wait_for_ssh_and_start_mounts_for(const std::stri
 }
 
 template <typename Reply>
-mp::Daemon::AsyncOperationStatus mp::Daemon::async_wait_for_ready_all(grpc::ServerWriter<Reply>* server,
+mp::Daemon::AsyncOperationStatus mp::Daemon::async_wait_for_ready_all(grpc::ServerWriterInterface<Reply>* server,
                                                                       const std::vector<std::string>& vms,
                                                                       std::promise<grpc::Status>* status_promise)
 {
@@ -27,11 +27,14 @@
 #include <multipass/network_interface.h>
 #include <multipass/sshfs_mount/sshfs_mounts.h>
 #include <multipass/virtual_machine.h>
+#include <multipass/vm_mount.h>
 #include <multipass/vm_status_monitor.h>
 
+#include <atomic>
 #include <future>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -40,13 +43,6 @@
 
 namespace multipass
 {
-struct VMMount
-{
-    std::string source_path;
-    std::unordered_map<int, int> gid_map;
-    std::unordered_map<int, int> uid_map;
-};
-
 struct VMSpecs
 {
     int num_cores;
@@ -73,6 +69,7 @@ class Daemon : public QObject, public multipass::VMStatusMonitor
     Q_OBJECT
 public:
     explicit Daemon(std::unique_ptr<const DaemonConfig> config);
+    ~Daemon();
     Daemon(const Daemon&) = delete;
     Daemon& operator=(const Daemon&) = delete;
 
@@ -87,69 +84,98 @@ protected:
     QJsonObject retrieve_metadata_for(const std::string& name) override;
 
 public slots:
-    virtual void create(const CreateRequest* request, grpc::ServerWriter<CreateReply>* reply,
+    virtual void create(const CreateRequest* request, grpc::ServerWriterInterface<CreateReply>* reply,
                         std::promise<grpc::Status>* status_promise);
 
-    virtual void launch(const LaunchRequest* request, grpc::ServerWriter<LaunchReply>* reply,
+    virtual void launch(const LaunchRequest* request, grpc::ServerWriterInterface<LaunchReply>* reply,
                         std::promise<grpc::Status>* status_promise);
 
-    virtual void purge(const PurgeRequest* request, grpc::ServerWriter<PurgeReply>* response,
+    virtual void purge(const PurgeRequest* request, grpc::ServerWriterInterface<PurgeReply>* response,
                        std::promise<grpc::Status>* status_promise);
 
-    virtual void find(const FindRequest* request, grpc::ServerWriter<FindReply>* response,
+    virtual void find(const FindRequest* request, grpc::ServerWriterInterface<FindReply>* response,
                       std::promise<grpc::Status>* status_promise);
 
-    virtual void info(const InfoRequest* request, grpc::ServerWriter<InfoReply>* response,
+    virtual void info(const InfoRequest* request, grpc::ServerWriterInterface<InfoReply>* response,
                       std::promise<grpc::Status>* status_promise);
 
-    virtual void list(const ListRequest* request, grpc::ServerWriter<ListReply>* response,
+    virtual void list(const ListRequest* request, grpc::ServerWriterInterface<ListReply>* response,
                       std::promise<grpc::Status>* status_promise);
 
-    virtual void networks(const NetworksRequest* request, grpc::ServerWriter<NetworksReply>* response,
+    virtual void networks(const NetworksRequest* request, grpc::ServerWriterInterface<NetworksReply>* response,
                           std::promise<grpc::Status>* status_promise);
 
-    virtual void mount(const MountRequest* request, grpc::ServerWriter<MountReply>* response,
+    virtual void mount(const MountRequest* request, grpc::ServerWriterInterface<MountReply>* response,
                        std::promise<grpc::Status>* status_promise);
 
-    virtual void recover(const RecoverRequest* request, grpc::ServerWriter<RecoverReply>* response,
+    virtual void recover(const RecoverRequest* request, grpc::ServerWriterInterface<RecoverReply>* response,
                          std::promise<grpc::Status>* status_promise);
 
-    virtual void ssh_info(const SSHInfoRequest* request, grpc::ServerWriter<SSHInfoReply>* response,
+    virtual void ssh_info(const SSHInfoRequest* request, grpc::ServerWriterInterface<SSHInfoReply>* response,
                           std::promise<grpc::Status>* status_promise);
 
-    virtual void start(const StartRequest* request, grpc::ServerWriter<StartReply>* response,
+    virtual void start(const StartRequest* request, grpc::ServerWriterInterface<StartReply>* response,
                        std::promise<grpc::Status>* status_promise);
 
-    virtual void stop(const StopRequest* request, grpc::ServerWriter<StopReply>* response,
+    virtual void stop(const StopRequest* request, grpc::ServerWriterInterface<StopReply>* response,
                       std::promise<grpc::Status>* status_promise);
 
-    virtual void suspend(const SuspendRequest* request, grpc::ServerWriter<SuspendReply>* response,
+    virtual void suspend(const SuspendRequest* request, grpc::ServerWriterInterface<SuspendReply>* response,
                          std::promise<grpc::Status>* status_promise);
 
-    virtual void restart(const RestartRequest* request, grpc::ServerWriter<RestartReply>* response,
+    virtual void restart(const RestartRequest* request, grpc::ServerWriterInterface<RestartReply>* response,
                          std::promise<grpc::Status>* status_promise);
 
-    virtual void delet(const DeleteRequest* request, grpc::ServerWriter<DeleteReply>* response,
+    virtual void delet(const DeleteRequest* request, grpc::ServerWriterInterface<DeleteReply>* response,
                        std::promise<grpc::Status>* status_promise);
 
-    virtual void umount(const UmountRequest* request, grpc::ServerWriter<UmountReply>* response,
+    virtual void umount(const UmountRequest* request, grpc::ServerWriterInterface<UmountReply>* response,
                         std::promise<grpc::Status>* status_promise);
 
-    virtual void version(const VersionRequest* request, grpc::ServerWriter<VersionReply>* response,
+    virtual void version(const VersionRequest* request, grpc::ServerWriterInterface<VersionReply>* response,
                          std::promise<grpc::Status>* status_promise);
 
+    virtual void watch(const WatchRequest* request, std::shared_ptr<WatchStream> stream);
+
 private:
     void persist_instances();
     void release_resources(const std::string& instance);
     std::string check_instance_operational(const std::string& instance_name) const;
     std::string check_instance_exists(const std::string& instance_name) const;
-    void create_vm(const CreateRequest* request, grpc::ServerWriter<CreateReply>* server,
+    void create_vm(const CreateRequest* request, grpc::ServerWriterInterface<CreateReply>* server,
                    std::promise<grpc::Status>* status_promise, bool start);
     grpc::Status reboot_vm(VirtualMachine& vm);
     grpc::Status shutdown_vm(VirtualMachine& vm, const std::chrono::milliseconds delay);
     grpc::Status cancel_vm_shutdown(const VirtualMachine& vm);
+    bool drop_delayed_shutdown_for(const std::string& name);
     grpc::Status cmd_vms(const std::vector<std::string>& tgts, std::function<grpc::Status(VirtualMachine&)> cmd);
     void install_sshfs(VirtualMachine* vm, const std::string& name);
+    void register_native_mounts_for(const std::string& name, const VMSpecs& specs);
+    void stop_native_mount(VirtualMachine* vm, const VMSpecs& specs, const std::string& target_path);
+
+    // What list and info report of an instance's backend and image. Not all backends can be asked from other threads,
+    // so the event loop asks, as their states change and every few seconds, and the RPC threads read the answers
+    struct ListedInstance
+    {
+        VirtualMachine::State state{VirtualMachine::State::unknown};
+        std::string management_ipv4;
+        std::string image_id;
+        std::string image_release;
+        bool image_found{false}; // looked up again until it is
+    };
+
+    void refresh_listing();
+    void refresh_listing_for(const std::string& name, VirtualMachine& vm);
+    ListedInstance listed_instance(const std::string& name);
+    void remember_ipv4_for(const std::string& name, const std::vector<std::string>& all_ipv4);
+    void refresh_guest_addresses();
+    VMSpecs specs_for(const std::string& name);
+    VMSpecs& specs_of(const std::string& name);
+    void list_instance(const std::string& name, ListVMInstance* entry);
+    void notify_watchers(const WatchReply& change);
+    void notify_watchers_of(const std::string& name, const VirtualMachine::State& state);
+    void forget_closed_watchers();
+    WatchReply instances_snapshot();
 
     struct AsyncOperationStatus
     {
@@ -158,15 +184,22 @@ private:
     };
 
     template <typename Reply>
-    std::string async_wait_for_ssh_and_start_mounts_for(const std::string& name, grpc::ServerWriter<Reply>* server);
+    std::string async_wait_for_ssh_and_start_mounts_for(const std::string& name,
+                                                        grpc::ServerWriterInterface<Reply>* server);
     template <typename Reply>
-    AsyncOperationStatus async_wait_for_ready_all(grpc::ServerWriter<Reply>* server,
+    AsyncOperationStatus async_wait_for_ready_all(grpc::ServerWriterInterface<Reply>* server,
                                                   const std::vector<std::string>& vms,
                                                   std::promise<grpc::Status>* status_promise);
     void finish_async_operation(QFuture<AsyncOperationStatus> async_future);
     QFutureWatcher<AsyncOperationStatus>* create_future_watcher(std::function<void()> const& finished_op = []() {});
 
     std::unique_ptr<const DaemonConfig> config;
+    // Read-only requests are served on the RPC threads: they hold this shared while they look at the instances, the
+    // event loop holds it exclusively while it adds, removes or reconfigures them
+    std::shared_mutex instances_mutex;
+    // Instance states and metadata are reported from any thread, then persisted. Every change to the specs is made
+    // holding this, after instances_mutex when both are needed, and never while persisting them
+    std::mutex specs_mutex;
     std::unordered_map<std::string, VMSpecs> vm_instance_specs;
     std::unordered_map<std::string, VirtualMachine::ShPtr> vm_instances;
     std::unordered_map<std::string, VirtualMachine::ShPtr> deleted_instances;
@@ -182,6 +215,19 @@ private:
     std::unordered_map<std::string, QFuture<std::string>> async_running_futures;
     std::mutex start_mutex;
     std::unordered_set<std::string> preparing_instances;
+    // What list reports about the guests, kept up to date by the operations that reach into them anyway
+    std::mutex listing_mutex;
+    std::unordered_map<std::string, ListedInstance> listed_instances;
+    std::unordered_map<std::string, std::vector<std::string>> listed_ipv4;
+    QTimer listing_refresh_task;
+    // Also asked of the running guests every so often, for what changed in them that the daemon did not see
+    QTimer guest_addresses_refresh_task;
+    QFuture<void> guest_addresses_refresh_future;
+    std::atomic_bool guest_addresses_refresh_stopped{false};
+
+    std::mutex watchers_mutex;
+    bool watching_stopped = false;
+    std::vector<std::shared_ptr<WatchStream>> watchers;
     QFuture<void> image_update_future;
 };
 } // namespace multipass
@@ -42,6 +42,7 @@ namespace mpl = multipass::logging;
 namespace
 {
 constexpr auto manifest_ttl = std::chrono::minutes{5};
+constexpr auto image_download_connections = 4;
 
 std::string server_name_from(const std::string& server_address)
 {
@@ -121,7 +122,8 @@ std::unique_ptr<const mp::DaemonConfig> mp::DaemonConfigBuilder::build()
             data_directory = MP_STDPATHS.writableLocation(StandardPaths::AppDataLocation);
     }
     if (url_downloader == nullptr)
-        url_downloader = std::make_unique<URLDownloader>(cache_directory, std::chrono::seconds{10});
+        url_downloader = std::make_unique<URLDownloader>(cache_directory, std::chrono::seconds{10},
+                                                         image_download_connections);
     if (factory == nullptr)
         factory = platform::vm_backend(data_directory);
     if (update_prompt == nullptr)
@@ -170,5 +172,5 @@ std::unique_ptr<const mp::DaemonConfig> mp::DaemonConfigBuilder::build()
         std::move(url_downloader), std::move(factory), std::move(image_hosts), std::move(vault),
         std::move(name_generator), std::move(ssh_key_provider), std::move(cert_provider), std::move(client_cert_store),
         std::move(update_prompt), multiplexing_logger, std::move(network_proxy), cache_directory, data_directory,
-        server_address, ssh_username, connection_type, image_refresh_timer});
+        server_address, ssh_username, connection_type, image_refresh_timer, max_rpc_requests, rpc_pollers});
 }
@@ -61,6 +61,8 @@ struct DaemonConfig
     const std::string ssh_username;
     const RpcConnectionType connection_type;
     const std::chrono::hours image_refresh_timer;
+    const int max_rpc_requests;
+    const int rpc_pollers;
 };
 
 struct DaemonConfigBuilder
@@ -82,6 +84,8 @@ struct DaemonConfigBuilder
     std::string ssh_username;
     multipass::days days_to_expire{14};
     std::chrono::hours image_refresh_timer{6};
+    int max_rpc_requests{32}; // served at once, however many clients connect
+    int rpc_pollers{2};
     multipass::logging::Level verbosity_level{multipass::logging::Level::info};
     RpcConnectionType connection_type{RpcConnectionType::ssl};
 
@@ -22,7 +22,11 @@
 #include <multipass/logging/log.h>
 #include <multipass/virtual_machine_factory.h>
 
+#include <QtConcurrent/QtConcurrent>
+
 #include <chrono>
+#include <deque>
+#include <functional>
 #include <stdexcept>
 
 namespace mp = multipass;
@@ -31,6 +35,14 @@ namespace mpl = multipass::logging;
 namespace
 {
 constexpr auto category = "rpc";
+constexpr auto shutdown_grace_period = std::chrono::seconds(1); // calls still going after that are cancelled
+constexpr std::size_t max_pending_watch_replies = 256; // a client further behind than this is told to watch again
+
+// Handed to gRPC with each operation on a call, and handed back by the completion queue once that operation is done
+struct Tag
+{
+    std::function<void(bool)> proceed;
+};
 
 void throw_if_server_exists(const std::string& address)
 {
@@ -49,9 +61,10 @@ void throw_if_server_exists(const std::string& address)
         throw std::runtime_error(fmt::format("a multipass daemon already exists at {}", address));
 }
 
+
 auto make_server(const std::string& server_address, mp::RpcConnectionType conn_type,
                  const mp::CertProvider& cert_provider, const mp::CertStore& client_cert_store,
-                 mp::Rpc::Service* service)
+                 grpc::Service* service, std::unique_ptr<grpc::ServerCompletionQueue>& completion_queue)
 {
     throw_if_server_exists(server_address);
     grpc::ServerBuilder builder;
@@ -75,6 +88,7 @@ auto make_server(const std::string& server_address, mp::RpcConnectionType conn_t
 
     builder.AddListeningPort(server_address, creds);
     builder.RegisterService(service);
+    completion_queue = builder.AddCompletionQueue();
 
     std::unique_ptr<grpc::Server> server{builder.BuildAndStart()};
     if (server == nullptr)
@@ -94,128 +108,548 @@ grpc::Status emit_signal_and_wait_for_result(OperationSignal operation_signal)
 }
 } // namespace
 
+// A request, from when the server starts waiting for one of its kind until it is answered. It is served on the request
+// pool, and writing to it waits for gRPC to be done with the write: there is only ever one in flight, so that whoever
+// writes cannot get further ahead of the client than that
+template <typename Request, typename Reply>
+class mp::DaemonRpc::StreamingCall : public grpc::ServerWriterInterface<Reply>
+{
+public:
+    using RequestCall = std::function<void(grpc::ServerContext*, Request*, grpc::ServerAsyncWriter<Reply>*, void*)>;
+    using Handler =
+        std::function<grpc::Status(grpc::ServerContext*, const Request*, grpc::ServerWriterInterface<Reply>*)>;
+
+    // The call deletes itself once answered, or once the server shuts down before a client makes it
+    static void await(DaemonRpc& rpc, RequestCall request_call, Handler handler)
+    {
+        new StreamingCall{rpc, std::move(request_call), std::move(handler)};
+    }
+
+    void SendInitialMetadata() override
+    {
+        complete([this](void* tag) { responder.SendInitialMetadata(tag); });
+    }
+
+    using grpc::ServerWriterInterface<Reply>::Write;
+    bool Write(const Reply& reply, grpc::WriteOptions options) override
+    {
+        return complete([this, &reply, &options](void* tag) { responder.Write(reply, options, tag); });
+    }
+
+private:
+    StreamingCall(DaemonRpc& rpc, RequestCall request_call, Handler handler)
+        : rpc{rpc}, request_call{std::move(request_call)}, handler{std::move(handler)}
+    {
+        rpc.track_call();
+        this->request_call(&context, &request, &responder, &arrived);
+    }
+
+    void start(bool ok)
+    {
+        if (!ok) // the server is shutting down
+            return end();
+
+        await(rpc, request_call, handler);
+        QtConcurrent::run(&rpc.request_pool, [this] { serve(); });
+    }
+
+    void serve()
+    {
+        grpc::Status status;
+        try
+        {
+            status = handler(&context, &request, this);
+        }
+        catch (const std::exception& e)
+        {
+            status = grpc::Status(grpc::StatusCode::INTERNAL, e.what(), "");
+        }
+
+        {
+            // Whatever else is still written to the call, such as a late log line, is dropped from here on
+            std::lock_guard<std::mutex> lock{writing_mutex};
+            answered = true;
+        }
+        responder.Finish(status, &finished);
+    }
+
+    template <typename Operation>
+    bool complete(Operation operation)
+    {
+        std::lock_guard<std::mutex> writing_lock{writing_mutex};
+        if (answered)
+            return false;
+
+        std::unique_lock<std::mutex> lock{completion_mutex};
+        completed = false;
+        operation(&written);
+        completion_cv.wait(lock, [this] { return completed; });
+
+        return succeeded;
+    }
+
+    void write_done(bool ok)
+    {
+        {
+            std::lock_guard<std::mutex> lock{completion_mutex};
+            completed = true;
+            succeeded = ok;
+        }
+        completion_cv.notify_one();
+    }
+
+    void end()
+    {
+        auto& rpc = this->rpc;
+        delete this;
+        rpc.untrack_call();
+    }
+
+    DaemonRpc& rpc;
+    const RequestCall request_call;
+    const Handler handler;
+    grpc::ServerContext context;
+    Request request;
+    grpc::ServerAsyncWriter<Reply> responder{&context};
+    Tag arrived{[this](bool ok) { start(ok); }};
+    Tag written{[this](bool ok) { write_done(ok); }};
+    Tag finished{[this](bool) { end(); }};
+    std::mutex writing_mutex; // writes go out one at a time, whichever threads they come from
+    bool answered{false};
+    std::mutex completion_mutex;
+    std::condition_variable completion_cv;
+    bool completed{false};
+    bool succeeded{false};
+};
+
+// A watch, from when the server starts waiting for one until its client is gone. Nothing ever waits on it: what the
+// daemon writes is queued, and each reply goes out as soon as gRPC is done with the one before
+class mp::DaemonRpc::WatchCall : public mp::WatchStream
+{
+public:
+    static void await(DaemonRpc& rpc)
+    {
+        std::shared_ptr<WatchCall> call{new WatchCall{rpc}};
+        call->self = call; // for as long as gRPC may hand back its tags
+
+        rpc.track_call();
+        call->context.AsyncNotifyWhenDone(&call->done);
+        rpc.service.Requestwatch(&call->context, &call->request, &call->responder, rpc.completion_queue.get(),
+                                 rpc.completion_queue.get(), &call->arrived);
+    }
+
+    void write_snapshot(const WatchReply& snapshot) override
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (!writable())
+            return;
+
+        pending.push_front(snapshot);
+        snapshot_written = true;
+        write_next();
+    }
+
+    void write_change(const WatchReply& change) override
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (!writable())
+            return;
+
+        if (pending.size() >= max_pending_watch_replies)
+            return end_with(grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
+                                         "too many changes went unread, watch again for a fresh snapshot", ""));
+
+        pending.push_back(change);
+        write_next();
+    }
+
+    void finish(const grpc::Status& status) override
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (writable())
+            end_with(status);
+    }
+
+    bool is_open() override
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        return writable();
+    }
+
+private:
+    explicit WatchCall(DaemonRpc& rpc) : rpc{rpc}
+    {
+    }
+
+    void start(bool ok)
+    {
+        if (ok)
+            await(rpc);
+
+        std::shared_ptr<WatchCall> call;
+        {
+            std::unique_lock<std::mutex> lock{mutex};
+            waiting_for_client = false;
+            started = ok;
+            call = self;
+            release(lock); // the server may be shutting down, or the client gone already
+        }
+
+        // The daemon takes the snapshot on the request pool, so that the pollers never wait on its locks
+        if (ok)
+            QtConcurrent::run(&rpc.request_pool, [this, call] { emit rpc.on_watch(&request, call); });
+    }
+
+    bool writable() const
+    {
+        return !over && !ending;
+    }
+
+    // What is still queued is dropped: the status goes out right after the write in flight, if there is one
+    void end_with(const grpc::Status& status)
+    {
+        pending.clear();
+        ending = true;
+        final_status = status;
+        write_next();
+    }
+
+    void write_next()
+    {
+        if (over || in_flight)
+            return;
+
+        if (ending)
+        {
+            in_flight = true;
+            over = true;
+            responder.Finish(final_status, &finished);
+        }
+        else if (snapshot_written && !pending.empty())
+        {
+            in_flight = true;
+            in_flight_reply = std::move(pending.front());
+            pending.pop_front();
+            responder.Write(in_flight_reply, &written);
+        }
+    }
+
+    void write_done(bool ok)
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        in_flight = false;
+        if (ok)
+            write_next();
+        else // the client is gone
+            over = true;
+
+        release(lock);
+    }
+
+    void call_done()
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        over = true;
+        call_ended = true;
+        pending.clear();
+        release(lock);
+    }
+
+    void finish_done()
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        in_flight = false;
+        release(lock);
+    }
+
+    // Once gRPC is to hand back no more tags, the call lives on only for as long as the daemon holds on to it
+    void release(std::unique_lock<std::mutex>& lock)
+    {
+        if (!self || waiting_for_client || (started && !call_ended) || in_flight)
+            return;
+
+        auto& rpc = this->rpc;
+        auto last_reference = std::move(self);
+        lock.unlock();
+
+        last_reference.reset();
+        rpc.untrack_call();
+    }
+
+    DaemonRpc& rpc;
+    grpc::ServerContext context;
+    WatchRequest request;
+    grpc::ServerAsyncWriter<WatchReply> responder{&context};
+    Tag arrived{[this](bool ok) { start(ok); }};
+    Tag written{[this](bool ok) { write_done(ok); }};
+    Tag finished{[this](bool) { finish_done(); }};
+    Tag done{[this](bool) { call_done(); }}; // whether answered or cancelled
+    std::mutex mutex;
+    std::shared_ptr<WatchCall> self;
+    std::deque<WatchReply> pending;
+    WatchReply in_flight_reply;
+    grpc::Status final_status;
+    bool waiting_for_client{true};
+    bool started{false};
+    bool snapshot_written{false};
+    bool in_flight{false};
+    bool ending{false};
+    bool over{false};
+    bool call_ended{false};
+};
+
+// Answered right on the completion queue, since there is nothing to it
+class mp::DaemonRpc::PingCall
+{
+public:
+    static void await(DaemonRpc& rpc)
+    {
+        new PingCall{rpc};
+    }
+
+private:
+    explicit PingCall(DaemonRpc& rpc) : rpc{rpc}
+    {
+        rpc.track_call();
+        rpc.service.Requestping(&context, &request, &responder, rpc.completion_queue.get(), rpc.completion_queue.get(),
+                                &arrived);
+    }
+
+    void answer(bool ok)
+    {
+        if (!ok) // the server is shutting down
+            return end();
+
+        await(rpc);
+        auto status = rpc.ping(&context, &request, &reply);
+        responder.Finish(reply, status, &finished);
+    }
+
+    void end()
+    {
+        auto& rpc = this->rpc;
+        delete this;
+        rpc.untrack_call();
+    }
+
+    DaemonRpc& rpc;
+    grpc::ServerContext context;
+    PingRequest request;
+    PingReply reply;
+    grpc::ServerAsyncResponseWriter<PingReply> responder{&context};
+    Tag arrived{[this](bool ok) { answer(ok); }};
+    Tag finished{[this](bool) { end(); }};
+};
+
+template <typename Service, typename Request, typename Reply>
+void mp::DaemonRpc::serve_calls(void (Service::*request_call)(grpc::ServerContext*, Request*,
+                                                              grpc::ServerAsyncWriter<Reply>*, grpc::CompletionQueue*,
+                                                              grpc::ServerCompletionQueue*, void*),
+                                grpc::Status (DaemonRpc::*handler)(grpc::ServerContext*, const Request*,
+                                                                   grpc::ServerWriterInterface<Reply>*))
+{
+    StreamingCall<Request, Reply>::await(
+        *this,
+        [this, request_call](grpc::ServerContext* context, Request* request, grpc::ServerAsyncWriter<Reply>* responder,
+                             void* tag) {
+            (service.*request_call)(context, request, responder, completion_queue.get(), completion_queue.get(), tag);
+        },
+        [this, handler](grpc::ServerContext* context, const Request* request,
+                        grpc::ServerWriterInterface<Reply>* response) {
+            return (this->*handler)(context, request, response); // dispatched to overrides too
+        });
+}
+
+void mp::DaemonRpc::track_call()
+{
+    std::lock_guard<std::mutex> lock{calls_mutex};
+    ++calls;
+}
+
+void mp::DaemonRpc::untrack_call()
+{
+    {
+        std::lock_guard<std::mutex> lock{calls_mutex};
+        --calls;
+    }
+    calls_cv.notify_all();
+}
+
 mp::DaemonRpc::DaemonRpc(const std::string& server_address, mp::RpcConnectionType type,
-                         const CertProvider& cert_provider, const CertStore& client_cert_store)
-    : server_address{server_address}, server{make_server(server_address, type, cert_provider, client_cert_store, this)}
+                         const CertProvider& cert_provider, const CertStore& client_cert_store, int max_requests,
+                         int num_pollers)
+    : server_address{server_address},
+      server{make_server(server_address, type, cert_provider, client_cert_store, &service, completion_queue)}
 {
+    request_pool.setMaxThreadCount(max_requests);
+
+    serve_calls(&Rpc::AsyncService::Requestcreate, &DaemonRpc::create);
+    serve_calls(&Rpc::AsyncService::Requestlaunch, &DaemonRpc::launch);
+    serve_calls(&Rpc::AsyncService::Requestpurge, &DaemonRpc::purge);
+    serve_calls(&Rpc::AsyncService::Requestfind, &DaemonRpc::find);
+    serve_calls(&Rpc::AsyncService::Requestinfo, &DaemonRpc::info);
+    serve_calls(&Rpc::AsyncService::Requestlist, &DaemonRpc::list);
+    serve_calls(&Rpc::AsyncService::Requestnetworks, &DaemonRpc::networks);
+    serve_calls(&Rpc::AsyncService::Requestmount, &DaemonRpc::mount);
+    serve_calls(&Rpc::AsyncService::Requestrecover, &DaemonRpc::recover);
+    serve_calls(&Rpc::AsyncService::Requestssh_info, &DaemonRpc::ssh_info);
+    serve_calls(&Rpc::AsyncService::Requeststart, &DaemonRpc::start);
+    serve_calls(&Rpc::AsyncService::Requeststop, &DaemonRpc::stop);
+    serve_calls(&Rpc::AsyncService::Requestsuspend, &DaemonRpc::suspend);
+    serve_calls(&Rpc::AsyncService::Requestrestart, &DaemonRpc::restart);
+    serve_calls(&Rpc::AsyncService::Requestdelet, &DaemonRpc::delet);
+    serve_calls(&Rpc::AsyncService::Requestumount, &DaemonRpc::umount);
+    serve_calls(&Rpc::AsyncService::Requestversion, &DaemonRpc::version);
+    WatchCall::await(*this);
+    PingCall::await(*this);
+
+    for (auto i = 0; i < num_pollers; ++i)
+        pollers.emplace_back([this] {
+            void* tag;
+            bool ok;
+            while (completion_queue->Next(&tag, &ok))
+            {
+                auto proceed = static_cast<Tag*>(tag)->proceed; // the call may be gone by the time it returns
+                proceed(ok);
+            }
+        });
+
     std::string ssl_enabled = type == mp::RpcConnectionType::ssl ? "on" : "off";
-    mpl::log(mpl::Level::info, category, fmt::format("gRPC listening on {}, SSL:{}", server_address, ssl_enabled));
+    mpl::log(mpl::Level::info, category,
+             fmt::format("gRPC listening on {}, SSL:{}, requests:{}, pollers:{}", server_address, ssl_enabled,
+                         max_requests, num_pollers));
+}
+
+mp::DaemonRpc::~DaemonRpc()
+{
+    // Calls still going after a moment are cancelled, which fails whatever they are writing. The completion queue is
+    // only shut down once gRPC handed every call back for the last time, so that none starts anything on it after
+    server->Shutdown(std::chrono::system_clock::now() + shutdown_grace_period);
+    {
+        std::unique_lock<std::mutex> lock{calls_mutex};
+        calls_cv.wait(lock, [this] { return calls == 0; });
+    }
+    request_pool.waitForDone();
+
+    completion_queue->Shutdown();
+    for (auto& poller : pollers)
+        poller.join();
 }
 
 grpc::Status mp::DaemonRpc::create(grpc::ServerContext* context, const CreateRequest* request,
-                                   grpc::ServerWriter<CreateReply>* reply)
+                                   grpc::ServerWriterInterface<CreateReply>* reply)
 {
     return emit_signal_and_wait_for_result(
         std::bind(&DaemonRpc::on_create, this, request, reply, std::placeholders::_1));
 }
 
 grpc::Status mp::DaemonRpc::launch(grpc::ServerContext* context, const LaunchRequest* request,
-                                   grpc::ServerWriter<LaunchReply>* reply)
+                                   grpc::ServerWriterInterface<LaunchReply>* reply)
 {
     return emit_signal_and_wait_for_result(
         std::bind(&DaemonRpc::on_launch, this, request, reply, std::placeholders::_1));
 }
 
 grpc::Status mp::DaemonRpc::purge(grpc::ServerContext* context, const PurgeRequest* request,
-                                  grpc::ServerWriter<PurgeReply>* response)
+                                  grpc::ServerWriterInterface<PurgeReply>* response)
 {
     return emit_signal_and_wait_for_result(
         std::bind(&DaemonRpc::on_purge, this, request, response, std::placeholders::_1));
 }
 
 grpc::Status mp::DaemonRpc::find(grpc::ServerContext* context, const FindRequest* request,
-                                 grpc::ServerWriter<FindReply>* response)
+                                 grpc::ServerWriterInterface<FindReply>* response)
 {
     return emit_signal_and_wait_for_result(
         std::bind(&DaemonRpc::on_find, this, request, response, std::placeholders::_1));
 }
 
 grpc::Status mp::DaemonRpc::info(grpc::ServerContext* context, const InfoRequest* request,
-                                 grpc::ServerWriter<InfoReply>* response)
+                                 grpc::ServerWriterInterface<InfoReply>* response)
 {
     return emit_signal_and_wait_for_result(
         std::bind(&DaemonRpc::on_info, this, request, response, std::placeholders::_1));
 }
 
 grpc::Status mp::DaemonRpc::list(grpc::ServerContext* context, const ListRequest* request,
-                                 grpc::ServerWriter<ListReply>* response)
+                                 grpc::ServerWriterInterface<ListReply>* response)
 {
     return emit_signal_and_wait_for_result(
         std::bind(&DaemonRpc::on_list, this, request, response, std::placeholders::_1));
 }
 
 grpc::Status mp::DaemonRpc::networks(grpc::ServerContext* context, const NetworksRequest* request,
-                                     grpc::ServerWriter<NetworksReply>* response)
+                                     grpc::ServerWriterInterface<NetworksReply>* response)
 {
     return emit_signal_and_wait_for_result(
         std::bind(&DaemonRpc::on_networks, this, request, response, std::placeholders::_1));
 }
 
 grpc::Status mp::DaemonRpc::mount(grpc::ServerContext* context, const MountRequest* request,
-                                  grpc::ServerWriter<MountReply>* response)
+                                  grpc::ServerWriterInterface<MountReply>* response)
 {
     return emit_signal_and_wait_for_result(
         std::bind(&DaemonRpc::on_mount, this, request, response, std::placeholders::_1));
 }
 
 grpc::Status mp::DaemonRpc::recover(grpc::ServerContext* context, const RecoverRequest* request,
-                                    grpc::ServerWriter<RecoverReply>* response)
+                                    grpc::ServerWriterInterface<RecoverReply>* response)
 {
     return emit_signal_and_wait_for_result(
         std::bind(&DaemonRpc::on_recover, this, request, response, std::placeholders::_1));
 }
 
 grpc::Status mp::DaemonRpc::ssh_info(grpc::ServerContext* context, const SSHInfoRequest* request,
-                                     grpc::ServerWriter<SSHInfoReply>* response)
+                                     grpc::ServerWriterInterface<SSHInfoReply>* response)
 {
     return emit_signal_and_wait_for_result(
         std::bind(&DaemonRpc::on_ssh_info, this, request, response, std::placeholders::_1));
 }
 
 grpc::Status mp::DaemonRpc::start(grpc::ServerContext* context, const StartRequest* request,
-                                  grpc::ServerWriter<StartReply>* response)
+                                  grpc::ServerWriterInterface<StartReply>* response)
 {
     return emit_signal_and_wait_for_result(
         std::bind(&DaemonRpc::on_start, this, request, response, std::placeholders::_1));
 }
 
 grpc::Status mp::DaemonRpc::stop(grpc::ServerContext* context, const StopRequest* request,
-                                 grpc::ServerWriter<StopReply>* response)
+                                 grpc::ServerWriterInterface<StopReply>* response)
 {
     return emit_signal_and_wait_for_result(
         std::bind(&DaemonRpc::on_stop, this, request, response, std::placeholders::_1));
 }
 
 grpc::Status mp::DaemonRpc::suspend(grpc::ServerContext* context, const SuspendRequest* request,
-                                    grpc::ServerWriter<SuspendReply>* response)
+                                    grpc::ServerWriterInterface<SuspendReply>* response)
 {
     return emit_signal_and_wait_for_result(
         std::bind(&DaemonRpc::on_suspend, this, request, response, std::placeholders::_1));
 }
 
 grpc::Status mp::DaemonRpc::restart(grpc::ServerContext* context, const RestartRequest* request,
-                                    grpc::ServerWriter<RestartReply>* response)
+                                    grpc::ServerWriterInterface<RestartReply>* response)
 {
     return emit_signal_and_wait_for_result(
         std::bind(&DaemonRpc::on_restart, this, request, response, std::placeholders::_1));
 }
 
 grpc::Status mp::DaemonRpc::delet(grpc::ServerContext* context, const DeleteRequest* request,
-                                  grpc::ServerWriter<DeleteReply>* response)
+                                  grpc::ServerWriterInterface<DeleteReply>* response)
 {
     return emit_signal_and_wait_for_result(
         std::bind(&DaemonRpc::on_delete, this, request, response, std::placeholders::_1));
 }
 
 grpc::Status mp::DaemonRpc::umount(grpc::ServerContext* context, const UmountRequest* request,
-                                   grpc::ServerWriter<UmountReply>* response)
+                                   grpc::ServerWriterInterface<UmountReply>* response)
 {
     return emit_signal_and_wait_for_result(
         std::bind(&DaemonRpc::on_umount, this, request, response, std::placeholders::_1));
 }
 
 grpc::Status mp::DaemonRpc::version(grpc::ServerContext* context, const VersionRequest* request,
-                                    grpc::ServerWriter<VersionReply>* response)
+                                    grpc::ServerWriterInterface<VersionReply>* response)
 {
     return emit_signal_and_wait_for_result(
         std::bind(&DaemonRpc::on_version, this, request, response, std::placeholders::_1));
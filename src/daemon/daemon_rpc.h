@@ -27,9 +27,14 @@
 #include <grpcpp/grpcpp.h>
 
 #include <QObject>
+#include <QThreadPool>
 
+#include <condition_variable>
 #include <future>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace multipass
 {
@@ -38,92 +43,128 @@ using CreateReply = LaunchReply;
 using CreateError = LaunchError;
 using CreateProgress = LaunchProgress;
 
+// A watch call as the daemon sees it: what it writes is queued, and goes out as fast as the client reads it
+class WatchStream
+{
+public:
+    virtual ~WatchStream() = default;
+    virtual void write_snapshot(const WatchReply& snapshot) = 0; // goes out ahead of any changes queued before it
+    virtual void write_change(const WatchReply& change) = 0;
+    virtual void finish(const grpc::Status& status) = 0;
+    virtual bool is_open() = 0; // false once the call is over, whichever side ended it
+};
+
 struct DaemonConfig;
-class DaemonRpc : public QObject, public multipass::Rpc::Service
+class DaemonRpc : public QObject
 {
     Q_OBJECT
 public:
     DaemonRpc(const std::string& server_address, multipass::RpcConnectionType type, const CertProvider& cert_provider,
-              const CertStore& client_cert_store);
+              const CertStore& client_cert_store, int max_requests, int num_pollers);
+    ~DaemonRpc();
     DaemonRpc(const DaemonRpc&) = delete;
     DaemonRpc& operator=(const DaemonRpc&) = delete;
 
 signals:
-    void on_create(const CreateRequest* request, grpc::ServerWriter<CreateReply>* reply,
+    void on_create(const CreateRequest* request, grpc::ServerWriterInterface<CreateReply>* reply,
                    std::promise<grpc::Status>* status_promise);
-    void on_launch(const LaunchRequest* request, grpc::ServerWriter<LaunchReply>* reply,
+    void on_launch(const LaunchRequest* request, grpc::ServerWriterInterface<LaunchReply>* reply,
                    std::promise<grpc::Status>* status_promise);
-    void on_purge(const PurgeRequest* request, grpc::ServerWriter<PurgeReply>* response,
+    void on_purge(const PurgeRequest* request, grpc::ServerWriterInterface<PurgeReply>* response,
                   std::promise<grpc::Status>* status_promise);
-    void on_find(const FindRequest* request, grpc::ServerWriter<FindReply>* response,
+    void on_find(const FindRequest* request, grpc::ServerWriterInterface<FindReply>* response,
                  std::promise<grpc::Status>* status_promise);
-    void on_info(const InfoRequest* request, grpc::ServerWriter<InfoReply>* response,
+    void on_info(const InfoRequest* request, grpc::ServerWriterInterface<InfoReply>* response,
                  std::promise<grpc::Status>* status_promise);
-    void on_list(const ListRequest* request, grpc::ServerWriter<ListReply>* response,
+    void on_list(const ListRequest* request, grpc::ServerWriterInterface<ListReply>* response,
                  std::promise<grpc::Status>* status_promise);
-    void on_networks(const NetworksRequest* request, grpc::ServerWriter<NetworksReply>* response,
+    void on_networks(const NetworksRequest* request, grpc::ServerWriterInterface<NetworksReply>* response,
                      std::promise<grpc::Status>* status_promise);
-    void on_mount(const MountRequest* request, grpc::ServerWriter<MountReply>* response,
+    void on_mount(const MountRequest* request, grpc::ServerWriterInterface<MountReply>* response,
                   std::promise<grpc::Status>* status_promise);
-    void on_recover(const RecoverRequest* request, grpc::ServerWriter<RecoverReply>* response,
+    void on_recover(const RecoverRequest* request, grpc::ServerWriterInterface<RecoverReply>* response,
                     std::promise<grpc::Status>* status_promise);
-    void on_ssh_info(const SSHInfoRequest* request, grpc::ServerWriter<SSHInfoReply>* response,
+    void on_ssh_info(const SSHInfoRequest* request, grpc::ServerWriterInterface<SSHInfoReply>* response,
                      std::promise<grpc::Status>* status_promise);
-    void on_start(const StartRequest* request, grpc::ServerWriter<StartReply>* response,
+    void on_start(const StartRequest* request, grpc::ServerWriterInterface<StartReply>* response,
                   std::promise<grpc::Status>* status_promise);
-    void on_stop(const StopRequest* request, grpc::ServerWriter<StopReply>* response,
+    void on_stop(const StopRequest* request, grpc::ServerWriterInterface<StopReply>* response,
                  std::promise<grpc::Status>* status_promise);
-    void on_suspend(const SuspendRequest* request, grpc::ServerWriter<SuspendReply>* response,
+    void on_suspend(const SuspendRequest* request, grpc::ServerWriterInterface<SuspendReply>* response,
                     std::promise<grpc::Status>* status_promise);
-    void on_restart(const RestartRequest* request, grpc::ServerWriter<RestartReply>* response,
+    void on_restart(const RestartRequest* request, grpc::ServerWriterInterface<RestartReply>* response,
                     std::promise<grpc::Status>* status_promise);
-    void on_delete(const DeleteRequest* request, grpc::ServerWriter<DeleteReply>* response,
+    void on_delete(const DeleteRequest* request, grpc::ServerWriterInterface<DeleteReply>* response,
                    std::promise<grpc::Status>* status_promise);
-    void on_umount(const UmountRequest* request, grpc::ServerWriter<UmountReply>* response,
+    void on_umount(const UmountRequest* request, grpc::ServerWriterInterface<UmountReply>* response,
                    std::promise<grpc::Status>* status_promise);
-    void on_version(const VersionRequest* request, grpc::ServerWriter<VersionReply>* response,
+    void on_version(const VersionRequest* request, grpc::ServerWriterInterface<VersionReply>* response,
                     std::promise<grpc::Status>* status_promise);
+    void on_watch(const WatchRequest* request, std::shared_ptr<WatchStream> stream);
 
 private:
+    template <typename Request, typename Reply>
+    class StreamingCall;
+    class WatchCall;
+    class PingCall;
+
+    template <typename Service, typename Request, typename Reply>
+    void serve_calls(void (Service::*request_call)(grpc::ServerContext*, Request*, grpc::ServerAsyncWriter<Reply>*,
+                                                   grpc::CompletionQueue*, grpc::ServerCompletionQueue*, void*),
+                     grpc::Status (DaemonRpc::*handler)(grpc::ServerContext*, const Request*,
+                                                        grpc::ServerWriterInterface<Reply>*));
+    void track_call();
+    void untrack_call();
+
     const std::string server_address;
+    // Calls come in on the completion queue, which a few pollers see to without ever waiting on the daemon. Requests
+    // are then served on this pool, where those beyond its threads wait their turn in its queue. Watches stay on the
+    // completion queue, so that they hold no thread however long they are open
+    QThreadPool request_pool;
+    Rpc::AsyncService service;
+    std::unique_ptr<grpc::ServerCompletionQueue> completion_queue;
     const std::unique_ptr<grpc::Server> server;
+    std::vector<std::thread> pollers;
+    std::mutex calls_mutex;
+    std::condition_variable calls_cv;
+    int calls{0}; // those gRPC may still hand back to the completion queue, waiting for a client or being served
 
 protected:
-    grpc::Status create(grpc::ServerContext* context, const CreateRequest* request,
-                        grpc::ServerWriter<CreateReply>* reply) override;
-    grpc::Status launch(grpc::ServerContext* context, const LaunchRequest* request,
-                        grpc::ServerWriter<LaunchReply>* reply) override;
-    grpc::Status purge(grpc::ServerContext* context, const PurgeRequest* request,
-                       grpc::ServerWriter<PurgeReply>* response) override;
-    grpc::Status find(grpc::ServerContext* context, const FindRequest* request,
-                      grpc::ServerWriter<FindReply>* response) override;
-    grpc::Status info(grpc::ServerContext* context, const InfoRequest* request,
-                      grpc::ServerWriter<InfoReply>* response) override;
-    grpc::Status list(grpc::ServerContext* context, const ListRequest* request,
-                      grpc::ServerWriter<ListReply>* response) override;
-    grpc::Status networks(grpc::ServerContext* context, const NetworksRequest* request,
-                          grpc::ServerWriter<NetworksReply>* response) override;
-    grpc::Status mount(grpc::ServerContext* context, const MountRequest* request,
-                       grpc::ServerWriter<MountReply>* response) override;
-    grpc::Status recover(grpc::ServerContext* context, const RecoverRequest* request,
-                         grpc::ServerWriter<RecoverReply>* response) override;
-    grpc::Status ssh_info(grpc::ServerContext* context, const SSHInfoRequest* request,
-                          grpc::ServerWriter<SSHInfoReply>* response) override;
-    grpc::Status start(grpc::ServerContext* context, const StartRequest* request,
-                       grpc::ServerWriter<StartReply>* response) override;
-    grpc::Status stop(grpc::ServerContext* context, const StopRequest* request,
-                      grpc::ServerWriter<StopReply>* response) override;
-    grpc::Status suspend(grpc::ServerContext* context, const SuspendRequest* request,
-                         grpc::ServerWriter<SuspendReply>* response) override;
-    grpc::Status restart(grpc::ServerContext* context, const RestartRequest* request,
-                         grpc::ServerWriter<RestartReply>* response) override;
-    grpc::Status delet(grpc::ServerContext* context, const DeleteRequest* request,
-                       grpc::ServerWriter<DeleteReply>* response) override;
-    grpc::Status umount(grpc::ServerContext* context, const UmountRequest* request,
-                        grpc::ServerWriter<UmountReply>* response) override;
-    grpc::Status version(grpc::ServerContext* context, const VersionRequest* request,
-                         grpc::ServerWriter<VersionReply>* response) override;
-    grpc::Status ping(grpc::ServerContext* context, const PingRequest* request, PingReply* response) override;
+    virtual grpc::Status create(grpc::ServerContext* context, const CreateRequest* request,
+                                grpc::ServerWriterInterface<CreateReply>* reply);
+    virtual grpc::Status launch(grpc::ServerContext* context, const LaunchRequest* request,
+                                grpc::ServerWriterInterface<LaunchReply>* reply);
+    virtual grpc::Status purge(grpc::ServerContext* context, const PurgeRequest* request,
+                               grpc::ServerWriterInterface<PurgeReply>* response);
+    virtual grpc::Status find(grpc::ServerContext* context, const FindRequest* request,
+                              grpc::ServerWriterInterface<FindReply>* response);
+    virtual grpc::Status info(grpc::ServerContext* context, const InfoRequest* request,
+                              grpc::ServerWriterInterface<InfoReply>* response);
+    virtual grpc::Status list(grpc::ServerContext* context, const ListRequest* request,
+                              grpc::ServerWriterInterface<ListReply>* response);
+    virtual grpc::Status networks(grpc::ServerContext* context, const NetworksRequest* request,
+                                  grpc::ServerWriterInterface<NetworksReply>* response);
+    virtual grpc::Status mount(grpc::ServerContext* context, const MountRequest* request,
+                               grpc::ServerWriterInterface<MountReply>* response);
+    virtual grpc::Status recover(grpc::ServerContext* context, const RecoverRequest* request,
+                                 grpc::ServerWriterInterface<RecoverReply>* response);
+    virtual grpc::Status ssh_info(grpc::ServerContext* context, const SSHInfoRequest* request,
+                                  grpc::ServerWriterInterface<SSHInfoReply>* response);
+    virtual grpc::Status start(grpc::ServerContext* context, const StartRequest* request,
+                               grpc::ServerWriterInterface<StartReply>* response);
+    virtual grpc::Status stop(grpc::ServerContext* context, const StopRequest* request,
+                              grpc::ServerWriterInterface<StopReply>* response);
+    virtual grpc::Status suspend(grpc::ServerContext* context, const SuspendRequest* request,
+                                 grpc::ServerWriterInterface<SuspendReply>* response);
+    virtual grpc::Status restart(grpc::ServerContext* context, const RestartRequest* request,
+                                 grpc::ServerWriterInterface<RestartReply>* response);
+    virtual grpc::Status delet(grpc::ServerContext* context, const DeleteRequest* request,
+                               grpc::ServerWriterInterface<DeleteReply>* response);
+    virtual grpc::Status umount(grpc::ServerContext* context, const UmountRequest* request,
+                                grpc::ServerWriterInterface<UmountReply>* response);
+    virtual grpc::Status version(grpc::ServerContext* context, const VersionRequest* request,
+                                 grpc::ServerWriterInterface<VersionReply>* response);
+    virtual grpc::Status ping(grpc::ServerContext* context, const PingRequest* request, PingReply* response);
 };
 } // namespace multipass
 #endif // MULTIPASS_DAEMON_RPC_H
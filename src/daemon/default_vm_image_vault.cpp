@@ -18,6 +18,7 @@
 #include "default_vm_image_vault.h"
 #include "json_writer.h"
 
+#include <multipass/constants.h>
 #include <multipass/exceptions/aborted_download_exception.h>
 #include <multipass/exceptions/create_image_exception.h>
 #include <multipass/exceptions/unsupported_image_exception.h>
@@ -26,6 +27,7 @@
 #include <multipass/process/qemuimg_process_spec.h>
 #include <multipass/query.h>
 #include <multipass/rpc/multipass.grpc.pb.h>
+#include <multipass/settings.h>
 #include <multipass/url_downloader.h>
 #include <multipass/utils.h>
 #include <multipass/vm_image.h>
@@ -39,6 +41,7 @@
 #include <QUrl>
 #include <QtConcurrent/QtConcurrent>
 
+#include <chrono>
 #include <exception>
 
 namespace mp = multipass;
@@ -89,6 +92,8 @@ auto record_to_json(const mp::VaultRecord& record)
     json.insert("image", image_to_json(record.image));
     json.insert("query", query_to_json(record.query));
     json.insert("last_accessed", static_cast<qint64>(record.last_accessed.time_since_epoch().count()));
+    if (record.image_size)
+        json.insert("image_size", record.image_size->in_bytes());
     return json;
 }
 
@@ -161,14 +166,38 @@ std::unordered_map<std::string, mp::VaultRecord> load_db(const QString& db_name)
             last_accessed = std::chrono::system_clock::time_point(duration);
         }
 
+        mp::optional<mp::MemorySize> image_size;
+        if (record["image_size"].isDouble())
+            image_size = mp::MemorySize{std::to_string(static_cast<qint64>(record["image_size"].toDouble()))};
+
         reconstructed_records[key] = {
             {image_path, kernel_path, initrd_path, image_id, original_release, current_release, release_date, aliases},
             {"", release.toStdString(), persistent.toBool(), remote_name.toStdString(), query_type},
-            last_accessed};
+            last_accessed,
+            image_size};
     }
     return reconstructed_records;
 }
 
+QString create_overlay(const mp::Path& backing_image_path, const QDir& output_dir)
+{
+    const auto overlay_path = output_dir.filePath(QFileInfo{backing_image_path}.fileName());
+
+    QStringList qemuimg_parameters{{"create", "-f", "qcow2", "-F", "qcow2", "-b", backing_image_path, overlay_path}};
+    auto qemuimg_process = mp::platform::make_process(
+        std::make_unique<mp::QemuImgProcessSpec>(qemuimg_parameters, backing_image_path, overlay_path));
+    auto process_state = qemuimg_process->execute();
+
+    if (!process_state.completed_successfully())
+    {
+        throw std::runtime_error(fmt::format("Cannot create instance image: qemu-img failed ({}) with output:\n{}",
+                                             process_state.failure_message(),
+                                             qemuimg_process->read_all_standard_error()));
+    }
+
+    return overlay_path;
+}
+
 QString copy(const QString& file_name, const QDir& output_dir)
 {
     if (file_name.isEmpty())
@@ -180,7 +209,9 @@ QString copy(const QString& file_name, const QDir& output_dir)
     QFileInfo info{file_name};
     const auto source_name = info.fileName();
     auto new_path = output_dir.filePath(source_name);
-    QFile::copy(file_name, new_path);
+    if (!mp::platform::copy_file(file_name, new_path))
+        throw std::runtime_error(fmt::format("Cannot copy {} to {}", file_name, new_path));
+
     return new_path;
 }
 
@@ -209,6 +240,10 @@ void delete_image_dir(const mp::Path& image_path)
 
 mp::MemorySize get_image_size(const mp::Path& image_path)
 {
+    // Reading the size from a qcow2 header spares forking qemu-img for it
+    if (const auto qcow2_size = mp::vault::qcow2_virtual_size(image_path))
+        return mp::MemorySize{std::to_string(qcow2_size)};
+
     QStringList qemuimg_parameters{{"info", image_path}};
     auto qemuimg_process =
         mp::platform::make_process(std::make_unique<mp::QemuImgProcessSpec>(qemuimg_parameters, image_path));
@@ -240,6 +275,48 @@ mp::MemorySize get_image_size(const mp::Path& image_path)
 
     return image_size;
 }
+
+// What was downloaded is verified against the image info, while what ends up on disk is what the store keeps
+struct DownloadHashes
+{
+    QString download_hash;
+    QString image_hash;
+};
+
+// The downloader keeps receiving on its own thread while this one decodes, so the two overlap
+DownloadHashes download_and_decode(mp::URLDownloader* url_downloader, const mp::VMImageInfo& info,
+                                   const mp::Path& decoded_image_path, const mp::ProgressMonitor& monitor)
+{
+    mp::XzImageDecoder xz_decoder;
+    xz_decoder.start_decoding_to(decoded_image_path);
+
+    auto download_hash = url_downloader->stream_to(
+        info.image_location, [&xz_decoder](const QByteArray& data) { xz_decoder.decode(data); }, info.size,
+        mp::LaunchProgress::IMAGE, monitor);
+
+    return {download_hash, xz_decoder.finish_decoding()};
+}
+
+// Decoding in parallel needs the index at the end of the compressed file, so that waits for the whole download
+DownloadHashes download_then_decode(mp::URLDownloader* url_downloader, const mp::VMImageInfo& info,
+                                    const mp::Path& decoded_image_path, int decoder_threads,
+                                    const mp::ProgressMonitor& monitor)
+{
+    const auto xz_image_path = decoded_image_path + ".xz";
+    mp::vault::DeleteOnException xz_image_file{xz_image_path};
+
+    auto download_hash =
+        url_downloader->download_to(info.image_location, xz_image_path, info.size, mp::LaunchProgress::IMAGE, monitor);
+    auto image_hash = mp::XzImageDecoder{xz_image_path, decoder_threads}.decode_to(decoded_image_path, monitor);
+    mp::vault::delete_file(xz_image_path);
+
+    return {download_hash, image_hash};
+}
+
+int image_decoder_threads()
+{
+    return MP_SETTINGS.get(mp::image_decoder_threads_key).toInt();
+}
 } // namespace
 
 mp::DefaultVMImageVault::DefaultVMImageVault(std::vector<VMImageHost*> image_hosts, URLDownloader* downloader,
@@ -250,6 +327,8 @@ mp::DefaultVMImageVault::DefaultVMImageVault(std::vector<VMImageHost*> image_hos
       data_dir{QDir(data_dir_path).filePath("vault")},
       instances_dir(data_dir.filePath("instances")),
       images_dir(cache_dir.filePath("images")),
+      // Instance images may be overlays backed by what is in the store, so it goes with them rather than in the cache
+      blob_store{data_dir.filePath("blobs")},
       days_to_expire{days_to_expire},
       prepared_image_records{load_db(cache_dir.filePath(image_db_name))},
       instance_image_records{load_db(data_dir.filePath(instance_db_name))}
@@ -270,6 +349,13 @@ mp::DefaultVMImageVault::~DefaultVMImageVault()
 
 mp::VMImage mp::DefaultVMImageVault::fetch_image(const FetchType& fetch_type, const Query& query,
                                                  const PrepareAction& prepare, const ProgressMonitor& monitor)
+{
+    return fetch_image_at_rate(fetch_type, query, prepare, monitor, 0);
+}
+
+mp::VMImage mp::DefaultVMImageVault::fetch_image_at_rate(const FetchType& fetch_type, const Query& query,
+                                                         const PrepareAction& prepare, const ProgressMonitor& monitor,
+                                                         qint64 max_bytes_per_second)
 {
     {
         std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
@@ -285,193 +371,188 @@ mp::VMImage mp::DefaultVMImageVault::fetch_image(const FetchType& fetch_type, co
     if (query.query_type != Query::Type::Alias && !mp::platform::is_image_url_supported())
         throw std::runtime_error(fmt::format("http and file based images are not supported"));
 
+    std::string id;
+    optional<VMImage> source_image{nullopt};
+    QFuture<VMImage> future;
+
     if (query.query_type == Query::Type::LocalFile)
     {
         QUrl image_url(QString::fromStdString(query.release));
-        VMImage source_image, vm_image;
 
         if (!QFile::exists(image_url.path()))
             throw std::runtime_error(fmt::format("Custom image `{}` does not exist.", image_url.path()));
 
-        source_image.image_path = image_url.path();
+        // Hashing the whole file takes a while, so it is left to the fetch in the background, which launches of the
+        // same file wait on in the meantime
+        id = image_url.path().toStdString();
 
-        if (source_image.image_path.endsWith(".xz"))
+        std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+        auto running_future = get_image_future(id);
+        if (running_future)
         {
-            source_image.image_path = extract_image_from(query.name, source_image, monitor);
+            monitor(LaunchProgress::WAITING, -1);
+            future = *running_future;
         }
         else
         {
-            source_image = image_instance_from(query.name, source_image);
-        }
+            // Had to use std::bind here to workaround the 5 allowable function arguments constraint of
+            // QtConcurrent::run()
+            future = QtConcurrent::run(std::bind(&DefaultVMImageVault::prepare_local_image, this, image_url.path(),
+                                                 query.name, fetch_type, prepare, monitor));
 
-        if (fetch_type == FetchType::ImageKernelAndInitrd)
-        {
-            auto info = get_kernel_query_info(query.name);
-
-            source_image =
-                fetch_kernel_and_initrd(info, source_image, QFileInfo(source_image.image_path).absoluteDir(), monitor);
-        }
-
-        vm_image = prepare(source_image);
-        vm_image.id = mp::vault::compute_image_hash(vm_image.image_path).toStdString();
-
-        remove_source_images(source_image, vm_image);
-
-        {
-            std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
-            instance_image_records[query.name] = {vm_image, query, std::chrono::system_clock::now()};
-            persist_instance_records();
+            in_progress_image_fetches[id] = future;
         }
-
-        return vm_image;
     }
-    else
+    else if (query.query_type == Query::Type::HttpDownload)
     {
-        std::string id;
-        optional<VMImage> source_image{nullopt};
-        QFuture<VMImage> future;
+        QUrl image_url(QString::fromStdString(query.release));
 
-        if (query.query_type == Query::Type::HttpDownload)
-        {
-            QUrl image_url(QString::fromStdString(query.release));
+        // Generate a sha256 hash based on the URL and use that for the id
+        id = QCryptographicHash::hash(query.release.c_str(), QCryptographicHash::Sha256).toHex().toStdString();
+        auto last_modified = url_downloader->last_modified(image_url);
 
-            // Generate a sha256 hash based on the URL and use that for the id
-            id = QCryptographicHash::hash(query.release.c_str(), QCryptographicHash::Sha256).toHex().toStdString();
-            auto last_modified = url_downloader->last_modified(image_url);
+        std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+        auto entry = prepared_image_records.find(id);
+        if (entry != prepared_image_records.end())
+        {
+            auto& record = entry->second;
 
-            std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
-            auto entry = prepared_image_records.find(id);
-            if (entry != prepared_image_records.end())
+            if (last_modified.isValid() && (last_modified.toString().toStdString() == record.image.release_date))
             {
-                auto& record = entry->second;
-
-                if (last_modified.isValid() && (last_modified.toString().toStdString() == record.image.release_date))
-                {
-                    return finalize_image_records(query, record.image, id);
-                }
+                return finalize_image_records(query, record.image, id);
             }
+        }
 
-            auto running_future = get_image_future(id);
-            if (running_future)
-            {
-                monitor(LaunchProgress::WAITING, -1);
-                future = *running_future;
-            }
-            else
-            {
-                auto kernel_info = get_kernel_query_info(query.name);
-                const VMImageInfo info{{},
-                                       {},
-                                       {},
-                                       {},
-                                       true,
-                                       image_url.url(),
-                                       kernel_info.kernel_location,
-                                       kernel_info.initrd_location,
-                                       QString::fromStdString(id),
-                                       {},
-                                       last_modified.toString(),
-                                       0,
-                                       false};
-                const auto image_filename = mp::vault::filename_for(image_url.path());
-                // Attempt to make a sane directory name based on the filename of the image
-
-                const auto image_dir_name =
-                    QString("%1-%2")
-                        .arg(image_filename.section(".", 0, image_filename.endsWith(".xz") ? -3 : -2))
-                        .arg(last_modified.toString("yyyyMMdd"));
-                const auto image_dir = mp::utils::make_dir(images_dir, image_dir_name);
-
-                // Had to use std::bind here to workaround the 5 allowable function arguments constraint of
-                // QtConcurrent::run()
-                future = QtConcurrent::run(std::bind(&DefaultVMImageVault::download_and_prepare_source_image, this,
-                                                     info, source_image, image_dir, fetch_type, prepare, monitor));
-
-                in_progress_image_fetches[id] = future;
-            }
+        auto running_future = get_image_future(id);
+        if (running_future)
+        {
+            monitor(LaunchProgress::WAITING, -1);
+            future = *running_future;
         }
         else
         {
-            const auto info = info_for(query);
+            auto kernel_info = get_kernel_query_info(query.name);
+            const VMImageInfo info{{},
+                                   {},
+                                   {},
+                                   {},
+                                   true,
+                                   image_url.url(),
+                                   kernel_info.kernel_location,
+                                   kernel_info.initrd_location,
+                                   QString::fromStdString(id),
+                                   {},
+                                   last_modified.toString(),
+                                   0,
+                                   false};
+            const auto image_filename = mp::vault::filename_for(image_url.path());
+            // Attempt to make a sane directory name based on the filename of the image
+
+            const auto image_dir_name =
+                QString("%1-%2")
+                    .arg(image_filename.section(".", 0, image_filename.endsWith(".xz") ? -3 : -2))
+                    .arg(last_modified.toString("yyyyMMdd"));
+            const auto image_dir = mp::utils::make_dir(images_dir, image_dir_name);
+
+            // Had to use std::bind here to workaround the 5 allowable function arguments constraint of
+            // QtConcurrent::run()
+            future = QtConcurrent::run(std::bind(&DefaultVMImageVault::download_and_prepare_source_image, this,
+                                                 info, source_image, image_dir, fetch_type, prepare, monitor));
+
+            in_progress_image_fetches[id] = future;
+        }
+    }
+    else
+    {
+        const auto info = info_for(query);
 
-            if (!mp::platform::is_remote_supported(query.remote_name))
-                throw std::runtime_error(
-                    fmt::format("{} is not a supported remote. Please use `multipass find` for supported images.",
-                                query.remote_name));
+        if (!mp::platform::is_remote_supported(query.remote_name))
+            throw std::runtime_error(
+                fmt::format("{} is not a supported remote. Please use `multipass find` for supported images.",
+                            query.remote_name));
 
-            if (!mp::platform::is_alias_supported(query.release, query.remote_name))
-                throw std::runtime_error(
-                    fmt::format("{} is not a supported alias. Please use `multipass find` for supported image aliases.",
-                                query.release));
+        if (!mp::platform::is_alias_supported(query.release, query.remote_name))
+            throw std::runtime_error(
+                fmt::format("{} is not a supported alias. Please use `multipass find` for supported image aliases.",
+                            query.release));
 
-            id = info.id.toStdString();
+        id = info.id.toStdString();
 
-            std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
-            if (!query.name.empty())
+        std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+        if (!query.name.empty())
+        {
+            for (auto& record : prepared_image_records)
             {
-                for (auto& record : prepared_image_records)
-                {
-                    if (record.second.query.remote_name != query.remote_name)
-                        continue;
+                if (record.second.query.remote_name != query.remote_name)
+                    continue;
 
-                    const auto aliases = record.second.image.aliases;
-                    if (id == record.first ||
-                        std::find(aliases.cbegin(), aliases.cend(), query.release) != aliases.cend())
+                const auto aliases = record.second.image.aliases;
+                if (id == record.first ||
+                    std::find(aliases.cbegin(), aliases.cend(), query.release) != aliases.cend())
+                {
+                    const auto prepared_image = record.second.image;
+                    try
                     {
-                        const auto prepared_image = record.second.image;
-                        try
-                        {
-                            return finalize_image_records(query, prepared_image, record.first);
-                        }
-                        catch (const std::exception& e)
-                        {
-                            mpl::log(mpl::Level::warning, category,
-                                     fmt::format("Cannot create instance image: {}", e.what()));
-
-                            break;
-                        }
+                        return finalize_image_records(query, prepared_image, record.first);
                     }
-                }
-            }
-
-            auto running_future = get_image_future(id);
-            if (running_future)
-            {
-                monitor(LaunchProgress::WAITING, -1);
-                future = *running_future;
-            }
-            else
-            {
-                const auto image_dir =
-                    mp::utils::make_dir(images_dir, QString("%1-%2").arg(info.release).arg(info.version));
-
-                // Had to use std::bind here to workaround the 5 allowable function arguments constraint of
-                // QtConcurrent::run()
-                future = QtConcurrent::run(std::bind(&DefaultVMImageVault::download_and_prepare_source_image, this,
-                                                     info, source_image, image_dir, fetch_type, prepare, monitor));
+                    catch (const std::exception& e)
+                    {
+                        mpl::log(mpl::Level::warning, category,
+                                 fmt::format("Cannot create instance image: {}", e.what()));
 
-                in_progress_image_fetches[id] = future;
+                        break;
+                    }
+                }
             }
         }
 
-        try
+        auto running_future = get_image_future(id);
+        if (running_future)
         {
-            auto prepared_image = future.result();
-            std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
-            in_progress_image_fetches.erase(id);
-            return finalize_image_records(query, prepared_image, id);
-        }
-        catch (const AbortedDownloadException&)
-        {
-            throw;
+            // Whoever wants the image unthrottled lifts the limit of the prefetch downloading it, while a prefetch
+            // leaves the download it joins as it is
+            if (max_bytes_per_second <= 0)
+                url_downloader->limit_rate(info.image_location, 0);
+
+            monitor(LaunchProgress::WAITING, -1);
+            future = *running_future;
         }
-        catch (const std::exception& e)
+        else
         {
-            std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
-            in_progress_image_fetches.erase(id);
-            throw;
+            url_downloader->limit_rate(info.image_location, max_bytes_per_second);
+
+            const auto image_dir =
+                mp::utils::make_dir(images_dir, QString("%1-%2").arg(info.release).arg(info.version));
+
+            // Had to use std::bind here to workaround the 5 allowable function arguments constraint of
+            // QtConcurrent::run()
+            future = QtConcurrent::run(std::bind(&DefaultVMImageVault::download_and_prepare_source_image, this,
+                                                 info, source_image, image_dir, fetch_type, prepare, monitor));
+
+            in_progress_image_fetches[id] = future;
         }
     }
+
+    try
+    {
+        auto prepared_image = future.result();
+        std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+        in_progress_image_fetches.erase(id);
+
+        // Local images are recorded by the hash of the file, as their fetch found it
+        return finalize_image_records(query, prepared_image,
+                                      query.query_type == Query::Type::LocalFile ? local_image_ids[id] : id);
+    }
+    catch (const AbortedDownloadException&)
+    {
+        throw;
+    }
+    catch (const std::exception& e)
+    {
+        std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+        in_progress_image_fetches.erase(id);
+        throw;
+    }
 }
 
 void mp::DefaultVMImageVault::remove(const std::string& name)
@@ -501,14 +582,19 @@ void mp::DefaultVMImageVault::prune_expired_images()
     for (const auto& record : prepared_image_records)
     {
         // Expire source images if they aren't persistent and haven't been accessed in 14 days
-        if (record.second.query.query_type == Query::Type::Alias && !record.second.query.persistent &&
+        const auto query_type = record.second.query.query_type;
+        if ((query_type == Query::Type::Alias || query_type == Query::Type::LocalFile) &&
+            !record.second.query.persistent &&
             record.second.last_accessed + days_to_expire <= std::chrono::system_clock::now())
         {
             mpl::log(
                 mpl::Level::info, category,
                 fmt::format("Source image {} is expired. Removing it from the cache.", record.second.query.release));
             expired_keys.push_back(record.first);
-            delete_image_dir(record.second.image.image_path);
+
+            // Images in the store may be shared, so they are only removed once nothing refers to them
+            if (blob_store.hash_of(record.second.image.image_path).isEmpty())
+                delete_image_dir(record.second.image.image_path);
         }
     }
 
@@ -530,6 +616,7 @@ void mp::DefaultVMImageVault::prune_expired_images()
     for (const auto& key : expired_keys)
         prepared_image_records.erase(key);
 
+    remove_unreferenced_blobs();
     persist_image_records();
 }
 
@@ -569,8 +656,10 @@ void mp::DefaultVMImageVault::update_images(const FetchType& fetch_type, const P
 
             // Remove old image
             std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
-            delete_image_dir(record.image.image_path);
+            if (blob_store.hash_of(record.image.image_path).isEmpty())
+                delete_image_dir(record.image.image_path);
             prepared_image_records.erase(key);
+            remove_unreferenced_blobs();
             persist_image_records();
         }
         catch (const CreateImageException& e)
@@ -581,16 +670,84 @@ void mp::DefaultVMImageVault::update_images(const FetchType& fetch_type, const P
     }
 }
 
+void mp::DefaultVMImageVault::prefetch_images(const FetchType& fetch_type, const std::vector<Query>& queries,
+                                              const PrepareAction& prepare, const ProgressMonitor& monitor,
+                                              const MemorySize& max_download_rate)
+{
+    for (const auto& query : queries)
+    {
+        try
+        {
+            const auto info = info_for(query);
+            const auto id = info.id.toStdString();
+
+            {
+                std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+                auto entry = prepared_image_records.find(id);
+                if (entry != prepared_image_records.end())
+                {
+                    // Keep prefetched images from expiring while they are still wanted
+                    entry->second.last_accessed = std::chrono::system_clock::now();
+                    persist_image_records();
+                    continue;
+                }
+            }
+
+            mpl::log(mpl::Level::info, category, fmt::format("Prefetching {} source image", query.release));
+
+            auto prefetch_query = query;
+            prefetch_query.name = "";
+
+            // The downloader keeps to the rate until the image is in, or a launch that wants it lifts the limit
+            try
+            {
+                fetch_image_at_rate(fetch_type, prefetch_query, prepare, monitor, max_download_rate.in_bytes());
+            }
+            catch (...)
+            {
+                url_downloader->limit_rate(info.image_location, 0);
+                throw;
+            }
+            url_downloader->limit_rate(info.image_location, 0);
+        }
+        catch (const AbortedDownloadException&)
+        {
+            throw;
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::warning, category,
+                     fmt::format("Cannot prefetch source image {}: {}", query.release, e.what()));
+        }
+    }
+}
+
 mp::MemorySize mp::DefaultVMImageVault::minimum_image_size_for(const std::string& id)
 {
+    std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+
     auto prepared_image_entry = prepared_image_records.find(id);
+    if (prepared_image_entry == prepared_image_records.end())
+    {
+        // Local images are recorded by the hash of their file rather than that of the prepared image
+        prepared_image_entry = std::find_if(
+            prepared_image_records.begin(), prepared_image_records.end(),
+            [&id](const std::pair<const std::string, VaultRecord>& record) { return record.second.image.id == id; });
+    }
+
     if (prepared_image_entry != prepared_image_records.end())
     {
-        const auto& record = prepared_image_entry->second;
+        auto& record = prepared_image_entry->second;
+        if (!record.image_size)
+        {
+            record.image_size = get_image_size(record.image.image_path);
+            persist_image_records();
+        }
 
-        return get_image_size(record.image.image_path);
+        return *record.image_size;
     }
 
+    // Instance images grow with their instances, so their size is not kept
     for (const auto& instance_image_entry : instance_image_records)
     {
         const auto& record = instance_image_entry.second;
@@ -628,17 +785,38 @@ mp::VMImage mp::DefaultVMImageVault::download_and_prepare_source_image(
         }
     }
 
+    // Compressed images are decoded as they download, so only the decoded image is ever stored
+    const auto xz_image = source_image.image_path.endsWith(".xz");
+    if (xz_image)
+        source_image.image_path.chop(3);
+
     mp::vault::DeleteOnException image_file{source_image.image_path};
 
     try
     {
-        url_downloader->download_to(info.image_location, source_image.image_path, info.size, LaunchProgress::IMAGE,
-                                    monitor);
+        // A single decoder thread might as well keep up with the download rather than wait for it
+        const auto decoder_threads = image_decoder_threads();
+
+        DownloadHashes hashes;
+        if (xz_image && decoder_threads == 1)
+        {
+            hashes = download_and_decode(url_downloader, info, source_image.image_path, monitor);
+        }
+        else if (xz_image)
+        {
+            hashes = download_then_decode(url_downloader, info, source_image.image_path, decoder_threads, monitor);
+        }
+        else
+        {
+            hashes.download_hash = url_downloader->download_to(info.image_location, source_image.image_path,
+                                                               info.size, LaunchProgress::IMAGE, monitor);
+            hashes.image_hash = hashes.download_hash;
+        }
 
         if (info.verify)
         {
             monitor(LaunchProgress::VERIFY, -1);
-            mp::vault::verify_image_download(source_image.image_path, id);
+            mp::vault::verify_image_hash(hashes.download_hash, id);
         }
 
         if (fetch_type == FetchType::ImageKernelAndInitrd)
@@ -646,14 +824,16 @@ mp::VMImage mp::DefaultVMImageVault::download_and_prepare_source_image(
             source_image = fetch_kernel_and_initrd(info, source_image, image_dir, monitor);
         }
 
-        if (source_image.image_path.endsWith(".xz"))
-        {
-            source_image.image_path = mp::vault::extract_image(source_image.image_path, monitor, true);
-        }
-
         auto prepared_image = prepare(source_image);
         remove_source_images(source_image, prepared_image);
 
+        // The hash computed while downloading still holds when prepare left the image alone
+        const auto prepared_image_hash = prepared_image.image_path == source_image.image_path
+                                             ? hashes.image_hash
+                                             : mp::vault::compute_image_hash(prepared_image.image_path);
+        prepared_image = store_prepared_image(prepared_image, prepared_image_hash);
+        QDir{}.rmdir(image_dir.absolutePath());
+
         return prepared_image;
     }
     catch (const AbortedDownloadException&)
@@ -666,16 +846,56 @@ mp::VMImage mp::DefaultVMImageVault::download_and_prepare_source_image(
     }
 }
 
-QString mp::DefaultVMImageVault::extract_image_from(const std::string& instance_name, const VMImage& source_image,
-                                                    const ProgressMonitor& monitor)
+mp::VMImage mp::DefaultVMImageVault::prepare_local_image(const QString& file_path, const std::string& instance_name,
+                                                         const FetchType& fetch_type, const PrepareAction& prepare,
+                                                         const ProgressMonitor& monitor)
 {
-    const auto name = QString::fromStdString(instance_name);
-    const QDir output_dir{mp::utils::make_dir(instances_dir, name)};
-    QFileInfo file_info{source_image.image_path};
-    const auto image_name = file_info.fileName().remove(".xz");
-    const auto image_path = output_dir.filePath(image_name);
+    // Local images are kept by the hash of the file, so launching one again only takes a new instance image
+    monitor(LaunchProgress::VERIFY, -1);
+    const auto file_hash = mp::vault::compute_image_hash(file_path);
+
+    {
+        std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+        local_image_ids[file_path.toStdString()] = file_hash.toStdString();
+
+        auto entry = prepared_image_records.find(file_hash.toStdString());
+        if (entry != prepared_image_records.end() && QFile::exists(entry->second.image.image_path))
+            return entry->second.image;
+    }
+
+    const QDir image_dir{mp::utils::make_dir(images_dir, file_hash)};
+    VMImage source_image;
+    QString decoded_image_hash;
+
+    const auto file_name = QFileInfo{file_path}.fileName();
+    if (file_name.endsWith(".xz"))
+    {
+        source_image.image_path = image_dir.filePath(file_name.left(file_name.size() - 3));
+        mp::vault::DeleteOnException image_file{source_image.image_path};
+        decoded_image_hash =
+            mp::XzImageDecoder{file_path, image_decoder_threads()}.decode_to(source_image.image_path, monitor);
+    }
+    else
+    {
+        source_image.image_path = copy(file_path, image_dir);
+    }
 
-    return mp::vault::extract_image(image_path, monitor);
+    if (fetch_type == FetchType::ImageKernelAndInitrd)
+    {
+        source_image = fetch_kernel_and_initrd(get_kernel_query_info(instance_name), source_image, image_dir, monitor);
+    }
+
+    auto prepared_image = prepare(source_image);
+    const auto image_hash = prepared_image.image_path == source_image.image_path && !decoded_image_hash.isEmpty()
+                                ? decoded_image_hash
+                                : mp::vault::compute_image_hash(prepared_image.image_path);
+    prepared_image.id = image_hash.toStdString();
+    remove_source_images(source_image, prepared_image);
+
+    prepared_image = store_prepared_image(prepared_image, image_hash);
+    QDir{}.rmdir(image_dir.absolutePath());
+
+    return prepared_image;
 }
 
 mp::VMImage mp::DefaultVMImageVault::image_instance_from(const std::string& instance_name,
@@ -684,9 +904,20 @@ mp::VMImage mp::DefaultVMImageVault::image_instance_from(const std::string& inst
     auto name = QString::fromStdString(instance_name);
     auto output_dir = mp::utils::make_dir(instances_dir, name);
 
-    return {copy(prepared_image.image_path, output_dir),
-            copy(prepared_image.kernel_path, output_dir),
-            copy(prepared_image.initrd_path, output_dir),
+    // Stored files stay put while anything refers to them, so instances can use them without copies: kernels and
+    // initrds as they are, and qcow2 images as the backing of an overlay that takes the instance's writes
+    const auto in_store = [this](const Path& path) { return !blob_store.hash_of(path).isEmpty(); };
+    const auto shared_or_copy = [&in_store, &output_dir](const Path& path) {
+        return in_store(path) ? path : copy(path, output_dir);
+    };
+
+    const auto image_path = in_store(prepared_image.image_path) && mp::vault::is_qcow2_image(prepared_image.image_path)
+                                ? create_overlay(prepared_image.image_path, output_dir)
+                                : copy(prepared_image.image_path, output_dir);
+
+    return {image_path,
+            shared_or_copy(prepared_image.kernel_path),
+            shared_or_copy(prepared_image.initrd_path),
             prepared_image.id,
             prepared_image.original_release,
             prepared_image.current_release,
@@ -728,13 +959,18 @@ mp::VMImage mp::DefaultVMImageVault::finalize_image_records(const Query& query,
     if (!query.name.empty())
     {
         vm_image = image_instance_from(query.name, prepared_image);
-        instance_image_records[query.name] = {vm_image, query, std::chrono::system_clock::now()};
+        instance_image_records[query.name] = {vm_image, query, std::chrono::system_clock::now(), nullopt};
     }
 
     // Do not save the instance name for prepared images
     Query prepared_query{query};
     prepared_query.name = "";
-    prepared_image_records[id] = {prepared_image, prepared_query, std::chrono::system_clock::now()};
+
+    // Keep the size worked out before, as long as the image is the same
+    auto& prepared_record = prepared_image_records[id];
+    const auto image_size =
+        prepared_record.image.image_path == prepared_image.image_path ? prepared_record.image_size : nullopt;
+    prepared_record = {prepared_image, prepared_query, std::chrono::system_clock::now(), image_size};
 
     persist_instance_records();
     persist_image_records();
@@ -742,6 +978,46 @@ mp::VMImage mp::DefaultVMImageVault::finalize_image_records(const Query& query,
     return vm_image;
 }
 
+mp::VMImage mp::DefaultVMImageVault::store_prepared_image(const VMImage& prepared_image, const QString& image_hash)
+{
+    auto stored_image{prepared_image};
+
+    stored_image.image_path = blob_store.add(prepared_image.image_path, image_hash);
+
+    if (!prepared_image.kernel_path.isEmpty())
+        stored_image.kernel_path =
+            blob_store.add(prepared_image.kernel_path, mp::vault::compute_image_hash(prepared_image.kernel_path));
+    if (!prepared_image.initrd_path.isEmpty())
+        stored_image.initrd_path =
+            blob_store.add(prepared_image.initrd_path, mp::vault::compute_image_hash(prepared_image.initrd_path));
+
+    return stored_image;
+}
+
+void mp::DefaultVMImageVault::remove_unreferenced_blobs()
+{
+    // Fetched images enter the store before their records are made, so leave it alone until fetches settle
+    if (!in_progress_image_fetches.empty())
+        return;
+
+    std::map<QString, int> reference_counts;
+    for (const auto* records : {&prepared_image_records, &instance_image_records})
+    {
+        for (const auto& record : *records)
+        {
+            const auto& image = record.second.image;
+            for (const auto& path : {image.image_path, image.kernel_path, image.initrd_path})
+                ++reference_counts[blob_store.hash_of(path)];
+        }
+    }
+
+    // Instance images may be overlays, whose backing images must outlive them
+    for (const auto& record : instance_image_records)
+        ++reference_counts[blob_store.hash_of(mp::vault::backing_image_of(record.second.image.image_path))];
+
+    blob_store.remove_unreferenced(reference_counts);
+}
+
 mp::VMImageInfo mp::DefaultVMImageVault::info_for(const mp::Query& query)
 {
     if (!query.remote_name.empty())
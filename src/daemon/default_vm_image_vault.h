@@ -18,7 +18,10 @@
 #ifndef MULTIPASS_DEFAULT_VM_IMAGE_VAULT_H
 #define MULTIPASS_DEFAULT_VM_IMAGE_VAULT_H
 
+#include "vault_blob_store.h"
+
 #include <multipass/days.h>
+#include <multipass/memory_size.h>
 #include <multipass/optional.h>
 #include <multipass/query.h>
 #include <multipass/vm_image.h>
@@ -41,6 +44,8 @@ public:
     multipass::VMImage image;
     multipass::Query query;
     std::chrono::system_clock::time_point last_accessed;
+    // Worked out the first time it is needed, as prepared images do not change
+    optional<MemorySize> image_size;
 };
 class DefaultVMImageVault final : public VMImageVault
 {
@@ -56,21 +61,29 @@ public:
     void prune_expired_images() override;
     void update_images(const FetchType& fetch_type, const PrepareAction& prepare,
                        const ProgressMonitor& monitor) override;
+    void prefetch_images(const FetchType& fetch_type, const std::vector<Query>& queries, const PrepareAction& prepare,
+                         const ProgressMonitor& monitor, const MemorySize& max_download_rate) override;
     MemorySize minimum_image_size_for(const std::string& id) override;
 
 private:
+    // A limit above 0 holds the download back to that rate, unless someone else fetching the image lifts it
+    VMImage fetch_image_at_rate(const FetchType& fetch_type, const Query& query, const PrepareAction& prepare,
+                                const ProgressMonitor& monitor, qint64 max_bytes_per_second);
     VMImage image_instance_from(const std::string& name, const VMImage& prepared_image);
     VMImage download_and_prepare_source_image(const VMImageInfo& info, optional<VMImage>& existing_source_image,
                                               const QDir& image_dir, const FetchType& fetch_type,
                                               const PrepareAction& prepare, const ProgressMonitor& monitor);
-    QString extract_image_from(const std::string& instance_name, const VMImage& source_image,
-                               const ProgressMonitor& monitor);
+    VMImage prepare_local_image(const QString& file_path, const std::string& instance_name,
+                                const FetchType& fetch_type, const PrepareAction& prepare,
+                                const ProgressMonitor& monitor);
     VMImage fetch_kernel_and_initrd(const VMImageInfo& info, const VMImage& source_image, const QDir& image_dir,
                                     const ProgressMonitor& monitor);
     optional<QFuture<VMImage>> get_image_future(const std::string& id);
     VMImage finalize_image_records(const Query& query, const VMImage& prepared_image, const std::string& id);
     VMImageInfo info_for(const Query& query);
     VMImageInfo get_kernel_query_info(const std::string& name);
+    VMImage store_prepared_image(const VMImage& prepared_image, const QString& image_hash);
+    void remove_unreferenced_blobs();
     void persist_image_records();
     void persist_instance_records();
 
@@ -80,6 +93,7 @@ private:
     const QDir data_dir;
     const QDir instances_dir;
     const QDir images_dir;
+    VaultBlobStore blob_store;
     const days days_to_expire;
     std::mutex fetch_mutex;
 
@@ -87,6 +101,8 @@ private:
     std::unordered_map<std::string, VaultRecord> instance_image_records;
     std::unordered_map<std::string, VMImageHost*> remote_image_host_map;
     std::unordered_map<std::string, QFuture<VMImage>> in_progress_image_fetches;
+    // The hash of each local image file, as of its last fetch
+    std::unordered_map<std::string, std::string> local_image_ids;
 };
 }
 #endif // MULTIPASS_DEFAULT_VM_IMAGE_VAULT_H
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "vault_blob_store.h"
+
+#include <multipass/format.h>
+#include <multipass/logging/log.h>
+#include <multipass/utils.h>
+
+#include <QFile>
+#include <QFileInfo>
+
+#include <stdexcept>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+
+namespace
+{
+constexpr auto category = "image vault";
+} // namespace
+
+mp::VaultBlobStore::VaultBlobStore(const QDir& store_dir) : store_dir{store_dir}
+{
+}
+
+mp::Path mp::VaultBlobStore::add(const Path& file_path, const QString& hash)
+{
+    std::lock_guard<decltype(store_mutex)> lock{store_mutex};
+    const QDir blob_dir{store_dir.filePath(hash)};
+
+    const auto existing_blobs = blob_dir.entryInfoList(QDir::Files);
+    if (!existing_blobs.isEmpty())
+    {
+        const auto blob_path = existing_blobs.first().absoluteFilePath();
+        mpl::log(mpl::Level::debug, category,
+                 fmt::format("{} has the same contents as {}, keeping that one", file_path, blob_path));
+
+        QFile::remove(file_path);
+        return blob_path;
+    }
+
+    const auto blob_path = QDir{mp::utils::make_dir(store_dir, hash)}.filePath(QFileInfo{file_path}.fileName());
+    if (!QFile::rename(file_path, blob_path))
+        throw std::runtime_error(fmt::format("Cannot move {} into the image store", file_path));
+
+    return blob_path;
+}
+
+QString mp::VaultBlobStore::hash_of(const Path& path) const
+{
+    if (path.isEmpty())
+        return {};
+
+    const auto blob_dir = QFileInfo{path}.absoluteDir();
+    if (QFileInfo{blob_dir.absolutePath()}.absolutePath() != store_dir.absolutePath())
+        return {};
+
+    return blob_dir.dirName();
+}
+
+void mp::VaultBlobStore::remove_unreferenced(const std::map<QString, int>& reference_counts)
+{
+    std::lock_guard<decltype(store_mutex)> lock{store_mutex};
+    for (const auto& blob_dir : store_dir.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        const auto references = reference_counts.find(blob_dir.fileName());
+        if (references != reference_counts.end() && references->second > 0)
+            continue;
+
+        mpl::log(mpl::Level::info, category,
+                 fmt::format("Image {} is no longer used. Removing it from the cache.", blob_dir.fileName()));
+        QDir{blob_dir.absoluteFilePath()}.removeRecursively();
+    }
+}
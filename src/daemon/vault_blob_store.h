@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_VAULT_BLOB_STORE_H
+#define MULTIPASS_VAULT_BLOB_STORE_H
+
+#include <multipass/path.h>
+
+#include <QDir>
+#include <QString>
+
+#include <map>
+#include <mutex>
+
+namespace multipass
+{
+// Keeps image files by the SHA-256 of their contents, each in a directory named after it. Files with the same contents
+// are stored once, however many vault records refer to them.
+class VaultBlobStore
+{
+public:
+    VaultBlobStore(const QDir& store_dir);
+
+    // Moves the file into the store and returns its new path. When the store holds the same contents already, the file
+    // is deleted and the path of those is returned instead.
+    Path add(const Path& file_path, const QString& hash);
+    // The hash of the blob at the given path, or an empty string if the path is not in the store
+    QString hash_of(const Path& path) const;
+    // Deletes the blobs that have no references left
+    void remove_unreferenced(const std::map<QString, int>& reference_counts);
+
+private:
+    const QDir store_dir;
+    std::mutex store_mutex;
+};
+} // namespace multipass
+#endif // MULTIPASS_VAULT_BLOB_STORE_H
@@ -22,16 +22,27 @@
 #include <multipass/format.h>
 #include <multipass/logging/log.h>
 
+#include <QCryptographicHash>
 #include <QDir>
 #include <QEventLoop>
 #include <QFile>
 #include <QNetworkAccessManager>
 #include <QNetworkDiskCache>
 #include <QNetworkReply>
+#include <QThread>
 #include <QTimer>
 #include <QUrl>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 namespace mp = multipass;
 namespace mpl = multipass::logging;
@@ -39,6 +50,18 @@ namespace mpl = multipass::logging;
 namespace
 {
 constexpr auto category = "url downloader";
+constexpr auto part_suffix = ".part";
+// Tells what the data in the .part file was downloaded as, so that resuming can make sure it is still the same
+constexpr auto validator_suffix = ".part.validator";
+// Smaller downloads are not worth splitting into ranges
+constexpr int64_t min_ranged_download_size = 64 * 1024 * 1024;
+constexpr auto ranged_progress_interval = std::chrono::milliseconds(100);
+constexpr auto abort_check_interval = std::chrono::milliseconds(100);
+constexpr qint64 hash_chunk_size = 1024 * 1024;
+// Rate limited replies hold no more than a tenth of a second's worth of data, within these bounds, before they stop
+// reading from the connection
+constexpr qint64 min_throttled_buffer_size = 4 * 1024;
+constexpr qint64 max_throttled_buffer_size = 64 * 1024;
 
 auto make_network_manager(const mp::Path& cache_dir_path)
 {
@@ -56,17 +79,145 @@ auto make_network_manager(const mp::Path& cache_dir_path)
     return manager;
 }
 
-auto get_network_cache_data(QAbstractNetworkCache* network_cache, const QUrl& url)
+// Runs the action on the thread the object lives on, waiting for it to be done
+template <typename Action>
+auto run_on_thread_of(QObject* object, Action&& action) -> decltype(action())
 {
-    auto contents = network_cache->data(url);
-    auto data = contents->readAll();
-    contents->deleteLater();
-    return data;
+    if (object->thread() == QThread::currentThread())
+        return action();
+
+    std::packaged_task<decltype(action())()> task{std::forward<Action>(action)};
+    auto result = task.get_future();
+    QTimer::singleShot(0, object, [&task] { task(); });
+
+    return result.get();
+}
+
+// A reply lives on the thread of the manager that sent it, and is only ever touched there. What it signals is handled
+// on the thread that asked for it, while that runs an event loop to wait.
+class Reply
+{
+public:
+    Reply(QNetworkAccessManager* manager, const std::function<QNetworkReply*(QNetworkAccessManager*)>& send)
+    {
+        // Connected before the reply gets a chance to signal anything
+        reply = run_on_thread_of(manager, [this, manager, &send] {
+            auto sent = send(manager);
+            QObject::connect(sent, &QNetworkReply::downloadProgress, &context, [this](qint64 received, qint64 total) {
+                if (on_progress)
+                    on_progress(received, total);
+            });
+            QObject::connect(sent, &QNetworkReply::readyRead, &context, [this] {
+                if (on_ready_read)
+                    on_ready_read();
+            });
+            QObject::connect(sent, &QNetworkReply::finished, &context, [this] {
+                if (on_finished)
+                    on_finished();
+            });
+            return sent;
+        });
+    }
+
+    ~Reply()
+    {
+        run_on_thread_of(reply, [this] { delete reply; });
+    }
+
+    template <typename Action>
+    auto with(Action&& action) -> decltype(action(std::declval<QNetworkReply*>()))
+    {
+        return run_on_thread_of(reply, [this, &action] { return action(reply); });
+    }
+
+    void abort()
+    {
+        with([](QNetworkReply* reply) { reply->abort(); });
+    }
+
+    std::function<void(qint64, qint64)> on_progress;
+    std::function<void()> on_ready_read;
+    std::function<void()> on_finished;
+
+private:
+    Reply(const Reply&) = delete;
+    Reply& operator=(const Reply&) = delete;
+
+    QObject context;
+    QNetworkReply* reply;
+};
+
+auto get_network_cache_metadata(QNetworkAccessManager* manager, const QUrl& url)
+{
+    return run_on_thread_of(manager, [manager, &url] { return manager->cache()->metaData(url); });
+}
+
+auto get_network_cache_data(QNetworkAccessManager* manager, const QUrl& url)
+{
+    return run_on_thread_of(manager, [manager, &url] {
+        auto contents = manager->cache()->data(url);
+        auto data = contents->readAll();
+        contents->deleteLater();
+        return data;
+    });
+}
+
+QByteArray range_for(qint64 offset, qint64 end)
+{
+    if (offset == 0 && end < 0)
+        return {};
+
+    return QByteArray("bytes=") + QByteArray::number(offset) + "-" + (end < 0 ? QByteArray() : QByteArray::number(end));
+}
+
+void finish_part_file(QFile& part_file, const QString& file_name)
+{
+    part_file.close();
+    QFile::remove(file_name);
+    QFile::remove(file_name + validator_suffix);
+
+    if (!part_file.rename(file_name))
+        throw std::runtime_error(fmt::format("error writing image: {}", part_file.errorString()));
+}
+
+// A strong ETag, or else the modification date, tells whether a later request for a range gets the same data
+QByteArray validator_of(QNetworkReply* reply)
+{
+    const auto etag = reply->rawHeader("ETag");
+    if (!etag.isEmpty() && !etag.startsWith("W/"))
+        return etag;
+
+    return reply->rawHeader("Last-Modified");
+}
+
+QByteArray load_validator(const QString& file_name)
+{
+    QFile validator_file{file_name + validator_suffix};
+    if (!validator_file.open(QIODevice::ReadOnly))
+        return {};
+
+    return validator_file.readAll();
+}
+
+void save_validator(const QString& file_name, const QByteArray& validator)
+{
+    QFile validator_file{file_name + validator_suffix};
+    if (validator.isEmpty())
+    {
+        validator_file.remove();
+        return;
+    }
+
+    if (!validator_file.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+        validator_file.write(validator) != validator.size())
+        throw std::runtime_error(fmt::format("error writing image: {}", validator_file.errorString()));
 }
 
 template <typename ProgressAction, typename DownloadAction, typename ErrorAction, typename Time>
 QByteArray download(QNetworkAccessManager* manager, const Time& timeout, QUrl const& url, ProgressAction&& on_progress,
-                    DownloadAction&& on_download, ErrorAction&& on_error, const std::atomic_bool& abort_download)
+                    DownloadAction&& on_download, ErrorAction&& on_error, const std::atomic_bool& abort_download,
+                    const QByteArray& range = QByteArray(), const QByteArray& if_range = QByteArray(),
+                    qint64 read_buffer_size = 0)
 {
     QEventLoop event_loop;
     QTimer download_timeout;
@@ -77,36 +228,83 @@ QByteArray download(QNetworkAccessManager* manager, const Time& timeout, QUrl co
     request.setAttribute(QNetworkRequest::HttpPipeliningAllowedAttribute, true);
     request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
     request.setAttribute(QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::AlwaysNetwork);
-
-    auto reply = manager->get(request);
-
-    QObject::connect(reply, &QNetworkReply::finished, &event_loop, &QEventLoop::quit);
-    QObject::connect(reply, &QNetworkReply::downloadProgress, [&](qint64 bytes_received, qint64 bytes_total) {
+    if (!range.isEmpty())
+        request.setRawHeader("Range", range);
+    // The server sends everything instead of the range when the data changed since
+    if (!range.isEmpty() && !if_range.isEmpty())
+        request.setRawHeader("If-Range", if_range);
+
+    Reply reply{manager, [&request, read_buffer_size](QNetworkAccessManager* manager) {
+                    auto reply = manager->get(request);
+                    // Once its buffer is full, the reply stops reading from the connection until it is read from
+                    reply->setReadBufferSize(read_buffer_size);
+                    return reply;
+                }};
+
+    reply.on_finished = [&event_loop] { event_loop.quit(); };
+    reply.on_progress = [&](qint64 bytes_received, qint64 bytes_total) {
         on_progress(reply, bytes_received, bytes_total);
-    });
-    QObject::connect(reply, &QNetworkReply::readyRead, [&]() { on_download(reply, download_timeout); });
+    };
+    reply.on_ready_read = [&]() { on_download(reply, download_timeout); };
     QObject::connect(&download_timeout, &QTimer::timeout, [&]() {
         download_timeout.stop();
-        reply->abort();
+        reply.abort();
     });
 
     download_timeout.start();
     event_loop.exec();
-    if (reply->error() != QNetworkReply::NoError)
+
+    const auto error = reply.with([](QNetworkReply* reply) { return reply->error(); });
+    if (error != QNetworkReply::NoError)
     {
         on_error();
 
-        const auto msg = reply->errorString().toStdString();
+        const auto msg = reply.with([](QNetworkReply* reply) { return reply->errorString(); }).toStdString();
 
-        if (reply->error() == QNetworkReply::ProxyAuthenticationRequiredError)
-            reply->abort();
+        if (error == QNetworkReply::ProxyAuthenticationRequiredError)
+            reply.abort();
 
         if (abort_download)
             throw mp::AbortedDownloadException{msg};
         else
             throw mp::DownloadException{url.toString().toStdString(), download_timeout.isActive() ? msg : "Network timeout"};
     }
-    return reply->readAll();
+    return reply.with([](QNetworkReply* reply) { return reply->readAll(); });
+}
+
+// Waits no longer than downloads do for the headers, and gives up as soon as downloads are aborted
+template <typename Time>
+std::unique_ptr<Reply> head(QNetworkAccessManager* manager, const Time& timeout, const QUrl& url,
+                            const std::atomic_bool& abort_download)
+{
+    QEventLoop event_loop;
+    QTimer head_timeout;
+    QTimer abort_check;
+    head_timeout.setSingleShot(true);
+
+    QNetworkRequest request{url};
+    request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+
+    auto reply =
+        std::make_unique<Reply>(manager, [&request](QNetworkAccessManager* manager) { return manager->head(request); });
+    if (abort_download)
+    {
+        reply->abort();
+        return reply;
+    }
+
+    reply->on_finished = [&event_loop] { event_loop.quit(); };
+    QObject::connect(&head_timeout, &QTimer::timeout, [&reply] { reply->abort(); });
+    QObject::connect(&abort_check, &QTimer::timeout, [&reply, &abort_download] {
+        if (abort_download)
+            reply->abort();
+    });
+
+    head_timeout.start(timeout);
+    abort_check.start(abort_check_interval);
+    event_loop.exec();
+
+    return reply;
 }
 } // namespace
 
@@ -114,65 +312,457 @@ mp::URLDownloader::URLDownloader(std::chrono::milliseconds timeout) : URLDownloa
 {
 }
 
-mp::URLDownloader::URLDownloader(const mp::Path& cache_dir, std::chrono::milliseconds timeout)
-    : cache_dir_path{QDir(cache_dir).filePath("network-cache")}, timeout{timeout}
+mp::URLDownloader::URLDownloader(const mp::Path& cache_dir, std::chrono::milliseconds timeout,
+                                 int download_connections)
+    : cache_dir_path{QDir(cache_dir).filePath("network-cache")},
+      timeout{timeout},
+      download_connections{download_connections}
 {
+    network_context.moveToThread(&network_thread);
 }
 
-void mp::URLDownloader::download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
-                                    const mp::ProgressMonitor& monitor)
+mp::URLDownloader::~URLDownloader()
 {
-    auto manager{make_network_manager(cache_dir_path)};
+    if (!network_thread.isRunning())
+        return;
 
-    QFile file{file_name};
-    file.open(QIODevice::ReadWrite | QIODevice::Truncate);
+    // The manager is deleted on its own thread, along with whatever replies it still has
+    run_on_thread_of(&network_context, [this] { delete manager; });
+    network_thread.quit();
+    network_thread.wait();
+}
 
-    auto progress_monitor = [&monitor, download_type, size](QNetworkReply* reply, qint64 bytes_received,
-                                                            qint64 bytes_total) {
-        if (bytes_received == 0)
-            return;
+QString mp::URLDownloader::download_to(const QUrl& url, const QString& file_name, int64_t size,
+                                       const int download_type, const mp::ProgressMonitor& monitor)
+{
+    QFile part_file{file_name + part_suffix};
+
+    // Rate limited downloads gain nothing from more connections
+    if (download_connections > 1 && size >= min_ranged_download_size && !part_file.exists() &&
+        rate_limit_for(url) <= 0 && accepts_ranges(url))
+        return download_ranges_to(url, file_name, size, download_type, monitor);
 
-        if (bytes_total == -1 && size > 0)
-            bytes_total = size;
+    if (!part_file.open(QIODevice::ReadWrite))
+        throw std::runtime_error(fmt::format("error writing image: {}", part_file.errorString()));
+
+    // What is there already cannot all be wanted, as the server would refuse to resume past the end
+    if (size > 0 && part_file.size() >= size)
+        part_file.resize(0);
+
+    // Without knowing what the data was downloaded as, there is no telling whether the rest would match it
+    auto validator = load_validator(file_name);
+    if (part_file.size() > 0 && validator.isEmpty())
+    {
+        mpl::log(mpl::Level::info, category,
+                 fmt::format("Cannot tell whether the partial download of {} is current, starting over",
+                             url.toString()));
+        part_file.resize(0);
+    }
+
+    const auto resume_offset = part_file.size();
+
+    QCryptographicHash hash{QCryptographicHash::Sha256};
+    if (resume_offset > 0)
+    {
+        mpl::log(mpl::Level::info, category,
+                 fmt::format("Resuming download of {} from byte {}", url.toString(), resume_offset));
 
-        auto progress = (size < 0) ? size : (100 * bytes_received + bytes_total / 2) / bytes_total;
-        if (!monitor(download_type, progress))
+        if (!hash.addData(&part_file))
+            throw std::runtime_error(fmt::format("error reading image: {}", part_file.errorString()));
+    }
+
+    // The validator is kept along with the data, for the next attempt to resume from it if this one fails
+    auto saved_validator = validator;
+    auto write_data = [&part_file, &file_name, &validator, &saved_validator](const QByteArray& data) {
+        if (validator != saved_validator)
         {
-            reply->abort();
+            save_validator(file_name, validator);
+            saved_validator = validator;
+        }
+
+        if (part_file.write(data) < 0)
+        {
+            mpl::log(mpl::Level::error, category, fmt::format("error writing image: {}", part_file.errorString()));
+            throw std::runtime_error(fmt::format("error writing image: {}", part_file.errorString()));
         }
     };
 
-    auto on_download = [this, &file](QNetworkReply* reply, QTimer& download_timeout) {
-        if (abort_download)
+    auto restart = [&part_file] {
+        if (!part_file.resize(0) || !part_file.seek(0))
+            throw std::runtime_error(fmt::format("error writing image: {}", part_file.errorString()));
+    };
+
+    try
+    {
+        const auto image_hash = download_to_consumer(url, write_data, restart, &hash, &validator, resume_offset, -1,
+                                                     size, download_type, monitor);
+        finish_part_file(part_file, file_name);
+
+        return image_hash;
+    }
+    catch (const AbortedDownloadException&)
+    {
+        throw;
+    }
+    catch (const DownloadException&)
+    {
+        // Nothing came of resuming from what there was, which may well be why; the next attempt starts over
+        if (part_file.size() == resume_offset)
         {
-            reply->abort();
-            return;
+            part_file.remove();
+            save_validator(file_name, {});
         }
+        throw;
+    }
+    catch (...)
+    {
+        part_file.remove();
+        save_validator(file_name, {});
+        throw;
+    }
+}
 
-        if (download_timeout.isActive())
-            download_timeout.stop();
-        else
-            return;
+QString mp::URLDownloader::stream_to(const QUrl& url, const DataConsumer& consumer, int64_t size,
+                                     const int download_type, const ProgressMonitor& monitor)
+{
+    QCryptographicHash hash{QCryptographicHash::Sha256};
+    QByteArray validator;
+
+    return download_to_consumer(url, consumer, nullptr, &hash, &validator, 0, -1, size, download_type, monitor);
+}
 
-        if (file.write(reply->readAll()) < 0)
+QString mp::URLDownloader::download_to_consumer(const QUrl& url, const DataConsumer& consumer,
+                                                const std::function<void()>& restart, QCryptographicHash* hash,
+                                                QByteArray* validator, qint64 offset, qint64 end, int64_t size,
+                                                const int download_type, const ProgressMonitor& monitor)
+{
+    auto manager = network_manager();
+
+    std::exception_ptr consumer_error;
+    auto cancelled = false;
+
+    // Data that would come in ahead of the rate limit is left in the reply until it is due, and the reply stops
+    // reading from the connection meanwhile, so the server is held back too
+    auto max_bytes_per_second = rate_limit_for(url);
+    auto read_buffer_size = [&max_bytes_per_second] {
+        return max_bytes_per_second > 0
+                   ? std::min(std::max(max_bytes_per_second / 10, min_throttled_buffer_size), max_throttled_buffer_size)
+                   : qint64{0};
+    };
+    auto rate_start = std::chrono::steady_clock::now();
+    qint64 bytes_consumed{0};
+    auto time_until_due = [&]() {
+        const auto due = rate_start + std::chrono::milliseconds(1000 * bytes_consumed / max_bytes_per_second);
+        return std::chrono::duration_cast<std::chrono::milliseconds>(due - std::chrono::steady_clock::now());
+    };
+
+    auto consume = [&](const QByteArray& data) {
+        // Hashing the data as it arrives spares reading it all back to verify it
+        if (hash)
+            hash->addData(data);
+
+        consumer(data);
+        offset += data.size();
+        bytes_consumed += data.size();
+    };
+
+    // Each attempt asks for what is still missing, for as long as the previous one got anywhere
+    while (true)
+    {
+        const auto attempt_offset = offset;
+        auto progress_offset = offset;
+        auto range_checked = range_for(offset, end).isEmpty();
+        auto validator_read = validator == nullptr;
+        // Owns the timers that resume held back reads, so that none fires once the attempt is over
+        QObject throttle_context;
+
+        auto progress_monitor = [&monitor, &progress_offset, &cancelled, download_type, size](
+                                    Reply& reply, qint64 bytes_received, qint64 bytes_total) {
+            if (bytes_received == 0)
+                return;
+
+            bytes_received += progress_offset;
+            bytes_total = (bytes_total == -1 && size > 0) ? size : bytes_total + progress_offset;
+
+            auto progress = (size < 0) ? size : (100 * bytes_received + bytes_total / 2) / bytes_total;
+            if (!monitor(download_type, progress))
+            {
+                cancelled = true;
+                reply.abort();
+            }
+        };
+
+        std::function<void(Reply&, QTimer&)> on_download = [&](Reply& reply, QTimer& download_timeout) {
+            if (abort_download)
+            {
+                reply.abort();
+                return;
+            }
+
+            // The timeout is stopped while reads are held back as well, as waiting on the rate limit is no stall
+            if (download_timeout.isActive())
+                download_timeout.stop();
+            else
+                return;
+
+            // Exceptions cannot go through the event loop, so they are rethrown once it is left
+            try
+            {
+                if (!range_checked)
+                {
+                    range_checked = true;
+                    const auto status = reply.with([](QNetworkReply* reply) {
+                        return reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+                    });
+                    if (status != 206)
+                    {
+                        if (!restart)
+                            throw DownloadException{url.toString().toStdString(),
+                                                    "the server does not support resuming downloads"};
+
+                        mpl::log(mpl::Level::info, category,
+                                 fmt::format("Server ignored the range asked for {}, starting over", url.toString()));
+                        restart();
+                        if (hash)
+                            hash->reset();
+                        offset = progress_offset = 0;
+                    }
+                }
+
+                if (!validator_read)
+                {
+                    validator_read = true;
+                    *validator = reply.with(validator_of);
+                }
+
+                // The limit is looked up again as the data comes in, as it can be lifted, by a launch that wants the
+                // image a prefetch is downloading, or changed while the download goes on
+                const auto current_limit = rate_limit_for(url);
+                if (current_limit != max_bytes_per_second)
+                {
+                    max_bytes_per_second = current_limit;
+                    rate_start = std::chrono::steady_clock::now();
+                    bytes_consumed = 0;
+                    reply.with([size = read_buffer_size()](QNetworkReply* reply) { reply->setReadBufferSize(size); });
+                }
+
+                if (max_bytes_per_second > 0)
+                {
+                    const auto wait = time_until_due();
+                    if (wait.count() > 0)
+                    {
+                        QTimer::singleShot(static_cast<int>(wait.count()), &throttle_context,
+                                           [&on_download, reply = &reply, download_timeout = &download_timeout] {
+                                               download_timeout->start();
+                                               on_download(*reply, *download_timeout);
+                                           });
+                        return;
+                    }
+                }
+
+                consume(reply.with([](QNetworkReply* reply) { return reply->readAll(); }));
+            }
+            catch (...)
+            {
+                consumer_error = std::current_exception();
+                reply.abort();
+                return;
+            }
+            download_timeout.start();
+        };
+
+        try
         {
-            mpl::log(mpl::Level::error, category, fmt::format("error writing image: {}", file.errorString()));
-            reply->abort();
+            // What the reply still held back when it finished is all that is left to receive
+            const auto unread =
+                ::download(manager, timeout, url, progress_monitor, on_download, [] {}, abort_download,
+                           range_for(attempt_offset, end), validator ? *validator : QByteArray(), read_buffer_size());
+
+            try
+            {
+                if (!unread.isEmpty())
+                    consume(unread);
+            }
+            catch (...)
+            {
+                consumer_error = std::current_exception();
+                throw;
+            }
+
+            return hash ? QString(hash->result().toHex()) : QString();
         }
-        download_timeout.start();
+        catch (const std::exception& e)
+        {
+            if (consumer_error)
+                std::rethrow_exception(consumer_error);
+
+            if (abort_download || cancelled || offset == attempt_offset)
+                throw;
+
+            mpl::log(mpl::Level::warning, category,
+                     fmt::format("Download of {} interrupted at byte {}, resuming: {}", url.toString(), offset,
+                                 e.what()));
+        }
+    }
+}
+
+// The ranges are received on threads of their own, each with its own connection, and written straight to where they
+// belong in the file. Everything up to the first range still coming in is there to stay, so that much gets hashed in
+// order while the rest arrives.
+QString mp::URLDownloader::download_ranges_to(const QUrl& url, const QString& file_name, int64_t size,
+                                              const int download_type, const ProgressMonitor& monitor)
+{
+    QFile part_file{file_name + part_suffix};
+    if (!part_file.open(QIODevice::ReadWrite | QIODevice::Truncate) || !part_file.resize(size))
+        throw std::runtime_error(fmt::format("error writing image: {}", part_file.errorString()));
+
+    // Unbuffered, so as not to read ahead into what the ranges have yet to write
+    QFile hash_file{part_file.fileName()};
+    if (!hash_file.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+        throw std::runtime_error(fmt::format("error reading image: {}", hash_file.errorString()));
+
+    std::vector<qint64> range_starts, range_ends;
+    const auto range_size = size / download_connections;
+    for (auto i = 0; i < download_connections; ++i)
+    {
+        range_starts.push_back(i * range_size);
+        range_ends.push_back(i == download_connections - 1 ? size - 1 : (i + 1) * range_size - 1);
+    }
+
+    std::vector<std::atomic<qint64>> range_bytes_received(download_connections);
+    std::atomic<qint64> bytes_received{0};
+    std::atomic_int ranges_left{download_connections};
+    std::atomic_bool failed{false};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    auto set_error = [&error_mutex, &error, &failed](std::exception_ptr e) {
+        std::lock_guard<std::mutex> lock{error_mutex};
+        if (!error)
+            error = e;
+        failed = true;
     };
 
-    auto on_error = [&file]() { file.remove(); };
+    auto download_range = [&](int range) {
+        try
+        {
+            // Opened ReadWrite, as WriteOnly would truncate what the other ranges are writing, and unbuffered, so
+            // that what is counted as received is in the file for hashing
+            QFile range_file{part_file.fileName()};
+            if (!range_file.open(QIODevice::ReadWrite | QIODevice::Unbuffered) || !range_file.seek(range_starts[range]))
+                throw std::runtime_error(fmt::format("error writing image: {}", range_file.errorString()));
+
+            auto write_data = [&, range](const QByteArray& data) {
+                // Another range failed, there is no point in going on
+                if (failed)
+                    throw std::runtime_error("download failed");
+
+                if (range_file.write(data) != data.size())
+                    throw std::runtime_error(fmt::format("error writing image: {}", range_file.errorString()));
+
+                range_bytes_received[range] += data.size();
+                bytes_received += data.size();
+            };
+
+            download_to_consumer(url, write_data, nullptr, nullptr, nullptr, range_starts[range], range_ends[range],
+                                 -1, download_type, [](int, int) { return true; });
+        }
+        catch (...)
+        {
+            set_error(std::current_exception());
+        }
+
+        --ranges_left;
+    };
 
-    ::download(manager.get(), timeout, url, progress_monitor, on_download, on_error, abort_download);
+    mpl::log(mpl::Level::debug, category,
+             fmt::format("Downloading {} in {} ranges", url.toString(), download_connections));
+
+    QCryptographicHash hash{QCryptographicHash::Sha256};
+    qint64 bytes_hashed{0};
+    auto hash_received = [&] {
+        qint64 hashable{0};
+        for (auto i = 0; i < download_connections; ++i)
+        {
+            hashable = range_starts[i] + range_bytes_received[i];
+            if (hashable <= range_ends[i])
+                break;
+        }
+
+        if (bytes_hashed < hashable && !hash_file.seek(bytes_hashed))
+            throw std::runtime_error(fmt::format("error reading image: {}", hash_file.errorString()));
+
+        while (bytes_hashed < hashable)
+        {
+            const auto data = hash_file.read(std::min(hashable - bytes_hashed, hash_chunk_size));
+            if (data.isEmpty())
+                throw std::runtime_error(fmt::format("error reading image: {}", hash_file.errorString()));
+
+            hash.addData(data);
+            bytes_hashed += data.size();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (auto i = 0; i < download_connections; ++i)
+        threads.emplace_back(download_range, i);
+
+    // Progress is reported from this thread alone, which keeps serving its own events in the meantime
+    QEventLoop event_loop;
+    QTimer progress_timer;
+    QObject::connect(&progress_timer, &QTimer::timeout, [&] {
+        const auto progress = static_cast<int>((100 * bytes_received + size / 2) / size);
+        if (!failed && !monitor(download_type, progress))
+            set_error(std::make_exception_ptr(
+                DownloadException{url.toString().toStdString(), "Operation canceled"}));
+
+        try
+        {
+            if (!failed)
+                hash_received();
+        }
+        catch (...)
+        {
+            set_error(std::current_exception());
+        }
+
+        if (ranges_left == 0)
+            event_loop.quit();
+    });
+    progress_timer.start(ranged_progress_interval);
+    event_loop.exec();
+
+    for (auto& thread : threads)
+        thread.join();
+
+    try
+    {
+        if (!error)
+            hash_received();
+    }
+    catch (...)
+    {
+        set_error(std::current_exception());
+    }
+
+    if (error)
+    {
+        hash_file.close();
+        part_file.remove();
+        std::rethrow_exception(error);
+    }
+
+    hash_file.close();
+    finish_part_file(part_file, file_name);
+
+    return hash.result().toHex();
 }
 
 QByteArray mp::URLDownloader::download(const QUrl& url)
 {
-    auto manager{make_network_manager(cache_dir_path)};
+    auto manager = network_manager();
 
-    auto network_cache = manager->cache();
-    auto metadata = network_cache->metaData(url);
+    auto metadata = get_network_cache_metadata(manager, url);
 
     if (metadata.isValid())
     {
@@ -180,7 +770,7 @@ QByteArray mp::URLDownloader::download(const QUrl& url)
         {
             if (last_modified(url) == metadata.lastModified())
             {
-                return get_network_cache_data(network_cache, url);
+                return get_network_cache_data(manager, url);
             }
         }
         catch (const std::exception& e)
@@ -188,16 +778,16 @@ QByteArray mp::URLDownloader::download(const QUrl& url)
             mpl::log(
                 mpl::Level::info, category,
                 fmt::format("Cannot get last modified date for {}: {}. Using cached data.", url.toString(), e.what()));
-            return get_network_cache_data(network_cache, url);
+            return get_network_cache_data(manager, url);
         }
     }
 
     // This will connect to the QNetworkReply::readReady signal and when emitted,
     // reset the timer.
-    auto on_download = [this](QNetworkReply* reply, QTimer& download_timeout) {
+    auto on_download = [this](Reply& reply, QTimer& download_timeout) {
         if (abort_download)
         {
-            reply->abort();
+            reply.abort();
             return;
         }
 
@@ -206,7 +796,7 @@ QByteArray mp::URLDownloader::download(const QUrl& url)
 
     try
     {
-        return ::download(manager.get(), timeout, url, [](QNetworkReply*, qint64, qint64) {}, on_download, [] {},
+        return ::download(manager, timeout, url, [](Reply&, qint64, qint64) {}, on_download, [] {},
                           abort_download);
     }
     catch (const std::exception& e)
@@ -216,7 +806,7 @@ QByteArray mp::URLDownloader::download(const QUrl& url)
             // Force using the cached data if there is an error retrieving the data from the network
             mpl::log(mpl::Level::warning, category,
                      fmt::format("Cannot download {}: {}. Using cached data instead.", url.toString(), e.what()));
-            return get_network_cache_data(network_cache, url);
+            return get_network_cache_data(manager, url);
         }
         else
         {
@@ -227,38 +817,76 @@ QByteArray mp::URLDownloader::download(const QUrl& url)
 
 QDateTime mp::URLDownloader::last_modified(const QUrl& url)
 {
-    auto manager{make_network_manager(cache_dir_path)};
-
-    QEventLoop event_loop;
-
-    QNetworkRequest request{url};
-    request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
-
-    auto reply = manager->head(request);
-    QObject::connect(reply, &QNetworkReply::finished, &event_loop, &QEventLoop::quit);
+    auto manager = network_manager();
+    const auto reply = head(manager, timeout, url, abort_download);
+    const auto error_string = reply->with([](QNetworkReply* reply) { return reply->errorString(); });
 
-    event_loop.exec();
+    if (abort_download)
+        throw mp::AbortedDownloadException{error_string.toStdString()};
 
-    if (reply->error() != QNetworkReply::NoError)
+    if (reply->with([](QNetworkReply* reply) { return reply->error(); }) != QNetworkReply::NoError)
     {
-        auto network_cache = manager->cache();
-        auto metadata = network_cache->metaData(url);
+        auto metadata = get_network_cache_metadata(manager, url);
 
         if (metadata.isValid())
         {
             mpl::log(mpl::Level::warning, category,
                      fmt::format("Cannot retrieve last modified date for {}: {}. Using cached data instead.",
-                                 url.toString(), reply->errorString()));
+                                 url.toString(), error_string));
             return metadata.lastModified();
         }
 
-        throw mp::DownloadException{url.toString().toStdString(), reply->errorString().toStdString()};
+        throw mp::DownloadException{url.toString().toStdString(), error_string.toStdString()};
     }
 
-    return reply->header(QNetworkRequest::LastModifiedHeader).toDateTime();
+    return reply->with(
+        [](QNetworkReply* reply) { return reply->header(QNetworkRequest::LastModifiedHeader).toDateTime(); });
+}
+
+bool mp::URLDownloader::accepts_ranges(const QUrl& url)
+{
+    if (url.isLocalFile())
+        return false;
+
+    const auto reply = head(network_manager(), timeout, url, abort_download);
+
+    return reply->with([](QNetworkReply* reply) {
+        return reply->error() == QNetworkReply::NoError && reply->rawHeader("Accept-Ranges") == "bytes";
+    });
+}
+
+// A manager can only be used from the thread that created it, so the one manager lives on a thread of its own, which
+// is started on first use. Every request from any thread goes through it, so connections, TLS sessions and DNS lookups
+// carry over from one request to the next, and HEAD requests share a connection with the downloads they precede.
+QNetworkAccessManager* mp::URLDownloader::network_manager()
+{
+    std::call_once(network_thread_started, [this] {
+        network_thread.start();
+        manager = run_on_thread_of(&network_context,
+                                   [this] { return make_network_manager(cache_dir_path).release(); });
+    });
+
+    return manager;
 }
 
 void mp::URLDownloader::abort_all_downloads()
 {
     abort_download = true;
 }
+
+void mp::URLDownloader::limit_rate(const QUrl& url, qint64 max_bytes_per_second)
+{
+    std::lock_guard<std::mutex> lock{rate_limits_mutex};
+    if (max_bytes_per_second > 0)
+        rate_limits[url.toString()] = max_bytes_per_second;
+    else
+        rate_limits.erase(url.toString());
+}
+
+qint64 mp::URLDownloader::rate_limit_for(const QUrl& url)
+{
+    std::lock_guard<std::mutex> lock{rate_limits_mutex};
+    const auto it = rate_limits.find(url.toString());
+
+    return it != rate_limits.end() ? it->second : 0;
+}
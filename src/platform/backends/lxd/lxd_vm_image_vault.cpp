@@ -393,6 +393,34 @@ void mp::LXDVMImageVault::update_images(const FetchType& fetch_type, const Prepa
     }
 }
 
+void mp::LXDVMImageVault::prefetch_images(const FetchType& fetch_type, const std::vector<Query>& queries,
+                                          const PrepareAction& prepare, const ProgressMonitor& monitor,
+                                          const MemorySize& max_download_rate)
+{
+    // LXD downloads the images itself, so there is no way to throttle them from here
+    if (max_download_rate.in_bytes() > 0)
+        mpl::log(mpl::Level::debug, category, "Prefetch rate is not applied to LXD image downloads");
+
+    for (const auto& query : queries)
+    {
+        try
+        {
+            auto prefetch_query = query;
+            prefetch_query.name = "";
+            fetch_image(fetch_type, prefetch_query, prepare, monitor);
+        }
+        catch (const AbortedDownloadException&)
+        {
+            throw;
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::warning, category,
+                     fmt::format("Cannot prefetch source image {}: {}", query.release, e.what()));
+        }
+    }
+}
+
 mp::MemorySize mp::LXDVMImageVault::minimum_image_size_for(const std::string& id)
 {
     MemorySize lxd_image_size{"10G"};
@@ -487,12 +515,13 @@ void mp::LXDVMImageVault::url_download_image(const VMImageInfo& info, const QStr
 {
     mp::vault::DeleteOnException image_file{image_path};
 
-    url_downloader->download_to(info.image_location, image_path, info.size, LaunchProgress::IMAGE, monitor);
+    const auto image_hash =
+        url_downloader->download_to(info.image_location, image_path, info.size, LaunchProgress::IMAGE, monitor);
 
     if (info.verify)
     {
         monitor(LaunchProgress::VERIFY, -1);
-        mp::vault::verify_image_download(image_path, info.id);
+        mp::vault::verify_image_hash(image_hash, info.id);
     }
 }
 
@@ -44,6 +44,8 @@ public:
 
     VMImage fetch_image(const FetchType& fetch_type, const Query& query, const PrepareAction& prepare,
                         const ProgressMonitor& monitor) override;
+    void prefetch_images(const FetchType& fetch_type, const std::vector<Query>& queries, const PrepareAction& prepare,
+                         const ProgressMonitor& monitor, const MemorySize& max_download_rate) override;
     void remove(const std::string& name) override;
     bool has_record_for(const std::string& name) override;
     void prune_expired_images() override;
@@ -20,6 +20,7 @@
 #include "dnsmasq_server.h"
 #include "qemu_vm_process_spec.h"
 #include "qemu_vmstate_process_spec.h"
+#include "virtiofsd_process_spec.h"
 #include <shared/linux/backend_utils.h>
 #include <shared/linux/process_factory.h>
 #include <shared/shared_backend_utils.h>
@@ -33,6 +34,7 @@
 #include <multipass/format.h>
 
 #include <QCoreApplication>
+#include <QDir>
 #include <QFile>
 #include <QHash>
 #include <QJsonArray>
@@ -43,8 +45,11 @@
 #include <QStringList>
 #include <QSysInfo>
 #include <QTemporaryFile>
+#include <QThread>
 
+#include <chrono>
 #include <thread>
+#include <vector>
 
 namespace mp = multipass;
 namespace mpl = multipass::logging;
@@ -54,6 +59,8 @@ namespace
 constexpr auto suspend_tag = "suspend";
 constexpr auto machine_type_key = "machine_type";
 constexpr auto arguments_key = "arguments";
+constexpr auto native_mount_socket_timeout = std::chrono::seconds(5);
+constexpr auto native_mount_unplug_timeout = std::chrono::seconds(10);
 
 bool use_cdrom_set(const QJsonObject& metadata)
 {
@@ -85,7 +92,7 @@ QStringList get_arguments(const QJsonObject& metadata)
 }
 
 auto make_qemu_process(const mp::VirtualMachineDescription& desc, const mp::optional<QJsonObject>& resume_metadata,
-                       const std::string& tap_device_name)
+                       const std::string& tap_device_name, const QString& native_mount_socket_dir)
 {
     if (!QFile::exists(desc.image.image_path) || !QFile::exists(desc.cloud_init_iso))
     {
@@ -100,8 +107,8 @@ auto make_qemu_process(const mp::VirtualMachineDescription& desc, const mp::opti
                                                         get_arguments(data)};
     }
 
-    auto process_spec =
-        std::make_unique<mp::QemuVMProcessSpec>(desc, QString::fromStdString(tap_device_name), resume_data);
+    auto process_spec = std::make_unique<mp::QemuVMProcessSpec>(desc, QString::fromStdString(tap_device_name),
+                                                                resume_data, native_mount_socket_dir);
     auto process = MP_PROCFACTORY.create_process(std::move(process_spec));
 
     mpl::log(mpl::Level::debug, desc.vm_name, fmt::format("process working dir '{}'", process->working_directory()));
@@ -118,13 +125,20 @@ void remove_tap_device(const QString& tap_device_name)
     }
 }
 
-auto qmp_execute_json(const QString& cmd)
+auto qmp_execute_json(const QString& cmd, const QJsonObject& arguments = QJsonObject())
 {
     QJsonObject qmp;
     qmp.insert("execute", cmd);
+    if (!arguments.isEmpty())
+        qmp.insert("arguments", arguments);
     return QJsonDocument(qmp).toJson();
 }
 
+QString native_mount_chardev(const QString& tag)
+{
+    return "chr-" + tag;
+}
+
 auto hmc_to_qmp_json(const QString& command_line)
 {
     auto qmp = QJsonDocument::fromJson(qmp_execute_json("human-monitor-command")).object();
@@ -212,6 +226,12 @@ mp::QemuVirtualMachine::QemuVirtualMachine(const VirtualMachineDescription& desc
                          delete_memory_snapshot = false;
                      },
                      Qt::QueuedConnection);
+    QObject::connect(this, &QemuVirtualMachine::on_qmp_command, this,
+                     [this](const QByteArray& command) {
+                         if (vm_process)
+                             vm_process->write(command);
+                     },
+                     Qt::QueuedConnection);
 }
 
 mp::QemuVirtualMachine::~QemuVirtualMachine()
@@ -222,7 +242,15 @@ mp::QemuVirtualMachine::~QemuVirtualMachine()
 
         if (state == State::running)
         {
-            suspend();
+            try
+            {
+                suspend();
+            }
+            catch (const std::exception& e)
+            {
+                mpl::log(mpl::Level::warning, vm_name, fmt::format("{}, shutting down instead", e.what()));
+                shutdown();
+            }
         }
         else
         {
@@ -232,6 +260,7 @@ mp::QemuVirtualMachine::~QemuVirtualMachine()
         vm_process->wait_for_finished();
     }
 
+    stop_native_mount_servers();
     remove_tap_device(QString::fromStdString(tap_device_name));
 }
 
@@ -313,6 +342,10 @@ void mp::QemuVirtualMachine::suspend()
 {
     if ((state == State::running || state == State::delayed_shutdown) && vm_process->running())
     {
+        // vhost-user-fs devices cannot be saved with the machine, the daemon plugs them back in once it resumes
+        if (!unplug_native_mounts())
+            throw std::runtime_error("cannot suspend the instance, the guest did not release its native mounts");
+
         vm_process->write(hmc_to_qmp_json("savevm " + QString::fromStdString(suspend_tag)));
 
         if (update_shutdown_status)
@@ -377,6 +410,7 @@ void mp::QemuVirtualMachine::on_shutdown()
     management_ip = nullopt;
     update_state();
     vm_process.reset(nullptr);
+    stop_native_mount_servers();
     lock.unlock();
     monitor->on_shutdown();
 }
@@ -445,11 +479,167 @@ void mp::QemuVirtualMachine::wait_until_ssh_up(std::chrono::milliseconds timeout
     }
 }
 
+bool mp::QemuVirtualMachine::add_native_mount(const std::string& target_path, const VMMount& mount)
+{
+    native_mounts[target_path] = mount;
+
+    if (native_mount_servers.find(target_path) != native_mount_servers.end())
+        return true;
+
+    // Devices are hot-plugged, which needs guest memory that virtiofsd can map. That is decided when the machine boots,
+    // so until the next cold boot, a machine that had no native mounts back then gets none.
+    if (!vm_process || !vm_process->running() || !native_mount_sockets || state == State::suspending)
+        return false;
+
+    plug_native_mount(target_path);
+    return true;
+}
+
+void mp::QemuVirtualMachine::remove_native_mount(const std::string& target_path)
+{
+    if (native_mount_servers.find(target_path) != native_mount_servers.end() && !unplug_native_mount(target_path))
+        mpl::log(mpl::Level::warning, vm_name,
+                 fmt::format("The device of native mount \"{}\" stays until the instance stops", target_path));
+
+    native_mounts.erase(target_path);
+}
+
+void mp::QemuVirtualMachine::write_qmp(const QByteArray& command)
+{
+    // Mounts are plugged in from the threads that wait for SSH, but the process is driven from the one it belongs to
+    if (QThread::currentThread() == thread())
+        vm_process->write(command);
+    else
+        emit on_qmp_command(command);
+}
+
+void mp::QemuVirtualMachine::plug_native_mount(const std::string& target_path)
+{
+    const auto& mount = native_mounts.at(target_path);
+    const auto tag = QString::fromStdString(mp::utils::native_mount_tag(target_path));
+    const auto socket_path = native_mount_sockets->filePath(tag + ".sock");
+    QFile::remove(socket_path); // left behind by an earlier virtiofsd, it would look ready
+
+    auto process =
+        MP_PROCFACTORY.create_process(std::make_unique<VirtiofsdProcessSpec>(vm_name, tag, socket_path, mount));
+    process->start();
+    if (!process->wait_for_started())
+        throw std::runtime_error(fmt::format("failed to start virtiofsd for '{}'", mount.source_path));
+
+    auto on_timeout = [&mount] {
+        throw std::runtime_error(fmt::format("timed out waiting for virtiofsd to serve '{}'", mount.source_path));
+    };
+    auto socket_ready = [&socket_path, &process] {
+        if (QFile::exists(socket_path))
+            return mp::utils::TimeoutAction::done;
+        if (!process->running())
+            throw std::runtime_error(
+                fmt::format("virtiofsd exited unexpectedly: {}", process->read_all_standard_error()));
+        return mp::utils::TimeoutAction::retry;
+    };
+    mp::utils::try_action_for(on_timeout, native_mount_socket_timeout, socket_ready);
+
+    const QJsonObject address{{"type", "unix"}, {"data", QJsonObject{{"path", socket_path}}}};
+    const QJsonObject backend{{"type", "socket"}, {"data", QJsonObject{{"addr", address}, {"server", false}}}};
+    write_qmp(qmp_execute_json("chardev-add", {{"id", native_mount_chardev(tag)}, {"backend", backend}}));
+    write_qmp(qmp_execute_json(
+        "device_add",
+        {{"driver", "vhost-user-fs-pci"}, {"id", tag}, {"chardev", native_mount_chardev(tag)}, {"tag", tag}}));
+
+    native_mount_servers[target_path] = std::move(process);
+}
+
+bool mp::QemuVirtualMachine::unplug_native_mount(const std::string& target_path)
+{
+    const auto tag = QString::fromStdString(mp::utils::native_mount_tag(target_path));
+
+    if (vm_process && vm_process->running())
+    {
+        deleted_devices.remove(tag);
+        vm_process->write(qmp_execute_json("device_del", {{"id", tag}}));
+
+        // The device is only gone once the guest lets go of it, which QEMU reports with an event
+        const auto deadline = std::chrono::steady_clock::now() + native_mount_unplug_timeout;
+        while (!deleted_devices.contains(tag))
+        {
+            const auto remaining =
+                std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            if (remaining.count() <= 0 || !vm_process->running())
+            {
+                mpl::log(mpl::Level::warning, vm_name,
+                         fmt::format("timed out unplugging the device of native mount \"{}\"", target_path));
+                return false;
+            }
+
+            vm_process->wait_for_ready_read(remaining.count());
+        }
+
+        deleted_devices.remove(tag);
+        vm_process->write(qmp_execute_json("chardev-remove", {{"id", native_mount_chardev(tag)}}));
+    }
+
+    auto server = native_mount_servers.find(target_path);
+    if (server->second->running())
+    {
+        server->second->terminate();
+        server->second->wait_for_finished();
+    }
+    native_mount_servers.erase(server);
+
+    return true;
+}
+
+bool mp::QemuVirtualMachine::unplug_native_mounts()
+{
+    std::vector<std::string> plugged;
+    for (const auto& server : native_mount_servers)
+        plugged.push_back(server.first);
+
+    auto unplugged_all = true;
+    for (const auto& target_path : plugged)
+        unplugged_all = unplug_native_mount(target_path) && unplugged_all;
+
+    return unplugged_all;
+}
+
+void mp::QemuVirtualMachine::stop_native_mount_servers()
+{
+    for (auto& server : native_mount_servers)
+    {
+        if (server.second->running())
+        {
+            server.second->terminate();
+            server.second->wait_for_finished();
+        }
+    }
+
+    native_mount_servers.clear();
+    native_mount_sockets.reset();
+    deleted_devices.clear();
+}
+
 void mp::QemuVirtualMachine::initialize_vm_process()
 {
-    vm_process = make_qemu_process(
-        desc, ((state == State::suspended) ? mp::make_optional(monitor->retrieve_metadata_for(vm_name)) : mp::nullopt),
-        tap_device_name);
+    const auto resume_metadata =
+        (state == State::suspended) ? mp::make_optional(monitor->retrieve_metadata_for(vm_name)) : mp::nullopt;
+
+    // Whether virtiofsd can map the guest memory is settled on cold boot, resumed machines keep what they had
+    const auto shared_memory = resume_metadata
+                                   ? get_arguments(*resume_metadata).join(' ').contains("memory-backend-memfd")
+                                   : !native_mounts.empty();
+
+    stop_native_mount_servers();
+    if (shared_memory)
+    {
+        native_mount_sockets =
+            std::make_unique<QTemporaryDir>(QDir(QDir::tempPath()).filePath("multipass-virtiofs-XXXXXX"));
+        if (!native_mount_sockets->isValid())
+            throw std::runtime_error(fmt::format("cannot create the native mount socket directory: {}",
+                                                 native_mount_sockets->errorString()));
+    }
+
+    vm_process = make_qemu_process(desc, resume_metadata, tap_device_name,
+                                   native_mount_sockets ? native_mount_sockets->path() : QString());
 
     QObject::connect(vm_process.get(), &Process::started, [this]() {
         mpl::log(mpl::Level::info, vm_name, "process started");
@@ -459,6 +649,13 @@ void mp::QemuVirtualMachine::initialize_vm_process()
     QObject::connect(vm_process.get(), &Process::ready_read_standard_output, [this]() {
         auto qmp_output = vm_process->read_all_standard_output();
         mpl::log(mpl::Level::debug, vm_name, fmt::format("QMP: {}", qmp_output));
+
+        for (const auto& line : qmp_output.split('\n'))
+        {
+            const auto message = QJsonDocument::fromJson(line).object();
+            if (message["event"].toString() == "DEVICE_DELETED")
+                deleted_devices.insert(message["data"].toObject()["device"].toString());
+        }
         auto qmp_object = QJsonDocument::fromJson(qmp_output.split('\n').first()).object();
         auto event = qmp_object["event"];
 
@@ -24,7 +24,11 @@
 #include <multipass/virtual_machine_description.h>
 
 #include <QObject>
+#include <QSet>
 #include <QStringList>
+#include <QTemporaryDir>
+
+#include <unordered_map>
 
 namespace multipass
 {
@@ -52,9 +56,12 @@ public:
     void ensure_vm_is_running() override;
     void wait_until_ssh_up(std::chrono::milliseconds timeout) override;
     void update_state() override;
+    bool add_native_mount(const std::string& target_path, const VMMount& mount) override;
+    void remove_native_mount(const std::string& target_path) override;
 
 signals:
     void on_delete_memory_snapshot();
+    void on_qmp_command(const QByteArray& command);
 
 private:
     void on_started();
@@ -63,6 +70,11 @@ private:
     void on_suspend();
     void on_restart();
     void initialize_vm_process();
+    void write_qmp(const QByteArray& command);
+    void plug_native_mount(const std::string& target_path);
+    bool unplug_native_mount(const std::string& target_path);
+    bool unplug_native_mounts();
+    void stop_native_mount_servers();
 
     const std::string tap_device_name;
     const VirtualMachineDescription desc;
@@ -74,6 +86,10 @@ private:
     std::string saved_error_msg;
     bool update_shutdown_status{true};
     bool delete_memory_snapshot{false};
+    std::unordered_map<std::string, VMMount> native_mounts;
+    std::unordered_map<std::string, std::unique_ptr<Process>> native_mount_servers; // the plugged ones, by target
+    std::unique_ptr<QTemporaryDir> native_mount_sockets; // only while the guest memory can be shared with virtiofsd
+    QSet<QString> deleted_devices;
 };
 } // namespace multipass
 
@@ -21,6 +21,7 @@
 #include <multipass/format.h>
 #include <multipass/logging/log.h>
 #include <multipass/snap_utils.h>
+#include <multipass/vm_image_vault.h>
 #include <shared/linux/backend_utils.h>
 
 namespace mp = multipass;
@@ -73,8 +74,12 @@ QStringList initial_qemu_arguments(const mp::VirtualMachineDescription& desc, co
 } // namespace
 
 mp::QemuVMProcessSpec::QemuVMProcessSpec(const mp::VirtualMachineDescription& desc, const QString& tap_device_name,
-                                         const multipass::optional<ResumeData>& resume_data)
-    : desc(desc), tap_device_name(tap_device_name), resume_data{resume_data}
+                                         const multipass::optional<ResumeData>& resume_data,
+                                         const QString& native_mount_socket_dir)
+    : desc(desc),
+      tap_device_name(tap_device_name),
+      resume_data{resume_data},
+      native_mount_socket_dir{native_mount_socket_dir}
 {
 }
 
@@ -148,6 +153,13 @@ QStringList mp::QemuVMProcessSpec::arguments() const
              << "-nographic";
         // Cloud-init disk
         args << "-cdrom" << desc.cloud_init_iso;
+
+        if (!native_mount_socket_dir.isEmpty())
+        {
+            // vhost-user-fs devices are hot-plugged later on, they need guest memory the daemons serving them can map
+            args << "-object" << QString("memory-backend-memfd,id=mem,size=%1,share=on").arg(mem_size) << "-numa"
+                 << "node,memdev=mem";
+        }
     }
 
     return args;
@@ -224,7 +236,7 @@ profile %1 flags=(attach_disconnected) {
   # Disk images
   %6 rwk,  # QCow2 filesystem image
   %7 rk,   # cloud-init ISO
-}
+%8%9}
     )END");
 
     /* Customisations depending on if running inside snap or not */
@@ -244,8 +256,18 @@ profile %1 flags=(attach_disconnected) {
         firmware = "/usr/share/seabios/*";
     }
 
+    QString native_mount_socket_rule;
+    if (!native_mount_socket_dir.isEmpty())
+        native_mount_socket_rule = QString("  %1/*.sock rw,  # native mount sockets\n").arg(native_mount_socket_dir);
+
+    QString backing_image_rule;
+    const auto backing_image = mp::vault::backing_image_of(desc.image.image_path);
+    if (!backing_image.isEmpty())
+        backing_image_rule = QString("  %1 rk,  # QCow2 backing image\n").arg(backing_image);
+
     return profile_template.arg(apparmor_profile_name(), signal_peer, firmware, root_dir, program(),
-                                desc.image.image_path, desc.cloud_init_iso);
+                                desc.image.image_path, desc.cloud_init_iso, native_mount_socket_rule,
+                                backing_image_rule);
 }
 
 QString mp::QemuVMProcessSpec::identifier() const
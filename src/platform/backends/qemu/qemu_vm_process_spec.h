@@ -40,7 +40,8 @@ public:
     static QString default_machine_type();
 
     explicit QemuVMProcessSpec(const VirtualMachineDescription& desc, const QString& tap_device_name,
-                               const multipass::optional<ResumeData>& resume_data);
+                               const multipass::optional<ResumeData>& resume_data,
+                               const QString& native_mount_socket_dir = QString());
 
     QStringList arguments() const override;
 
@@ -51,6 +52,7 @@ private:
     const VirtualMachineDescription desc;
     const QString tap_device_name;
     const multipass::optional<ResumeData> resume_data;
+    const QString native_mount_socket_dir; // where the vhost-user sockets of hot-plugged native mounts live
 };
 
 } // namespace multipass
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "virtiofsd_process_spec.h"
+
+#include <multipass/cli/client_platform.h>
+#include <multipass/exceptions/snap_environment_exception.h>
+#include <multipass/snap_utils.h>
+
+namespace mp = multipass;
+namespace mu = multipass::utils;
+
+namespace
+{
+QStringList translation_arguments(const QString& option, const std::unordered_map<int, int>& id_map)
+{
+    QStringList args;
+    for (const auto& [host_id, instance_id] : id_map)
+    {
+        // Only the instance knows the IDs of its default user, mappings to it must be resolved beforehand
+        if (instance_id == mp::default_id)
+            continue;
+
+        args << QString("--%1=map:%2:%3:1").arg(option).arg(instance_id).arg(host_id);
+    }
+
+    return args;
+}
+} // namespace
+
+mp::VirtiofsdProcessSpec::VirtiofsdProcessSpec(const std::string& vm_name, const QString& tag,
+                                               const QString& socket_path, const VMMount& mount)
+    : vm_name{vm_name}, tag{tag}, socket_path{socket_path}, mount{mount}
+{
+}
+
+QString mp::VirtiofsdProcessSpec::program() const
+{
+    return "virtiofsd"; // depend on desired binary being in $PATH
+}
+
+QStringList mp::VirtiofsdProcessSpec::arguments() const
+{
+    // AppArmor confines the daemon to the shared directory, so it does not need to set up its own sandbox
+    return QStringList() << QString("--socket-path=%1").arg(socket_path)
+                         << QString("--shared-dir=%1").arg(QString::fromStdString(mount.source_path))
+                         << "--sandbox=none"
+                         << "--cache=auto" << translation_arguments("translate-uid", mount.uid_map)
+                         << translation_arguments("translate-gid", mount.gid_map);
+}
+
+mp::logging::Level mp::VirtiofsdProcessSpec::error_log_level() const
+{
+    return mp::logging::Level::debug;
+}
+
+QString mp::VirtiofsdProcessSpec::apparmor_profile() const
+{
+    QString profile_template(R"END(
+#include <tunables/global>
+profile %1 flags=(attach_disconnected) {
+  #include <abstractions/base>
+
+  # changing ownership and permissions of shared files on behalf of the instance
+  capability chown,
+  capability dac_override,
+  capability dac_read_search,
+  capability fowner,
+  capability fsetid,
+  capability setgid,
+  capability setuid,
+  capability mknod,
+
+  # Allow multipassd send virtiofsd signals
+  signal (receive) peer=%2,
+
+  # binary and its libs
+  %3/{usr/,}{bin,libexec,lib}/%4 ixr,
+  %3/{,usr/}lib/{,@{multiarch}/}{,**/}*.so* rm,
+
+  @{PROC}/@{pid}/fd/ r,
+  @{PROC}/sys/fs/file-max r,
+
+  # the socket QEMU connects to
+  %5 rw,
+
+  # the shared directory
+  %6/ r,
+  %6/** rwlk,
+}
+    )END");
+
+    QString root_dir;    // root directory: either "" or $SNAP
+    QString signal_peer; // who can send kill signal to virtiofsd
+
+    try
+    {
+        root_dir = mu::snap_dir();
+        signal_peer = "snap.multipass.multipassd"; // only multipassd can send virtiofsd signals
+    }
+    catch (const mp::SnapEnvironmentException&)
+    {
+        signal_peer = "unconfined";
+    }
+
+    return profile_template.arg(apparmor_profile_name(), signal_peer, root_dir, program(), socket_path,
+                                QString::fromStdString(mount.source_path));
+}
+
+QString mp::VirtiofsdProcessSpec::identifier() const
+{
+    return QString("%1.%2").arg(QString::fromStdString(vm_name), tag);
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_VIRTIOFSD_PROCESS_SPEC_H
+#define MULTIPASS_VIRTIOFSD_PROCESS_SPEC_H
+
+#include <multipass/process/process_spec.h>
+#include <multipass/vm_mount.h>
+
+#include <string>
+
+namespace multipass
+{
+
+// Serves the source directory of a native mount to QEMU over a vhost-user socket. Mappings to the default ID of the
+// instance are expected to be resolved to the actual IDs of its default user, any left are not translated.
+class VirtiofsdProcessSpec : public ProcessSpec
+{
+public:
+    explicit VirtiofsdProcessSpec(const std::string& vm_name, const QString& tag, const QString& socket_path,
+                                  const VMMount& mount);
+
+    QString program() const override;
+    QStringList arguments() const override;
+    logging::Level error_log_level() const override;
+
+    QString apparmor_profile() const override;
+    QString identifier() const override;
+
+private:
+    const std::string vm_name;
+    const QString tag;
+    const QString socket_path;
+    const VMMount mount;
+};
+
+} // namespace multipass
+
+#endif // MULTIPASS_VIRTIOFSD_PROCESS_SPEC_H
@@ -23,6 +23,7 @@
 #include <multipass/process/process.h>
 #include <multipass/process/qemuimg_process_spec.h>
 #include <multipass/utils.h>
+#include <multipass/vm_image_vault.h>
 
 #include <multipass/format.h>
 
@@ -133,8 +134,9 @@ void mp::backend::resize_instance_image(const MemorySize& disk_space, const mp::
 {
     auto disk_size = QString::number(disk_space.in_bytes()); // format documented in `man qemu-img` (look for "size")
     QStringList qemuimg_parameters{{"resize", image_path, disk_size}};
-    auto qemuimg_process =
-        mp::platform::make_process(std::make_unique<mp::QemuImgProcessSpec>(qemuimg_parameters, "", image_path));
+    // qemu-img opens the backing image of an overlay too, so it must be allowed to read it
+    auto qemuimg_process = mp::platform::make_process(std::make_unique<mp::QemuImgProcessSpec>(
+        qemuimg_parameters, mp::vault::backing_image_of(image_path), image_path));
 
     auto process_state = qemuimg_process->execute(mp::backend::image_resize_timeout);
     if (!process_state.completed_successfully())
@@ -151,6 +153,10 @@ mp::Path mp::backend::convert_to_qcow_if_necessary(const mp::Path& image_path)
     // TODO: we could support converting from other the image formats that qemu-img can deal with
     const auto qcow2_path{image_path + ".qcow2"};
 
+    // A qcow2 header is quicker to recognize than to have qemu-img probe for it
+    if (mp::vault::is_qcow2_image(image_path))
+        return image_path;
+
     auto qemuimg_info_spec =
         std::make_unique<mp::QemuImgProcessSpec>(QStringList{"info", "--output=json", image_path}, image_path);
     auto qemuimg_info_process = MP_PROCFACTORY.create_process(std::move(qemuimg_info_spec));
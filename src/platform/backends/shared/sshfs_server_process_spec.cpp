@@ -45,6 +45,19 @@ QByteArray gen_hash(const std::string& path)
     // so hash it and return first 8 hex chars.
     return QCryptographicHash::hash(QByteArray::fromStdString(path), QCryptographicHash::Sha256).toHex().left(8);
 }
+
+QString source_dir_rules(const std::string& source_path, mp::VMMount::MountProfile profile)
+{
+    if (profile == mp::VMMount::MountProfile::ReadonlyCached)
+        return QString("    %1/ r,\n    %1/** r,\n").arg(QString::fromStdString(source_path));
+
+    return QString("    %1/ rw,\n    %1/** rwlk,\n").arg(QString::fromStdString(source_path));
+}
+
+QString serialise_profile(mp::VMMount::MountProfile profile)
+{
+    return QString::number(static_cast<int>(profile));
+}
 } // namespace
 
 mp::SSHFSServerProcessSpec::SSHFSServerProcessSpec(const SSHFSServerConfig& config)
@@ -59,10 +72,19 @@ QString mp::SSHFSServerProcessSpec::program() const
 
 QStringList mp::SSHFSServerProcessSpec::arguments() const
 {
-    return QStringList() << QString::fromStdString(config.host) << QString::number(config.port)
-                         << QString::fromStdString(config.username) << QString::fromStdString(config.source_path)
-                         << QString::fromStdString(config.target_path) << serialise_id_map(config.uid_map)
-                         << serialise_id_map(config.gid_map);
+    auto args = QStringList() << QString::fromStdString(config.host) << QString::number(config.port)
+                              << QString::fromStdString(config.username) << QString::fromStdString(config.source_path)
+                              << QString::fromStdString(config.target_path) << serialise_id_map(config.uid_map)
+                              << serialise_id_map(config.gid_map) << QString::number(config.worker_threads)
+                              << QString::number(config.cache_attributes ? 1 : 0)
+                              << serialise_profile(config.mount_profile);
+
+    for (const auto& mount : config.additional_mounts)
+        args << QString::fromStdString(mount.source_path) << QString::fromStdString(mount.target_path)
+             << serialise_id_map(mount.uid_map) << serialise_id_map(mount.gid_map)
+             << serialise_profile(mount.mount_profile);
+
+    return args;
 }
 
 QProcessEnvironment mp::SSHFSServerProcessSpec::environment() const
@@ -113,10 +135,8 @@ profile %1 flags=(attach_disconnected) {
     # CLASSIC ONLY: need to specify required libs from core snap
     /{,var/lib/snapd/}snap/core18/*/{,usr/}lib/@{multiarch}/{,**/}*.so* rm,
 
-    # allow full access just to this user-specified source directory on the host
-    %4/ rw,
-    %4/** rwlk,
-}
+    # allow full access just to the user-specified source directories on the host
+%4}
     )END");
 
     /* Customisations depending on if running inside snap or not */
@@ -137,8 +157,11 @@ profile %1 flags=(attach_disconnected) {
         signal_peer = "unconfined";
     }
 
-    return profile_template.arg(apparmor_profile_name(), signal_peer, root_dir,
-                                QString::fromStdString(config.source_path));
+    auto source_rules = source_dir_rules(config.source_path, config.mount_profile);
+    for (const auto& mount : config.additional_mounts)
+        source_rules += source_dir_rules(mount.source_path, mount.mount_profile);
+
+    return profile_template.arg(apparmor_profile_name(), signal_peer, root_dir, source_rules);
 }
 
 QString mp::SSHFSServerProcessSpec::identifier() const
@@ -38,6 +38,18 @@
 #include "shared/sshfs_server_process_spec.h"
 #include <disabled_update_prompt.h>
 
+#include <QFile>
+
+#include <algorithm>
+#include <cerrno>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace mp = multipass;
 namespace mpl = multipass::logging;
 namespace mu = multipass::utils;
@@ -45,6 +57,62 @@ namespace mu = multipass::utils;
 namespace
 {
 constexpr auto autostart_filename = "multipass.gui.autostart.desktop";
+constexpr auto max_copy_chunk_size = 64u * 1024u * 1024u;
+constexpr auto copy_buffer_size = 1024u * 1024u;
+
+bool kernel_cannot_copy(int error)
+{
+    return error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP;
+}
+
+// Copies [offset, end) to the same offset in out_fd, in the kernel when it can
+bool copy_range(int in_fd, int out_fd, off_t offset, off_t end, bool& kernel_copy, std::vector<char>& buffer)
+{
+    while (offset < end)
+    {
+        const auto chunk_size = std::min<off_t>(end - offset, max_copy_chunk_size);
+
+        ssize_t r;
+        if (kernel_copy)
+        {
+            loff_t in_offset = offset, out_offset = offset;
+            r = ::copy_file_range(in_fd, &in_offset, out_fd, &out_offset, chunk_size, 0);
+            if (r < 0 && kernel_cannot_copy(errno))
+            {
+                kernel_copy = false;
+                continue;
+            }
+        }
+        else
+        {
+            buffer.resize(copy_buffer_size);
+            r = ::pread(in_fd, buffer.data(), std::min<off_t>(chunk_size, buffer.size()), offset);
+            for (ssize_t written = 0; r > 0 && written < r;)
+            {
+                auto w = ::pwrite(out_fd, buffer.data() + written, r - written, offset + written);
+                if (w < 0 && errno != EINTR)
+                    return false;
+
+                written += std::max<ssize_t>(w, 0);
+            }
+        }
+
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        if (r == 0) // the file shrank under us
+            return false;
+
+        offset += r;
+    }
+
+    return true;
+}
 
 } // namespace
 
@@ -153,6 +221,53 @@ bool mp::platform::link(const char* target, const char* link)
     return ::link(target, link) == 0;
 }
 
+bool mp::platform::copy_file(const Path& source, const Path& destination)
+{
+    QFile source_file{source};
+    QFile destination_file{destination};
+    if (!source_file.open(QIODevice::ReadOnly) || !destination_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    const auto in_fd = source_file.handle();
+    const auto out_fd = destination_file.handle();
+
+    struct stat source_stat
+    {
+    };
+    if (::fstat(in_fd, &source_stat) < 0)
+        return false;
+
+    ::fchmod(out_fd, source_stat.st_mode & 07777);
+
+    // Filesystems like btrfs and XFS can share the extents outright
+    if (::ioctl(out_fd, FICLONE, in_fd) == 0)
+        return true;
+
+    // Otherwise copy only the data, skipping holes, which make up most of a cloud image
+    auto kernel_copy = true;
+    std::vector<char> buffer;
+    for (off_t offset = 0; offset < source_stat.st_size;)
+    {
+        auto data_start = ::lseek(in_fd, offset, SEEK_DATA);
+        if (data_start < 0 && errno == ENXIO) // only a hole is left
+            break;
+
+        auto data_end = data_start < 0 ? source_stat.st_size : ::lseek(in_fd, data_start, SEEK_HOLE);
+        if (data_start < 0) // no hole detection, so all of it is data
+            data_start = offset;
+        if (data_end < 0)
+            data_end = source_stat.st_size;
+
+        if (!copy_range(in_fd, out_fd, data_start, data_end, kernel_copy, buffer))
+            return false;
+
+        offset = data_end;
+    }
+
+    // Extend the copy over any trailing hole
+    return ::ftruncate(out_fd, source_stat.st_size) == 0;
+}
+
 bool mp::platform::is_alias_supported(const std::string& alias, const std::string& remote)
 {
     return true;
@@ -26,6 +26,8 @@
 #include <QString>
 #include <QTimer>
 
+#include <mutex>
+
 namespace multipass
 {
 class LatestReleaseChecker;
@@ -59,6 +61,7 @@ private slots:
 private:
     const QString current_version, update_url;
     optional<NewReleaseInfo> new_release;
+    mutable std::mutex new_release_mutex; // read from RPC threads, written on the event loop
     QTimer refresh_timer;
 
     qt_delete_later_unique_ptr<LatestReleaseChecker> worker_thread;
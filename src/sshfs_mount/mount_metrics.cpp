@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/sshfs_mount/mount_metrics.h>
+
+#include <QJsonArray>
+
+namespace mp = multipass;
+
+namespace
+{
+// JSON numbers are doubles, so counters are exact up to 2^53
+QJsonValue to_json_value(uint64_t value)
+{
+    return static_cast<double>(value);
+}
+
+uint64_t from_json_value(const QJsonValue& value)
+{
+    return static_cast<uint64_t>(value.toDouble());
+}
+} // namespace
+
+QJsonObject mp::to_json(const MountMetrics& metrics)
+{
+    QJsonObject operations;
+    for (const auto& entry : metrics.operations)
+    {
+        QJsonArray histogram;
+        for (auto bucket : entry.second.latency_histogram)
+            histogram.append(to_json_value(bucket));
+
+        QJsonObject operation;
+        operation.insert("count", to_json_value(entry.second.count));
+        operation.insert("total_latency_us", to_json_value(entry.second.total_latency_us));
+        operation.insert("latency_histogram", histogram);
+        operations.insert(QString::fromStdString(entry.first), operation);
+    }
+
+    QJsonObject json;
+    json.insert("bytes_read", to_json_value(metrics.bytes_read));
+    json.insert("bytes_written", to_json_value(metrics.bytes_written));
+    json.insert("attr_cache_hits", to_json_value(metrics.attr_cache_hits));
+    json.insert("attr_cache_misses", to_json_value(metrics.attr_cache_misses));
+    json.insert("operations", operations);
+    return json;
+}
+
+mp::MountMetrics mp::mount_metrics_from(const QJsonObject& json)
+{
+    MountMetrics metrics;
+    metrics.bytes_read = from_json_value(json["bytes_read"]);
+    metrics.bytes_written = from_json_value(json["bytes_written"]);
+    metrics.attr_cache_hits = from_json_value(json["attr_cache_hits"]);
+    metrics.attr_cache_misses = from_json_value(json["attr_cache_misses"]);
+
+    const auto operations = json["operations"].toObject();
+    for (auto it = operations.begin(); it != operations.end(); ++it)
+    {
+        const auto entry = it.value().toObject();
+
+        MountMetrics::Operation operation;
+        operation.count = from_json_value(entry["count"]);
+        operation.total_latency_us = from_json_value(entry["total_latency_us"]);
+
+        const auto histogram = entry["latency_histogram"].toArray();
+        for (auto i = 0u; i < operation.latency_histogram.size() && i < static_cast<unsigned>(histogram.size()); ++i)
+            operation.latency_histogram[i] = from_json_value(histogram[i]);
+
+        metrics.operations[it.key().toStdString()] = operation;
+    }
+
+    return metrics;
+}
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "sftp_attr_cache.h"
+
+#include <algorithm>
+
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mp = multipass;
+
+namespace
+{
+constexpr auto watch_mask = IN_ATTRIB | IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                            IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+constexpr auto dir_changing_events = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+
+bool ends_with(const std::string& str, const std::string& suffix)
+{
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::string child_path(const std::string& dir, const std::string& name)
+{
+    return ends_with(dir, "/") ? dir + name : dir + "/" + name;
+}
+
+// Each cached path must name one entry only, so those with "." or ".." components are left alone
+bool is_cacheable(const std::string& root, const std::string& path)
+{
+    if (path.compare(0, root.size(), root) != 0)
+        return false;
+
+    if (!ends_with(root, "/") && path.size() > root.size() && path[root.size()] != '/')
+        return false;
+
+    return path.find("//") == std::string::npos && path.find("/./") == std::string::npos &&
+           path.find("/../") == std::string::npos && !ends_with(path, "/.") && !ends_with(path, "/..") &&
+           (path == root || !ends_with(path, "/"));
+}
+
+// The root and every directory below it down to the one containing path
+std::vector<std::string> dirs_leading_to(const std::string& root, const std::string& path)
+{
+    std::vector<std::string> dirs{root};
+
+    auto pos = root.size();
+    while ((pos = path.find('/', pos + 1)) != std::string::npos)
+        dirs.push_back(path.substr(0, pos));
+
+    return dirs;
+}
+
+template <typename T>
+auto below(std::map<std::string, T>& map, const std::string& dir)
+{
+    const auto prefix = child_path(dir, "");
+    auto first = map.lower_bound(prefix);
+    auto last = first;
+    while (last != map.end() && last->first.compare(0, prefix.size(), prefix) == 0)
+        ++last;
+
+    return std::make_pair(first, last);
+}
+} // namespace
+
+std::unique_ptr<mp::SftpAttrCache> mp::SftpAttrCache::make(const std::string& root, std::size_t max_entries)
+{
+    auto inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0)
+        return nullptr;
+
+    return std::unique_ptr<SftpAttrCache>(new SftpAttrCache(inotify_fd, root, max_entries));
+}
+
+mp::SftpAttrCache::SftpAttrCache(int inotify_fd, const std::string& root, std::size_t max_entries)
+    : inotify_fd{inotify_fd}, root{root}, max_entries{max_entries}
+{
+}
+
+mp::SftpAttrCache::~SftpAttrCache()
+{
+    ::close(inotify_fd);
+}
+
+bool mp::SftpAttrCache::lookup(const std::string& path, bool follow, Entry& entry)
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    read_events();
+
+    const auto& cache = follow ? followed_entries : entries;
+    auto it = cache.find(path);
+    if (it != cache.end())
+    {
+        ++num_hits;
+        entry = it->second;
+        return true;
+    }
+
+    ++num_misses;
+
+    // Watches must be in place before the caller looks at the path, or changes in between would go unnoticed
+    if (is_cacheable(root, path))
+    {
+        for (const auto& dir : dirs_leading_to(root, path))
+        {
+            if (!watch(dir))
+                return false;
+        }
+
+        // Entries created in a directory change its attributes too, so directories watch themselves
+        watch(path);
+    }
+
+    return false;
+}
+
+std::uint64_t mp::SftpAttrCache::generation() const
+{
+    return current_generation;
+}
+
+void mp::SftpAttrCache::insert(const std::string& path, bool follow, const Entry& entry, std::uint64_t generation)
+{
+    if (!is_cacheable(root, path))
+        return;
+
+    std::lock_guard<std::mutex> lock{mutex};
+    if (generation != current_generation)
+        return;
+
+    for (const auto& dir : dirs_leading_to(root, path))
+    {
+        if (watched_dirs.find(dir) == watched_dirs.end())
+            return;
+    }
+
+    if (entry.exists && S_ISDIR(entry.attr.permissions) && watched_dirs.find(path) == watched_dirs.end())
+        return;
+
+    auto& cache = follow ? followed_entries : entries;
+    if (cache.size() >= max_entries)
+        cache.clear();
+
+    cache[path] = entry;
+}
+
+std::uint64_t mp::SftpAttrCache::hits() const
+{
+    return num_hits;
+}
+
+std::uint64_t mp::SftpAttrCache::misses() const
+{
+    return num_misses;
+}
+
+void mp::SftpAttrCache::read_events()
+{
+    alignas(inotify_event) char buffer[16 * 1024];
+
+    ssize_t len;
+    while ((len = ::read(inotify_fd, buffer, sizeof(buffer))) > 0)
+    {
+        ++current_generation;
+
+        for (auto ptr = buffer; ptr < buffer + len;)
+        {
+            const auto event = reinterpret_cast<const inotify_event*>(ptr);
+            ptr += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                entries.clear();
+                followed_entries.clear();
+                continue;
+            }
+
+            auto it = watch_paths.find(event->wd);
+            if (it == watch_paths.end())
+                continue;
+
+            const auto paths = it->second;
+            if (event->mask & IN_IGNORED)
+            {
+                watch_paths.erase(it);
+                for (const auto& dir : paths)
+                    invalidate_below(dir);
+                continue;
+            }
+
+            for (const auto& dir : paths)
+            {
+                if (event->len > 0)
+                {
+                    invalidate_below(child_path(dir, event->name));
+                    if (event->mask & dir_changing_events)
+                        invalidate(dir);
+                }
+                else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+                {
+                    invalidate_below(dir);
+                }
+                else
+                {
+                    invalidate(dir);
+                }
+            }
+        }
+    }
+}
+
+bool mp::SftpAttrCache::watch(const std::string& dir)
+{
+    if (watched_dirs.find(dir) != watched_dirs.end())
+        return true;
+
+    auto wd = ::inotify_add_watch(inotify_fd, dir.c_str(), watch_mask);
+    if (wd < 0)
+        return false;
+
+    watched_dirs.emplace(dir, wd);
+    watch_paths[wd].push_back(dir);
+
+    return true;
+}
+
+void mp::SftpAttrCache::unwatch_below(const std::string& dir)
+{
+    auto unwatch = [this](const std::string& path, int wd) {
+        auto it = watch_paths.find(wd);
+        if (it == watch_paths.end())
+            return;
+
+        auto& paths = it->second;
+        paths.erase(std::remove(paths.begin(), paths.end(), path), paths.end());
+        if (paths.empty())
+        {
+            ::inotify_rm_watch(inotify_fd, wd);
+            watch_paths.erase(it);
+        }
+    };
+
+    auto it = watched_dirs.find(dir);
+    if (it != watched_dirs.end())
+    {
+        unwatch(it->first, it->second);
+        watched_dirs.erase(it);
+    }
+
+    auto range = below(watched_dirs, dir);
+    for (auto sub = range.first; sub != range.second; ++sub)
+        unwatch(sub->first, sub->second);
+    watched_dirs.erase(range.first, range.second);
+}
+
+void mp::SftpAttrCache::invalidate(const std::string& path)
+{
+    entries.erase(path);
+    followed_entries.erase(path);
+}
+
+void mp::SftpAttrCache::invalidate_below(const std::string& dir)
+{
+    invalidate(dir);
+
+    for (auto cache : {&entries, &followed_entries})
+    {
+        auto range = below(*cache, dir);
+        cache->erase(range.first, range.second);
+    }
+
+    unwatch_below(dir);
+}
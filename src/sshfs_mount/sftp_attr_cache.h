@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef MULTIPASS_SFTP_ATTR_CACHE_H
+#define MULTIPASS_SFTP_ATTR_CACHE_H
+
+#include <libssh/sftp.h>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace multipass
+{
+// Attributes of paths under a mounted source directory, as last replied to the client. Every directory leading
+// to a cached path is watched with inotify and entries are dropped as soon as the host reports a change, so
+// the cache is never staler than the events that are still queued in the kernel. Those are read before each
+// lookup.
+class SftpAttrCache
+{
+public:
+    struct Entry
+    {
+        bool exists{false};
+        sftp_attributes_struct attr{};
+    };
+
+    // Returns nullptr when inotify is not available
+    static std::unique_ptr<SftpAttrCache> make(const std::string& root, std::size_t max_entries);
+    ~SftpAttrCache();
+
+    bool lookup(const std::string& path, bool follow, Entry& entry);
+
+    // Changes seen after generation() was taken make the entry stale, so it is not stored then
+    std::uint64_t generation() const;
+    void insert(const std::string& path, bool follow, const Entry& entry, std::uint64_t generation);
+
+    std::uint64_t hits() const;
+    std::uint64_t misses() const;
+
+private:
+    SftpAttrCache(int inotify_fd, const std::string& root, std::size_t max_entries);
+
+    void read_events();
+    bool watch(const std::string& dir);
+    void unwatch_below(const std::string& dir);
+    void invalidate(const std::string& path);
+    void invalidate_below(const std::string& dir);
+
+    const int inotify_fd;
+    const std::string root;
+    const std::size_t max_entries;
+
+    std::mutex mutex;
+    std::map<std::string, Entry> followed_entries;
+    std::map<std::string, Entry> entries;
+    std::map<std::string, int> watched_dirs;
+    std::unordered_map<int, std::vector<std::string>> watch_paths; // a directory may be reached by several paths
+    std::atomic<std::uint64_t> current_generation{0};
+    std::atomic<std::uint64_t> num_hits{0};
+    std::atomic<std::uint64_t> num_misses{0};
+};
+} // namespace multipass
+#endif // MULTIPASS_SFTP_ATTR_CACHE_H
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "sftp_buffer_pool.h"
+
+#include <atomic>
+
+namespace mp = multipass;
+
+mp::SftpBufferPool::SftpBufferPool(std::size_t buffer_size, std::size_t max_buffers)
+    : size{buffer_size}, max_buffers{max_buffers}
+{
+}
+
+mp::SftpBufferPool::Buffer mp::SftpBufferPool::acquire()
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    for (const auto& buffer : buffers)
+    {
+        // New references are only ever taken here, so a buffer held by the pool alone is free to be reused.
+        // The fence pairs with the release of the last reference, to see what its holder did with the buffer.
+        if (buffer.use_count() == 1)
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return buffer;
+        }
+    }
+
+    auto buffer = std::make_shared<std::vector<char>>(size);
+    if (buffers.size() < max_buffers)
+        buffers.push_back(buffer);
+
+    return buffer;
+}
+
+std::size_t mp::SftpBufferPool::buffer_size() const
+{
+    return size;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef MULTIPASS_SFTP_BUFFER_POOL_H
+#define MULTIPASS_SFTP_BUFFER_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace multipass
+{
+// Enough buffers for every READ that sshfs keeps outstanding, well over the 12 background requests FUSE allows it by
+// default, so that reads only allocate when a client goes way beyond that
+constexpr std::size_t max_outstanding_sftp_reads = 32;
+
+// Fixed size buffers that are handed out again once whoever acquired them drops their reference, so that
+// serving a read only allocates a buffer while all the pooled ones are still in use.
+class SftpBufferPool
+{
+public:
+    using Buffer = std::shared_ptr<std::vector<char>>;
+
+    SftpBufferPool(std::size_t buffer_size, std::size_t max_buffers);
+
+    Buffer acquire();
+    std::size_t buffer_size() const;
+
+private:
+    const std::size_t size;
+    const std::size_t max_buffers;
+    std::mutex mutex;
+    std::vector<Buffer> buffers;
+};
+} // namespace multipass
+#endif // MULTIPASS_SFTP_BUFFER_POOL_H
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sftp_metrics.h"
+
+#include <libssh/sftp.h>
+
+#include <algorithm>
+
+namespace mp = multipass;
+
+namespace
+{
+constexpr std::array<const char*, 6> operation_names{"open", "read", "write", "stat", "readdir", "other"};
+
+std::size_t latency_bucket_for(uint64_t latency_us)
+{
+    const auto& bounds = mp::MountMetrics::latency_bucket_bounds_us;
+    return std::upper_bound(bounds.begin(), bounds.end(), latency_us) - bounds.begin();
+}
+} // namespace
+
+mp::SftpMetrics::Operation mp::SftpMetrics::operation_for(uint8_t sftp_type)
+{
+    switch (sftp_type)
+    {
+    case SFTP_OPEN:
+        return Operation::open;
+    case SFTP_READ:
+        return Operation::read;
+    case SFTP_WRITE:
+        return Operation::write;
+    case SFTP_STAT:
+    case SFTP_LSTAT:
+    case SFTP_FSTAT:
+        return Operation::stat;
+    case SFTP_OPENDIR:
+    case SFTP_READDIR:
+        return Operation::readdir;
+    default:
+        return Operation::other;
+    }
+}
+
+void mp::SftpMetrics::record(Operation operation, std::chrono::nanoseconds latency)
+{
+    const auto latency_us =
+        static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+
+    auto& stats = operations[static_cast<std::size_t>(operation)];
+    ++stats.count;
+    stats.total_latency_us += latency_us;
+    ++stats.latency_histogram[latency_bucket_for(latency_us)];
+}
+
+void mp::SftpMetrics::add_bytes_read(uint64_t bytes)
+{
+    bytes_read += bytes;
+}
+
+void mp::SftpMetrics::add_bytes_written(uint64_t bytes)
+{
+    bytes_written += bytes;
+}
+
+void mp::SftpMetrics::add_attr_cache_lookup(bool hit)
+{
+    ++(hit ? attr_cache_hits : attr_cache_misses);
+}
+
+uint64_t mp::SftpMetrics::requests() const
+{
+    uint64_t requests{0};
+    for (const auto& stats : operations)
+        requests += stats.count;
+
+    return requests;
+}
+
+mp::MountMetrics mp::SftpMetrics::snapshot() const
+{
+    MountMetrics metrics;
+    metrics.bytes_read = bytes_read;
+    metrics.bytes_written = bytes_written;
+    metrics.attr_cache_hits = attr_cache_hits;
+    metrics.attr_cache_misses = attr_cache_misses;
+
+    for (auto i = 0u; i < num_operations; ++i)
+    {
+        const auto& stats = operations[i];
+        if (stats.count == 0)
+            continue;
+
+        auto& operation = metrics.operations[operation_names[i]];
+        operation.count = stats.count;
+        operation.total_latency_us = stats.total_latency_us;
+        for (auto bucket = 0u; bucket < operation.latency_histogram.size(); ++bucket)
+            operation.latency_histogram[bucket] = stats.latency_histogram[bucket];
+    }
+
+    return metrics;
+}
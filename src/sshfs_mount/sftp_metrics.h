@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef MULTIPASS_SFTP_METRICS_H
+#define MULTIPASS_SFTP_METRICS_H
+
+#include <multipass/sshfs_mount/mount_metrics.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace multipass
+{
+// Counts the requests served for a mount, and how long they took. Safe to update from the worker threads while
+// being read from another one.
+class SftpMetrics
+{
+public:
+    enum class Operation
+    {
+        open,
+        read,
+        write,
+        stat,
+        readdir,
+        other
+    };
+
+    static Operation operation_for(uint8_t sftp_type);
+
+    void record(Operation operation, std::chrono::nanoseconds latency);
+    void add_bytes_read(uint64_t bytes);
+    void add_bytes_written(uint64_t bytes);
+    void add_attr_cache_lookup(bool hit);
+
+    uint64_t requests() const;
+    MountMetrics snapshot() const;
+
+private:
+    static constexpr auto num_operations = static_cast<std::size_t>(Operation::other) + 1;
+
+    struct OperationStats
+    {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> total_latency_us{0};
+        std::array<std::atomic<uint64_t>, MountMetrics::num_latency_buckets> latency_histogram{};
+    };
+
+    std::array<OperationStats, num_operations> operations;
+    std::atomic<uint64_t> bytes_read{0};
+    std::atomic<uint64_t> bytes_written{0};
+    std::atomic<uint64_t> attr_cache_hits{0};
+    std::atomic<uint64_t> attr_cache_misses{0};
+};
+} // namespace multipass
+#endif // MULTIPASS_SFTP_METRICS_H
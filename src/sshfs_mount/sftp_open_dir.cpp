@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "sftp_open_dir.h"
+
+#include <fcntl.h>
+
+namespace mp = multipass;
+
+std::unique_ptr<mp::SftpOpenDir> mp::SftpOpenDir::open(const std::string& path)
+{
+    auto dir = ::opendir(path.c_str());
+    if (dir == nullptr)
+        return nullptr;
+
+    return std::unique_ptr<SftpOpenDir>(new SftpOpenDir(dir));
+}
+
+mp::SftpOpenDir::SftpOpenDir(DIR* dir) : dir{dir}
+{
+}
+
+mp::SftpOpenDir::~SftpOpenDir()
+{
+    ::closedir(dir);
+}
+
+const mp::SftpOpenDir::Entry* mp::SftpOpenDir::peek()
+{
+    while (!has_current)
+    {
+        auto entry = ::readdir(dir);
+        if (entry == nullptr)
+            return nullptr;
+
+        // Entries removed since the directory was read are skipped
+        if (::fstatat(::dirfd(dir), entry->d_name, &current.st, AT_SYMLINK_NOFOLLOW) == 0)
+        {
+            current.name = entry->d_name;
+            has_current = true;
+        }
+    }
+
+    return &current;
+}
+
+void mp::SftpOpenDir::pop()
+{
+    has_current = false;
+}
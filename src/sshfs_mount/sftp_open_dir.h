@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef MULTIPASS_SFTP_OPEN_DIR_H
+#define MULTIPASS_SFTP_OPEN_DIR_H
+
+#include <memory>
+#include <string>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace multipass
+{
+// A directory opened on behalf of an SFTP client. Entries are read from the OS as the client asks for them,
+// each with a single lstat() relative to the directory.
+class SftpOpenDir
+{
+public:
+    struct Entry
+    {
+        std::string name;
+        struct stat st;
+    };
+
+    // Returns nullptr and leaves errno set when the directory cannot be opened
+    static std::unique_ptr<SftpOpenDir> open(const std::string& path);
+    ~SftpOpenDir();
+
+    // The next entry, or nullptr when there are none left. It stays current until pop() is called,
+    // so that an entry that does not fit in one reply can be sent in the next one.
+    const Entry* peek();
+    void pop();
+
+private:
+    explicit SftpOpenDir(DIR* dir);
+
+    DIR* dir;
+    Entry current;
+    bool has_current{false};
+};
+} // namespace multipass
+#endif // MULTIPASS_SFTP_OPEN_DIR_H
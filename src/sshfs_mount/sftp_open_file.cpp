@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "sftp_open_file.h"
+
+#include <algorithm>
+#include <cerrno>
+
+#include <unistd.h>
+
+namespace mp = multipass;
+
+namespace
+{
+constexpr auto max_pending_writes_size = 1024u * 1024u;
+constexpr auto max_copy_chunk_size = 8u * 1024u * 1024u;
+constexpr auto copy_buffer_size = 256u * 1024u;
+
+bool kernel_cannot_copy(int error)
+{
+    return error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP;
+}
+
+// Fallback for when the kernel cannot copy between the two files, returns the amount copied
+ssize_t copy_through_buffer(int in_fd, loff_t& in_offset, int out_fd, loff_t& out_offset, std::size_t len,
+                            std::vector<char>& buffer)
+{
+    buffer.resize(copy_buffer_size);
+
+    auto r = ::pread(in_fd, buffer.data(), std::min<std::size_t>(len, buffer.size()), in_offset);
+    if (r <= 0)
+        return r;
+
+    for (ssize_t written = 0; written < r;)
+    {
+        auto w = ::pwrite(out_fd, buffer.data() + written, r - written, out_offset + written);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return -1;
+        }
+
+        written += w;
+    }
+
+    in_offset += r;
+    out_offset += r;
+    return r;
+}
+} // namespace
+
+mp::SftpOpenFile::SftpOpenFile(const std::string& name) : name{name}, qfile{QString::fromStdString(name)}
+{
+}
+
+QFile& mp::SftpOpenFile::file()
+{
+    return qfile;
+}
+
+const std::string& mp::SftpOpenFile::path() const
+{
+    return name;
+}
+
+bool mp::SftpOpenFile::write(uint64_t offset, const char* data, std::size_t len)
+{
+    if (!pending_writes.empty() && offset != pending_offset + pending_writes.size())
+    {
+        if (!flush())
+            return false;
+    }
+
+    // The buffer grows with the writes, so handles only ever written to a little stay small
+    if (pending_writes.empty())
+        pending_offset = offset;
+
+    pending_writes.insert(pending_writes.end(), data, data + len);
+
+    // Keep the buffer while the client streams writes, it will fill it again
+    if (pending_writes.size() >= max_pending_writes_size)
+        return write_pending();
+
+    return true;
+}
+
+ssize_t mp::SftpOpenFile::read(char* data, std::size_t len, uint64_t offset)
+{
+    if (!flush())
+        return -1;
+
+    ssize_t r;
+    do
+    {
+        r = ::pread(qfile.handle(), data, len, offset);
+    } while (r < 0 && errno == EINTR);
+
+    return r;
+}
+
+bool mp::SftpOpenFile::flush()
+{
+    auto written = write_pending();
+    auto error = errno;
+
+    // Something else needs the data now, which ends the run of writes, so give up the memory until the next one
+    std::vector<char>{}.swap(pending_writes);
+    errno = error;
+    return written;
+}
+
+bool mp::SftpOpenFile::write_pending()
+{
+    auto data = pending_writes.data();
+    auto len = pending_writes.size();
+    auto offset = pending_offset;
+
+    while (len > 0)
+    {
+        auto r = ::pwrite(qfile.handle(), data, len, offset);
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            pending_writes.clear();
+            return false;
+        }
+
+        data += r;
+        len -= r;
+        offset += r;
+    }
+
+    pending_writes.clear();
+    return true;
+}
+
+void mp::SftpOpenFile::flush_deferring_error()
+{
+    if (!flush())
+        deferred_error = errno;
+}
+
+bool mp::SftpOpenFile::fsync()
+{
+    return flush() && ::fsync(qfile.handle()) == 0;
+}
+
+bool mp::SftpOpenFile::has_pending_writes() const
+{
+    return !pending_writes.empty();
+}
+
+bool mp::SftpOpenFile::copy_to(uint64_t offset, uint64_t len, SftpOpenFile& dest, uint64_t dest_offset)
+{
+    if (!flush() || !dest.flush())
+        return false;
+
+    const auto to_end = len == 0;
+    loff_t in_offset = offset;
+    loff_t out_offset = dest_offset;
+    auto kernel_copy = true;
+    std::vector<char> buffer;
+
+    while (to_end || len > 0)
+    {
+        const auto chunk_size = to_end ? max_copy_chunk_size : std::min<uint64_t>(len, max_copy_chunk_size);
+
+        ssize_t r;
+        if (kernel_copy)
+        {
+            r = ::copy_file_range(qfile.handle(), &in_offset, dest.qfile.handle(), &out_offset, chunk_size, 0);
+            if (r < 0 && kernel_cannot_copy(errno))
+            {
+                kernel_copy = false;
+                continue;
+            }
+        }
+        else
+        {
+            r = copy_through_buffer(qfile.handle(), in_offset, dest.qfile.handle(), out_offset, chunk_size, buffer);
+        }
+
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        if (r == 0) // end of file
+            break;
+
+        if (!to_end)
+            len -= r;
+    }
+
+    return true;
+}
+
+bool mp::SftpOpenFile::has_deferred_error() const
+{
+    return deferred_error != 0;
+}
+
+int mp::SftpOpenFile::take_deferred_error()
+{
+    auto error = deferred_error;
+    deferred_error = 0;
+    return error;
+}
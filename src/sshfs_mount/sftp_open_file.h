@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef MULTIPASS_SFTP_OPEN_FILE_H
+#define MULTIPASS_SFTP_OPEN_FILE_H
+
+#include <QFile>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace multipass
+{
+// A file opened on behalf of an SFTP client. Contiguous writes are coalesced in memory and only handed to the
+// OS once enough of them accumulate, or when the client needs to observe them (read, stat, close, fsync).
+class SftpOpenFile
+{
+public:
+    explicit SftpOpenFile(const std::string& name);
+
+    QFile& file();
+    const std::string& path() const;
+
+    bool write(uint64_t offset, const char* data, std::size_t len);
+    ssize_t read(char* data, std::size_t len, uint64_t offset);
+    bool flush();
+    bool fsync();
+    bool has_pending_writes() const;
+
+    // Copies len bytes at offset, or everything from there to the end of the file if len is 0, into dest.
+    // The kernel copies the data itself where it can, sharing extents on filesystems that support reflinks.
+    bool copy_to(uint64_t offset, uint64_t len, SftpOpenFile& dest, uint64_t dest_offset);
+
+    // Errors from writes that are flushed without a client request waiting on them are kept to be
+    // reported on the next write, fsync or close of the file
+    void flush_deferring_error();
+    bool has_deferred_error() const;
+    int take_deferred_error();
+
+private:
+    bool write_pending();
+
+    const std::string name;
+    QFile qfile;
+    std::vector<char> pending_writes;
+    uint64_t pending_offset{0};
+    int deferred_error{0};
+};
+} // namespace multipass
+#endif // MULTIPASS_SFTP_OPEN_FILE_H
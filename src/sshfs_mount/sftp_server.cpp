@@ -17,6 +17,13 @@
 
 #include <multipass/sshfs_mount/sftp_server.h>
 
+#include "sftp_attr_cache.h"
+#include "sftp_buffer_pool.h"
+#include "sftp_metrics.h"
+#include "sftp_open_dir.h"
+#include "sftp_open_file.h"
+#include "sftp_worker_pool.h"
+
 #include <multipass/cli/client_platform.h>
 #include <multipass/exceptions/exitless_sshprocess_exception.h>
 #include <multipass/format.h>
@@ -30,12 +37,36 @@
 #include <QDir>
 #include <QFile>
 
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <string_view>
+
+#include <poll.h>
+#include <sys/statvfs.h>
+
 namespace mp = multipass;
 namespace mpl = multipass::logging;
 
 namespace
 {
 constexpr auto category = "sftp server";
+constexpr auto reply_wait_timeout_ms = 100; // only bounds the wait, the workers wake this thread as they finish
+constexpr auto max_read_size = 256u * 1024u; // largest amount of data served by a single READ request
+constexpr auto max_messages_per_turn = 64;    // when sharing a session, so that no mount starves the others
+constexpr auto max_readdir_reply_size = 64u * 1024u;
+constexpr auto readdir_entry_overhead = 64u; // length fields and attributes sent along with each name
+constexpr auto max_cached_attrs = 100000u;
+constexpr auto max_packet_overhead = 1024u; // for what comes along with the data in READ replies and WRITE requests
+constexpr uint64_t statvfs_read_only = 0x1;  // SSH_FXE_STATVFS_ST_RDONLY
+constexpr uint64_t statvfs_no_suid = 0x2;    // SSH_FXE_STATVFS_ST_NOSUID
+constexpr auto max_init_packet_size = 64u * 1024u;
+
+// Extensions served by handle_extended(), listed to the client along with their versions
+constexpr std::pair<const char*, const char*> sftp_extensions[] = {
+    {"posix-rename@openssh.com", "1"}, {"hardlink@openssh.com", "1"}, {"fsync@openssh.com", "1"},
+    {"copy-data", "1"}, {"statvfs@openssh.com", "2"}, {"limits@openssh.com", "1"}};
 using SftpHandleUPtr = std::unique_ptr<ssh_string_struct, void (*)(ssh_string)>;
 using namespace std::literals::chrono_literals;
 
@@ -52,10 +83,84 @@ enum Permissions
     exec_other = 01
 };
 
+void append_u32(std::string& packet, uint32_t value)
+{
+    for (auto shift : {24, 16, 8, 0})
+        packet.push_back(static_cast<char>((value >> shift) & 0xff));
+}
+
+void append_string(std::string& packet, const std::string& value)
+{
+    append_u32(packet, value.size());
+    packet.append(value);
+}
+
+uint32_t u32_from(const unsigned char* data)
+{
+    return (uint32_t{data[0]} << 24) | (uint32_t{data[1]} << 16) | (uint32_t{data[2]} << 8) | uint32_t{data[3]};
+}
+
+bool read_from(ssh_channel channel, unsigned char* data, uint32_t len)
+{
+    while (len > 0)
+    {
+        auto r = ssh_channel_read(channel, data, len, 0);
+        if (r <= 0)
+            return false;
+
+        data += r;
+        len -= r;
+    }
+
+    return true;
+}
+
+// The packet is expected to start with room for its length, which is filled in here
+int send_packet(ssh_channel channel, std::string& packet)
+{
+    const auto length = packet.size() - 4;
+    for (auto i = 0u; i < 4u; ++i)
+        packet[i] = static_cast<char>((length >> (24 - 8 * i)) & 0xff);
+
+    auto written = ssh_channel_write(channel, packet.data(), packet.size());
+    return written == static_cast<int>(packet.size()) ? SSH_OK : SSH_ERROR;
+}
+
+// libssh answers SSH_FXP_INIT without listing any extension, and clients only use the extensions that are listed,
+// so the version is negotiated here instead
+int init_sftp_server(sftp_session sftp)
+{
+    unsigned char length_field[4];
+    if (!read_from(sftp->channel, length_field, sizeof(length_field)))
+        return SSH_ERROR;
+
+    // The type and the version, possibly followed by extensions of the client, which are of no interest here
+    const auto length = u32_from(length_field);
+    if (length < 5 || length > max_init_packet_size)
+        return SSH_ERROR;
+
+    std::vector<unsigned char> payload(length);
+    if (!read_from(sftp->channel, payload.data(), length) || payload[0] != SSH_FXP_INIT)
+        return SSH_ERROR;
+
+    sftp->client_version = static_cast<int>(u32_from(payload.data() + 1));
+
+    std::string packet(4, '\0');
+    packet.push_back(static_cast<char>(SSH_FXP_VERSION));
+    append_u32(packet, LIBSFTP_VERSION);
+    for (const auto& extension : sftp_extensions)
+    {
+        append_string(packet, extension.first);
+        append_string(packet, extension.second);
+    }
+
+    return send_packet(sftp->channel, packet);
+}
+
 auto make_sftp_session(ssh_session session, ssh_channel channel)
 {
     mp::SftpServer::SftpSessionUptr sftp_server_session{sftp_server_new(session, channel), sftp_free};
-    mp::SSH::throw_on_error(sftp_server_session, session, "[sftp] server init failed", sftp_server_init);
+    mp::SSH::throw_on_error(sftp_server_session, session, "[sftp] server init failed", init_sftp_server);
     return sftp_server_session;
 }
 
@@ -84,78 +189,55 @@ int reply_unsupported(sftp_client_message msg)
     return sftp_reply_status(msg, SSH_FX_OP_UNSUPPORTED, "Unsupported message");
 }
 
+// libssh has no call to send SSH_FXP_EXTENDED_REPLY, so the packet is put together here
+int reply_extended(sftp_client_message msg, std::initializer_list<uint64_t> values)
+{
+    std::string packet(4, '\0');
+    packet.push_back(static_cast<char>(SSH_FXP_EXTENDED_REPLY));
+    append_u32(packet, msg->id);
+    for (auto value : values)
+    {
+        append_u32(packet, value >> 32);
+        append_u32(packet, value & 0xffffffff);
+    }
+
+    return send_packet(msg->sftp->channel, packet);
+}
+
 fmt::memory_buffer& operator<<(fmt::memory_buffer& buf, const char* v)
 {
     fmt::format_to(buf, v);
     return buf;
 }
 
-auto longname_from(const QFileInfo& file_info, const std::string& filename)
+auto longname_from(const struct stat& st, const std::string& filename)
 {
+    constexpr const char* months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                      "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    constexpr const char* mode_chars[] = {"r", "w", "x"};
     fmt::memory_buffer out;
-    auto mode = file_info.permissions();
 
-    if (file_info.isSymLink())
+    if (S_ISLNK(st.st_mode))
         out << "l";
-    else if (file_info.isDir())
+    else if (S_ISDIR(st.st_mode))
         out << "d";
     else
         out << "-";
 
-    /* user */
-    if (mode & QFileDevice::ReadOwner)
-        out << "r";
-    else
-        out << "-";
+    /* user, group and other */
+    for (auto i = 0; i < 9; ++i)
+        out << ((st.st_mode & (Permissions::read_user >> i)) ? mode_chars[i % 3] : "-");
 
-    if (mode & QFileDevice::WriteOwner)
-        out << "w";
-    else
-        out << "-";
+    fmt::format_to(out, " 1 {} {} {}", st.st_uid, st.st_gid, st.st_size);
 
-    if (mode & QFileDevice::ExeOwner)
-        out << "x";
-    else
-        out << "-";
-
-    /*group*/
-    if (mode & QFileDevice::ReadGroup)
-        out << "r";
-    else
-        out << "-";
-
-    if (mode & QFileDevice::WriteGroup)
-        out << "w";
-    else
-        out << "-";
-
-    if (mode & QFileDevice::ExeGroup)
-        out << "x";
-    else
-        out << "-";
-
-    /* other */
-    if (mode & QFileDevice::ReadOther)
-        out << "r";
-    else
-        out << "-";
-
-    if (mode & QFileDevice::WriteOther)
-        out << "w";
-    else
-        out << "-";
-
-    if (mode & QFileDevice::ExeOther)
-        out << "x";
-    else
-        out << "-";
-
-    fmt::format_to(out, " 1 {} {} {}", file_info.ownerId(), file_info.groupId(), file_info.size());
-
-    const auto timestamp = file_info.lastModified().toString("MMM d hh:mm:ss yyyy").toStdString();
-    fmt::format_to(out, " {} {}", timestamp, filename);
+    struct tm mtime
+    {
+    };
+    localtime_r(&st.st_mtime, &mtime);
+    fmt::format_to(out, " {} {} {:02}:{:02}:{:02} {} {}", months[mtime.tm_mon], mtime.tm_mday, mtime.tm_hour,
+                   mtime.tm_min, mtime.tm_sec, mtime.tm_year + 1900, filename);
 
-    return out;
+    return fmt::to_string(out);
 }
 
 auto to_qt_permissions(uint32_t perms)
@@ -228,6 +310,61 @@ auto handle_from(sftp_client_message msg, const std::unordered_map<void*, std::u
     return nullptr;
 }
 
+// libssh only parses the arguments of the extensions it knows about, so the others are read from the raw
+// message: the request id and the extension name, followed by the extension specific fields
+class ExtensionArgs
+{
+public:
+    explicit ExtensionArgs(sftp_client_message msg)
+    {
+        if (msg->complete_message != nullptr)
+        {
+            pos = static_cast<const unsigned char*>(ssh_buffer_get(msg->complete_message));
+            end = pos + ssh_buffer_get_len(msg->complete_message);
+        }
+
+        uint32_t id;
+        std::string name;
+        read_u32(id);
+        read_string(name);
+    }
+
+    bool read_u32(uint32_t& out)
+    {
+        if (end - pos < 4)
+            return false;
+
+        out = (uint32_t{pos[0]} << 24) | (uint32_t{pos[1]} << 16) | (uint32_t{pos[2]} << 8) | uint32_t{pos[3]};
+        pos += 4;
+        return true;
+    }
+
+    bool read_u64(uint64_t& out)
+    {
+        uint32_t high, low;
+        if (!read_u32(high) || !read_u32(low))
+            return false;
+
+        out = (uint64_t{high} << 32) | low;
+        return true;
+    }
+
+    bool read_string(std::string& out)
+    {
+        uint32_t len;
+        if (!read_u32(len) || static_cast<uint32_t>(end - pos) < len)
+            return false;
+
+        out.assign(reinterpret_cast<const char*>(pos), len);
+        pos += len;
+        return true;
+    }
+
+private:
+    const unsigned char* pos{nullptr};
+    const unsigned char* end{nullptr};
+};
+
 void check_sshfs_status(mp::SSHSession& session, mp::SSHProcess& sshfs_process)
 {
     try
@@ -250,28 +387,117 @@ auto create_sshfs_process(mp::SSHSession& session, const std::string& sshfs_exec
 
     return std::make_unique<mp::SSHProcess>(std::move(sshfs_process));
 }
+
+std::unique_ptr<mp::SftpWorkerPool> make_worker_pool(int worker_threads)
+{
+    if (worker_threads <= 0)
+        return nullptr;
+
+    return std::make_unique<mp::SftpWorkerPool>(worker_threads);
+}
+
+std::unique_ptr<mp::SftpBufferPool> make_read_buffers()
+{
+    return std::make_unique<mp::SftpBufferPool>(max_read_size, mp::max_outstanding_sftp_reads);
+}
+
+std::unique_ptr<mp::SftpAttrCache> make_attr_cache(const std::string& source, bool cache_attributes)
+{
+    if (!cache_attributes)
+        return nullptr;
+
+    auto attr_cache = mp::SftpAttrCache::make(source, max_cached_attrs);
+    if (attr_cache == nullptr)
+        mpl::log(mpl::Level::warning, category,
+                 fmt::format("cannot watch \"{}\" for changes, attributes will not be cached: {}", source,
+                             std::strerror(errno)));
+
+    return attr_cache;
+}
+
+bool is_pipelined(uint8_t type)
+{
+    switch (type)
+    {
+    case SFTP_READ:
+    case SFTP_WRITE:
+    case SFTP_FSTAT:
+    case SFTP_STAT:
+    case SFTP_LSTAT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Whether copying length bytes at read_offset to write_offset within the same file would overwrite the source as it
+// is being read. A length of 0 reaches to the end of the file, so the file must have no pending writes then.
+bool copy_ranges_overlap(mp::SftpOpenFile& file, uint64_t read_offset, uint64_t length, uint64_t write_offset)
+{
+    if (length == 0)
+    {
+        const auto size = static_cast<uint64_t>(file.file().size());
+        length = size > read_offset ? size - read_offset : 0u;
+    }
+
+    return write_offset >= read_offset ? write_offset - read_offset < length : read_offset - write_offset < length;
+}
+
+void log_reply_error(int ret)
+{
+    if (ret != 0)
+        mpl::log(mpl::Level::error, category, fmt::format("error occurred when replying to client: {}", ret));
+}
 } // namespace
 
 mp::SftpServer::SftpServer(SSHSession&& session, const std::string& source, const std::string& target,
                            const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map,
-                           int default_uid, int default_gid, const std::string& sshfs_exec_line)
-    : ssh_session{std::move(session)},
-      sshfs_process{create_sshfs_process(ssh_session, sshfs_exec_line, mp::utils::escape_char(source, '"'),
+                           int default_uid, int default_gid, const std::string& sshfs_exec_line, int worker_threads,
+                           bool cache_attributes)
+    : SftpServer{std::make_shared<SSHSession>(std::move(session)),
+                 make_worker_pool(worker_threads),
+                 make_read_buffers(),
+                 source,
+                 target,
+                 gid_map,
+                 uid_map,
+                 default_uid,
+                 default_gid,
+                 sshfs_exec_line,
+                 cache_attributes}
+{
+}
+
+mp::SftpServer::SftpServer(std::shared_ptr<SSHSession> ssh_session, std::shared_ptr<SftpWorkerPool> worker_pool,
+                           std::shared_ptr<SftpBufferPool> read_buffers, const std::string& source,
+                           const std::string& target, const std::unordered_map<int, int>& gid_map,
+                           const std::unordered_map<int, int>& uid_map, int default_uid, int default_gid,
+                           const std::string& sshfs_exec_line, bool cache_attributes)
+    : ssh_session{std::move(ssh_session)},
+      sshfs_process{create_sshfs_process(*this->ssh_session, sshfs_exec_line, mp::utils::escape_char(source, '"'),
                                          mp::utils::escape_char(target, '"'))},
-      sftp_server_session{make_sftp_session(ssh_session, sshfs_process->release_channel())},
+      sftp_server_session{make_sftp_session(*this->ssh_session, sshfs_process->release_channel())},
       source_path{source},
       target_path{target},
       gid_map{gid_map},
       uid_map{uid_map},
       default_uid{default_uid},
       default_gid{default_gid},
-      sshfs_exec_line{sshfs_exec_line}
+      sshfs_exec_line{sshfs_exec_line},
+      read_buffers{std::move(read_buffers)},
+      attr_cache{make_attr_cache(source, cache_attributes)},
+      request_metrics{std::make_shared<SftpMetrics>()},
+      worker_pool{std::move(worker_pool)}
 {
 }
 
 mp::SftpServer::~SftpServer()
 {
     stop_invoked = true;
+    if (worker_pool)
+        discard_pending_replies();
+
+    worker_pool.reset();
 }
 
 sftp_attributes_struct mp::SftpServer::attr_from(const QFileInfo& file_info)
@@ -299,6 +525,24 @@ sftp_attributes_struct mp::SftpServer::attr_from(const QFileInfo& file_info)
     return attr;
 }
 
+sftp_attributes_struct mp::SftpServer::attr_from(const struct stat& st)
+{
+    sftp_attributes_struct attr{};
+
+    attr.size = st.st_size;
+
+    attr.uid = mapped_uid_for(st.st_uid);
+    attr.gid = mapped_gid_for(st.st_gid);
+
+    attr.permissions = st.st_mode;
+    attr.atime = st.st_atime;
+    attr.mtime = st.st_mtime;
+    attr.flags =
+        SSH_FILEXFER_ATTR_SIZE | SSH_FILEXFER_ATTR_UIDGID | SSH_FILEXFER_ATTR_PERMISSIONS | SSH_FILEXFER_ATTR_ACMODTIME;
+
+    return attr;
+}
+
 int mp::SftpServer::mapped_uid_for(const int uid)
 {
     if (uid == mp::no_id_info_available)
@@ -396,74 +640,317 @@ void mp::SftpServer::process_message(sftp_client_message msg)
         mpl::log(mpl::Level::warning, category, fmt::format("Unknown message: {}", static_cast<int>(type)));
         ret = reply_unsupported(msg);
     }
-    if (ret != 0)
-        mpl::log(mpl::Level::error, category, fmt::format("error occurred when replying to client: {}", ret));
+    log_reply_error(ret);
 }
 
-void mp::SftpServer::run()
+void mp::SftpServer::dispatch(MsgUPtr client_msg)
+{
+    auto msg = client_msg.release();
+
+    {
+        std::lock_guard<std::mutex> lock{replies_mutex};
+        ++pending_replies;
+    }
+
+    const auto received = std::chrono::steady_clock::now();
+    worker_pool->submit(ordering_key_for(msg), [this, msg, received] {
+        Reply reply;
+        try
+        {
+            reply = prepare_pipelined(msg);
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::error, category, fmt::format("failed to serve request: {}", e.what()));
+            reply = [msg] { return reply_failure(msg); };
+        }
+
+        // Notified under the lock, as this server may be gone as soon as it sees the last reply
+        std::lock_guard<std::mutex> lock{replies_mutex};
+        completed_replies.push_back({msg, std::move(reply), received});
+        replies_cv.notify_one();
+    });
+}
+
+// libssh sessions must only be used from one thread, so replies from the workers are sent from here,
+// in between waiting for the next client message.
+bool mp::SftpServer::client_message_ready()
+{
+    send_completed_replies();
+
+    {
+        std::lock_guard<std::mutex> lock{replies_mutex};
+        if (pending_replies == 0)
+            return true;
+    }
+
+    if (stop_invoked)
+        return true;
+
+    if (ssh_channel_poll_timeout(sftp_server_session->channel, 0, 0) != 0)
+        return true;
+
+    // Sleep until the client sends more or a worker finishes, whichever comes first
+    pollfd fds[] = {{ssh_get_fd(*ssh_session), POLLIN, 0}, {worker_pool->finished_fd(), POLLIN, 0}};
+    ::poll(fds, 2, reply_wait_timeout_ms);
+    worker_pool->clear_finished();
+
+    return false;
+}
+
+void mp::SftpServer::send_completed_replies()
+{
+    // Swapped back and forth so that neither list needs to allocate once it has grown
+    {
+        std::lock_guard<std::mutex> lock{replies_mutex};
+        sending_replies.swap(completed_replies);
+    }
+
+    for (auto& entry : sending_replies)
+    {
+        MsgUPtr client_msg{entry.msg, sftp_client_message_free};
+        const auto operation = SftpMetrics::operation_for(sftp_client_message_get_type(entry.msg));
+        log_reply_error(entry.reply());
+
+        // Timed until the reply is sent, which includes waiting in the queues like it does for the client
+        request_metrics->record(operation, std::chrono::steady_clock::now() - entry.received);
+    }
+
+    const auto num_sent = sending_replies.size();
+    sending_replies.clear();
+
+    std::lock_guard<std::mutex> lock{replies_mutex};
+    pending_replies -= num_sent;
+}
+
+void mp::SftpServer::wait_for_pending_replies()
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock{replies_mutex};
+            replies_cv.wait(lock, [this] { return pending_replies == 0 || !completed_replies.empty(); });
+            if (pending_replies == 0)
+                return;
+        }
+
+        send_completed_replies();
+    }
+}
+
+// Replies that can no longer be sent, for when this server goes away with requests in flight
+void mp::SftpServer::discard_pending_replies()
+{
+    std::unique_lock<std::mutex> lock{replies_mutex};
+    replies_cv.wait(lock, [this] { return completed_replies.size() == pending_replies; });
+
+    for (auto& entry : completed_replies)
+        sftp_client_message_free(entry.msg);
+
+    completed_replies.clear();
+    pending_replies = 0;
+}
+
+void mp::SftpServer::flush_pending_writes()
+{
+    for (auto& entry : open_file_handles)
+        entry.second->flush_deferring_error();
+}
+
+// Writes buffered through any handle of the file become visible to requests naming it by path or through another
+// handle. Those are all served by the same worker, see ordering_key_for(), while the paths never change.
+void mp::SftpServer::flush_pending_writes_to(std::string_view path)
+{
+    for (auto& entry : open_file_handles)
+    {
+        auto& open_file = *entry.second;
+        if (open_file.path() == path && open_file.has_pending_writes())
+            open_file.flush_deferring_error();
+    }
+}
+
+// Requests on the same file must be served in the order they were sent, whether they name it by path or through
+// any of its handles, so they all go to the same worker
+std::size_t mp::SftpServer::ordering_key_for(sftp_client_message msg)
+{
+    const auto type = sftp_client_message_get_type(msg);
+    if (type == SFTP_STAT || type == SFTP_LSTAT)
+        return std::hash<std::string_view>{}(sftp_client_message_get_filename(msg));
+
+    auto open_file = handle_from(msg, open_file_handles);
+    return open_file ? std::hash<std::string_view>{}(open_file->path()) : 0u;
+}
+
+mp::SftpServer::Reply mp::SftpServer::prepare_pipelined(sftp_client_message msg)
 {
-    using MsgUPtr = std::unique_ptr<sftp_client_message_struct, decltype(sftp_client_message_free)*>;
+    const auto type = sftp_client_message_get_type(msg);
+    switch (type)
+    {
+    case SFTP_READ:
+        return prepare_read(msg);
+    case SFTP_WRITE:
+        return prepare_write(msg);
+    case SFTP_FSTAT:
+        return prepare_fstat(msg);
+    case SFTP_LSTAT:
+    case SFTP_STAT:
+        return prepare_stat(msg, type == SFTP_STAT);
+    default:
+        return [msg] { return reply_unsupported(msg); };
+    }
+}
 
+void mp::SftpServer::run()
+{
     while (true)
     {
-        MsgUPtr client_msg{sftp_get_client_message(sftp_server_session.get()), sftp_client_message_free};
-        auto msg = client_msg.get();
-        if (msg == nullptr)
+        if (worker_pool && !client_message_ready())
+            continue;
+
+        if (!serve_next_message())
+            break;
+    }
+
+    finish();
+}
+
+bool mp::SftpServer::serve_ready_messages()
+{
+    if (worker_pool)
+        send_completed_replies();
+
+    for (auto i = 0; i < max_messages_per_turn; ++i)
+    {
+        if (!stop_invoked && ssh_channel_poll(sftp_server_session->channel, 0) == 0)
+            return true;
+
+        if (!serve_next_message())
         {
-            if (stop_invoked)
-                break;
-
-            int status{0};
-            try
-            {
-                status = sshfs_process->exit_code(250ms);
-            }
-            catch (const mp::ExitlessSSHProcessException&)
-            {
-                status = 1;
-            }
-
-            if (status != 0)
-            {
-                mpl::log(mpl::Level::error, category,
-                         "sshfs in the instance appears to have exited unexpectedly.  Trying to recover.");
-                auto proc = ssh_session.exec(fmt::format("findmnt --source :{}  -o TARGET -n", source_path));
-                auto mount_path = proc.read_std_output();
-                if (!mount_path.empty())
-                {
-                    ssh_session.exec(fmt::format("sudo umount {}", mount_path));
-                }
-
-                sshfs_process =
-                    create_sshfs_process(ssh_session, sshfs_exec_line, mp::utils::escape_char(source_path, '"'),
-                                         mp::utils::escape_char(target_path, '"'));
-                sftp_server_session = make_sftp_session(ssh_session, sshfs_process->release_channel());
-
-                continue;
-            }
-            else
-            {
-                break;
-            }
+            finish();
+            return false;
         }
+    }
 
-        process_message(msg);
+    return true;
+}
+
+ssh_channel mp::SftpServer::channel() const
+{
+    return sftp_server_session->channel;
+}
+
+std::shared_ptr<const mp::SftpMetrics> mp::SftpServer::metrics() const
+{
+    return request_metrics;
+}
+
+void mp::SftpServer::close()
+{
+    stop_invoked = true;
+    if (worker_pool)
+        wait_for_pending_replies();
+
+    finish();
+
+    // Closing the channel makes sshfs in the instance exit, which unmounts the target
+    sftp_server_session.reset();
+}
+
+bool mp::SftpServer::serve_next_message()
+{
+    MsgUPtr client_msg{sftp_get_client_message(sftp_server_session.get()), sftp_client_message_free};
+    auto msg = client_msg.get();
+    if (msg == nullptr)
+    {
+        if (worker_pool)
+            wait_for_pending_replies();
+
+        if (stop_invoked)
+            return false;
+
+        int status{0};
+        try
+        {
+            status = sshfs_process->exit_code(250ms);
+        }
+        catch (const mp::ExitlessSSHProcessException&)
+        {
+            status = 1;
+        }
+
+        if (status == 0)
+            return false;
+
+        mpl::log(mpl::Level::error, category,
+                 "sshfs in the instance appears to have exited unexpectedly.  Trying to recover.");
+        auto proc = ssh_session->exec(fmt::format("findmnt --source :{}  -o TARGET -n", source_path));
+        auto mount_path = proc.read_std_output();
+        if (!mount_path.empty())
+        {
+            ssh_session->exec(fmt::format("sudo umount {}", mount_path));
+        }
+
+        sshfs_process = create_sshfs_process(*ssh_session, sshfs_exec_line, mp::utils::escape_char(source_path, '"'),
+                                             mp::utils::escape_char(target_path, '"'));
+        sftp_server_session = make_sftp_session(*ssh_session, sshfs_process->release_channel());
+
+        return true;
     }
+
+    if (worker_pool && is_pipelined(sftp_client_message_get_type(msg)))
+    {
+        dispatch(std::move(client_msg));
+        return true;
+    }
+
+    // Anything else may change the set of open handles or refer to files by name, so let the workers
+    // finish first and make buffered writes visible
+    if (worker_pool)
+        wait_for_pending_replies();
+
+    if (!is_pipelined(sftp_client_message_get_type(msg)))
+        flush_pending_writes();
+
+    const auto received = std::chrono::steady_clock::now();
+    const auto operation = SftpMetrics::operation_for(sftp_client_message_get_type(msg));
+    process_message(msg);
+    request_metrics->record(operation, std::chrono::steady_clock::now() - received);
+
+    return true;
+}
+
+void mp::SftpServer::finish()
+{
+    flush_pending_writes();
+
+    const auto snapshot = request_metrics->snapshot();
+    mpl::log(mpl::Level::info, category,
+             fmt::format("served {} requests for \"{}\": {} bytes read, {} bytes written", request_metrics->requests(),
+                         target_path, snapshot.bytes_read, snapshot.bytes_written));
 }
 
 void mp::SftpServer::stop()
 {
     stop_invoked = true;
-    ssh_session.force_shutdown();
+    ssh_session->force_shutdown();
 }
 
 int mp::SftpServer::handle_close(sftp_client_message msg)
 {
     const auto id = sftp_handle(sftp_server_session.get(), msg->handle);
 
-    auto erased = open_file_handles.erase(id);
-    erased += open_dir_handles.erase(id);
-    if (erased == 0)
+    auto entry = open_file_handles.find(id);
+    if (entry != open_file_handles.end())
+    {
+        auto& open_file = *entry->second;
+        const auto write_failed = open_file.take_deferred_error() != 0 || !open_file.flush();
+
+        open_file_handles.erase(entry);
+        sftp_handle_remove(sftp_server_session.get(), id);
+        return write_failed ? reply_failure(msg) : reply_ok(msg);
+    }
+
+    if (open_dir_handles.erase(id) == 0)
         return reply_bad_handle(msg, "close");
 
     sftp_handle_remove(sftp_server_session.get(), id);
@@ -472,17 +959,23 @@ int mp::SftpServer::handle_close(sftp_client_message msg)
 
 int mp::SftpServer::handle_fstat(sftp_client_message msg)
 {
-    auto file = handle_from(msg, open_file_handles);
-    if (file == nullptr)
-        return reply_bad_handle(msg, "fstat");
+    return prepare_fstat(msg)();
+}
+
+mp::SftpServer::Reply mp::SftpServer::prepare_fstat(sftp_client_message msg)
+{
+    auto open_file = handle_from(msg, open_file_handles);
+    if (open_file == nullptr)
+        return [msg] { return reply_bad_handle(msg, "fstat"); };
 
-    QFileInfo file_info(*file);
+    flush_pending_writes_to(open_file->path());
+    QFileInfo file_info(open_file->file());
 
     if (file_info.isSymLink())
         file_info = QFileInfo(file_info.symLinkTarget());
 
     auto attr = attr_from(file_info);
-    return sftp_reply_attr(msg, &attr);
+    return [msg, attr]() mutable { return sftp_reply_attr(msg, &attr); };
 }
 
 int mp::SftpServer::handle_mkdir(sftp_client_message msg)
@@ -555,16 +1048,17 @@ int mp::SftpServer::handle_open(sftp_client_message msg)
     if (flags & SSH_FXF_TRUNC)
         mode |= QIODevice::Truncate;
 
-    auto file = std::make_unique<QFile>(filename);
+    auto open_file = std::make_unique<SftpOpenFile>(filename);
+    auto& file = open_file->file();
 
-    auto exists = QFileInfo(filename).isSymLink() || file->exists();
+    auto exists = QFileInfo(filename).isSymLink() || file.exists();
 
-    if (!file->open(mode))
+    if (!file.open(mode))
         return reply_failure(msg);
 
     if (!exists)
     {
-        if (!file->setPermissions(to_qt_permissions(msg->attr->permissions)))
+        if (!file.setPermissions(to_qt_permissions(msg->attr->permissions)))
             return reply_failure(msg);
 
         QFileInfo current_file(filename);
@@ -579,8 +1073,8 @@ int mp::SftpServer::handle_open(sftp_client_message msg)
         }
     }
 
-    SftpHandleUPtr sftp_handle{sftp_handle_alloc(sftp_server_session.get(), file.get()), ssh_string_free};
-    open_file_handles.emplace(file.get(), std::move(file));
+    SftpHandleUPtr sftp_handle{sftp_handle_alloc(sftp_server_session.get(), open_file.get()), ssh_string_free};
+    open_file_handles.emplace(open_file.get(), std::move(open_file));
 
     return sftp_reply_handle(msg, sftp_handle.get());
 }
@@ -591,74 +1085,81 @@ int mp::SftpServer::handle_opendir(sftp_client_message msg)
     if (!validate_path(source_path, filename))
         return reply_perm_denied(msg);
 
-    QDir dir(filename);
-    if (!dir.exists())
-        return sftp_reply_status(msg, SSH_FX_NO_SUCH_FILE, "no such directory");
+    auto dir = SftpOpenDir::open(filename);
+    if (dir == nullptr)
+    {
+        if (errno == ENOENT || errno == ENOTDIR)
+            return sftp_reply_status(msg, SSH_FX_NO_SUCH_FILE, "no such directory");
 
-    if (!dir.isReadable())
-        return reply_perm_denied(msg);
+        if (errno == EACCES)
+            return reply_perm_denied(msg);
 
-    auto entry_list =
-        std::make_unique<QFileInfoList>(dir.entryInfoList(QDir::AllEntries | QDir::System | QDir::Hidden));
+        return reply_failure(msg);
+    }
 
-    SftpHandleUPtr sftp_handle{sftp_handle_alloc(sftp_server_session.get(), entry_list.get()), ssh_string_free};
-    open_dir_handles.emplace(entry_list.get(), std::move(entry_list));
+    SftpHandleUPtr sftp_handle{sftp_handle_alloc(sftp_server_session.get(), dir.get()), ssh_string_free};
+    open_dir_handles.emplace(dir.get(), std::move(dir));
 
     return sftp_reply_handle(msg, sftp_handle.get());
 }
 
 int mp::SftpServer::handle_read(sftp_client_message msg)
 {
-    auto file = handle_from(msg, open_file_handles);
-    if (file == nullptr)
-        return reply_bad_handle(msg, "read");
+    return prepare_read(msg)();
+}
+
+mp::SftpServer::Reply mp::SftpServer::prepare_read(sftp_client_message msg)
+{
+    auto open_file = handle_from(msg, open_file_handles);
+    if (open_file == nullptr)
+        return [msg] { return reply_bad_handle(msg, "read"); };
 
-    const auto max_packet_size = 65536u;
-    const auto len = std::min(msg->len, max_packet_size);
+    if (open_file_handles.size() > 1)
+        flush_pending_writes_to(open_file->path());
 
-    std::vector<char> data;
-    data.reserve(len);
+    auto buffer = read_buffers->acquire();
+    const auto len = std::min<std::size_t>(msg->len, buffer->size());
 
-    file->seek(msg->offset);
-    auto r = file->read(data.data(), len);
+    auto r = open_file->read(buffer->data(), len, msg->offset);
     if (r < 0)
-        return sftp_reply_status(msg, SSH_FX_FAILURE, file->errorString().toStdString().c_str());
+        return [msg, error = std::string{std::strerror(errno)}] {
+            return sftp_reply_status(msg, SSH_FX_FAILURE, error.c_str());
+        };
     else if (r == 0)
-        return sftp_reply_status(msg, SSH_FX_EOF, "End of file");
+        return [msg] { return sftp_reply_status(msg, SSH_FX_EOF, "End of file"); };
+
+    request_metrics->add_bytes_read(r);
 
-    return sftp_reply_data(msg, data.data(), r);
+    // The buffer goes back to the pool once the reply has been sent
+    return [msg, buffer, r] { return sftp_reply_data(msg, buffer->data(), r); };
 }
 
 int mp::SftpServer::handle_readdir(sftp_client_message msg)
 {
-    auto dir_entries = handle_from(msg, open_dir_handles);
-    if (dir_entries == nullptr)
+    auto dir = handle_from(msg, open_dir_handles);
+    if (dir == nullptr)
         return reply_bad_handle(msg, "readdir");
 
-    if (dir_entries->empty())
+    auto entry = dir->peek();
+    if (entry == nullptr)
         return sftp_reply_status(msg, SSH_FX_EOF, nullptr);
 
-    const auto max_num_entries_per_packet = 50;
-    const auto num_entries = std::min(dir_entries->size(), max_num_entries_per_packet);
-
-    for (int i = 0; i < num_entries; i++)
+    // Send as many entries as fit in a reply, the client keeps asking until it gets EOF
+    std::size_t reply_size{0};
+    int num_entries{0};
+    do
     {
-        const QFileInfo entry = dir_entries->takeFirst();
-        const auto filename = entry.fileName().toStdString();
-        sftp_attributes_struct attr{};
-        if (entry.isSymLink())
-        {
-            mp::platform::symlink_attr_from(entry.absoluteFilePath().toStdString().c_str(), &attr);
-            attr.uid = mapped_uid_for(attr.uid);
-            attr.gid = mapped_gid_for(attr.gid);
-        }
-        else
-        {
-            attr = attr_from(entry);
-        }
-        const auto longname = longname_from(entry, filename);
-        sftp_reply_names_add(msg, filename.c_str(), longname.data(), &attr);
-    }
+        const auto longname = longname_from(entry->st, entry->name);
+        reply_size += entry->name.size() + longname.size() + readdir_entry_overhead;
+        if (num_entries > 0 && reply_size > max_readdir_reply_size)
+            break;
+
+        auto attr = attr_from(entry->st);
+        sftp_reply_names_add(msg, entry->name.c_str(), longname.c_str(), &attr);
+        ++num_entries;
+
+        dir->pop();
+    } while ((entry = dir->peek()) != nullptr);
 
     return sftp_reply_names(msg);
 }
@@ -733,7 +1234,7 @@ int mp::SftpServer::handle_setstat(sftp_client_message msg)
         auto handle = handle_from(msg, open_file_handles);
         if (handle == nullptr)
             return reply_bad_handle(msg, "setstat");
-        filename = handle->fileName();
+        filename = handle->file().fileName();
     }
     else
     {
@@ -773,32 +1274,54 @@ int mp::SftpServer::handle_setstat(sftp_client_message msg)
 }
 
 int mp::SftpServer::handle_stat(sftp_client_message msg, const bool follow)
+{
+    return prepare_stat(msg, follow)();
+}
+
+mp::SftpServer::Reply mp::SftpServer::prepare_stat(sftp_client_message msg, const bool follow)
 {
     auto filename = sftp_client_message_get_filename(msg);
     if (!validate_path(source_path, filename))
-        return reply_perm_denied(msg);
+        return [msg] { return reply_perm_denied(msg); };
 
-    QFileInfo file_info(filename);
-    if (!file_info.isSymLink() && !file_info.exists())
-        return sftp_reply_status(msg, SSH_FX_NO_SUCH_FILE, "no such file");
+    flush_pending_writes_to(filename);
 
-    sftp_attributes_struct attr{};
+    SftpAttrCache::Entry entry;
+    const auto cached = attr_cache && attr_cache->lookup(filename, follow, entry);
+    if (attr_cache)
+        request_metrics->add_attr_cache_lookup(cached);
 
-    if (!follow && file_info.isSymLink())
-    {
-        mp::platform::symlink_attr_from(filename, &attr);
-        attr.uid = mapped_uid_for(attr.uid);
-        attr.gid = mapped_gid_for(attr.gid);
-    }
-    else
+    if (!cached)
     {
-        if (file_info.isSymLink())
-            file_info = QFileInfo(file_info.symLinkTarget());
+        const auto generation = attr_cache ? attr_cache->generation() : 0u;
+
+        QFileInfo file_info(filename);
+        const auto is_symlink = file_info.isSymLink();
+        entry.exists = is_symlink || file_info.exists();
 
-        attr = attr_from(file_info);
+        if (entry.exists && !follow && is_symlink)
+        {
+            mp::platform::symlink_attr_from(filename, &entry.attr);
+            entry.attr.uid = mapped_uid_for(entry.attr.uid);
+            entry.attr.gid = mapped_gid_for(entry.attr.gid);
+        }
+        else if (entry.exists)
+        {
+            if (is_symlink)
+                file_info = QFileInfo(file_info.symLinkTarget());
+
+            entry.attr = attr_from(file_info);
+        }
+
+        // Link targets are not watched, so what a followed link points to is never cached
+        if (attr_cache && !(follow && is_symlink))
+            attr_cache->insert(filename, follow, entry, generation);
     }
 
-    return sftp_reply_attr(msg, &attr);
+    if (!entry.exists)
+        return [msg] { return sftp_reply_status(msg, SSH_FX_NO_SUCH_FILE, "no such file"); };
+
+    return [msg, attr = entry.attr]() mutable { return sftp_reply_attr(msg, &attr); };
 }
 
 int mp::SftpServer::handle_symlink(sftp_client_message msg)
@@ -828,28 +1351,22 @@ int mp::SftpServer::handle_symlink(sftp_client_message msg)
 
 int mp::SftpServer::handle_write(sftp_client_message msg)
 {
-    auto file = handle_from(msg, open_file_handles);
-    if (file == nullptr)
-        return reply_bad_handle(msg, "write");
+    return prepare_write(msg)();
+}
+
+mp::SftpServer::Reply mp::SftpServer::prepare_write(sftp_client_message msg)
+{
+    auto open_file = handle_from(msg, open_file_handles);
+    if (open_file == nullptr)
+        return [msg] { return reply_bad_handle(msg, "write"); };
 
     auto len = ssh_string_len(msg->data);
     auto data_ptr = ssh_string_get_char(msg->data);
-    if (!file->seek(msg->offset))
-        return reply_failure(msg);
+    if (open_file->take_deferred_error() != 0 || !open_file->write(msg->offset, data_ptr, len))
+        return [msg] { return reply_failure(msg); };
 
-    do
-    {
-        auto r = file->write(data_ptr, len);
-        if (r < 0)
-            return reply_failure(msg);
-
-        file->flush();
-
-        data_ptr += r;
-        len -= r;
-    } while (len > 0);
-
-    return reply_ok(msg);
+    request_metrics->add_bytes_written(len);
+    return [msg] { return reply_ok(msg); };
 }
 
 int mp::SftpServer::handle_extended(sftp_client_message msg)
@@ -874,6 +1391,23 @@ int mp::SftpServer::handle_extended(sftp_client_message msg)
     {
         return handle_rename(msg);
     }
+    else if (method == "fsync@openssh.com")
+    {
+        return handle_fsync(msg);
+    }
+    else if (method == "copy-data")
+    {
+        return handle_copy_data(msg);
+    }
+    else if (method == "statvfs@openssh.com")
+    {
+        return handle_statvfs(msg);
+    }
+    else if (method == "limits@openssh.com")
+    {
+        // Maximum packet, read and write lengths, no limit on open handles
+        return reply_extended(msg, {max_read_size + max_packet_overhead, max_read_size, max_read_size, 0u});
+    }
     else
     {
         return reply_unsupported(msg);
@@ -881,3 +1415,82 @@ int mp::SftpServer::handle_extended(sftp_client_message msg)
 
     return reply_ok(msg);
 }
+
+int mp::SftpServer::handle_fsync(sftp_client_message msg)
+{
+    std::string handle;
+    if (!ExtensionArgs{msg}.read_string(handle))
+        return sftp_reply_status(msg, SSH_FX_BAD_MESSAGE, "fsync: missing handle");
+
+    auto open_file = open_file_from(handle);
+    if (open_file == nullptr)
+        return reply_bad_handle(msg, "fsync");
+
+    if (open_file->take_deferred_error() != 0 || !open_file->fsync())
+        return reply_failure(msg);
+
+    return reply_ok(msg);
+}
+
+int mp::SftpServer::handle_copy_data(sftp_client_message msg)
+{
+    ExtensionArgs args{msg};
+    std::string read_handle, write_handle;
+    uint64_t read_offset, read_length, write_offset;
+    if (!args.read_string(read_handle) || !args.read_u64(read_offset) || !args.read_u64(read_length) ||
+        !args.read_string(write_handle) || !args.read_u64(write_offset))
+        return sftp_reply_status(msg, SSH_FX_BAD_MESSAGE, "copy-data: malformed request");
+
+    auto source = open_file_from(read_handle);
+    auto destination = open_file_from(write_handle);
+    if (source == nullptr || destination == nullptr)
+        return reply_bad_handle(msg, "copy-data");
+
+    if (source == destination)
+    {
+        // Writes that fail to go out are dropped, so the copy must not go ahead as if they had
+        if (read_length == 0 && !source->flush())
+            return reply_failure(msg);
+
+        if (copy_ranges_overlap(*source, read_offset, read_length, write_offset))
+            return sftp_reply_status(msg, SSH_FX_FAILURE, "copy-data: overlapping ranges");
+    }
+
+    if (destination->take_deferred_error() != 0 ||
+        !source->copy_to(read_offset, read_length, *destination, write_offset))
+        return reply_failure(msg);
+
+    return reply_ok(msg);
+}
+
+int mp::SftpServer::handle_statvfs(sftp_client_message msg)
+{
+    std::string path;
+    if (!ExtensionArgs{msg}.read_string(path))
+        return sftp_reply_status(msg, SSH_FX_BAD_MESSAGE, "statvfs: missing path");
+
+    if (!validate_path(source_path, path))
+        return reply_perm_denied(msg);
+
+    struct statvfs st;
+    if (::statvfs(path.c_str(), &st) != 0)
+        return sftp_reply_status(msg, errno == ENOENT ? SSH_FX_NO_SUCH_FILE : SSH_FX_FAILURE, std::strerror(errno));
+
+    const uint64_t flags =
+        ((st.f_flag & ST_RDONLY) ? statvfs_read_only : 0u) | ((st.f_flag & ST_NOSUID) ? statvfs_no_suid : 0u);
+
+    return reply_extended(msg, {st.f_bsize, st.f_frsize, st.f_blocks, st.f_bfree, st.f_bavail, st.f_files, st.f_ffree,
+                                st.f_favail, st.f_fsid, flags, st.f_namemax});
+}
+
+mp::SftpOpenFile* mp::SftpServer::open_file_from(const std::string& handle)
+{
+    SftpHandleUPtr handle_string{ssh_string_new(handle.size()), ssh_string_free};
+    ssh_string_fill(handle_string.get(), handle.data(), handle.size());
+
+    auto entry = open_file_handles.find(sftp_handle(sftp_server_session.get(), handle_string.get()));
+    if (entry == open_file_handles.end())
+        return nullptr;
+
+    return entry->second.get();
+}
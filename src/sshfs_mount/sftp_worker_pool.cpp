@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "sftp_worker_pool.h"
+
+#include <multipass/format.h>
+#include <multipass/logging/log.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+
+namespace
+{
+constexpr auto category = "sftp server";
+
+void make_pipe(int (&fds)[2])
+{
+    if (::pipe(fds) != 0)
+        throw std::runtime_error(fmt::format("cannot create pipe for the sftp workers: {}", std::strerror(errno)));
+
+    for (auto fd : fds)
+    {
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+}
+} // namespace
+
+mp::SftpWorkerPool::SftpWorkerPool(int num_workers)
+{
+    make_pipe(finished_pipe);
+
+    for (int i = 0; i < std::max(num_workers, 1); ++i)
+    {
+        auto worker = std::make_unique<Worker>();
+        worker->thread = std::thread{&SftpWorkerPool::work, this, std::ref(*worker)};
+        workers.push_back(std::move(worker));
+    }
+}
+
+mp::SftpWorkerPool::~SftpWorkerPool()
+{
+    for (auto& worker : workers)
+    {
+        {
+            std::lock_guard<std::mutex> lock{worker->mutex};
+            worker->stop = true;
+        }
+        worker->cv.notify_one();
+    }
+
+    for (auto& worker : workers)
+    {
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+
+    ::close(finished_pipe[0]);
+    ::close(finished_pipe[1]);
+}
+
+void mp::SftpWorkerPool::submit(std::size_t key, Job job)
+{
+    auto& worker = *workers[key % workers.size()];
+    {
+        std::lock_guard<std::mutex> lock{worker.mutex};
+        worker.jobs.push_back(std::move(job));
+    }
+    worker.cv.notify_one();
+}
+
+std::size_t mp::SftpWorkerPool::size() const
+{
+    return workers.size();
+}
+
+int mp::SftpWorkerPool::finished_fd() const
+{
+    return finished_pipe[0];
+}
+
+// Drains before re-arming: a job finishing in between then finds the flag still set and writes nothing, but its reply
+// is already there for the caller, which looks for replies after this. Re-arming first could swallow the byte of a job
+// finishing in between, leaving the flag set over an empty pipe and no later job able to wake the caller.
+void mp::SftpWorkerPool::clear_finished()
+{
+    char buffer[64];
+    while (::read(finished_pipe[0], buffer, sizeof(buffer)) > 0)
+        ;
+
+    finished_signalled = false;
+}
+
+// A single byte in the pipe is enough to wake the waiting thread, however many jobs finish before it looks
+void mp::SftpWorkerPool::signal_finished()
+{
+    if (finished_signalled.exchange(true))
+        return;
+
+    const char byte{0};
+    while (::write(finished_pipe[1], &byte, 1) < 0 && errno == EINTR)
+        ;
+}
+
+void mp::SftpWorkerPool::work(Worker& worker)
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock{worker.mutex};
+            worker.cv.wait(lock, [&worker] { return worker.stop || !worker.jobs.empty(); });
+
+            // Finish whatever was queued before stopping, so that no request is left without a reply
+            if (worker.jobs.empty())
+                return;
+
+            job = std::move(worker.jobs.front());
+            worker.jobs.pop_front();
+        }
+
+        try
+        {
+            job();
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::error, category, fmt::format("worker job failed: {}", e.what()));
+        }
+
+        signal_finished();
+    }
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef MULTIPASS_SFTP_WORKER_POOL_H
+#define MULTIPASS_SFTP_WORKER_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace multipass
+{
+// A fixed set of worker threads, each with its own queue. Jobs submitted with the same key always land on
+// the same worker, so they run one after the other in submission order.
+class SftpWorkerPool
+{
+public:
+    using Job = std::function<void()>;
+
+    explicit SftpWorkerPool(int num_workers);
+    ~SftpWorkerPool();
+
+    SftpWorkerPool(const SftpWorkerPool&) = delete;
+    SftpWorkerPool& operator=(const SftpWorkerPool&) = delete;
+
+    void submit(std::size_t key, Job job);
+    std::size_t size() const;
+
+    // Becomes readable when a job finishes, so that a thread can wait on it alongside its sockets.
+    // It stays readable until clear_finished() is called.
+    int finished_fd() const;
+    void clear_finished();
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<Job> jobs;
+        bool stop{false};
+        std::thread thread;
+    };
+
+    void work(Worker& worker);
+    void signal_finished();
+
+    int finished_pipe[2];
+    std::atomic<bool> finished_signalled{false};
+    std::vector<std::unique_ptr<Worker>> workers;
+};
+} // namespace multipass
+#endif // MULTIPASS_SFTP_WORKER_POOL_H
@@ -23,18 +23,34 @@
 #include <multipass/sshfs_mount/sshfs_mount.h>
 #include <multipass/utils.h>
 
+#include "sftp_buffer_pool.h"
+#include "sftp_metrics.h"
+#include "sftp_worker_pool.h"
+
 #include <semver200.h>
 
 #include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QString>
+
+#include <algorithm>
 #include <iostream>
 
+#include <poll.h>
+
 namespace mp = multipass;
 namespace mpl = multipass::logging;
 
 namespace
 {
 constexpr auto category = "sshfs mount";
+constexpr auto max_read_size = 256u * 1024u;
+constexpr auto idle_poll_interval = std::chrono::milliseconds(100);
+constexpr auto metrics_report_interval = std::chrono::seconds(5);
+constexpr auto default_cache_timeout = 3;   // seconds
+constexpr auto readonly_cache_timeout = 60; // seconds
+constexpr auto readonly_max_read = 128u * 1024u;
 const std::string fuse_version_string{"FUSE library version"};
 const std::string ld_library_path_key{"LD_LIBRARY_PATH="};
 const std::string snap_path_key{"SNAP="};
@@ -50,7 +66,13 @@ auto run_cmd(mp::SSHSession& session, std::string&& cmd)
     return ssh_process.read_std_output() + ssh_process.read_std_error();
 }
 
-auto get_sshfs_exec_and_options(mp::SSHSession& session)
+struct SshfsExec
+{
+    std::string exec_line;
+    std::string cache_timeout_option; // renamed in libfuse 3.0, empty if the version is unknown
+};
+
+SshfsExec get_sshfs_exec_and_options(mp::SSHSession& session)
 {
     std::string sshfs_exec;
 
@@ -88,6 +110,7 @@ auto get_sshfs_exec_and_options(mp::SSHSession& session)
     auto version_info{run_cmd(session, fmt::format("sudo {} -V", sshfs_exec))};
 
     sshfs_exec += " -o slave -o transform_symlinks -o allow_other -o Compression=no";
+    std::string cache_timeout_option;
 
     auto fuse_version_line = mp::utils::match_line_for(version_info, fuse_version_string);
     if (!fuse_version_line.empty())
@@ -107,11 +130,12 @@ auto get_sshfs_exec_and_options(mp::SSHSession& session)
         // The option was made the default in libfuse 3.0
         else if (version::Semver200_version(fuse_version) < version::Semver200_version("3.0.0"))
         {
-            sshfs_exec += " -o nonempty -o cache_timeout=3";
+            sshfs_exec += " -o nonempty";
+            cache_timeout_option = "cache_timeout";
         }
         else
         {
-            sshfs_exec += " -o dcache_timeout=3";
+            cache_timeout_option = "dcache_timeout";
         }
     }
     else
@@ -119,7 +143,33 @@ auto get_sshfs_exec_and_options(mp::SSHSession& session)
         mpl::log(mpl::Level::warning, category, fmt::format("Unable to retrieve \'{}\'", fuse_version_string));
     }
 
-    return sshfs_exec;
+    return {sshfs_exec, cache_timeout_option};
+}
+
+std::string sshfs_exec_line_for(const SshfsExec& sshfs_exec, mp::VMMount::MountProfile profile)
+{
+    auto exec_line = sshfs_exec.exec_line;
+    auto add_cache_timeout = [&exec_line, &sshfs_exec](int timeout) {
+        if (!sshfs_exec.cache_timeout_option.empty())
+            exec_line += fmt::format(" -o {}={}", sshfs_exec.cache_timeout_option, timeout);
+    };
+
+    switch (profile)
+    {
+    case mp::VMMount::MountProfile::ReadonlyCached:
+        // auto_cache keeps file contents cached across opens for as long as the size and mtime are unchanged
+        exec_line += fmt::format(" -o ro -o auto_cache -o max_read={}", readonly_max_read);
+        add_cache_timeout(readonly_cache_timeout);
+        break;
+    case mp::VMMount::MountProfile::Strict:
+        exec_line += " -o cache=no -o entry_timeout=0 -o attr_timeout=0";
+        break;
+    default:
+        add_cache_timeout(default_cache_timeout);
+        break;
+    }
+
+    return exec_line;
 }
 
 // Split a path into existing and to-be-created parts.
@@ -167,48 +217,97 @@ void set_owner_for(mp::SSHSession& session, const std::string& root, const std::
                                  relative_target.substr(0, relative_target.find_first_of('/'))));
 }
 
-auto make_sftp_server(mp::SSHSession&& session, const std::string& source, const std::string& target,
-                      const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map)
+int instance_id(mp::SSHSession& session, const std::string& option)
 {
+    auto output = run_cmd(session, fmt::format("id -{}", option));
     mpl::log(mpl::Level::debug, category,
-             fmt::format("{}:{} {}(source = {}, target = {}, …): ", __FILE__, __LINE__, __FUNCTION__, source, target));
+             fmt::format("{}:{} {}(): `id -{}` = {}", __FILE__, __LINE__, __FUNCTION__, option, output));
+    return std::stoi(output);
+}
 
-    auto sshfs_exec_line = get_sshfs_exec_and_options(session);
+std::shared_ptr<mp::SftpWorkerPool> make_worker_pool(int worker_threads)
+{
+    if (worker_threads <= 0)
+        return nullptr;
 
-    // Split the path in existing and missing parts.
-    const auto& [leading, missing] = get_path_split(session, target);
+    return std::make_shared<mp::SftpWorkerPool>(worker_threads);
+}
 
-    auto output = run_cmd(session, "id -u");
-    mpl::log(mpl::Level::debug, category,
-             fmt::format("{}:{} {}(): `id -u` = {}", __FILE__, __LINE__, __FUNCTION__, output));
-    auto default_uid = std::stoi(output);
+auto make_sftp_servers(const std::shared_ptr<mp::SSHSession>& session,
+                       const std::vector<mp::SshfsMount::Target>& targets,
+                       const std::shared_ptr<mp::SftpWorkerPool>& worker_pool, int worker_threads,
+                       bool cache_attributes)
+{
+    auto sshfs_exec = get_sshfs_exec_and_options(*session);
+    auto default_uid = instance_id(*session, "u");
+    auto default_gid = instance_id(*session, "g");
 
-    output = run_cmd(session, "id -g");
-    mpl::log(mpl::Level::debug, category,
-             fmt::format("{}:{} {}(): `id -g` = {}", __FILE__, __LINE__, __FUNCTION__, output));
-    auto default_gid = std::stoi(output);
+    // All the mounts share the workers and their read buffers
+    auto read_buffers = std::make_shared<mp::SftpBufferPool>(max_read_size, mp::max_outstanding_sftp_reads);
 
-    // We need to create the part of the path which does not still exist,
-    // and set then the correct ownership.
-    if (missing != ".")
+    std::unordered_map<std::string, std::unique_ptr<mp::SftpServer>> sftp_servers;
+    for (const auto& target : targets)
     {
-        make_target_dir(session, leading, missing);
-        set_owner_for(session, leading, missing, default_uid, default_gid);
+        mpl::log(mpl::Level::debug, category,
+                 fmt::format("{}:{} {}(source = {}, target = {}, …): ", __FILE__, __LINE__, __FUNCTION__,
+                             target.source, target.target));
+
+        // Split the path in existing and missing parts.
+        const auto& [leading, missing] = get_path_split(*session, target.target);
+
+        // We need to create the part of the path which does not still exist,
+        // and set then the correct ownership.
+        if (missing != ".")
+        {
+            make_target_dir(*session, leading, missing);
+            set_owner_for(*session, leading, missing, default_uid, default_gid);
+        }
+
+        // Nothing is written through a read-only mount, so the attributes it is served can always be cached
+        const auto cache_target_attributes =
+            cache_attributes || target.profile == mp::VMMount::MountProfile::ReadonlyCached;
+        sftp_servers.emplace(
+            target.target, std::make_unique<mp::SftpServer>(session, worker_pool, read_buffers, target.source,
+                                                            leading + missing, target.gid_map, target.uid_map,
+                                                            default_uid, default_gid,
+                                                            sshfs_exec_line_for(sshfs_exec, target.profile),
+                                                            cache_target_attributes));
     }
 
-    return std::make_unique<mp::SftpServer>(std::move(session), source, leading + missing, gid_map, uid_map,
-                                            default_uid, default_gid, sshfs_exec_line);
+    return sftp_servers;
+}
+
+auto metrics_of(const std::unordered_map<std::string, std::unique_ptr<mp::SftpServer>>& sftp_servers)
+{
+    std::unordered_map<std::string, std::shared_ptr<const mp::SftpMetrics>> target_metrics;
+    for (const auto& entry : sftp_servers)
+        target_metrics.emplace(entry.first, entry.second->metrics());
+
+    return target_metrics;
 }
 
 } // namespace
 
 mp::SshfsMount::SshfsMount(SSHSession&& session, const std::string& source, const std::string& target,
-                           const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map)
-    : sftp_server{make_sftp_server(std::move(session), source, target, gid_map, uid_map)}, sftp_thread{[this] {
-          std::cout << "Connected" << std::endl;
-          sftp_server->run();
-          std::cout << "Stopped" << std::endl;
-      }}
+                           const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map,
+                           int worker_threads, bool cache_attributes)
+    : SshfsMount{std::move(session), {{source, target, gid_map, uid_map}}, worker_threads, cache_attributes}
+{
+}
+
+mp::SshfsMount::SshfsMount(SSHSession&& session, const std::vector<Target>& targets, int worker_threads,
+                           bool cache_attributes)
+    : ssh_session{std::make_shared<SSHSession>(std::move(session))},
+      worker_pool{make_worker_pool(worker_threads)},
+      sftp_servers{make_sftp_servers(ssh_session, targets, worker_pool, worker_threads, cache_attributes)},
+      single_target{sftp_servers.size() == 1},
+      target_metrics{metrics_of(sftp_servers)},
+      sftp_thread{[this] {
+          print_line("Connected");
+          serve();
+          print_line("Stopped");
+      }},
+      metrics_thread{[this] { report_metrics(); }}
 {
 }
 
@@ -219,7 +318,130 @@ mp::SshfsMount::~SshfsMount()
 
 void mp::SshfsMount::stop()
 {
-    sftp_server->stop();
+    {
+        std::lock_guard<std::mutex> lock{metrics_mutex};
+        stop_invoked = true;
+    }
+    metrics_cv.notify_all();
+
+    if (metrics_thread.joinable())
+        metrics_thread.join();
+
+    // A lone server is blocked waiting for its client, the others notice the session going down on their turn
+    if (single_target)
+        sftp_servers.begin()->second->stop();
+    else
+        ssh_session->force_shutdown();
+
     if (sftp_thread.joinable())
         sftp_thread.join();
 }
+
+void mp::SshfsMount::stop(const std::string& target)
+{
+    if (single_target)
+        return stop();
+
+    std::lock_guard<std::mutex> lock{stopped_targets_mutex};
+    stopped_targets.push_back(target);
+}
+
+void mp::SshfsMount::serve()
+{
+    // With the session to itself, a server can simply block waiting for requests
+    if (single_target)
+    {
+        sftp_servers.begin()->second->run();
+        return;
+    }
+
+    // libssh sessions must only be used from one thread, so every mount is served from this one
+    while (!sftp_servers.empty())
+    {
+        if (stop_invoked)
+        {
+            for (auto& entry : sftp_servers)
+                entry.second->stop();
+        }
+        else
+        {
+            close_stopped_targets();
+            wait_for_ready_channels();
+        }
+
+        for (auto it = sftp_servers.begin(); it != sftp_servers.end();)
+            it = it->second->serve_ready_messages() ? std::next(it) : sftp_servers.erase(it);
+    }
+}
+
+void mp::SshfsMount::wait_for_ready_channels()
+{
+    // What libssh has already read off the socket would not wake the poll below
+    for (auto& entry : sftp_servers)
+    {
+        if (ssh_channel_poll(entry.second->channel(), 0) != 0)
+            return;
+    }
+
+    // Sleep until the instance sends more or a worker finishes, whichever comes first
+    std::vector<pollfd> fds{{ssh_get_fd(*ssh_session), POLLIN, 0}};
+    if (worker_pool)
+        fds.push_back({worker_pool->finished_fd(), POLLIN, 0});
+
+    ::poll(fds.data(), fds.size(), idle_poll_interval.count());
+
+    if (worker_pool)
+        worker_pool->clear_finished();
+}
+
+void mp::SshfsMount::close_stopped_targets()
+{
+    std::vector<std::string> targets;
+    {
+        std::lock_guard<std::mutex> lock{stopped_targets_mutex};
+        targets.swap(stopped_targets);
+    }
+
+    for (const auto& target : targets)
+    {
+        auto it = sftp_servers.find(target);
+        if (it == sftp_servers.end())
+            continue;
+
+        it->second->close();
+        sftp_servers.erase(it);
+
+        std::lock_guard<std::mutex> lock{metrics_mutex};
+        target_metrics.erase(target);
+    }
+}
+
+// multipassd keeps the latest report of each target, so only those that served anything since are sent again
+void mp::SshfsMount::report_metrics()
+{
+    std::unordered_map<std::string, uint64_t> reported_requests;
+
+    std::unique_lock<std::mutex> lock{metrics_mutex};
+    while (!metrics_cv.wait_for(lock, metrics_report_interval, [this] { return stop_invoked.load(); }))
+    {
+        for (const auto& entry : target_metrics)
+        {
+            const auto requests = entry.second->requests();
+            if (requests == reported_requests[entry.first])
+                continue;
+
+            reported_requests[entry.first] = requests;
+
+            QJsonObject report;
+            report.insert("target", QString::fromStdString(entry.first));
+            report.insert("metrics", to_json(entry.second->snapshot()));
+            print_line("Metrics " + QJsonDocument(report).toJson(QJsonDocument::Compact).toStdString());
+        }
+    }
+}
+
+void mp::SshfsMount::print_line(const std::string& line)
+{
+    std::lock_guard<std::mutex> lock{output_mutex};
+    std::cout << line << std::endl;
+}
@@ -15,10 +15,12 @@
  *
  */
 
+#include <multipass/constants.h>
 #include <multipass/exceptions/sshfs_missing_error.h>
 #include <multipass/format.h>
 #include <multipass/logging/log.h>
 #include <multipass/platform.h>
+#include <multipass/settings.h>
 #include <multipass/ssh/ssh_key_provider.h>
 #include <multipass/sshfs_mount/sshfs_mounts.h>
 #include <multipass/sshfs_server_config.h>
@@ -26,6 +28,11 @@
 #include <multipass/virtual_machine.h>
 
 #include <QEventLoop>
+#include <QJsonDocument>
+
+#include <algorithm>
+#include <unordered_set>
+#include <vector>
 
 namespace mp = multipass;
 namespace mpl = multipass::logging;
@@ -33,6 +40,8 @@ namespace mpl = multipass::logging;
 namespace
 {
 constexpr auto category = "sshfs-mounts";
+constexpr auto sftp_worker_threads = 4;
+const QByteArray metrics_prefix{"Metrics "}; // Magic string printed by sshfs_server before each report
 
 template <typename Signal>
 void start_and_block_until(mp::Process* process, Signal signal, std::function<bool(mp::Process* process)> ready_decider)
@@ -64,18 +73,64 @@ mp::SSHFSMounts::SSHFSMounts(const SSHKeyProvider& key_provider) : key(key_provi
 
 void mp::SSHFSMounts::start_mount(VirtualMachine* vm, const std::string& source_path, const std::string& target_path,
                                   const std::unordered_map<int, int>& gid_map,
-                                  const std::unordered_map<int, int>& uid_map)
+                                  const std::unordered_map<int, int>& uid_map,
+                                  VMMount::MountProfile mount_profile)
+{
+    auto config = server_config_for(vm);
+    config.target_path = target_path;
+    config.source_path = source_path;
+    config.uid_map = uid_map;
+    config.gid_map = gid_map;
+    config.mount_profile = mount_profile;
+
+    start_server(vm, config);
+}
+
+void mp::SSHFSMounts::start_mounts(VirtualMachine* vm, const std::unordered_map<std::string, VMMount>& mounts)
+{
+    if (mounts.empty())
+        return;
+
+    auto config = server_config_for(vm);
+    for (const auto& mount : mounts)
+    {
+        if (config.target_path.empty())
+        {
+            config.target_path = mount.first;
+            config.source_path = mount.second.source_path;
+            config.uid_map = mount.second.uid_map;
+            config.gid_map = mount.second.gid_map;
+            config.mount_profile = mount.second.mount_profile;
+        }
+        else
+        {
+            config.additional_mounts.push_back({mount.second.source_path, mount.first, mount.second.gid_map,
+                                                mount.second.uid_map, mount.second.mount_profile});
+        }
+    }
+
+    start_server(vm, config);
+}
+
+mp::SSHFSServerConfig mp::SSHFSMounts::server_config_for(VirtualMachine* vm) const
 {
     mp::SSHFSServerConfig config;
     config.host = vm->ssh_hostname();
     config.port = vm->ssh_port();
     config.username = vm->ssh_username();
     config.instance = vm->vm_name;
-    config.target_path = target_path;
-    config.source_path = source_path;
-    config.uid_map = uid_map;
-    config.gid_map = gid_map;
     config.private_key = key;
+    config.worker_threads = sftp_worker_threads;
+    config.cache_attributes = MP_SETTINGS.get(mp::mount_cache_attributes_key) == QStringLiteral("true");
+
+    return config;
+}
+
+void mp::SSHFSMounts::start_server(VirtualMachine* vm, const SSHFSServerConfig& config)
+{
+    std::vector<std::string> target_paths{config.target_path};
+    for (const auto& mount : config.additional_mounts)
+        target_paths.push_back(mount.target_path);
 
     auto sshfs_server_process_t = mp::platform::make_sshfs_server_process(config);
     // FIXME: ProcessFactory really should return qt_delete_later_unique_ptr<Process> as Process emits signals
@@ -85,33 +140,51 @@ void mp::SSHFSMounts::start_mount(VirtualMachine* vm, const std::string& source_
 
     QObject::connect(
         sshfs_server_process.get(), &mp::Process::finished, this,
-        [this, instance = vm->vm_name, target_path](mp::ProcessState exit_state) {
+        [this, instance = vm->vm_name, target_paths,
+         process = sshfs_server_process.get()](mp::ProcessState exit_state) {
+            const auto targets = fmt::format("{}", fmt::join(target_paths, "', '"));
             if (exit_state.completed_successfully())
             {
                 mpl::log(mpl::Level::info, category,
-                         fmt::format("Mount '{}' in instance \"{}\" has stopped", target_path, instance));
+                         fmt::format("Mount '{}' in instance \"{}\" has stopped", targets, instance));
             }
             else
             {
                 mpl::log(mpl::Level::warning, // not error as it failing can indicate we need to install sshfs in the VM
                          category,
-                         fmt::format("Mount '{}' in instance \"{}\" has stopped unexpectedly: {}", target_path,
-                                     instance, exit_state.failure_message()));
+                         fmt::format("Mount '{}' in instance \"{}\" has stopped unexpectedly: {}", targets, instance,
+                                     exit_state.failure_message()));
             }
 
-            mount_processes[instance].erase(target_path);
+            // Only forget the targets still served by this process; stopped ones may have been mounted again
+            auto& instance_processes = mount_processes[instance];
+            for (const auto& target_path : target_paths)
+            {
+                auto it = instance_processes.find(target_path);
+                if (it != instance_processes.end() && it->second.get() == process)
+                {
+                    instance_processes.erase(it);
+
+                    std::lock_guard<decltype(metrics_mutex)> lock{metrics_mutex};
+                    mount_metrics[instance].erase(target_path);
+                }
+            }
         });
 
     QObject::connect(
         sshfs_server_process.get(), &mp::Process::error_occurred, this,
-        [instance = vm->vm_name, target_path, process = sshfs_server_process.get()](QProcess::ProcessError error,
-                                                                                    QString error_string) {
+        [instance = vm->vm_name, target_path = config.target_path](QProcess::ProcessError error,
+                                                                   QString error_string) {
             mpl::log(mpl::Level::error, category,
                      fmt::format("There was an error with sshfs_server for instance \"{}\" with path '{}': {} - {}",
                                  instance, target_path, mp::utils::qenum_to_string(error), error_string));
         });
 
-    mpl::log(mpl::Level::info, category, fmt::format("mounting {} => {} in {}", source_path, target_path, vm->vm_name));
+    mpl::log(mpl::Level::info, category,
+             fmt::format("mounting {} => {} in {}", config.source_path, config.target_path, vm->vm_name));
+    for (const auto& mount : config.additional_mounts)
+        mpl::log(mpl::Level::info, category,
+                 fmt::format("mounting {} => {} in {}", mount.source_path, mount.target_path, vm->vm_name));
     mpl::log(mpl::Level::info, category,
              fmt::format("process program '{}'", sshfs_server_process->program().toStdString()));
     mpl::log(mpl::Level::info, category,
@@ -134,7 +207,37 @@ void mp::SSHFSMounts::start_mount(VirtualMachine* vm, const std::string& source_
             fmt::format("{}: {}", process_state.failure_message(), sshfs_server_process->read_all_standard_error()));
     }
 
-    mount_processes[vm->vm_name][target_path] = std::move(sshfs_server_process);
+    collect_metrics(vm->vm_name, sshfs_server_process.get());
+
+    std::shared_ptr<mp::Process> shared_process{std::move(sshfs_server_process)};
+    for (const auto& target_path : target_paths)
+        mount_processes[vm->vm_name][target_path] = shared_process;
+}
+
+void mp::SSHFSMounts::collect_metrics(const std::string& instance, Process* process)
+{
+    QObject::connect(process, &mp::Process::ready_read_standard_output, this,
+                     [this, instance, process, pending = QByteArray{}]() mutable {
+                         pending += process->read_all_standard_output();
+
+                         int end;
+                         while ((end = pending.indexOf('\n')) >= 0)
+                         {
+                             const auto line = pending.left(end);
+                             pending.remove(0, end + 1);
+
+                             if (!line.startsWith(metrics_prefix))
+                                 continue;
+
+                             const auto report = QJsonDocument::fromJson(line.mid(metrics_prefix.size())).object();
+                             const auto target = report["target"].toString().toStdString();
+                             if (has_instance_already_mounted(instance, target))
+                             {
+                                 std::lock_guard<decltype(metrics_mutex)> lock{metrics_mutex};
+                                 mount_metrics[instance][target] = mount_metrics_from(report["metrics"].toObject());
+                             }
+                         }
+                     });
 }
 
 bool mp::SSHFSMounts::stop_mount(const std::string& instance, const std::string& path)
@@ -150,6 +253,21 @@ bool mp::SSHFSMounts::stop_mount(const std::string& instance, const std::string&
     if (map_entry != sshfs_mount_map.end())
     {
         auto& sshfs_mount = map_entry->second;
+        auto same_process = [&sshfs_mount](const auto& entry) { return entry.second == sshfs_mount; };
+
+        // Other targets are still being served by this process, so only ask it to let go of this one
+        if (std::count_if(sshfs_mount_map.begin(), sshfs_mount_map.end(), same_process) > 1)
+        {
+            mpl::log(mpl::Level::info, category,
+                     fmt::format("stopping '{}' in the sshfs_server for \"{}\"", path, instance));
+            sshfs_mount->write(QByteArray::fromStdString(fmt::format("stop {}\n", path)));
+            sshfs_mount_map.erase(map_entry);
+
+            std::lock_guard<decltype(metrics_mutex)> lock{metrics_mutex};
+            mount_metrics[instance].erase(path);
+            return true;
+        }
+
         mpl::log(mpl::Level::info, category,
                  fmt::format("stopping sshfs_server for \"{}\" serving '{}'", instance, path));
         sshfs_mount->terminate(); // TODO - if non-responsive, then kill()
@@ -167,14 +285,19 @@ void mp::SSHFSMounts::stop_all_mounts_for_instance(const std::string& instance)
     }
     else
     {
+        std::unordered_set<mp::Process*> stopped_processes;
         for (auto& sshfs_mount : mounts_it->second)
         {
             mpl::log(mpl::Level::debug, category,
                      fmt::format("Stopping mount '{}' in instance \"{}\"", sshfs_mount.first, instance));
-            sshfs_mount.second->terminate();
+            if (stopped_processes.insert(sshfs_mount.second.get()).second)
+                sshfs_mount.second->terminate();
         }
     }
     mount_processes[instance].clear();
+
+    std::lock_guard<decltype(metrics_mutex)> lock{metrics_mutex};
+    mount_metrics.erase(instance);
 }
 
 bool mp::SSHFSMounts::has_instance_already_mounted(const std::string& instance, const std::string& path) const
@@ -186,3 +309,18 @@ bool mp::SSHFSMounts::has_instance_already_mounted(const std::string& instance,
     }
     return false;
 }
+
+mp::optional<mp::MountMetrics> mp::SSHFSMounts::metrics_for(const std::string& instance,
+                                                          const std::string& path) const
+{
+    std::lock_guard<decltype(metrics_mutex)> lock{metrics_mutex};
+    auto instance_it = mount_metrics.find(instance);
+    if (instance_it == mount_metrics.end())
+        return mp::nullopt;
+
+    auto entry = instance_it->second.find(path);
+    if (entry == instance_it->second.end())
+        return mp::nullopt;
+
+    return entry->second;
+}
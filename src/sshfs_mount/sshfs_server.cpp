@@ -15,13 +15,20 @@
  *
  */
 
+#include <atomic>
+#include <cerrno>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
 
 #include <QStringList>
 
 #include "../ssh/ssh_client_key_provider.h" // FIXME
+#include <multipass/auto_join_thread.h>
 #include <multipass/exceptions/sshfs_missing_error.h>
 #include <multipass/logging/log.h>
 #include <multipass/logging/standard_logger.h>
@@ -36,6 +43,41 @@ using namespace std;
 
 namespace
 {
+constexpr auto control_poll_interval_ms = 100;
+
+// multipassd stops single mounts by writing "stop <target>" lines to our stdin. Polls, so that it can be told to quit
+// before the mount it acts on goes away.
+void run_stop_commands(mp::SshfsMount& sshfs_mount, const atomic<bool>& quit)
+{
+    const string stop_command{"stop "};
+    string pending;
+    char buffer[256];
+
+    while (!quit)
+    {
+        pollfd control_fd{STDIN_FILENO, POLLIN, 0};
+        const auto ready = poll(&control_fd, 1, control_poll_interval_ms);
+        if (ready < 0 && errno != EINTR)
+            return;
+        if (ready <= 0)
+            continue;
+
+        const auto r = read(STDIN_FILENO, buffer, sizeof(buffer));
+        if (r <= 0) // multipassd closed our stdin
+            return;
+
+        pending.append(buffer, r);
+        for (auto eol = pending.find('\n'); eol != string::npos; eol = pending.find('\n'))
+        {
+            const auto line = pending.substr(0, eol);
+            pending.erase(0, eol + 1);
+
+            if (line.compare(0, stop_command.size(), stop_command) == 0)
+                sshfs_mount.stop(line.substr(stop_command.size()));
+        }
+    }
+}
+
 unordered_map<int, int> deserialise_id_map(const char* in)
 {
     unordered_map<int, int> id_map;
@@ -62,11 +104,17 @@ unordered_map<int, int> deserialise_id_map(const char* in)
     }
     return id_map;
 }
+
+mp::VMMount::MountProfile deserialise_profile(const char* in)
+{
+    return static_cast<mp::VMMount::MountProfile>(atoi(in));
+}
 } // namespace
 
 int main(int argc, char* argv[])
 {
-    if (argc != 8)
+    // Any mounts after the first come in fives at the end: source, target, uid map, gid map and profile
+    if (argc < 8 || (argc > 11 && (argc - 11) % 5 != 0))
     {
         cerr << "Incorrect arguments" << endl;
         exit(2);
@@ -82,10 +130,14 @@ int main(int argc, char* argv[])
     const auto host = string(argv[1]);
     const int port = atoi(argv[2]);
     const auto username = string(argv[3]);
-    const auto source_path = string(argv[4]);
-    const auto target_path = string(argv[5]);
-    const unordered_map<int, int> uid_map = deserialise_id_map(argv[6]);
-    const unordered_map<int, int> gid_map = deserialise_id_map(argv[7]);
+    const int worker_threads = argc > 8 ? atoi(argv[8]) : 0;
+    const bool cache_attributes = argc > 9 && atoi(argv[9]) != 0;
+    vector<mp::SshfsMount::Target> targets{
+        {string(argv[4]), string(argv[5]), deserialise_id_map(argv[7]), deserialise_id_map(argv[6]),
+         argc > 10 ? deserialise_profile(argv[10]) : mp::VMMount::MountProfile::Default}};
+    for (int i = 11; i < argc; i += 5)
+        targets.push_back({string(argv[i]), string(argv[i + 1]), deserialise_id_map(argv[i + 3]),
+                           deserialise_id_map(argv[i + 2]), deserialise_profile(argv[i + 4])});
 
     auto logger = std::make_shared<mpl::StandardLogger>(mpl::Level::error); // QUESTION - how to pass verbosity level?
     mpl::set_logger(logger);
@@ -95,11 +147,18 @@ int main(int argc, char* argv[])
         auto watchdog = mpp::make_quit_watchdog(); // called while there is only one thread
 
         mp::SSHSession session{host, port, username, mp::SSHClientKeyProvider{priv_key_blob}};
-        mp::SshfsMount sshfs_mount(move(session), source_path, target_path, gid_map, uid_map);
+        mp::SshfsMount sshfs_mount(move(session), targets, worker_threads, cache_attributes);
+
+        {
+            atomic<bool> quit{false};
+            mp::AutoJoinThread control_thread{[&sshfs_mount, &quit] { run_stop_commands(sshfs_mount, quit); }};
+
+            // ssh lives on its own thread, use this thread to listen for quit signal
+            if (int sig = watchdog())
+                cout << "Received signal " << sig << ". Stopping" << endl;
 
-        // ssh lives on its own thread, use this thread to listen for quit signal
-        if (int sig = watchdog())
-            cout << "Received signal " << sig << ". Stopping" << endl;
+            quit = true;
+        } // the control thread is joined here, while sshfs_mount is still around
 
         sshfs_mount.stop();
         exit(0);
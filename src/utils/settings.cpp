@@ -23,6 +23,7 @@
 
 #include <QDir>
 #include <QKeySequence>
+#include <QRegularExpression>
 #include <QSettings>
 
 #include <algorithm>
@@ -42,6 +43,10 @@ const auto daemon_root = QStringLiteral("local");
 const auto client_root = QStringLiteral("client");
 const auto petenv_name = QStringLiteral("primary");
 const auto autostart_default = QStringLiteral("true");
+const auto prefetch_images_default = QStringLiteral("");
+const auto prefetch_rate_default = QStringLiteral("0"); // no limit
+const auto mount_cache_attributes_default = QStringLiteral("false");
+const auto image_decoder_threads_default = QStringLiteral("0"); // one per core
 
 QString default_hotkey()
 {
@@ -53,7 +58,11 @@ std::map<QString, QString> make_defaults()
     auto ret = std::map<QString, QString>{{mp::petenv_key, petenv_name},
                                           {mp::driver_key, mp::platform::default_driver()},
                                           {mp::autostart_key, autostart_default},
-                                          {mp::hotkey_key, default_hotkey()}};
+                                          {mp::hotkey_key, default_hotkey()},
+                                          {mp::prefetch_images_key, prefetch_images_default},
+                                          {mp::prefetch_rate_key, prefetch_rate_default},
+                                          {mp::mount_cache_attributes_key, mount_cache_attributes_default},
+                                          {mp::image_decoder_threads_key, image_decoder_threads_default}};
 
     for(const auto& [k, v] : mp::platform::extra_settings_defaults())
         ret.insert_or_assign(k, v);
@@ -205,10 +214,20 @@ void multipass::Settings::set_aux(const QString& key, QString val) // work with
         throw InvalidSettingsException{key, val, "Invalid hostname"};
     else if (key == driver_key && !mp::platform::is_backend_supported(val))
         throw InvalidSettingsException(key, val, "Invalid driver");
-    else if (key == autostart_key && (val = interpret_bool(val)) != "true" && val != "false")
+    else if ((key == autostart_key || key == mount_cache_attributes_key) && (val = interpret_bool(val)) != "true" &&
+             val != "false")
         throw InvalidSettingsException(key, val, "Invalid flag, try \"true\" or \"false\"");
     else if (key == winterm_key || key == hotkey_key)
         val = mp::platform::interpret_setting(key, val);
+    else if (key == prefetch_images_key && val.contains(QRegularExpression{"\\s"}))
+        throw InvalidSettingsException(key, val,
+                                       "Invalid image list, try a comma-separated list like \"lts,daily:devel\"");
+    else if (key == prefetch_rate_key &&
+             !QRegularExpression{"^\\d+[KMG]?B?$", QRegularExpression::CaseInsensitiveOption}.match(val).hasMatch())
+        throw InvalidSettingsException(key, val,
+                                       "Invalid rate, try a size per second like \"10M\" or 0 for no limit");
+    else if (key == image_decoder_threads_key && !QRegularExpression{"^\\d+$"}.match(val).hasMatch())
+        throw InvalidSettingsException(key, val, "Invalid number of threads, try a number or 0 for one per core");
 
     auto settings = persistent_settings(key);
     checked_set(*settings, key, val, mutex);
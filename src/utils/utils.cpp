@@ -26,6 +26,7 @@
 #include <multipass/standard_paths.h>
 #include <multipass/utils.h>
 
+#include <QCryptographicHash>
 #include <QDateTime>
 #include <QDir>
 #include <QFileInfo>
@@ -98,6 +99,14 @@ bool mp::utils::invalid_target_path(const QString& target_path)
     return matcher.exactMatch(sanitized_path);
 }
 
+// Hypervisors limit the length of mount tags, virtio-fs to 36 bytes
+std::string mp::utils::native_mount_tag(const std::string& target_path)
+{
+    const auto hash = QCryptographicHash::hash(QDir::cleanPath(QString::fromStdString(target_path)).toUtf8(),
+                                               QCryptographicHash::Sha256);
+    return "mp-" + hash.toHex().left(24).toStdString();
+}
+
 qint64 mp::utils::filesystem_bytes_available(const QString& data_directory)
 {
     return QStorageInfo(QDir(data_directory)).bytesAvailable();
@@ -15,16 +15,31 @@
  *
  */
 
+#include <multipass/constants.h>
+#include <multipass/settings.h>
 #include <multipass/vm_image_vault.h>
 #include <multipass/xz_image_decoder.h>
 
 #include <QCryptographicHash>
+#include <QDataStream>
 #include <QFileInfo>
 
 #include <stdexcept>
 
 namespace mp = multipass;
 
+namespace
+{
+constexpr quint32 qcow2_magic{0x514649fb}; // "QFI\xfb"
+constexpr quint32 max_backing_file_size{1023}; // as qcow2 allows
+
+// qcow version 1 images share the magic, but not the rest of the header
+bool is_qcow2_header(QDataStream& header, quint32 magic, quint32 version)
+{
+    return header.status() == QDataStream::Ok && magic == qcow2_magic && (version == 2 || version == 3);
+}
+} // namespace
+
 QString mp::vault::filename_for(const mp::Path& path)
 {
     QFileInfo file_info(path);
@@ -56,8 +71,11 @@ QString mp::vault::compute_image_hash(const mp::Path& image_path)
 
 void mp::vault::verify_image_download(const mp::Path& image_path, const QString& image_hash)
 {
-    auto computed_hash = compute_image_hash(image_path);
+    verify_image_hash(compute_image_hash(image_path), image_hash);
+}
 
+void mp::vault::verify_image_hash(const QString& computed_hash, const QString& image_hash)
+{
     if (computed_hash != image_hash)
     {
         throw std::runtime_error("Downloaded image hash does not match");
@@ -66,7 +84,7 @@ void mp::vault::verify_image_download(const mp::Path& image_path, const QString&
 
 QString mp::vault::extract_image(const mp::Path& image_path, const mp::ProgressMonitor& monitor, const bool delete_file)
 {
-    mp::XzImageDecoder xz_decoder(image_path);
+    mp::XzImageDecoder xz_decoder(image_path, MP_SETTINGS.get(mp::image_decoder_threads_key).toInt());
     QString new_image_path{image_path};
 
     new_image_path.remove(".xz");
@@ -77,3 +95,53 @@ QString mp::vault::extract_image(const mp::Path& image_path, const mp::ProgressM
 
     return new_image_path;
 }
+
+bool mp::vault::is_qcow2_image(const mp::Path& image_path)
+{
+    QFile image_file{image_path};
+    if (!image_file.open(QFile::ReadOnly))
+        return false;
+
+    quint32 magic{0}, version{0};
+    QDataStream header{&image_file};
+    header >> magic >> version;
+
+    return is_qcow2_header(header, magic, version);
+}
+
+mp::Path mp::vault::backing_image_of(const mp::Path& image_path)
+{
+    QFile image_file{image_path};
+    if (!image_file.open(QFile::ReadOnly))
+        return {};
+
+    // The qcow2 header starts with the magic, the version, and where the backing file name is and how long it is
+    quint32 magic{0}, version{0}, backing_file_size{0};
+    quint64 backing_file_offset{0};
+    QDataStream header{&image_file};
+    header >> magic >> version >> backing_file_offset >> backing_file_size;
+
+    if (!is_qcow2_header(header, magic, version) || backing_file_offset == 0 ||
+        backing_file_size > max_backing_file_size || !image_file.seek(static_cast<qint64>(backing_file_offset)))
+        return {};
+
+    return QString::fromUtf8(image_file.read(backing_file_size));
+}
+
+qint64 mp::vault::qcow2_virtual_size(const mp::Path& image_path)
+{
+    QFile image_file{image_path};
+    if (!image_file.open(QFile::ReadOnly))
+        return 0;
+
+    // The size follows the magic, version, backing file offset and size, and cluster bits
+    quint32 magic{0}, version{0}, backing_file_size{0}, cluster_bits{0};
+    quint64 backing_file_offset{0}, size{0};
+    QDataStream header{&image_file};
+    header >> magic >> version >> backing_file_offset >> backing_file_size >> cluster_bits >> size;
+
+    if (!is_qcow2_header(header, magic, version))
+        return 0;
+
+    return static_cast<qint64>(size);
+}
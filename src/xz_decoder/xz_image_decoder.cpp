@@ -17,16 +17,29 @@
 
 #include <multipass/xz_image_decoder.h>
 
+#include <multipass/logging/log.h>
 #include <multipass/rpc/multipass.grpc.pb.h>
 
 #include <multipass/format.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <vector>
 
 namespace mp = multipass;
+namespace mpl = multipass::logging;
 
 namespace
 {
+constexpr auto category = "xz decoder";
+constexpr auto max_size = 65536u;
+
 bool verify_decode(const xz_ret& ret)
 {
     switch (ret)
@@ -52,64 +65,466 @@ bool verify_decode(const xz_ret& ret)
 
     return true;
 }
+
+// Feeds data to the decoder, handing the size of whatever gets decoded into decoded_data to write. Returns false
+// once the end of the stream was decoded.
+bool run_decoder(xz_dec* decoder, const char* data, std::size_t size, std::vector<uint8_t>& decoded_data,
+                 const std::function<void(std::size_t)>& write)
+{
+    struct xz_buf decode_buf
+    {
+    };
+    decode_buf.in = reinterpret_cast<const uint8_t*>(data);
+    decode_buf.in_pos = 0;
+    decode_buf.in_size = size;
+    decode_buf.out = decoded_data.data();
+    decode_buf.out_size = decoded_data.size();
+
+    // Keep going while there is input left, or output that did not fit in the buffer
+    do
+    {
+        decode_buf.out_pos = 0;
+        const auto ret = xz_dec_run(decoder, &decode_buf);
+        write(decode_buf.out_pos);
+
+        if (!verify_decode(ret))
+            return false;
+    } while (decode_buf.in_pos < decode_buf.in_size || decode_buf.out_pos == decode_buf.out_size);
+
+    return true;
+}
+
+// The xz format is described in https://tukaani.org/xz/xz-file-format.txt
+constexpr auto stream_header_size = 12;
+constexpr auto stream_footer_size = 12;
+constexpr char stream_header_magic[] = {'\xFD', '7', 'z', 'X', 'Z', '\0'};
+constexpr auto stream_footer_magic = "YZ";
+
+struct XzBlock
+{
+    qint64 offset;  // in the xz file
+    qint64 size;    // including the block padding
+    uint64_t unpadded_size;
+    qint64 decoded_offset;
+    uint64_t decoded_size;
+};
+
+struct XzBlockIndex
+{
+    QByteArray stream_header;
+    QByteArray stream_flags;
+    std::vector<XzBlock> blocks;
+};
+
+uint32_t read_le32(const char* data)
+{
+    const auto bytes = reinterpret_cast<const uint8_t*>(data);
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | static_cast<uint32_t>(bytes[3]) << 24;
+}
+
+void append_le32(QByteArray& data, uint32_t value)
+{
+    for (auto i = 0; i < 4; ++i)
+        data.append(static_cast<char>((value >> (i * 8)) & 0xFF));
+}
+
+bool read_vli(const QByteArray& data, int& pos, uint64_t& value)
+{
+    value = 0;
+    for (auto i = 0; i < 9 && pos < data.size(); ++i)
+    {
+        const auto byte = static_cast<uint8_t>(data[pos++]);
+        value |= static_cast<uint64_t>(byte & 0x7F) << (i * 7);
+
+        if (!(byte & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+void append_vli(QByteArray& data, uint64_t value)
+{
+    for (; value >= 0x80; value >>= 7)
+        data.append(static_cast<char>((value & 0x7F) | 0x80));
+
+    data.append(static_cast<char>(value));
+}
+
+uint32_t crc32_of(const QByteArray& data)
+{
+    return xz_crc32(reinterpret_cast<const uint8_t*>(data.constData()), data.size(), 0);
+}
+
+// Reads the index at the end of an xz file made of a single stream. Anything else, like concatenated streams or
+// stream padding, gets nothing back and is left to the sequential decoder, which validates it properly.
+std::optional<XzBlockIndex> read_block_index(QFile& xz_file)
+{
+    const auto file_size = xz_file.size();
+    if (file_size < stream_header_size + stream_footer_size || !xz_file.seek(0))
+        return std::nullopt;
+
+    XzBlockIndex index;
+    index.stream_header = xz_file.read(stream_header_size);
+    if (index.stream_header.size() != stream_header_size ||
+        !index.stream_header.startsWith(QByteArray(stream_header_magic, sizeof(stream_header_magic))))
+        return std::nullopt;
+
+    index.stream_flags = index.stream_header.mid(sizeof(stream_header_magic), 2);
+
+    if (!xz_file.seek(file_size - stream_footer_size))
+        return std::nullopt;
+
+    const auto footer = xz_file.read(stream_footer_size);
+    if (footer.size() != stream_footer_size || !footer.endsWith(stream_footer_magic) ||
+        footer.mid(8, 2) != index.stream_flags || read_le32(footer.constData()) != crc32_of(footer.mid(4, 6)))
+        return std::nullopt;
+
+    const auto index_size = (static_cast<qint64>(read_le32(footer.constData() + 4)) + 1) * 4;
+    const auto index_offset = file_size - stream_footer_size - index_size;
+    if (index_offset < stream_header_size || !xz_file.seek(index_offset))
+        return std::nullopt;
+
+    const auto index_data = xz_file.read(index_size);
+    if (index_data.size() != index_size || index_data[0] != '\0' ||
+        read_le32(index_data.constData() + index_size - 4) != crc32_of(index_data.left(index_size - 4)))
+        return std::nullopt;
+
+    auto pos = 1;
+    uint64_t num_blocks;
+    if (!read_vli(index_data, pos, num_blocks) || num_blocks > static_cast<uint64_t>(index_size))
+        return std::nullopt;
+
+    qint64 offset{stream_header_size}, decoded_offset{0};
+    for (auto i = 0u; i < num_blocks; ++i)
+    {
+        XzBlock block;
+        if (!read_vli(index_data, pos, block.unpadded_size) || !read_vli(index_data, pos, block.decoded_size) ||
+            block.unpadded_size > static_cast<uint64_t>(file_size) ||
+            block.decoded_size > static_cast<uint64_t>(std::numeric_limits<qint64>::max() - decoded_offset))
+            return std::nullopt;
+
+        block.offset = offset;
+        block.size = (block.unpadded_size + 3) & ~uint64_t{3};
+        block.decoded_offset = decoded_offset;
+
+        offset += block.size;
+        decoded_offset += block.decoded_size;
+        index.blocks.push_back(block);
+    }
+
+    // The blocks must take up everything between the stream header and the index
+    if (offset != index_offset || pos > index_size - 4)
+        return std::nullopt;
+
+    return index;
+}
+
+// The index and footer of a stream holding nothing but the given block, which is how each block gets decoded on its
+// own. The decoder checks the block against them as it would against the real ones.
+QByteArray single_block_stream_end(const XzBlockIndex& index, const XzBlock& block)
+{
+    QByteArray index_data(1, '\0');
+    append_vli(index_data, 1);
+    append_vli(index_data, block.unpadded_size);
+    append_vli(index_data, block.decoded_size);
+    while (index_data.size() % 4 != 0)
+        index_data.append('\0');
+    append_le32(index_data, crc32_of(index_data));
+
+    QByteArray footer_fields;
+    append_le32(footer_fields, index_data.size() / 4 - 1);
+    footer_fields += index.stream_flags;
+
+    auto stream_end = index_data;
+    append_le32(stream_end, crc32_of(footer_fields));
+
+    return stream_end + footer_fields + stream_footer_magic;
+}
+
+void decode_block(xz_dec* decoder, const XzBlockIndex& index, const XzBlock& block, QFile& xz_file,
+                  QFile& decoded_file, std::vector<uint8_t>& decoded_data)
+{
+    if (!xz_file.seek(block.offset))
+        throw std::runtime_error(fmt::format("failed to read {}", xz_file.fileName()));
+
+    if (!decoded_file.seek(block.decoded_offset))
+        throw std::runtime_error(
+            fmt::format("failed to write {}: {}", decoded_file.fileName(), decoded_file.errorString()));
+
+    auto write = [&decoded_file, &decoded_data](std::size_t size) {
+        if (size > 0 && decoded_file.write(reinterpret_cast<const char*>(decoded_data.data()), size) !=
+                            static_cast<qint64>(size))
+            throw std::runtime_error(
+                fmt::format("failed to write {}: {}", decoded_file.fileName(), decoded_file.errorString()));
+    };
+    auto feed = [decoder, &decoded_data, &write](const QByteArray& data) {
+        return run_decoder(decoder, data.constData(), data.size(), decoded_data, write);
+    };
+
+    xz_dec_reset(decoder);
+    feed(index.stream_header);
+
+    for (auto remaining = block.size; remaining > 0;)
+    {
+        const auto read_data = xz_file.read(std::min<qint64>(remaining, max_size));
+        if (read_data.isEmpty())
+            throw std::runtime_error(fmt::format("failed to read {}", xz_file.fileName()));
+
+        remaining -= read_data.size();
+        if (!feed(read_data))
+            throw std::runtime_error("xz file is corrupt");
+    }
+
+    if (feed(single_block_stream_end(index, block)))
+        throw std::runtime_error("xz file is corrupt");
+}
+
+void hash_block(QCryptographicHash& hash, QFile& decoded_file, const XzBlock& block)
+{
+    if (!decoded_file.seek(block.decoded_offset))
+        throw std::runtime_error(fmt::format("failed to read {}", decoded_file.fileName()));
+
+    for (auto remaining = static_cast<qint64>(block.decoded_size); remaining > 0;)
+    {
+        const auto data = decoded_file.read(std::min<qint64>(remaining, max_size));
+        if (data.isEmpty())
+            throw std::runtime_error(fmt::format("failed to read {}", decoded_file.fileName()));
+
+        remaining -= data.size();
+        hash.addData(data);
+    }
+}
 } // namespace
 
-mp::XzImageDecoder::XzImageDecoder(const Path& xz_file_path)
-    : xz_file{xz_file_path}, xz_decoder{xz_dec_init(XZ_DYNALLOC, 1u << 26), xz_dec_end}
+mp::XzImageDecoder::XzImageDecoder(const Path& xz_file_path, int decoder_threads)
+    : xz_file{xz_file_path},
+      decoder_threads{decoder_threads},
+      xz_decoder{xz_dec_init(XZ_DYNALLOC, 1u << 26), xz_dec_end},
+      decoded_data(max_size)
 {
     xz_crc32_init();
     xz_crc64_init();
 }
 
-void mp::XzImageDecoder::decode_to(const Path& decoded_image_path, const ProgressMonitor& monitor)
+mp::XzImageDecoder::XzImageDecoder() : XzImageDecoder{Path()}
+{
+}
+
+QString mp::XzImageDecoder::decode_to(const Path& decoded_image_path, const ProgressMonitor& monitor)
 {
     if (!xz_file.open(QIODevice::ReadOnly))
         throw std::runtime_error(fmt::format("failed to open {} for reading", xz_file.fileName()));
 
-    QFile decoded_file{decoded_image_path};
-    if (!decoded_file.open(QIODevice::WriteOnly))
-        throw std::runtime_error(fmt::format("failed to open {} for writing", decoded_file.fileName()));
-
-    struct xz_buf decode_buf
-    {
-    };
-    const auto max_size = 65536u;
+    if (decode_blocks_to(decoded_image_path, monitor))
+        return finish_decoding();
 
-    std::vector<char> read_data, write_data;
-    read_data.reserve(max_size);
-    write_data.reserve(max_size);
+    if (!xz_file.seek(0))
+        throw std::runtime_error(fmt::format("failed to read {}", xz_file.fileName()));
 
-    decode_buf.in = reinterpret_cast<unsigned char*>(read_data.data());
-    decode_buf.in_pos = 0;
-    decode_buf.in_size = 0;
-    decode_buf.out = reinterpret_cast<unsigned char*>(write_data.data());
-    decode_buf.out_pos = 0;
-    decode_buf.out_size = max_size;
+    start_decoding_to(decoded_image_path);
 
     const auto file_size = xz_file.size();
     qint64 total_bytes_extracted{0};
 
-    while (true)
+    while (!xz_file.atEnd())
     {
-        if (decode_buf.in_pos == decode_buf.in_size)
+        const auto read_data = xz_file.read(max_size);
+        if (read_data.isEmpty())
+            throw std::runtime_error(fmt::format("failed to read {}", xz_file.fileName()));
+
+        total_bytes_extracted += read_data.size();
+        auto progress = (total_bytes_extracted / (float)file_size) * 100;
+        monitor(LaunchProgress::EXTRACT, progress);
+
+        if (!decode(read_data))
+            break;
+    }
+
+    return finish_decoding();
+}
+
+void mp::XzImageDecoder::start_decoding_to(const Path& decoded_image_path)
+{
+    decoded_file.setFileName(decoded_image_path);
+    if (!decoded_file.open(QIODevice::WriteOnly))
+        throw std::runtime_error(fmt::format("failed to open {} for writing", decoded_file.fileName()));
+}
+
+bool mp::XzImageDecoder::decode(const QByteArray& xz_data)
+{
+    if (stream_ended)
+        return false;
+
+    if (xz_data.isEmpty())
+        return true;
+
+    stream_ended = !run_decoder(xz_decoder.get(), xz_data.constData(), xz_data.size(), decoded_data,
+                                [this](std::size_t size) { write_decoded(size); });
+
+    return !stream_ended;
+}
+
+QString mp::XzImageDecoder::finish_decoding()
+{
+    decoded_file.close();
+
+    if (!stream_ended)
+        throw std::runtime_error("xz file is corrupt");
+
+    return decoded_hash.result().toHex();
+}
+
+void mp::XzImageDecoder::write_decoded(qint64 size)
+{
+    if (size <= 0)
+        return;
+
+    const auto data = reinterpret_cast<const char*>(decoded_data.data());
+    if (decoded_file.write(data, size) != size)
+        throw std::runtime_error(
+            fmt::format("failed to write {}: {}", decoded_file.fileName(), decoded_file.errorString()));
+
+    decoded_hash.addData(data, size);
+}
+
+// Decodes the blocks of a multi-block file at the same time, each one into its place in the decoded file, and hashes
+// them in order as they are done. Returns false, without touching the decoded file, when the file cannot be decoded
+// that way.
+bool mp::XzImageDecoder::decode_blocks_to(const Path& decoded_image_path, const ProgressMonitor& monitor)
+{
+    const auto index = read_block_index(xz_file);
+    if (!index || index->blocks.size() < 2)
+        return false;
+
+    const auto max_threads = decoder_threads > 0 ? static_cast<unsigned>(decoder_threads)
+                                                 : std::max(1u, std::thread::hardware_concurrency());
+    const auto num_threads = std::min<std::size_t>(max_threads, index->blocks.size());
+    if (num_threads < 2)
+        return false;
+
+    mpl::log(mpl::Level::debug, category,
+             fmt::format("Decoding {} blocks of {} on {} threads", index->blocks.size(), xz_file.fileName(),
+                         num_threads));
+
+    start_decoding_to(decoded_image_path);
+
+    const auto& last_block = index->blocks.back();
+    if (!decoded_file.resize(last_block.decoded_offset + last_block.decoded_size))
+        throw std::runtime_error(
+            fmt::format("failed to write {}: {}", decoded_file.fileName(), decoded_file.errorString()));
+    decoded_file.close();
+
+    // The threads open the files for themselves and leave the ones here alone
+    const auto xz_file_name = xz_file.fileName();
+    const auto xz_file_size = xz_file.size();
+
+    std::mutex progress_mutex;
+    std::condition_variable progress_cv;
+    std::size_t next_block{0};
+    std::vector<bool> block_decoded(index->blocks.size());
+    qint64 bytes_decoded{0};
+    std::exception_ptr error;
+
+    auto set_error = [&progress_mutex, &progress_cv, &error](std::exception_ptr e) {
         {
-            decode_buf.in_size = xz_file.read(read_data.data(), max_size);
-            decode_buf.in_pos = 0;
-            total_bytes_extracted += decode_buf.in_size;
-            auto progress = (total_bytes_extracted / (float)file_size) * 100;
-            monitor(LaunchProgress::EXTRACT, progress);
+            std::lock_guard<std::mutex> lock{progress_mutex};
+            if (!error)
+                error = e;
         }
+        progress_cv.notify_all();
+    };
+
+    auto decode_blocks = [&] {
+        try
+        {
+            QFile block_file{xz_file_name};
+            if (!block_file.open(QIODevice::ReadOnly))
+                throw std::runtime_error(fmt::format("failed to open {} for reading", block_file.fileName()));
 
-        if (!verify_decode(xz_dec_run(xz_decoder.get(), &decode_buf)))
+            // ReadWrite rather than WriteOnly, which would truncate what the other threads are writing
+            QFile block_decoded_file{decoded_image_path};
+            if (!block_decoded_file.open(QIODevice::ReadWrite))
+                throw std::runtime_error(
+                    fmt::format("failed to open {} for writing", block_decoded_file.fileName()));
+
+            XzDecoderUPtr block_decoder{xz_dec_init(XZ_DYNALLOC, 1u << 26), xz_dec_end};
+            std::vector<uint8_t> block_decoded_data(max_size);
+
+            while (true)
+            {
+                std::size_t block;
+                {
+                    std::lock_guard<std::mutex> lock{progress_mutex};
+                    if (error || next_block == index->blocks.size())
+                        return;
+                    block = next_block++;
+                }
+
+                decode_block(block_decoder.get(), *index, index->blocks[block], block_file, block_decoded_file,
+                             block_decoded_data);
+
+                // Hashing reads the block back through another file
+                if (!block_decoded_file.flush())
+                    throw std::runtime_error(fmt::format("failed to write {}: {}", block_decoded_file.fileName(),
+                                                         block_decoded_file.errorString()));
+
+                {
+                    std::lock_guard<std::mutex> lock{progress_mutex};
+                    block_decoded[block] = true;
+                    bytes_decoded += index->blocks[block].size;
+                }
+                progress_cv.notify_all();
+            }
+        }
+        catch (...)
         {
-            decoded_file.write(write_data.data(), decode_buf.out_pos);
-            return;
+            set_error(std::current_exception());
         }
+    };
+
+    std::vector<std::thread> threads;
+    for (auto i = 0u; i < num_threads; ++i)
+        threads.emplace_back(decode_blocks);
+
+    // Progress is reported from this thread only, as the monitor is not meant to be called concurrently
+    try
+    {
+        QFile hash_file{decoded_image_path};
+        if (!hash_file.open(QIODevice::ReadOnly))
+            throw std::runtime_error(fmt::format("failed to open {} for reading", hash_file.fileName()));
 
-        if (decode_buf.out_pos == max_size)
+        std::size_t blocks_hashed{0};
+        std::unique_lock<std::mutex> lock{progress_mutex};
+        while (blocks_hashed < index->blocks.size())
         {
-            decoded_file.write(write_data.data(), decode_buf.out_pos);
-            decode_buf.out_pos = 0;
+            progress_cv.wait(lock, [&] { return error || block_decoded[blocks_hashed]; });
+            if (error)
+                break;
+
+            auto blocks_to_hash = blocks_hashed;
+            while (blocks_to_hash < index->blocks.size() && block_decoded[blocks_to_hash])
+                ++blocks_to_hash;
+
+            const auto progress = static_cast<int>(bytes_decoded * 100 / xz_file_size);
+            lock.unlock();
+            monitor(LaunchProgress::EXTRACT, progress);
+            for (; blocks_hashed < blocks_to_hash; ++blocks_hashed)
+                hash_block(decoded_hash, hash_file, index->blocks[blocks_hashed]);
+            lock.lock();
         }
     }
+    catch (...)
+    {
+        set_error(std::current_exception());
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    if (error)
+        std::rethrow_exception(error);
+
+    stream_ended = true;
+    return true;
 }
@@ -40,7 +40,10 @@ add_c_mocks(
   ssh_channel_request_shell
   ssh_channel_request_pty
   ssh_channel_change_pty_size
+  ssh_channel_read
   ssh_channel_read_timeout
+  ssh_channel_poll_timeout
+  ssh_channel_write
   ssh_channel_get_exit_status
   ssh_event_dopoll
   ssh_add_channel_callbacks
@@ -23,7 +23,9 @@
 #include <shared/shared_backend_utils.h>
 
 #include "tests/extra_assertions.h"
+#include "tests/file_operations.h"
 #include "tests/mock_process_factory.h"
+#include "tests/temp_dir.h"
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -222,3 +224,25 @@ TEST_P(ImageConversionTestSuite, properly_handles_image_conversion)
 }
 
 INSTANTIATE_TEST_SUITE_P(BackendUtils, ImageConversionTestSuite, ValuesIn(image_conversion_inputs));
+
+TEST(BackendUtils, image_conversion_recognizes_qcow2_header_without_qemuimg)
+{
+    mpt::TempDir temp_dir;
+    const auto img_path = temp_dir.path() + "/image.qcow2";
+    mpt::make_file_with_content(img_path, std::string{"QFI\xfb\0\0\0\3", 8});
+
+    auto mock_factory_scope = mpt::MockProcessFactory::Inject();
+
+    EXPECT_THAT(mp::backend::convert_to_qcow_if_necessary(img_path), Eq(img_path));
+    EXPECT_THAT(mock_factory_scope->process_list(), IsEmpty());
+}
+
+TEST(BackendUtils, image_conversion_leaves_qcow_version_1_header_to_qemuimg)
+{
+    mpt::TempDir temp_dir;
+    const auto img_path = (temp_dir.path() + "/image.qcow").toStdString();
+    mpt::make_file_with_content(QString::fromStdString(img_path), std::string{"QFI\xfb\0\0\0\1", 8});
+
+    test_image_conversion(img_path.c_str(), img_path.c_str(), "{\n    \"format\": \"qcow\"\n}", success, false,
+                          mp::ProcessState{}, null_string_matcher);
+}
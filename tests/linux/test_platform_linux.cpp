@@ -18,6 +18,7 @@
 #include "tests/fake_handle.h"
 #include "tests/mock_environment_helpers.h"
 #include "tests/mock_settings.h"
+#include "tests/temp_dir.h"
 #include "tests/test_with_mocked_bin_path.h"
 
 #include <src/platform/backends/libvirt/libvirt_virtual_machine_factory.h>
@@ -41,6 +42,10 @@
 
 #include <stdexcept>
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace mp = multipass;
 namespace mpt = multipass::test;
 using namespace testing;
@@ -56,6 +61,28 @@ void setup_driver_settings(const QString& driver)
         expectation.WillRepeatedly(Return(driver));
 }
 
+// What the file takes up on disk, which is less than its size when it has holes
+qint64 allocated_bytes(const QString& path)
+{
+    struct stat file_stat;
+    if (::stat(path.toStdString().c_str(), &file_stat) != 0)
+        return -1;
+
+    return static_cast<qint64>(file_stat.st_blocks) * 512;
+}
+
+qint64 first_hole_in(const QString& path)
+{
+    const auto fd = ::open(path.toStdString().c_str(), O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    const auto hole = ::lseek(fd, 0, SEEK_HOLE);
+    ::close(fd);
+
+    return hole;
+}
+
 // hold on to return until the change is to be discarded
 auto temporarily_change_env(const char* var_name, QByteArray var_value)
 {
@@ -358,6 +385,41 @@ TEST_F(PlatformLinux, test_not_snap_returns_expected_default_address)
     EXPECT_EQ(mp::platform::default_server_address(), fmt::format("unix:/run/multipass_socket"));
 }
 
+TEST_F(PlatformLinux, copy_file_copies_data_around_holes)
+{
+    mpt::TempDir temp_dir;
+    const auto source = temp_dir.path() + "/source.img";
+    const auto destination = temp_dir.path() + "/destination.img";
+
+    QFile source_file{source};
+    ASSERT_TRUE(source_file.open(QIODevice::WriteOnly));
+    source_file.write("start");
+    source_file.seek(8 * 1024 * 1024);
+    source_file.write("middle");
+    source_file.resize(16 * 1024 * 1024);
+    source_file.close();
+
+    ASSERT_TRUE(mp::platform::copy_file(source, destination));
+
+    QFile destination_file{destination};
+    ASSERT_TRUE(destination_file.open(QIODevice::ReadOnly));
+    ASSERT_TRUE(source_file.open(QIODevice::ReadOnly));
+    EXPECT_EQ(destination_file.size(), source_file.size());
+    EXPECT_TRUE(destination_file.readAll() == source_file.readAll());
+
+    // Wherever the filesystem keeps the holes of the source, the copy keeps them too
+    EXPECT_LE(allocated_bytes(destination), allocated_bytes(source));
+    if (first_hole_in(source) < 8 * 1024 * 1024)
+        EXPECT_LT(first_hole_in(destination), 8 * 1024 * 1024);
+}
+
+TEST_F(PlatformLinux, copy_file_fails_for_missing_source)
+{
+    mpt::TempDir temp_dir;
+
+    EXPECT_FALSE(mp::platform::copy_file(temp_dir.path() + "/missing.img", temp_dir.path() + "/destination.img"));
+}
+
 struct TestUnsupportedDrivers : public TestWithParam<QString>
 {
 };
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "local_http_server.h"
+
+#include <multipass/format.h>
+
+#include <QHostAddress>
+#include <QRegularExpression>
+#include <QTcpSocket>
+
+#include <stdexcept>
+
+namespace mpt = multipass::test;
+
+mpt::LocalHttpServer::LocalHttpServer(const QByteArray& content) : content{content}
+{
+    if (!server.listen(QHostAddress::LocalHost))
+        throw std::runtime_error("test failed to start local http server");
+
+    QObject::connect(&server, &QTcpServer::newConnection, [this] {
+        while (auto socket = server.nextPendingConnection())
+        {
+            ++connections;
+
+            QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            QObject::connect(socket, &QTcpSocket::readyRead, [this, socket] {
+                auto received = socket->property("received").toByteArray() + socket->readAll();
+
+                // Requests have no body, so the end of the headers is the end of the request
+                for (auto end = received.indexOf("\r\n\r\n"); end >= 0; end = received.indexOf("\r\n\r\n"))
+                {
+                    respond(socket, received.left(end + 4));
+                    received.remove(0, end + 4);
+                }
+
+                socket->setProperty("received", received);
+            });
+        }
+    });
+}
+
+QUrl mpt::LocalHttpServer::url() const
+{
+    return QUrl{QString("http://127.0.0.1:%1/image.img").arg(server.serverPort())};
+}
+
+void mpt::LocalHttpServer::cut_responses_short(const std::deque<qint64>& body_sizes)
+{
+    cut_body_sizes = body_sizes;
+}
+
+void mpt::LocalHttpServer::set_accepts_ranges(bool accepts)
+{
+    accepts_ranges = accepts;
+}
+
+void mpt::LocalHttpServer::set_keeps_connections_alive(bool keep_alive)
+{
+    keeps_connections_alive = keep_alive;
+}
+
+void mpt::LocalHttpServer::set_etag(const QByteArray& etag)
+{
+    this->etag = etag;
+}
+
+void mpt::LocalHttpServer::set_answers_head_requests(bool answers)
+{
+    answers_head_requests = answers;
+}
+
+const std::vector<std::string>& mpt::LocalHttpServer::requested_ranges() const
+{
+    return ranges;
+}
+
+int mpt::LocalHttpServer::connections_accepted() const
+{
+    return connections;
+}
+
+void mpt::LocalHttpServer::respond(QTcpSocket* socket, const QByteArray& request)
+{
+    const auto head = request.startsWith("HEAD ");
+    const auto range_match = QRegularExpression{"\r\nRange: bytes=(\\d+)-(\\d*)\r\n"}.match(request);
+    const auto if_range_match = QRegularExpression{"\r\nIf-Range: ([^\r]*)\r\n"}.match(request);
+
+    if (head && !answers_head_requests)
+        return;
+
+    if (!head)
+        ranges.push_back(range_match.hasMatch()
+                             ? fmt::format("bytes={}-{}", range_match.captured(1), range_match.captured(2))
+                             : "");
+
+    QByteArray headers;
+    auto body = content;
+
+    const auto same_content = !if_range_match.hasMatch() || if_range_match.captured(1).toUtf8() == etag;
+    if (range_match.hasMatch() && accepts_ranges && same_content && !head)
+    {
+        const auto start = range_match.captured(1).toLongLong();
+        const auto end = range_match.captured(2).isEmpty() ? content.size() - 1 : range_match.captured(2).toLongLong();
+
+        body = content.mid(start, end - start + 1);
+        headers = QString("HTTP/1.1 206 Partial Content\r\nContent-Range: bytes %1-%2/%3\r\n")
+                      .arg(start)
+                      .arg(end)
+                      .arg(content.size())
+                      .toUtf8();
+    }
+    else
+    {
+        headers = "HTTP/1.1 200 OK\r\n";
+    }
+
+    headers += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    headers += "ETag: " + etag + "\r\n";
+    if (accepts_ranges)
+        headers += "Accept-Ranges: bytes\r\n";
+    headers += keeps_connections_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+
+    socket->write(headers);
+
+    // Closing before the whole body was sent is what a dropped connection looks like to the client
+    auto cut_short = false;
+    if (!head)
+    {
+        if (!cut_body_sizes.empty())
+        {
+            body = body.left(cut_body_sizes.front());
+            cut_body_sizes.pop_front();
+            cut_short = true;
+        }
+
+        socket->write(body);
+    }
+
+    if (!keeps_connections_alive || cut_short)
+        socket->disconnectFromHost();
+}
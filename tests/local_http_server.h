@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_LOCAL_HTTP_SERVER_H
+#define MULTIPASS_LOCAL_HTTP_SERVER_H
+
+#include <QByteArray>
+#include <QTcpServer>
+#include <QUrl>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+class QTcpSocket;
+
+namespace multipass
+{
+namespace test
+{
+// Serves content over HTTP on the loopback interface, from the thread it was created on, for whatever path is asked.
+// Connections are closed after each response, unless asked to keep them alive.
+class LocalHttpServer
+{
+public:
+    LocalHttpServer(const QByteArray& content);
+
+    QUrl url() const;
+
+    // The next responses are cut off after sending this many bytes of their body each, one per response
+    void cut_responses_short(const std::deque<qint64>& body_sizes);
+    // When false, the Range header is ignored and the whole content sent
+    void set_accepts_ranges(bool accepts);
+    void set_keeps_connections_alive(bool keep_alive);
+    // Sent as the ETag of the content, ranges are only sent when an If-Range header matches it
+    void set_etag(const QByteArray& etag);
+    // When false, HEAD requests are left without an answer
+    void set_answers_head_requests(bool answers);
+    // The Range header of every GET received, empty if there was none
+    const std::vector<std::string>& requested_ranges() const;
+    int connections_accepted() const;
+
+private:
+    void respond(QTcpSocket* socket, const QByteArray& request);
+
+    QTcpServer server;
+    const QByteArray content;
+    std::deque<qint64> cut_body_sizes;
+    bool accepts_ranges{true};
+    bool keeps_connections_alive{false};
+    QByteArray etag{"\"1\""};
+    bool answers_head_requests{true};
+    std::vector<std::string> ranges;
+    int connections{0};
+};
+} // namespace test
+} // namespace multipass
+
+#endif // MULTIPASS_LOCAL_HTTP_SERVER_H
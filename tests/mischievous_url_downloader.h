@@ -31,8 +31,8 @@ class MischievousURLDownloader : public URLDownloader
 public:
     MischievousURLDownloader(std::chrono::milliseconds timeout);
 
-    void download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
-                     const ProgressMonitor& monitor) override;
+    QString download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
+                        const ProgressMonitor& monitor) override;
     QByteArray download(const QUrl& url) override;
     QDateTime last_modified(const QUrl& url) override;
 
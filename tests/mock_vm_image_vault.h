@@ -48,6 +48,8 @@ public:
     MOCK_METHOD1(has_record_for, bool(const std::string&));
     MOCK_METHOD0(prune_expired_images, void());
     MOCK_METHOD3(update_images, void(const FetchType&, const PrepareAction&, const ProgressMonitor&));
+    MOCK_METHOD5(prefetch_images, void(const FetchType&, const std::vector<Query>&, const PrepareAction&,
+                                       const ProgressMonitor&, const MemorySize&));
     MOCK_METHOD1(minimum_image_size_for, MemorySize(const std::string&));
 
 private:
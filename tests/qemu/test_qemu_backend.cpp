@@ -147,6 +147,23 @@ TEST_F(QemuBackend, machine_start_suspend_sends_monitoring_event)
     machine->suspend();
 }
 
+TEST_F(QemuBackend, machine_with_native_mounts_not_plugged_in_suspends)
+{
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    mp::QemuVirtualMachineFactory backend{data_dir.path()};
+
+    auto machine = backend.create_virtual_machine(default_description, mock_monitor);
+
+    const mp::VMMount mount{data_dir.path().toStdString(), {}, {}, mp::VMMount::MountType::Native};
+    EXPECT_FALSE(machine->add_native_mount("/mnt/native", mount));
+
+    machine->start();
+    machine->state = mp::VirtualMachine::State::running;
+
+    EXPECT_CALL(mock_monitor, on_suspend());
+    EXPECT_NO_THROW(machine->suspend());
+}
+
 TEST_F(QemuBackend, throws_when_starting_while_suspending)
 {
     NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
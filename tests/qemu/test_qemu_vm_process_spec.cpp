@@ -163,6 +163,35 @@ TEST_F(TestQemuVMProcessSpec, resume_with_missing_machine_type_guesses_correctly
     EXPECT_EQ(spec.arguments(), QStringList({"-args", "-loadvm", "suspend_tag"}));
 }
 
+TEST_F(TestQemuVMProcessSpec, native_mount_sockets_give_shared_guest_memory)
+{
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt, "/run/virtiofs");
+
+    const auto args = spec.arguments();
+    EXPECT_THAT(args, Contains("memory-backend-memfd,id=mem,size=3072M,share=on"));
+    EXPECT_THAT(args, Contains("node,memdev=mem"));
+    EXPECT_FALSE(args.join(' ').contains("vhost-user-fs-pci"));
+    EXPECT_TRUE(spec.apparmor_profile().contains("/run/virtiofs/*.sock rw,"));
+}
+
+TEST_F(TestQemuVMProcessSpec, no_native_mount_sockets_keep_private_guest_memory)
+{
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt);
+
+    EXPECT_FALSE(spec.arguments().join(' ').contains("memory-backend-memfd"));
+    EXPECT_FALSE(spec.apparmor_profile().contains("native mount sockets"));
+}
+
+TEST_F(TestQemuVMProcessSpec, resume_keeps_saved_arguments_with_native_mount_sockets)
+{
+    const mp::QemuVMProcessSpec::ResumeData resume_data{"suspend_tag", "machine_type", false, {"-one", "-two"}};
+
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, resume_data, "/run/virtiofs");
+
+    EXPECT_EQ(spec.arguments(), QStringList({"-one", "-two", "-loadvm", "suspend_tag", "-machine", "machine_type"}));
+    EXPECT_TRUE(spec.apparmor_profile().contains("/run/virtiofs/*.sock rw,"));
+}
+
 TEST_F(TestQemuVMProcessSpec, apparmor_profile_has_correct_name)
 {
     mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt);
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <src/platform/backends/qemu/virtiofsd_process_spec.h>
+
+#include "tests/mock_environment_helpers.h"
+#include <gmock/gmock.h>
+#include <multipass/cli/client_platform.h>
+
+#include <QTemporaryDir>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+using namespace testing;
+
+struct TestVirtiofsdProcessSpec : public Test
+{
+    const std::string vm_name{"foo"};
+    const QString tag{"mp-0123456789abcdef01234567"};
+    const QString socket_path{"/run/virtiofs/mp-0123456789abcdef01234567.sock"};
+    mp::VMMount mount{"/home/user/source", {{1000, 1001}}, {{1000, 1002}}, mp::VMMount::MountType::Native};
+};
+
+TEST_F(TestVirtiofsdProcessSpec, default_arguments_correct)
+{
+    mp::VirtiofsdProcessSpec spec(vm_name, tag, socket_path, mount);
+
+    EXPECT_EQ(spec.program(), "virtiofsd");
+    EXPECT_EQ(spec.arguments(),
+              QStringList({"--socket-path=/run/virtiofs/mp-0123456789abcdef01234567.sock",
+                           "--shared-dir=/home/user/source", "--sandbox=none", "--cache=auto",
+                           "--translate-uid=map:1002:1000:1", "--translate-gid=map:1001:1000:1"}));
+}
+
+TEST_F(TestVirtiofsdProcessSpec, does_not_translate_unresolved_default_ids)
+{
+    mount.uid_map = {{1000, mp::default_id}};
+    mount.gid_map = {{1000, mp::default_id}};
+    mp::VirtiofsdProcessSpec spec(vm_name, tag, socket_path, mount);
+
+    const auto args = spec.arguments().join(' ');
+    EXPECT_FALSE(args.contains("--translate-uid"));
+    EXPECT_FALSE(args.contains("--translate-gid"));
+}
+
+TEST_F(TestVirtiofsdProcessSpec, apparmor_profile_identifier)
+{
+    mp::VirtiofsdProcessSpec spec(vm_name, tag, socket_path, mount);
+
+    EXPECT_EQ(spec.identifier(), "foo.mp-0123456789abcdef01234567");
+    EXPECT_TRUE(spec.apparmor_profile().contains("profile multipass.foo.mp-0123456789abcdef01234567.virtiofsd"));
+}
+
+TEST_F(TestVirtiofsdProcessSpec, apparmor_profile_permits_socket_and_shared_dir)
+{
+    mp::VirtiofsdProcessSpec spec(vm_name, tag, socket_path, mount);
+
+    const auto profile = spec.apparmor_profile();
+    EXPECT_TRUE(profile.contains("/run/virtiofs/mp-0123456789abcdef01234567.sock rw,"));
+    EXPECT_TRUE(profile.contains("/home/user/source/ r,"));
+    EXPECT_TRUE(profile.contains("/home/user/source/** rwlk,"));
+}
+
+TEST_F(TestVirtiofsdProcessSpec, apparmor_profile_running_as_snap_correct)
+{
+    const QByteArray snap_name{"multipass"};
+    QTemporaryDir snap_dir;
+
+    mpt::SetEnvScope e1("SNAP", snap_dir.path().toUtf8());
+    mpt::SetEnvScope e2("SNAP_NAME", snap_name);
+    mp::VirtiofsdProcessSpec spec(vm_name, tag, socket_path, mount);
+
+    EXPECT_TRUE(spec.apparmor_profile().contains("signal (receive) peer=snap.multipass.multipassd"));
+    EXPECT_TRUE(spec.apparmor_profile().contains(
+        QString("%1/{usr/,}{bin,libexec,lib}/virtiofsd ixr,").arg(snap_dir.path())));
+}
+
+TEST_F(TestVirtiofsdProcessSpec, apparmor_profile_not_running_as_snap_correct)
+{
+    const QByteArray snap_name{"multipass"};
+
+    mpt::UnsetEnvScope e("SNAP");
+    mpt::SetEnvScope e2("SNAP_NAME", snap_name);
+    mp::VirtiofsdProcessSpec spec(vm_name, tag, socket_path, mount);
+
+    EXPECT_TRUE(spec.apparmor_profile().contains("signal (receive) peer=unconfined"));
+    EXPECT_TRUE(spec.apparmor_profile().contains(" /{usr/,}{bin,libexec,lib}/virtiofsd ixr,")); // space wanted
+}
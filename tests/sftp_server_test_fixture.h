@@ -70,31 +70,45 @@ private:
 struct SftpServerTest : public testing::Test
 {
     SftpServerTest()
-        : free_sftp{mock_sftp_free, [](sftp_session sftp) {
+        : free_sftp{mock_sftp_free,
+                    [](sftp_session sftp) {
                         std::free(sftp->handles);
                         std::free(sftp);
-                    }}
+                    }},
+          // Every sftp session starts with the client sending SSH_FXP_INIT, for version 3
+          read_init{mock_ssh_channel_read,
+                    [this](ssh_channel, void* dest, uint32_t count, int) {
+                        const unsigned char init[] = {0, 0, 0, 5, SSH_FXP_INIT, 0, 0, 0, 3};
+                        for (auto i = 0u; i < count; ++i)
+                            static_cast<unsigned char*>(dest)[i] = init[init_read_pos++ % sizeof(init)];
+                        return static_cast<int>(count);
+                    }},
+          write_version{mock_ssh_channel_write,
+                        [](ssh_channel, const void*, uint32_t len) { return static_cast<int>(len); }}
     {
         connect.returnValue(SSH_OK);
         is_connected.returnValue(true);
         open_session.returnValue(SSH_OK);
         request_exec.returnValue(SSH_OK);
-        init_sftp.returnValue(SSH_OK);
         reply_status.returnValue(SSH_OK);
         get_client_msg.returnValue(nullptr);
         handle_sftp.returnValue(nullptr);
+        channel_poll.returnValue(1);
     }
 
     decltype(MOCK(ssh_connect)) connect{MOCK(ssh_connect)};
     decltype(MOCK(ssh_is_connected)) is_connected{MOCK(ssh_is_connected)};
     decltype(MOCK(ssh_channel_open_session)) open_session{MOCK(ssh_channel_open_session)};
     decltype(MOCK(ssh_channel_request_exec)) request_exec{MOCK(ssh_channel_request_exec)};
-    decltype(MOCK(sftp_server_init)) init_sftp{MOCK(sftp_server_init)};
     decltype(MOCK(sftp_reply_status)) reply_status{MOCK(sftp_reply_status)};
     decltype(MOCK(sftp_get_client_message)) get_client_msg{MOCK(sftp_get_client_message)};
     decltype(MOCK(sftp_client_message_free)) msg_free{MOCK(sftp_client_message_free)};
     decltype(MOCK(sftp_handle)) handle_sftp{MOCK(sftp_handle)};
+    decltype(MOCK(ssh_channel_poll_timeout)) channel_poll{MOCK(ssh_channel_poll_timeout)};
     MockScope<decltype(mock_sftp_free)> free_sftp;
+    std::size_t init_read_pos{0};
+    MockScope<decltype(mock_ssh_channel_read)> read_init;
+    MockScope<decltype(mock_ssh_channel_write)> write_version;
 };
 } // namespace test
 } // namespace multipass
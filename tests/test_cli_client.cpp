@@ -59,38 +59,39 @@ struct MockDaemonRpc : public mp::DaemonRpc
 {
     using mp::DaemonRpc::DaemonRpc; // ctor
 
-    MOCK_METHOD3(create, grpc::Status(grpc::ServerContext* context, const mp::CreateRequest* request,
-                                      grpc::ServerWriter<mp::CreateReply>* reply)); // here only to ensure not called
+    MOCK_METHOD3(create,
+                 grpc::Status(grpc::ServerContext* context, const mp::CreateRequest* request,
+                              grpc::ServerWriterInterface<mp::CreateReply>* reply)); // here only to ensure not called
     MOCK_METHOD3(launch, grpc::Status(grpc::ServerContext* context, const mp::LaunchRequest* request,
-                                      grpc::ServerWriter<mp::LaunchReply>* reply));
+                                      grpc::ServerWriterInterface<mp::LaunchReply>* reply));
     MOCK_METHOD3(purge, grpc::Status(grpc::ServerContext* context, const mp::PurgeRequest* request,
-                                     grpc::ServerWriter<mp::PurgeReply>* response));
+                                     grpc::ServerWriterInterface<mp::PurgeReply>* response));
     MOCK_METHOD3(find, grpc::Status(grpc::ServerContext* context, const mp::FindRequest* request,
-                                    grpc::ServerWriter<mp::FindReply>* response));
+                                    grpc::ServerWriterInterface<mp::FindReply>* response));
     MOCK_METHOD3(info, grpc::Status(grpc::ServerContext* context, const mp::InfoRequest* request,
-                                    grpc::ServerWriter<mp::InfoReply>* response));
+                                    grpc::ServerWriterInterface<mp::InfoReply>* response));
     MOCK_METHOD3(list, grpc::Status(grpc::ServerContext* context, const mp::ListRequest* request,
-                                    grpc::ServerWriter<mp::ListReply>* response));
+                                    grpc::ServerWriterInterface<mp::ListReply>* response));
     MOCK_METHOD3(mount, grpc::Status(grpc::ServerContext* context, const mp::MountRequest* request,
-                                     grpc::ServerWriter<mp::MountReply>* response));
+                                     grpc::ServerWriterInterface<mp::MountReply>* response));
     MOCK_METHOD3(recover, grpc::Status(grpc::ServerContext* context, const mp::RecoverRequest* request,
-                                       grpc::ServerWriter<mp::RecoverReply>* response));
+                                       grpc::ServerWriterInterface<mp::RecoverReply>* response));
     MOCK_METHOD3(ssh_info, grpc::Status(grpc::ServerContext* context, const mp::SSHInfoRequest* request,
-                                        grpc::ServerWriter<mp::SSHInfoReply>* response));
+                                        grpc::ServerWriterInterface<mp::SSHInfoReply>* response));
     MOCK_METHOD3(start, grpc::Status(grpc::ServerContext* context, const mp::StartRequest* request,
-                                     grpc::ServerWriter<mp::StartReply>* response));
+                                     grpc::ServerWriterInterface<mp::StartReply>* response));
     MOCK_METHOD3(stop, grpc::Status(grpc::ServerContext* context, const mp::StopRequest* request,
-                                    grpc::ServerWriter<mp::StopReply>* response));
+                                    grpc::ServerWriterInterface<mp::StopReply>* response));
     MOCK_METHOD3(suspend, grpc::Status(grpc::ServerContext* context, const mp::SuspendRequest* request,
-                                       grpc::ServerWriter<mp::SuspendReply>* response));
+                                       grpc::ServerWriterInterface<mp::SuspendReply>* response));
     MOCK_METHOD3(restart, grpc::Status(grpc::ServerContext* context, const mp::RestartRequest* request,
-                                       grpc::ServerWriter<mp::RestartReply>* response));
+                                       grpc::ServerWriterInterface<mp::RestartReply>* response));
     MOCK_METHOD3(delet, grpc::Status(grpc::ServerContext* context, const mp::DeleteRequest* request,
-                                     grpc::ServerWriter<mp::DeleteReply>* response));
+                                     grpc::ServerWriterInterface<mp::DeleteReply>* response));
     MOCK_METHOD3(umount, grpc::Status(grpc::ServerContext* context, const mp::UmountRequest* request,
-                                      grpc::ServerWriter<mp::UmountReply>* response));
+                                      grpc::ServerWriterInterface<mp::UmountReply>* response));
     MOCK_METHOD3(version, grpc::Status(grpc::ServerContext* context, const mp::VersionRequest* request,
-                                       grpc::ServerWriter<mp::VersionReply>* response));
+                                       grpc::ServerWriterInterface<mp::VersionReply>* response));
     MOCK_METHOD3(ping,
                  grpc::Status(grpc::ServerContext* context, const mp::PingRequest* request, mp::PingReply* response));
 };
@@ -225,7 +226,7 @@ struct Client : public Test
 
     auto make_fill_listreply(std::vector<mp::InstanceStatus_Status> statuses)
     {
-        return [statuses](Unused, Unused, grpc::ServerWriter<mp::ListReply>* response) {
+        return [statuses](Unused, Unused, grpc::ServerWriterInterface<mp::ListReply>* response) {
             mp::ListReply list_reply;
 
             for (mp::InstanceStatus_Status status : statuses)
@@ -253,8 +254,8 @@ struct Client : public Test
 #endif
     mpt::StubCertProvider cert_provider;
     mpt::StubCertStore cert_store;
-    StrictMock<MockDaemonRpc> mock_daemon{server_address, mp::RpcConnectionType::insecure, cert_provider,
-                                          cert_store}; // strict to fail on unexpected calls and play well with sharing
+    StrictMock<MockDaemonRpc> mock_daemon{server_address, mp::RpcConnectionType::insecure, cert_provider, cert_store,
+                                          4, 1}; // strict to fail on unexpected calls and play well with sharing
     mpt::MockSettings& mock_settings = mpt::MockSettings::mock_instance(); /* although this is shared, expectations are
                                                                               reset at the end of each test */
     static std::stringstream trash_stream; // this may have contents (that we don't care about)
@@ -934,6 +935,60 @@ TEST_F(Client, mount_cmd_fails_invalid_host_int_gid_map)
                 Eq(mp::ReturnCode::CommandLineError));
 }
 
+TEST_F(Client, mount_cmd_good_native_type)
+{
+    EXPECT_CALL(mock_daemon,
+                mount(_, Property(&mp::MountRequest::mount_type, Eq(mp::MountRequest::NATIVE)), _));
+    EXPECT_THAT(send_command({"mount", mpt::test_data_path().toStdString(), "-t", "native", "test-vm:test"}),
+                Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, mount_cmd_defaults_to_classic_type)
+{
+    EXPECT_CALL(mock_daemon,
+                mount(_, Property(&mp::MountRequest::mount_type, Eq(mp::MountRequest::CLASSIC)), _));
+    EXPECT_THAT(send_command({"mount", mpt::test_data_path().toStdString(), "test-vm:test"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, mount_cmd_fails_invalid_type)
+{
+    EXPECT_THAT(send_command({"mount", mpt::test_data_path().toStdString(), "-t", "nfs", "test-vm:test"}),
+                Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, mount_cmd_good_readonly_cached_profile)
+{
+    EXPECT_CALL(mock_daemon, mount(_,
+                                   Property(&mp::MountRequest::mount_profile,
+                                            Eq(mp::MountRequest::PROFILE_READONLY_CACHED)),
+                                   _));
+    EXPECT_THAT(send_command({"mount", mpt::test_data_path().toStdString(), "--mount-profile", "readonly-cached",
+                              "test-vm:test"}),
+                Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, mount_cmd_defaults_to_default_profile)
+{
+    EXPECT_CALL(mock_daemon,
+                mount(_, Property(&mp::MountRequest::mount_profile, Eq(mp::MountRequest::PROFILE_DEFAULT)), _));
+    EXPECT_THAT(send_command({"mount", mpt::test_data_path().toStdString(), "test-vm:test"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, mount_cmd_fails_invalid_profile)
+{
+    EXPECT_THAT(send_command({"mount", mpt::test_data_path().toStdString(), "--mount-profile", "fast",
+                              "test-vm:test"}),
+                Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, mount_cmd_fails_profile_with_native_type)
+{
+    EXPECT_CALL(mock_daemon, mount(_, _, _)).Times(0);
+    EXPECT_THAT(send_command({"mount", mpt::test_data_path().toStdString(), "-t", "native", "--mount-profile",
+                              "strict", "test-vm:test"}),
+                Eq(mp::ReturnCode::CommandLineError));
+}
+
 // recover cli tests
 TEST_F(Client, recover_cmd_fails_no_args)
 {
@@ -1606,7 +1661,9 @@ TEST_P(TestBasicGetSetOptions, set_cmd_allows_empty_val)
 }
 
 INSTANTIATE_TEST_SUITE_P(Client, TestBasicGetSetOptions,
-                         Values(mp::petenv_key, mp::driver_key, mp::autostart_key, mp::hotkey_key));
+                         Values(mp::petenv_key, mp::driver_key, mp::autostart_key, mp::hotkey_key,
+                                mp::prefetch_images_key, mp::prefetch_rate_key, mp::mount_cache_attributes_key,
+                                mp::image_decoder_threads_key));
 
 TEST_F(Client, get_cmd_fails_with_no_arguments)
 {
@@ -1714,6 +1771,22 @@ TEST_F(Client, get_returns_normalized_hotkey_by_default)
     EXPECT_EQ(hotkey, (QKeySequence{hotkey, QKeySequence::NativeText}.toString(QKeySequence::NativeText)));
 }
 
+TEST_F(Client, get_returns_no_prefetch_images_and_unlimited_rate_by_default)
+{
+    EXPECT_THAT(get_setting(mp::prefetch_images_key), IsEmpty());
+    EXPECT_THAT(get_setting(mp::prefetch_rate_key), Eq("0"));
+}
+
+TEST_F(Client, get_returns_attribute_caching_disabled_by_default)
+{
+    EXPECT_THAT(get_setting(mp::mount_cache_attributes_key), Eq("false"));
+}
+
+TEST_F(Client, get_returns_one_image_decoder_thread_per_core_by_default)
+{
+    EXPECT_THAT(get_setting(mp::image_decoder_threads_key), Eq("0"));
+}
+
 TEST_F(Client, set_cmd_rejects_bad_autostart_values)
 {
     aux_set_cmd_rejects_bad_val(mp::autostart_key, "asdf");
@@ -38,7 +38,9 @@
 #include "mock_environment_helpers.h"
 #include "mock_logger.h"
 #include "mock_process_factory.h"
+#include "mock_ssh.h"
 #include "mock_standard_paths.h"
+#include "mock_virtual_machine.h"
 #include "mock_virtual_machine_factory.h"
 #include "mock_vm_image_vault.h"
 #include "stub_cert_store.h"
@@ -56,6 +58,8 @@
 #include <gtest/gtest.h>
 
 #include <QCoreApplication>
+#include <QDir>
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QNetworkProxyFactory>
@@ -65,10 +69,20 @@
 
 #include <scope_guard.hpp>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <ostream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace mp = multipass;
 namespace mpl = multipass::logging;
@@ -99,38 +113,42 @@ struct MockDaemon : public mp::Daemon
 {
     using mp::Daemon::Daemon;
 
-    MOCK_METHOD3(create,
-                 void(const mp::CreateRequest*, grpc::ServerWriter<mp::CreateReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(launch,
-                 void(const mp::LaunchRequest*, grpc::ServerWriter<mp::LaunchReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(purge,
-                 void(const mp::PurgeRequest*, grpc::ServerWriter<mp::PurgeReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(find,
-                 void(const mp::FindRequest* request, grpc::ServerWriter<mp::FindReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(info, void(const mp::InfoRequest*, grpc::ServerWriter<mp::InfoReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(list, void(const mp::ListRequest*, grpc::ServerWriter<mp::ListReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(mount, void(const mp::MountRequest* request, grpc::ServerWriter<mp::MountReply>*,
+    MOCK_METHOD3(create, void(const mp::CreateRequest*, grpc::ServerWriterInterface<mp::CreateReply>*,
+                              std::promise<grpc::Status>*));
+    MOCK_METHOD3(launch, void(const mp::LaunchRequest*, grpc::ServerWriterInterface<mp::LaunchReply>*,
+                              std::promise<grpc::Status>*));
+    MOCK_METHOD3(purge, void(const mp::PurgeRequest*, grpc::ServerWriterInterface<mp::PurgeReply>*,
                              std::promise<grpc::Status>*));
-    MOCK_METHOD3(recover,
-                 void(const mp::RecoverRequest*, grpc::ServerWriter<mp::RecoverReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(ssh_info,
-                 void(const mp::SSHInfoRequest*, grpc::ServerWriter<mp::SSHInfoReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(start,
-                 void(const mp::StartRequest*, grpc::ServerWriter<mp::StartReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(stop, void(const mp::StopRequest*, grpc::ServerWriter<mp::StopReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(suspend,
-                 void(const mp::SuspendRequest*, grpc::ServerWriter<mp::SuspendReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(restart,
-                 void(const mp::RestartRequest*, grpc::ServerWriter<mp::RestartReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(delet,
-                 void(const mp::DeleteRequest*, grpc::ServerWriter<mp::DeleteReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(umount,
-                 void(const mp::UmountRequest*, grpc::ServerWriter<mp::UmountReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(version,
-                 void(const mp::VersionRequest*, grpc::ServerWriter<mp::VersionReply>*, std::promise<grpc::Status>*));
+    MOCK_METHOD3(find, void(const mp::FindRequest* request, grpc::ServerWriterInterface<mp::FindReply>*,
+                            std::promise<grpc::Status>*));
+    MOCK_METHOD3(info, void(const mp::InfoRequest*, grpc::ServerWriterInterface<mp::InfoReply>*,
+                            std::promise<grpc::Status>*));
+    MOCK_METHOD3(list, void(const mp::ListRequest*, grpc::ServerWriterInterface<mp::ListReply>*,
+                            std::promise<grpc::Status>*));
+    MOCK_METHOD3(mount, void(const mp::MountRequest* request, grpc::ServerWriterInterface<mp::MountReply>*,
+                             std::promise<grpc::Status>*));
+    MOCK_METHOD3(recover, void(const mp::RecoverRequest*, grpc::ServerWriterInterface<mp::RecoverReply>*,
+                               std::promise<grpc::Status>*));
+    MOCK_METHOD3(ssh_info, void(const mp::SSHInfoRequest*, grpc::ServerWriterInterface<mp::SSHInfoReply>*,
+                                std::promise<grpc::Status>*));
+    MOCK_METHOD3(start, void(const mp::StartRequest*, grpc::ServerWriterInterface<mp::StartReply>*,
+                             std::promise<grpc::Status>*));
+    MOCK_METHOD3(stop, void(const mp::StopRequest*, grpc::ServerWriterInterface<mp::StopReply>*,
+                            std::promise<grpc::Status>*));
+    MOCK_METHOD3(suspend, void(const mp::SuspendRequest*, grpc::ServerWriterInterface<mp::SuspendReply>*,
+                               std::promise<grpc::Status>*));
+    MOCK_METHOD3(restart, void(const mp::RestartRequest*, grpc::ServerWriterInterface<mp::RestartReply>*,
+                               std::promise<grpc::Status>*));
+    MOCK_METHOD3(delet, void(const mp::DeleteRequest*, grpc::ServerWriterInterface<mp::DeleteReply>*,
+                             std::promise<grpc::Status>*));
+    MOCK_METHOD3(umount, void(const mp::UmountRequest*, grpc::ServerWriterInterface<mp::UmountReply>*,
+                              std::promise<grpc::Status>*));
+    MOCK_METHOD3(version, void(const mp::VersionRequest*, grpc::ServerWriterInterface<mp::VersionReply>*,
+                               std::promise<grpc::Status>*));
 
     template <typename Request, typename Reply>
-    void set_promise_value(const Request*, grpc::ServerWriter<Reply>*, std::promise<grpc::Status>* status_promise)
+    void set_promise_value(const Request*, grpc::ServerWriterInterface<Reply>*,
+                           std::promise<grpc::Status>* status_promise)
     {
         status_promise->set_value(grpc::Status::OK);
     }
@@ -1217,6 +1235,977 @@ TEST_F(Daemon, skips_over_instance_ghosts_in_db) // which will have been sometim
     mp::Daemon daemon{config_builder.build()};
 }
 
+TEST_F(Daemon, persists_mount_profiles)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    constexpr auto mount_template = R"({{
+    "{}": {{
+        "deleted": false,
+        "disk_space": "3232323232",
+        "mac_addr": "ab:cd:ef:12:34:56",
+        "mem_size": "2323232323",
+        "metadata": {{}},
+        "mounts": [
+            {{
+                "gid_mappings": [],
+                "mount_profile": 2,
+                "source_path": "/home/user/strict",
+                "target_path": "strict",
+                "uid_mappings": []
+            }},
+            {{
+                "gid_mappings": [],
+                "source_path": "/home/user/legacy",
+                "target_path": "legacy",
+                "uid_mappings": []
+            }}
+        ],
+        "num_cores": 4,
+        "ssh_username": "ubuntu",
+        "state": 1
+    }}
+}})";
+
+    const auto name = "real-zebraphant";
+    auto temp_dir = plant_instance_json(fmt::format(mount_template, name));
+    const auto filename = temp_dir->path() + "/multipassd-vm-instances.json";
+
+    config_builder.data_directory = temp_dir->path();
+    mp::Daemon daemon{config_builder.build()};
+
+    // Rewrite the database from what the daemon read, through a purge that has nothing else to do
+    QFile::remove(filename);
+    send_command({"purge"});
+
+    const auto mounts = QJsonDocument::fromJson(mpt::load(filename)).object()[name].toObject()["mounts"].toArray();
+    ASSERT_EQ(mounts.size(), 2);
+
+    std::unordered_map<std::string, int> profiles;
+    for (const auto& mount : mounts)
+        profiles[mount.toObject()["target_path"].toString().toStdString()] = mount.toObject()["mount_profile"].toInt();
+
+    EXPECT_EQ(profiles["strict"], static_cast<int>(mp::VMMount::MountProfile::Strict));
+    EXPECT_EQ(profiles["legacy"], static_cast<int>(mp::VMMount::MountProfile::Default)); // written before profiles
+}
+
+TEST_F(Daemon, lists_running_instances_without_reaching_into_them)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    const auto name = "real-zebraphant";
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    config_builder.data_directory = temp_dir->path();
+
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        EXPECT_CALL(*vm, current_state).WillRepeatedly(Return(mp::VirtualMachine::State::running));
+        EXPECT_CALL(*vm, management_ipv4).WillRepeatedly(Return("10.1.2.3"));
+        // Only asked by the refresh at startup, the next one being a minute away
+        EXPECT_CALL(*vm, get_all_ipv4).WillOnce(Return(std::vector<std::string>{"10.1.2.3", "192.168.7.8"}));
+        return vm;
+    });
+
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream stream;
+    send_command({"list"}, stream);
+    EXPECT_THAT(stream.str(), AllOf(HasSubstr(name), HasSubstr("10.1.2.3")));
+
+    // The addresses of instances that were already running when the daemon started are listed once asked for
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (stream.str().find("192.168.7.8") == std::string::npos && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        stream.str("");
+        send_command({"list"}, stream);
+    }
+    EXPECT_THAT(stream.str(), HasSubstr("192.168.7.8"));
+}
+
+TEST_F(Daemon, watch_starts_with_a_snapshot_of_the_instances)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    const auto name = "real-zebraphant";
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    config_builder.data_directory = temp_dir->path();
+    use_a_mock_vm_factory();
+
+    mp::Daemon daemon{config_builder.build()};
+
+    mp::WatchReply reply;
+    mp::AutoJoinThread t([this, &reply] {
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        grpc::ClientContext context;
+        auto reader = stub->watch(&context, mp::WatchRequest{});
+        reader->Read(&reply);
+
+        context.TryCancel();
+        reader->Finish();
+        loop.quit();
+    });
+    loop.exec();
+
+    ASSERT_THAT(reply.snapshot().instances_size(), Eq(1));
+    EXPECT_THAT(reply.snapshot().instances(0).name(), Eq(name));
+    EXPECT_THAT(reply.snapshot().instances(0).instance_status().status(), Eq(mp::InstanceStatus::STOPPED));
+}
+
+TEST_F(Daemon, watch_streams_changes_that_follow_the_snapshot)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    const auto name = "real-zebraphant";
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    config_builder.data_directory = temp_dir->path();
+    use_a_mock_vm_factory();
+
+    mp::Daemon daemon{config_builder.build()};
+
+    mp::WatchReply change;
+    {
+        mp::AutoJoinThread t([this, &daemon, &change, name] {
+            auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+            grpc::ClientContext context;
+            auto reader = stub->watch(&context, mp::WatchRequest{});
+
+            mp::WatchReply snapshot;
+            reader->Read(&snapshot);
+            daemon.persist_state_for(name, mp::VirtualMachine::State::running);
+            reader->Read(&change);
+
+            context.TryCancel();
+            reader->Finish();
+        });
+    } // the event loop never runs: watches are served from the completion queue
+
+    ASSERT_THAT(change.changed_instances_size(), Eq(1));
+    EXPECT_THAT(change.changed_instances(0).name(), Eq(name));
+    EXPECT_THAT(change.changed_instances(0).instance_status().status(), Eq(mp::InstanceStatus::RUNNING));
+}
+
+TEST_F(Daemon, watch_streams_successive_changes_in_order)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    const auto name = "real-zebraphant";
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    config_builder.data_directory = temp_dir->path();
+    use_a_mock_vm_factory();
+
+    mp::Daemon daemon{config_builder.build()};
+
+    const std::vector<mp::VirtualMachine::State> states{
+        mp::VirtualMachine::State::starting, mp::VirtualMachine::State::running,
+        mp::VirtualMachine::State::suspending, mp::VirtualMachine::State::suspended, mp::VirtualMachine::State::off};
+    std::vector<mp::InstanceStatus::Status> statuses;
+    {
+        mp::AutoJoinThread t([this, &daemon, &states, &statuses, name] {
+            auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+            grpc::ClientContext context;
+            auto reader = stub->watch(&context, mp::WatchRequest{});
+
+            mp::WatchReply reply;
+            reader->Read(&reply);
+
+            // Report them all before reading any, some landing while the previous ones are being written
+            for (const auto& state : states)
+                daemon.persist_state_for(name, state);
+
+            while (statuses.size() < states.size() && reader->Read(&reply))
+                for (const auto& changed : reply.changed_instances())
+                    statuses.push_back(changed.instance_status().status());
+
+            context.TryCancel();
+            reader->Finish();
+        });
+    }
+
+    EXPECT_THAT(statuses, ElementsAre(mp::InstanceStatus::STARTING, mp::InstanceStatus::RUNNING,
+                                      mp::InstanceStatus::SUSPENDING, mp::InstanceStatus::SUSPENDED,
+                                      mp::InstanceStatus::STOPPED));
+}
+
+TEST_F(Daemon, watch_ends_when_the_client_cancels_and_leaves_others_watching)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    const auto name = "real-zebraphant";
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    config_builder.data_directory = temp_dir->path();
+    use_a_mock_vm_factory();
+
+    mp::Daemon daemon{config_builder.build()};
+
+    grpc::Status cancelled_status;
+    mp::WatchReply change;
+    {
+        mp::AutoJoinThread t([this, &daemon, &cancelled_status, &change, name] {
+            auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+            grpc::ClientContext cancelled_context, context;
+            auto cancelled_reader = stub->watch(&cancelled_context, mp::WatchRequest{});
+            auto reader = stub->watch(&context, mp::WatchRequest{});
+
+            mp::WatchReply snapshot;
+            cancelled_reader->Read(&snapshot);
+            reader->Read(&snapshot);
+
+            // Cancel while the watch is waiting for changes, and change things as it goes away
+            cancelled_context.TryCancel();
+            daemon.persist_state_for(name, mp::VirtualMachine::State::running);
+            cancelled_status = cancelled_reader->Finish();
+
+            reader->Read(&change);
+            context.TryCancel();
+            reader->Finish();
+        });
+    } // the daemon going away next waits for both watchers to be done
+
+    EXPECT_THAT(cancelled_status.error_code(), Eq(grpc::StatusCode::CANCELLED));
+    ASSERT_THAT(change.changed_instances_size(), Eq(1));
+    EXPECT_THAT(change.changed_instances(0).instance_status().status(), Eq(mp::InstanceStatus::RUNNING));
+}
+
+// Reports more changes to an instance than a client that is not reading can take in, so that writing to it stalls
+void report_more_changes_than_are_read(mp::Daemon& daemon, const std::string& name)
+{
+    for (auto i = 0; i < 6000; ++i)
+        daemon.persist_state_for(name, i % 2 ? mp::VirtualMachine::State::running : mp::VirtualMachine::State::stopped);
+}
+
+TEST_F(Daemon, watch_ends_with_resource_exhausted_for_clients_too_far_behind)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    const auto name = std::string(1000, 'z'); // big changes fill what the transport buffers sooner
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    config_builder.data_directory = temp_dir->path();
+    use_a_mock_vm_factory();
+
+    mp::Daemon daemon{config_builder.build()};
+
+    auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+    grpc::ClientContext context;
+    auto reader = stub->watch(&context, mp::WatchRequest{});
+
+    mp::WatchReply reply;
+    ASSERT_TRUE(reader->Read(&reply));
+    report_more_changes_than_are_read(daemon, name);
+
+    auto changes_read = 0;
+    while (reader->Read(&reply))
+        ++changes_read;
+
+    EXPECT_THAT(reader->Finish().error_code(), Eq(grpc::StatusCode::RESOURCE_EXHAUSTED));
+    EXPECT_THAT(changes_read, Lt(6000));
+}
+
+TEST_F(Daemon, goes_away_without_waiting_for_watch_clients_that_stopped_reading)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    const auto name = std::string(1000, 'z');
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    config_builder.data_directory = temp_dir->path();
+    use_a_mock_vm_factory();
+
+    auto daemon = std::make_unique<mp::Daemon>(config_builder.build());
+
+    auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+    grpc::ClientContext context;
+    auto reader = stub->watch(&context, mp::WatchRequest{});
+
+    mp::WatchReply reply;
+    ASSERT_TRUE(reader->Read(&reply));
+    report_more_changes_than_are_read(*daemon, name);
+
+    const auto start = std::chrono::steady_clock::now();
+    daemon.reset();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+
+    context.TryCancel();
+    reader->Finish();
+}
+
+TEST_F(Daemon, lists_without_the_event_loop)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    const auto name = "real-zebraphant";
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    config_builder.data_directory = temp_dir->path();
+    use_a_mock_vm_factory();
+
+    mp::Daemon daemon{config_builder.build()};
+
+    mp::ListReply reply;
+    grpc::Status status;
+    {
+        mp::AutoJoinThread t([this, &reply, &status] {
+            auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+            grpc::ClientContext context;
+            auto reader = stub->list(&context, mp::ListRequest{});
+            reader->Read(&reply);
+            status = reader->Finish();
+        });
+    } // the event loop never runs
+
+    EXPECT_TRUE(status.ok());
+    ASSERT_THAT(reply.instances_size(), Eq(1));
+    EXPECT_THAT(reply.instances(0).name(), Eq(name));
+}
+
+TEST_F(Daemon, asks_backends_and_vault_about_instances_on_the_event_loop_only)
+{
+    const auto event_loop_thread = std::this_thread::get_id();
+    std::atomic_int calls_elsewhere{0};
+    auto check_thread = [event_loop_thread, &calls_elsewhere] {
+        if (std::this_thread::get_id() != event_loop_thread)
+            ++calls_elsewhere;
+    };
+
+    auto mock_vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+    EXPECT_CALL(*mock_vault, fetch_image).WillRepeatedly([check_thread](auto...) {
+        check_thread();
+        return mp::VMImage{};
+    });
+    config_builder.vault = std::move(mock_vault);
+
+    const auto name = "real-zebraphant";
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    config_builder.data_directory = temp_dir->path();
+
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([check_thread](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        EXPECT_CALL(*vm, current_state).WillRepeatedly([check_thread] {
+            check_thread();
+            return mp::VirtualMachine::State::running;
+        });
+        EXPECT_CALL(*vm, management_ipv4).WillRepeatedly([check_thread] {
+            check_thread();
+            return "10.1.2.3";
+        });
+        EXPECT_CALL(*vm, ssh_hostname(_)).WillRepeatedly(Throw(std::runtime_error{"no address yet"}));
+        return vm;
+    });
+
+    mp::Daemon daemon{config_builder.build()};
+
+    // Backends report their states from threads of their own, which has the event loop ask about the rest
+    std::thread{[&daemon, name] { daemon.persist_state_for(name, mp::VirtualMachine::State::running); }}.join();
+
+    std::stringstream stream;
+    send_commands({{"list"}, {"info", name}}, stream);
+
+    EXPECT_THAT(stream.str(), AllOf(HasSubstr(name), HasSubstr("10.1.2.3")));
+    EXPECT_THAT(calls_elsewhere.load(), Eq(0));
+}
+
+// Has an instance come and go through the RPC, as clients do, reporting whether every step succeeded
+bool launch_mount_and_delete(mp::Rpc::Stub& stub, const std::string& name, const std::string& source_path)
+{
+    mp::LaunchRequest launch_request;
+    launch_request.set_instance_name(name);
+
+    auto metrics_pending = true;
+    while (metrics_pending) // every few launches ask about metrics first, and are sent again
+    {
+        metrics_pending = false;
+
+        grpc::ClientContext context;
+        mp::LaunchReply reply;
+        auto reader = stub.launch(&context, launch_request);
+        while (reader->Read(&reply))
+            metrics_pending = metrics_pending || reply.metrics_pending();
+        if (!reader->Finish().ok())
+            return false;
+    }
+
+    mp::MountRequest mount_request;
+    mount_request.set_source_path(source_path);
+    auto target = mount_request.add_target_paths();
+    target->set_instance_name(name);
+    target->set_target_path("target");
+    {
+        grpc::ClientContext context;
+        mp::MountReply reply;
+        auto reader = stub.mount(&context, mount_request);
+        while (reader->Read(&reply))
+            ;
+        if (!reader->Finish().ok())
+            return false;
+    }
+
+    mp::DeleteRequest delete_request;
+    delete_request.mutable_instance_names()->add_instance_name(name);
+    delete_request.set_purge(true);
+
+    grpc::ClientContext context;
+    mp::DeleteReply reply;
+    auto reader = stub.delet(&context, delete_request);
+    while (reader->Read(&reply))
+        ;
+    return reader->Finish().ok();
+}
+
+TEST_F(Daemon, launches_and_mounts_alongside_backend_state_reports)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    const auto name = "real-zebraphant";
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    const auto filename = temp_dir->path() + "/multipassd-vm-instances.json";
+    config_builder.data_directory = temp_dir->path();
+    use_a_mock_vm_factory();
+
+    mp::Daemon daemon{config_builder.build()};
+
+    // Backends report states and metadata from threads of their own, while instances come and go
+    std::atomic_bool reporting{true};
+    mp::AutoJoinThread backend([&daemon, &reporting, name] {
+        auto state = mp::VirtualMachine::State::running;
+        for (auto i = 0; reporting; ++i)
+        {
+            state = state == mp::VirtualMachine::State::running ? mp::VirtualMachine::State::stopped
+                                                                 : mp::VirtualMachine::State::running;
+            daemon.persist_state_for(name, state);
+            daemon.update_metadata_for(name, QJsonObject{{"reports", i}});
+        }
+    });
+
+    constexpr auto num_instances = 10;
+    std::atomic<int> failures{0};
+    mp::AutoJoinThread client([&] {
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        for (auto i = 0; i < num_instances; ++i)
+        {
+            const auto launched = fmt::format("launched-zebraphant-{}", i);
+            if (!launch_mount_and_delete(*stub, launched, temp_dir->path().toStdString()))
+                ++failures;
+        }
+
+        reporting = false;
+        loop.quit();
+    });
+    loop.exec();
+
+    EXPECT_THAT(failures.load(), Eq(0));
+
+    // Only what is left is written out, with what the backend reported last
+    const auto records = QJsonDocument::fromJson(mpt::load(filename)).object();
+    EXPECT_THAT(records.keys(), ElementsAre(QString{name}));
+    EXPECT_TRUE(records[name].toObject()["metadata"].toObject().contains("reports"));
+}
+
+TEST_F(Daemon, serves_concurrent_reads_alongside_mutations)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    const auto name = "real-zebraphant";
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    config_builder.data_directory = temp_dir->path();
+    use_a_mock_vm_factory();
+
+    mp::Daemon daemon{config_builder.build()};
+
+    constexpr auto num_readers = 8;
+    constexpr auto requests_per_client = 50;
+    std::atomic<int> failures{0};
+    std::mutex latencies_mutex;
+    std::vector<std::chrono::microseconds> latencies;
+
+    mp::AutoJoinThread clients([&] {
+        auto channel = grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials());
+
+        std::vector<std::thread> readers;
+        for (auto i = 0; i < num_readers; ++i)
+            readers.emplace_back([&, i] {
+                auto stub = mp::Rpc::NewStub(channel);
+                for (auto j = 0; j < requests_per_client; ++j)
+                {
+                    const auto start = std::chrono::steady_clock::now();
+                    grpc::ClientContext context;
+                    grpc::Status status;
+                    if ((i + j) % 2)
+                    {
+                        mp::ListReply reply;
+                        auto reader = stub->list(&context, mp::ListRequest{});
+                        reader->Read(&reply);
+                        status = reader->Finish();
+                    }
+                    else
+                    {
+                        mp::InfoRequest request;
+                        request.mutable_instance_names()->add_instance_name(name);
+
+                        mp::InfoReply reply;
+                        auto reader = stub->info(&context, request);
+                        reader->Read(&reply);
+                        status = reader->Finish();
+                    }
+                    const auto latency = std::chrono::steady_clock::now() - start;
+
+                    if (!status.ok())
+                        ++failures;
+
+                    std::lock_guard<std::mutex> lock{latencies_mutex};
+                    latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(latency));
+                }
+            });
+
+        // Meanwhile, keep the event loop busy with instances coming and going, and with purges in between
+        auto stub = mp::Rpc::NewStub(channel);
+        for (auto j = 0; j < requests_per_client; ++j)
+        {
+            if (j % 5 == 0 && !launch_mount_and_delete(*stub, fmt::format("launched-zebraphant-{}", j),
+                                                       temp_dir->path().toStdString()))
+                ++failures;
+
+            grpc::ClientContext context;
+            mp::PurgeReply reply;
+            auto reader = stub->purge(&context, mp::PurgeRequest{});
+            while (reader->Read(&reply))
+                ;
+            if (!reader->Finish().ok())
+                ++failures;
+        }
+
+        for (auto& reader : readers)
+            reader.join();
+
+        loop.quit();
+    });
+    loop.exec();
+
+    EXPECT_THAT(failures.load(), Eq(0));
+    ASSERT_THAT(latencies.size(), Eq(static_cast<std::size_t>(num_readers * requests_per_client)));
+
+    std::sort(latencies.begin(), latencies.end());
+    const auto p50 = latencies[latencies.size() / 2].count();
+    const auto p99 = latencies[latencies.size() * 99 / 100].count();
+    RecordProperty("read_latency_p50_us", static_cast<int>(p50));
+    RecordProperty("read_latency_p99_us", static_cast<int>(p99));
+}
+
+TEST_F(Daemon, info_reports_what_it_can_of_unreachable_running_instances)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    const auto name = "real-zebraphant";
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    config_builder.data_directory = temp_dir->path();
+
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        EXPECT_CALL(*vm, current_state).WillRepeatedly(Return(mp::VirtualMachine::State::running));
+        EXPECT_CALL(*vm, management_ipv4).WillRepeatedly(Return("10.1.2.3"));
+        EXPECT_CALL(*vm, ssh_hostname(_)).WillRepeatedly(Throw(std::runtime_error{"no address yet"}));
+        return vm;
+    });
+
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream stream;
+    send_command({"info", name}, stream);
+    EXPECT_THAT(stream.str(), AllOf(HasSubstr(name), HasSubstr("Running"), HasSubstr("10.1.2.3")));
+}
+
+// Has every SSH command on any guest exit right away, printing the given output. Guests are probed from several
+// threads at once, so all of this is safe to call concurrently.
+struct AnsweringGuests
+{
+    explicit AnsweringGuests(const std::string& output) : output{output}
+    {
+    }
+
+    int read(ssh_channel channel, void* dest, uint32_t count, int is_stderr)
+    {
+        if (is_stderr)
+            return 0;
+
+        std::lock_guard<std::mutex> lock{read_mutex};
+        auto offset = read_offsets[channel];
+        const auto size = std::min<std::size_t>(count, output.size() - offset);
+        std::copy_n(output.data() + offset, size, static_cast<char*>(dest));
+
+        // Channels that are done with may have their address reused by the next
+        if (size == 0)
+            read_offsets.erase(channel);
+        else
+            read_offsets[channel] = offset + size;
+
+        return static_cast<int>(size);
+    }
+
+    const std::string output;
+    std::mutex read_mutex;
+    std::map<ssh_channel, std::size_t> read_offsets;
+
+    MockScope<decltype(mock_ssh_connect)> connect{mock_ssh_connect, [](auto...) { return SSH_OK; }};
+    MockScope<decltype(mock_ssh_is_connected)> is_connected{mock_ssh_is_connected, [](auto...) { return 1; }};
+    MockScope<decltype(mock_ssh_userauth_publickey)> userauth{mock_ssh_userauth_publickey,
+                                                              [](auto...) { return SSH_AUTH_SUCCESS; }};
+    MockScope<decltype(mock_ssh_channel_open_session)> open_session{mock_ssh_channel_open_session,
+                                                                    [](auto...) { return SSH_OK; }};
+    MockScope<decltype(mock_ssh_channel_request_exec)> request_exec{mock_ssh_channel_request_exec,
+                                                                    [](auto...) { return SSH_OK; }};
+    MockScope<decltype(mock_ssh_channel_is_closed)> channel_is_closed{mock_ssh_channel_is_closed,
+                                                                      [](auto...) { return 0; }};
+    MockScope<decltype(mock_ssh_add_channel_callbacks)> add_channel_callbacks{
+        mock_ssh_add_channel_callbacks, [](ssh_channel, ssh_channel_callbacks callbacks) {
+            callbacks->channel_exit_status_function(nullptr, nullptr, 0, callbacks->userdata);
+            return SSH_OK;
+        }};
+    MockScope<decltype(mock_ssh_channel_read_timeout)> read_timeout{
+        mock_ssh_channel_read_timeout, [this](ssh_channel channel, void* dest, uint32_t count, int is_stderr, int) {
+            return read(channel, dest, count, is_stderr);
+        }};
+};
+
+constexpr auto guest_probe_output = "0.01 0.02 0.03\n"
+                                    "1073741824\n"
+                                    "2147483648\n"
+                                    "3221225472\n"
+                                    "5368709120\n"
+                                    "Ubuntu 20.04.2 LTS\n"
+                                    "ens3             UP             10.1.2.3/24 \n"
+                                    "ens4             UP             192.168.7.8/24 \n";
+
+TEST_F(Daemon, info_reports_what_guests_answer_to_the_probe)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    const auto name = "real-zebraphant";
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    config_builder.data_directory = temp_dir->path();
+
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        EXPECT_CALL(*vm, current_state).WillRepeatedly(Return(mp::VirtualMachine::State::running));
+        EXPECT_CALL(*vm, management_ipv4).WillRepeatedly(Return("10.1.2.3"));
+        return vm;
+    });
+
+    AnsweringGuests guests{guest_probe_output};
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream stream;
+    send_command({"info", name, "--format", "json"}, stream);
+
+    const auto info = QJsonDocument::fromJson(QByteArray::fromStdString(stream.str()))
+                          .object()["info"]
+                          .toObject()[name]
+                          .toObject();
+    EXPECT_EQ(info["load"].toArray(), QJsonArray({0.01, 0.02, 0.03}));
+    EXPECT_EQ(info["memory"].toObject()["used"].toDouble(), 1073741824);
+    EXPECT_EQ(info["memory"].toObject()["total"].toDouble(), 2147483648);
+    EXPECT_EQ(info["disks"].toObject()["sda1"].toObject()["used"].toString(), "3221225472");
+    EXPECT_EQ(info["disks"].toObject()["sda1"].toObject()["total"].toString(), "5368709120");
+    EXPECT_EQ(info["release"].toString(), "Ubuntu 20.04.2 LTS");
+    EXPECT_EQ(info["ipv4"].toArray(), QJsonArray({"10.1.2.3", "192.168.7.8"}));
+}
+
+TEST_F(Daemon, info_leaves_guest_values_out_when_probe_output_is_cut_short)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    const auto name = "real-zebraphant";
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    config_builder.data_directory = temp_dir->path();
+
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        EXPECT_CALL(*vm, current_state).WillRepeatedly(Return(mp::VirtualMachine::State::running));
+        EXPECT_CALL(*vm, management_ipv4).WillRepeatedly(Return("10.1.2.3"));
+        return vm;
+    });
+
+    AnsweringGuests guests{"0.01 0.02 0.03\n1073741824\n"};
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream stream;
+    send_command({"info", name}, stream);
+    EXPECT_THAT(stream.str(), AllOf(HasSubstr(name), HasSubstr("Running"), HasSubstr("10.1.2.3")));
+    EXPECT_THAT(stream.str(), Not(HasSubstr("0.01 0.02 0.03")));
+}
+
+TEST_F(Daemon, info_probes_each_guest_within_one_deadline)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    const auto name = "real-zebraphant";
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    config_builder.data_directory = temp_dir->path();
+
+    std::chrono::milliseconds hostname_timeout{0};
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([&hostname_timeout](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        EXPECT_CALL(*vm, current_state).WillRepeatedly(Return(mp::VirtualMachine::State::running));
+        EXPECT_CALL(*vm, ssh_hostname(_)).WillRepeatedly([&hostname_timeout](std::chrono::milliseconds timeout) {
+            hostname_timeout = timeout;
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            return "localhost";
+        });
+        return vm;
+    });
+
+    // The guest never gets to exit, so waiting for it is what the deadline is left for
+    AnsweringGuests guests{guest_probe_output};
+    std::atomic_int exit_wait_timeout{0};
+    REPLACE(ssh_add_channel_callbacks, [](auto...) { return SSH_OK; });
+    REPLACE(ssh_event_dopoll, [&exit_wait_timeout](ssh_event, int timeout) {
+        exit_wait_timeout = timeout;
+        return SSH_ERROR;
+    });
+
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream stream;
+    send_command({"info", name}, stream);
+
+    EXPECT_THAT(hostname_timeout, AllOf(Gt(std::chrono::seconds(4)), Le(std::chrono::seconds(5))));
+    EXPECT_THAT(exit_wait_timeout.load(), AllOf(Gt(0), Le(4000))); // what is left after finding the address
+    EXPECT_THAT(stream.str(), AllOf(HasSubstr(name), Not(HasSubstr("0.01 0.02 0.03"))));
+}
+
+TEST_F(Daemon, info_probes_guests_concurrently)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    const std::vector<std::string> names{"real-zebraphant", "fake-zebraphant", "other-zebraphant"};
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{},\n{},\n{}\n}}", fmt::format(valid_template, names[0], "56"),
+                                                    fmt::format(valid_template, names[1], "78"),
+                                                    fmt::format(valid_template, names[2], "9a")));
+    config_builder.data_directory = temp_dir->path();
+
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).Times(3).WillRepeatedly([](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        EXPECT_CALL(*vm, current_state).WillRepeatedly(Return(mp::VirtualMachine::State::running));
+        EXPECT_CALL(*vm, ssh_hostname(_)).WillRepeatedly([](auto) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            return "localhost";
+        });
+        return vm;
+    });
+
+    AnsweringGuests guests{guest_probe_output};
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream stream;
+    const auto start = std::chrono::steady_clock::now();
+    send_command({"info", "--all"}, stream);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    for (const auto& name : names)
+        EXPECT_THAT(stream.str(), HasSubstr(name));
+    const auto output = QString::fromStdString(stream.str());
+    EXPECT_EQ(output.count("0.01 0.02 0.03"), 3);
+    EXPECT_LT(elapsed, std::chrono::seconds(2)); // rather than a second per guest
+}
+
+TEST_F(Daemon, queues_requests_beyond_its_limit_rather_than_turning_them_away)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+    config_builder.max_rpc_requests = 2;
+
+    const auto name = "real-zebraphant";
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    config_builder.data_directory = temp_dir->path();
+
+    std::atomic_int probing{0}, most_probing{0};
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([&probing, &most_probing](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        EXPECT_CALL(*vm, current_state).WillRepeatedly(Return(mp::VirtualMachine::State::running));
+        EXPECT_CALL(*vm, ssh_hostname(_)).WillRepeatedly([&probing, &most_probing](auto) {
+            auto now_probing = ++probing;
+            auto most = most_probing.load();
+            while (now_probing > most && !most_probing.compare_exchange_weak(most, now_probing))
+                ;
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            --probing;
+            return "localhost";
+        });
+        return vm;
+    });
+
+    AnsweringGuests guests{guest_probe_output};
+    mp::Daemon daemon{config_builder.build()};
+
+    constexpr auto num_clients = 6;
+    std::atomic_int failures{0};
+    std::vector<std::thread> clients;
+    for (auto i = 0; i < num_clients; ++i)
+        clients.emplace_back([this, &failures, name] {
+            auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+            mp::InfoRequest request;
+            request.mutable_instance_names()->add_instance_name(name);
+
+            grpc::ClientContext context;
+            mp::InfoReply reply;
+            auto reader = stub->info(&context, request);
+            while (reader->Read(&reply))
+                ;
+            if (!reader->Finish().ok())
+                ++failures;
+        });
+
+    for (auto& client : clients) // info is served without the event loop
+        client.join();
+
+    EXPECT_THAT(failures.load(), Eq(0));
+    EXPECT_THAT(most_probing.load(), AllOf(Gt(0), Le(2)));
+}
+
+TEST_F(Daemon, serves_requests_while_watches_are_open_beyond_its_limit)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+    config_builder.max_rpc_requests = 1;
+
+    const auto name = "real-zebraphant";
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    config_builder.data_directory = temp_dir->path();
+    use_a_mock_vm_factory();
+
+    mp::Daemon daemon{config_builder.build()};
+
+    auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+    grpc::ClientContext first_watch_context, second_watch_context;
+    auto first_watch = stub->watch(&first_watch_context, mp::WatchRequest{});
+    auto second_watch = stub->watch(&second_watch_context, mp::WatchRequest{});
+
+    mp::WatchReply snapshot;
+    ASSERT_TRUE(first_watch->Read(&snapshot));
+    ASSERT_TRUE(second_watch->Read(&snapshot));
+
+    // Were watches counted, this would wait for them to end
+    grpc::ClientContext context;
+    context.set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(5));
+    mp::ListReply reply;
+    auto reader = stub->list(&context, mp::ListRequest{});
+    reader->Read(&reply);
+    EXPECT_TRUE(reader->Finish().ok());
+    EXPECT_THAT(reply.instances_size(), Eq(1));
+
+    first_watch_context.TryCancel();
+    second_watch_context.TryCancel();
+    first_watch->Finish();
+    second_watch->Finish();
+}
+
+#ifdef MULTIPASS_PLATFORM_LINUX
+int thread_count()
+{
+    return QDir{"/proc/self/task"}.entryList(QDir::Dirs | QDir::NoDotAndDotDot).size();
+}
+
+struct HeldUpdatePrompt : public mp::UpdatePrompt
+{
+    explicit HeldUpdatePrompt(std::shared_future<void> released) : released{std::move(released)}
+    {
+    }
+
+    bool is_time_to_show() override
+    {
+        return false;
+    }
+
+    void populate(mp::UpdateInfo*) override
+    {
+        auto now_held = ++held;
+        auto most = most_held.load();
+        while (now_held > most && !most_held.compare_exchange_weak(most, now_held))
+            ;
+
+        released.wait();
+        --held;
+    }
+
+    void populate_if_time_to_show(mp::UpdateInfo*) override
+    {
+    }
+
+    std::shared_future<void> released;
+    std::atomic_int held{0}, most_held{0};
+};
+
+TEST_F(Daemon, bounds_its_threads_however_many_calls_are_open)
+{
+    std::promise<void> release;
+    auto update_prompt = std::make_unique<HeldUpdatePrompt>(release.get_future().share());
+    auto& prompt = *update_prompt;
+    config_builder.update_prompt = std::move(update_prompt);
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+    config_builder.max_rpc_requests = 2;
+    config_builder.rpc_pollers = 1;
+
+    const auto name = "real-zebraphant";
+    auto temp_dir = plant_instance_json(fmt::format("{{\n{}\n}}", fmt::format(valid_template, name, "56")));
+    config_builder.data_directory = temp_dir->path();
+    use_a_mock_vm_factory();
+
+    mp::Daemon daemon{config_builder.build()};
+
+    auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+    {
+        grpc::ClientContext context;
+        mp::ListReply reply;
+        auto reader = stub->list(&context, mp::ListRequest{});
+        reader->Read(&reply);
+        ASSERT_TRUE(reader->Finish().ok());
+    }
+    const auto threads_before = thread_count();
+
+    constexpr auto num_calls = 16;
+    std::array<grpc::ClientContext, num_calls> watch_contexts, version_contexts;
+    std::vector<std::unique_ptr<grpc::ClientReader<mp::WatchReply>>> watches;
+    std::vector<std::unique_ptr<grpc::ClientReader<mp::VersionReply>>> versions;
+    for (auto& context : watch_contexts)
+    {
+        watches.push_back(stub->watch(&context, mp::WatchRequest{}));
+
+        mp::WatchReply snapshot;
+        ASSERT_TRUE(watches.back()->Read(&snapshot));
+    }
+    for (auto& context : version_contexts)
+        versions.push_back(stub->version(&context, mp::VersionRequest{}));
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (prompt.held < 2 && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200)); // give any extra threads the chance to show up
+
+    // Open watches hold no thread and calls beyond the pool's two wait in its queue, so neither adds threads;
+    // the slack is for the threads gRPC keeps for itself
+    EXPECT_THAT(prompt.held.load(), Eq(2));
+    EXPECT_THAT(thread_count(), Le(threads_before + 2 + 4));
+
+    release.set_value();
+    for (auto& version : versions)
+    {
+        mp::VersionReply reply;
+        EXPECT_TRUE(version->Read(&reply));
+        EXPECT_TRUE(version->Finish().ok());
+    }
+    EXPECT_THAT(prompt.most_held.load(), Eq(2));
+
+    for (auto i = 0; i < num_calls; ++i)
+    {
+        watch_contexts[i].TryCancel();
+        watches[i]->Finish();
+    }
+}
+#endif
+
 TEST_F(Daemon, prevents_repetition_of_loaded_mac_addresses)
 {
     config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
@@ -21,27 +21,37 @@
 #include "extra_assertions.h"
 #include "file_operations.h"
 #include "mock_image_host.h"
+#include "mock_logger.h"
 #include "mock_process_factory.h"
+#include "mock_settings.h"
 #include "path.h"
 #include "stub_url_downloader.h"
 #include "temp_dir.h"
 #include "temp_file.h"
 #include "tracking_url_downloader.h"
 
+#include <multipass/constants.h>
 #include <multipass/exceptions/aborted_download_exception.h>
 #include <multipass/exceptions/create_image_exception.h>
 #include <multipass/format.h>
 #include <multipass/query.h>
+#include <multipass/rpc/multipass.grpc.pb.h>
 #include <multipass/url_downloader.h>
 #include <multipass/utils.h>
 
+#include <QCryptographicHash>
+#include <QDataStream>
 #include <QDateTime>
 #include <QThread>
 #include <QUrl>
 
 #include <gmock/gmock.h>
 
+#include <future>
+#include <thread>
+
 namespace mp = multipass;
+namespace mpl = multipass::logging;
 namespace mpt = multipass::test;
 
 using namespace testing;
@@ -50,15 +60,49 @@ namespace
 {
 const QDateTime default_last_modified{QDate(2019, 6, 25), QTime(13, 15, 0)};
 
+// Just enough of a qcow2 header for the vault to tell it apart and find its backing image
+std::string qcow2_header(const QString& backing_image_path = {}, quint64 virtual_size = 0, quint32 version = 3)
+{
+    const auto backing_file_name = backing_image_path.toUtf8();
+    const quint64 backing_file_offset = backing_file_name.isEmpty() ? 0 : 32;
+
+    QByteArray header;
+    QDataStream stream{&header, QIODevice::WriteOnly};
+    stream << quint32{0x514649fb} << version << backing_file_offset << quint32(backing_file_name.size())
+           << quint32{16} << virtual_size;
+
+    return (header + backing_file_name).toStdString();
+}
+
 struct BadURLDownloader : public mp::URLDownloader
 {
     BadURLDownloader() : mp::URLDownloader{std::chrono::seconds(10)}
     {
     }
-    void download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
-                     const mp::ProgressMonitor&) override
+    QString download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
+                        const mp::ProgressMonitor&) override
     {
         mpt::make_file_with_content(file_name, "Bad hash");
+        return QCryptographicHash::hash("Bad hash", QCryptographicHash::Sha256).toHex();
+    }
+
+    QByteArray download(const QUrl& url) override
+    {
+        return {};
+    }
+};
+
+// Writes something other than what it reports to have hashed, which was the default image
+struct MisreportingURLDownloader : public mp::URLDownloader
+{
+    MisreportingURLDownloader() : mp::URLDownloader{std::chrono::seconds(10)}
+    {
+    }
+    QString download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
+                        const mp::ProgressMonitor&) override
+    {
+        mpt::make_file_with_content(file_name, "Not what was hashed");
+        return mpt::default_id;
     }
 
     QByteArray download(const QUrl& url) override
@@ -72,12 +116,14 @@ struct HttpURLDownloader : public mp::URLDownloader
     HttpURLDownloader() : mp::URLDownloader{std::chrono::seconds(10)}
     {
     }
-    void download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
-                     const mp::ProgressMonitor&) override
+    QString download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
+                        const mp::ProgressMonitor&) override
     {
         mpt::make_file_with_content(file_name, "");
         downloaded_urls << url.toString();
         downloaded_files << file_name;
+
+        return QCryptographicHash::hash("", QCryptographicHash::Sha256).toHex();
     }
 
     QByteArray download(const QUrl& url) override
@@ -99,8 +145,8 @@ struct RunningURLDownloader : public mp::URLDownloader
     RunningURLDownloader() : mp::URLDownloader{std::chrono::seconds(10)}
     {
     }
-    void download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
-                     const mp::ProgressMonitor&) override
+    QString download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
+                        const mp::ProgressMonitor&) override
     {
         while (!abort_download)
             QThread::yieldCurrentThread();
@@ -157,6 +203,11 @@ struct ImageVault : public testing::Test
         return mock_factory_scope;
     }
 
+    QStringList stored_blobs()
+    {
+        return QDir{QDir{data_dir.path()}.filePath("vault/blobs")}.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    }
+
     QString host_url{QUrl::fromLocalFile(mpt::test_data_path()).toString()};
     mpt::TrackingURLDownloader url_downloader;
     std::vector<mp::VMImageHost*> hosts;
@@ -328,11 +379,11 @@ TEST_F(ImageVault, image_purged_expired)
     };
     auto vm_image = vault.fetch_image(mp::FetchType::ImageOnly, default_query, prepare, stub_monitor);
 
-    EXPECT_TRUE(QFileInfo::exists(file_name));
+    EXPECT_THAT(stored_blobs().size(), Eq(1));
 
     vault.prune_expired_images();
 
-    EXPECT_FALSE(QFileInfo::exists(file_name));
+    EXPECT_THAT(stored_blobs(), IsEmpty());
 }
 
 TEST_F(ImageVault, image_exists_not_expired)
@@ -348,11 +399,139 @@ TEST_F(ImageVault, image_exists_not_expired)
     };
     auto vm_image = vault.fetch_image(mp::FetchType::ImageOnly, default_query, prepare, stub_monitor);
 
-    EXPECT_TRUE(QFileInfo::exists(file_name));
+    EXPECT_THAT(stored_blobs().size(), Eq(1));
 
     vault.prune_expired_images();
 
-    EXPECT_TRUE(QFileInfo::exists(file_name));
+    EXPECT_THAT(stored_blobs().size(), Eq(1));
+}
+
+TEST_F(ImageVault, images_with_the_same_contents_are_stored_once)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+
+    mp::Query custom_query{"valley-pied-piper-chat", "custom", false, "", mp::Query::Type::Alias};
+    vault.fetch_image(mp::FetchType::ImageOnly, custom_query, stub_prepare, stub_monitor);
+
+    EXPECT_THAT(url_downloader.downloaded_files.size(), Eq(2));
+    EXPECT_THAT(stored_blobs(), ElementsAre(QString{mpt::default_id}));
+}
+
+TEST_F(ImageVault, shared_image_is_kept_until_no_record_refers_to_it)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{1}};
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+
+    mp::Query custom_query{"valley-pied-piper-chat", "custom", false, "", mp::Query::Type::Alias};
+    host.mock_custom_image_info.id = "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b856";
+    vault.fetch_image(mp::FetchType::ImageOnly, custom_query, stub_prepare, stub_monitor);
+
+    // Updating one of the images drops its old record, which shares its contents with the other
+    host.mock_bionic_image_info.id = "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b857";
+    host.mock_bionic_image_info.verify = false;
+    vault.update_images(mp::FetchType::ImageOnly, stub_prepare, stub_monitor);
+
+    EXPECT_THAT(stored_blobs(), ElementsAre(QString{mpt::default_id}));
+}
+
+TEST_F(ImageVault, prefetch_downloads_images_only_once)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{1}};
+    mp::Query prefetch_query{"", "xenial", false, "", mp::Query::Type::Alias};
+
+    vault.prefetch_images(mp::FetchType::ImageOnly, {prefetch_query}, stub_prepare, stub_monitor, mp::MemorySize{});
+    EXPECT_THAT(url_downloader.downloaded_files.size(), Eq(1));
+    EXPECT_FALSE(vault.has_record_for(prefetch_query.name));
+
+    vault.prefetch_images(mp::FetchType::ImageOnly, {prefetch_query}, stub_prepare, stub_monitor, mp::MemorySize{});
+    EXPECT_THAT(url_downloader.downloaded_files.size(), Eq(1));
+
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+    EXPECT_THAT(url_downloader.downloaded_files.size(), Eq(1));
+}
+
+TEST_F(ImageVault, prefetch_limits_download_rate_while_fetching)
+{
+    struct RateRecordingURLDownloader : public mpt::TrackingURLDownloader
+    {
+        QString download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
+                            const mp::ProgressMonitor& monitor) override
+        {
+            rates << rate_limit_for(url);
+            return TrackingURLDownloader::download_to(url, file_name, size, download_type, monitor);
+        }
+
+        using TrackingURLDownloader::rate_limit_for;
+        QList<qint64> rates;
+    } rate_recording_url_downloader;
+
+    mp::DefaultVMImageVault vault{hosts, &rate_recording_url_downloader, cache_dir.path(), data_dir.path(),
+                                  mp::days{1}};
+    mp::Query prefetch_query{"", "xenial", false, "", mp::Query::Type::Alias};
+
+    vault.prefetch_images(mp::FetchType::ImageOnly, {prefetch_query}, stub_prepare, stub_monitor,
+                          mp::MemorySize{"1M"});
+
+    ASSERT_THAT(rate_recording_url_downloader.downloaded_urls.size(), Eq(1));
+    EXPECT_THAT(rate_recording_url_downloader.rates, ElementsAre(1024 * 1024));
+    EXPECT_THAT(rate_recording_url_downloader.rate_limit_for(rate_recording_url_downloader.downloaded_urls.front()),
+                Eq(0));
+}
+
+TEST_F(ImageVault, launch_lifts_rate_limit_of_prefetch_it_joins)
+{
+    // Holds the download until the limit is lifted, as a launch joining it should do
+    struct LaunchAwaitingURLDownloader : public mpt::TrackingURLDownloader
+    {
+        QString download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
+                            const mp::ProgressMonitor& monitor) override
+        {
+            rates << rate_limit_for(url);
+            started.set_value();
+
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (rate_limit_for(url) > 0 && std::chrono::steady_clock::now() < deadline)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+            rates << rate_limit_for(url);
+            return TrackingURLDownloader::download_to(url, file_name, size, download_type, monitor);
+        }
+
+        std::promise<void> started;
+        QList<qint64> rates;
+    } launch_awaiting_url_downloader;
+
+    mp::DefaultVMImageVault vault{hosts, &launch_awaiting_url_downloader, cache_dir.path(), data_dir.path(),
+                                  mp::days{1}};
+    mp::Query prefetch_query{"", "xenial", false, "", mp::Query::Type::Alias};
+
+    auto prefetched = std::async(std::launch::async, [&] {
+        vault.prefetch_images(mp::FetchType::ImageOnly, {prefetch_query}, stub_prepare, stub_monitor,
+                              mp::MemorySize{"1M"});
+    });
+    launch_awaiting_url_downloader.started.get_future().wait();
+
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+    prefetched.get();
+
+    EXPECT_THAT(launch_awaiting_url_downloader.downloaded_urls.size(), Eq(1));
+    EXPECT_THAT(launch_awaiting_url_downloader.rates, ElementsAre(1024 * 1024, 0));
+}
+
+TEST_F(ImageVault, prefetch_goes_on_past_images_it_cannot_fetch)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{1}};
+    mp::Query bogus_query{"", "bogus", false, "nowhere", mp::Query::Type::Alias};
+    mp::Query prefetch_query{"", "xenial", false, "", mp::Query::Type::Alias};
+
+    auto logger_scope = mpt::MockLogger::inject();
+    logger_scope.mock_logger->screen_logs(mpl::Level::warning);
+    logger_scope.mock_logger->expect_log(mpl::Level::warning, "Cannot prefetch source image bogus");
+
+    EXPECT_NO_THROW(vault.prefetch_images(mp::FetchType::ImageOnly, {bogus_query, prefetch_query}, stub_prepare,
+                                          stub_monitor, mp::MemorySize{}));
+    EXPECT_THAT(url_downloader.downloaded_files.size(), Eq(1));
 }
 
 TEST_F(ImageVault, invalid_image_dir_is_removed)
@@ -387,6 +566,148 @@ TEST_F(ImageVault, DISABLE_ON_WINDOWS_AND_MACOS(file_based_fetch_copies_image_an
     EXPECT_EQ(vm_image.id, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
 }
 
+TEST_F(ImageVault, DISABLE_ON_WINDOWS_AND_MACOS(file_based_fetch_prepares_each_file_once))
+{
+    mpt::TempFile file;
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    int prepare_called_count{0};
+    auto prepare = [&prepare_called_count](const mp::VMImage& source_image) -> mp::VMImage {
+        ++prepare_called_count;
+        return source_image;
+    };
+    auto query = default_query;
+
+    query.release = file.url().toStdString();
+    query.query_type = mp::Query::Type::LocalFile;
+    auto vm_image1 = vault.fetch_image(mp::FetchType::ImageOnly, query, prepare, stub_monitor);
+
+    query.name = "valley-pied-piper-chat";
+    auto vm_image2 = vault.fetch_image(mp::FetchType::ImageOnly, query, prepare, stub_monitor);
+
+    EXPECT_THAT(prepare_called_count, Eq(1));
+    EXPECT_THAT(vm_image1.image_path, Ne(vm_image2.image_path));
+    EXPECT_TRUE(QFileInfo::exists(vm_image2.image_path));
+    EXPECT_THAT(vm_image1.id, Eq(vm_image2.id));
+}
+
+TEST_F(ImageVault, DISABLE_ON_WINDOWS_AND_MACOS(qcow2_instance_image_is_overlay_kept_with_its_backing_image))
+{
+    auto mock_factory_scope = mpt::MockProcessFactory::Inject();
+    mock_factory_scope->register_callback([](mpt::MockProcess* process) {
+        ASSERT_EQ(process->program().toStdString(), "qemu-img");
+        EXPECT_CALL(*process, execute).WillOnce([process](int) {
+            const auto args = process->arguments();
+            mpt::make_file_with_content(args.last(), qcow2_header(args.at(args.indexOf("-b") + 1)));
+            return mp::ProcessState{0, mp::nullopt};
+        });
+    });
+
+    const auto file_name = QDir{cache_dir.path()}.filePath("prepared-image.qcow2");
+    auto prepare = [&file_name](const mp::VMImage& source_image) -> mp::VMImage {
+        mpt::make_file_with_content(file_name, qcow2_header());
+        return {file_name, "", "", source_image.id, "", "", "", {}};
+    };
+
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    auto vm_image = vault.fetch_image(mp::FetchType::ImageOnly, default_query, prepare, stub_monitor);
+
+    const auto processes = mock_factory_scope->process_list();
+    ASSERT_THAT(processes.size(), Eq(1u));
+    EXPECT_THAT(processes.front().arguments, Contains("create"));
+    EXPECT_TRUE(mp::vault::backing_image_of(vm_image.image_path).startsWith(data_dir.path()));
+
+    // The prepared image expires, but the overlay still needs it
+    vault.prune_expired_images();
+    EXPECT_THAT(stored_blobs().size(), Eq(1));
+
+    vault.remove(instance_name);
+    vault.prune_expired_images();
+    EXPECT_THAT(stored_blobs(), IsEmpty());
+}
+
+TEST_F(ImageVault, DISABLE_ON_WINDOWS_AND_MACOS(qcow2_backing_image_survives_clearing_the_cache))
+{
+    auto mock_factory_scope = mpt::MockProcessFactory::Inject();
+    mock_factory_scope->register_callback([](mpt::MockProcess* process) {
+        EXPECT_CALL(*process, execute).WillOnce([process](int) {
+            const auto args = process->arguments();
+            mpt::make_file_with_content(args.last(), qcow2_header(args.at(args.indexOf("-b") + 1)));
+            return mp::ProcessState{0, mp::nullopt};
+        });
+    });
+
+    const auto file_name = QDir{cache_dir.path()}.filePath("prepared-image.qcow2");
+    auto prepare = [&file_name](const mp::VMImage& source_image) -> mp::VMImage {
+        mpt::make_file_with_content(file_name, qcow2_header());
+        return {file_name, "", "", source_image.id, "", "", "", {}};
+    };
+
+    QString backing_image;
+    {
+        mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+        auto vm_image = vault.fetch_image(mp::FetchType::ImageOnly, default_query, prepare, stub_monitor);
+        backing_image = mp::vault::backing_image_of(vm_image.image_path);
+    }
+
+    ASSERT_TRUE(QDir{QDir{cache_dir.path()}.filePath("vault")}.removeRecursively());
+
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    vault.prune_expired_images();
+
+    EXPECT_TRUE(QFileInfo::exists(backing_image));
+}
+
+TEST_F(ImageVault, backing_image_of_ignores_names_longer_than_qcow2_allows)
+{
+    const auto image_path = QDir{data_dir.path()}.filePath("overlay.qcow2");
+
+    mpt::make_file_with_content(image_path, qcow2_header(QString(1023, 'a')));
+    EXPECT_THAT(mp::vault::backing_image_of(image_path), Eq(QString(1023, 'a')));
+
+    mpt::make_file_with_content(image_path, qcow2_header(QString(1024, 'a')));
+    EXPECT_THAT(mp::vault::backing_image_of(image_path), IsEmpty());
+}
+
+TEST_F(ImageVault, only_qcow2_versions_2_and_3_are_read_as_qcow2)
+{
+    const auto image_path = QDir{data_dir.path()}.filePath("image.qcow2");
+
+    for (quint32 version : {2u, 3u})
+    {
+        mpt::make_file_with_content(image_path, qcow2_header("backing.img", 1024, version));
+        EXPECT_TRUE(mp::vault::is_qcow2_image(image_path));
+        EXPECT_THAT(mp::vault::backing_image_of(image_path), Eq("backing.img"));
+        EXPECT_THAT(mp::vault::qcow2_virtual_size(image_path), Eq(1024));
+    }
+
+    // qcow version 1 has the same magic, but lays out the rest of its header differently
+    mpt::make_file_with_content(image_path, qcow2_header("backing.img", 1024, 1));
+    EXPECT_FALSE(mp::vault::is_qcow2_image(image_path));
+    EXPECT_THAT(mp::vault::backing_image_of(image_path), IsEmpty());
+    EXPECT_THAT(mp::vault::qcow2_virtual_size(image_path), Eq(0));
+}
+
+TEST_F(ImageVault, DISABLE_ON_WINDOWS_AND_MACOS(local_image_is_hashed_away_from_the_calling_thread))
+{
+    mpt::TempFile file;
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    std::vector<QThread*> verifying_threads;
+    auto monitor = [&verifying_threads](int progress_type, int) {
+        if (progress_type == mp::LaunchProgress::VERIFY)
+            verifying_threads.push_back(QThread::currentThread());
+        return true;
+    };
+    auto query = default_query;
+
+    query.release = file.url().toStdString();
+    query.query_type = mp::Query::Type::LocalFile;
+    auto vm_image = vault.fetch_image(mp::FetchType::ImageOnly, query, stub_prepare, monitor);
+
+    ASSERT_THAT(verifying_threads.size(), Eq(1u));
+    EXPECT_THAT(verifying_threads.front(), Ne(QThread::currentThread()));
+    EXPECT_THAT(vm_image.id, Eq(mp::vault::compute_image_hash(file.name()).toStdString()));
+}
+
 TEST_F(ImageVault, invalid_custom_image_file_throws)
 {
     mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
@@ -412,6 +733,66 @@ TEST_F(ImageVault, DISABLE_ON_WINDOWS_AND_MACOS(custom_image_url_downloads))
     EXPECT_TRUE(url_downloader.downloaded_urls.contains(QString::fromStdString(query.release)));
 }
 
+TEST_F(ImageVault, DISABLE_ON_WINDOWS_AND_MACOS(xz_image_decoded_while_downloading_with_one_decoder_thread))
+{
+    auto& mock_settings = mpt::MockSettings::mock_instance();
+    EXPECT_CALL(mock_settings, get(Eq(mp::image_decoder_threads_key))).WillRepeatedly(Return("1"));
+
+    mpt::TrackingURLDownloader xz_url_downloader{mpt::load_test_file("sample.img.xz").toStdString()};
+    mp::DefaultVMImageVault vault{hosts, &xz_url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    auto query = default_query;
+
+    query.release = "http://www.foo.com/fake.img.xz";
+    query.query_type = mp::Query::Type::HttpDownload;
+
+    auto vm_image = vault.fetch_image(mp::FetchType::ImageOnly, query, stub_prepare, stub_monitor);
+
+    EXPECT_TRUE(xz_url_downloader.streamed_urls.contains(QString::fromStdString(query.release)));
+    EXPECT_TRUE(xz_url_downloader.downloaded_files.isEmpty());
+    EXPECT_TRUE(vm_image.image_path.endsWith("fake.img"));
+    EXPECT_TRUE(mpt::load(vm_image.image_path).startsWith("multipass xz test line 0\n"));
+}
+
+TEST_F(ImageVault, DISABLE_ON_WINDOWS_AND_MACOS(xz_image_downloaded_whole_to_decode_in_parallel))
+{
+    auto& mock_settings = mpt::MockSettings::mock_instance();
+    EXPECT_CALL(mock_settings, get(Eq(mp::image_decoder_threads_key))).WillRepeatedly(Return("4"));
+
+    mpt::TrackingURLDownloader xz_url_downloader{mpt::load_test_file("sample-multi-block.img.xz").toStdString()};
+    mp::DefaultVMImageVault vault{hosts, &xz_url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    auto query = default_query;
+
+    query.release = "http://www.foo.com/fake.img.xz";
+    query.query_type = mp::Query::Type::HttpDownload;
+
+    auto vm_image = vault.fetch_image(mp::FetchType::ImageOnly, query, stub_prepare, stub_monitor);
+
+    EXPECT_TRUE(xz_url_downloader.streamed_urls.isEmpty());
+    ASSERT_THAT(xz_url_downloader.downloaded_files.size(), Eq(1));
+    EXPECT_TRUE(xz_url_downloader.downloaded_files.first().endsWith("fake.img.xz"));
+    EXPECT_FALSE(QFileInfo::exists(xz_url_downloader.downloaded_files.first()));
+    EXPECT_TRUE(vm_image.image_path.endsWith("fake.img"));
+    EXPECT_TRUE(mpt::load(vm_image.image_path).startsWith("multipass xz test line 0\n"));
+}
+
+TEST_F(ImageVault, DISABLE_ON_WINDOWS_AND_MACOS(xz_image_is_stored_by_the_hash_of_what_it_decodes_to))
+{
+    const auto xz_data = mpt::load_test_file("sample.img.xz");
+    mpt::TrackingURLDownloader xz_url_downloader{xz_data.toStdString()};
+    mp::DefaultVMImageVault vault{hosts, &xz_url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    auto query = default_query;
+
+    query.release = "http://www.foo.com/fake.img.xz";
+    query.query_type = mp::Query::Type::HttpDownload;
+
+    auto vm_image = vault.fetch_image(mp::FetchType::ImageOnly, query, stub_prepare, stub_monitor);
+
+    const auto decoded_hash = QCryptographicHash::hash(mpt::load(vm_image.image_path), QCryptographicHash::Sha256);
+    const auto download_hash = QCryptographicHash::hash(xz_data, QCryptographicHash::Sha256);
+    EXPECT_THAT(stored_blobs(), ElementsAre(QString{decoded_hash.toHex()}));
+    EXPECT_THAT(stored_blobs(), Not(Contains(QString{download_hash.toHex()})));
+}
+
 TEST_F(ImageVault, missing_downloaded_image_throws)
 {
     mpt::StubURLDownloader stub_url_downloader;
@@ -428,6 +809,16 @@ TEST_F(ImageVault, hash_mismatch_throws)
                  mp::CreateImageException);
 }
 
+TEST_F(ImageVault, verifies_hash_computed_while_downloading)
+{
+    MisreportingURLDownloader misreporting_url_downloader;
+    mp::DefaultVMImageVault vault{hosts, &misreporting_url_downloader, cache_dir.path(), data_dir.path(),
+                                  mp::days{0}};
+
+    // The image is not read back to verify it, so only the reported hash counts
+    EXPECT_NO_THROW(vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor));
+}
+
 TEST_F(ImageVault, invalid_remote_throws)
 {
     mpt::StubURLDownloader stub_url_downloader;
@@ -482,14 +873,13 @@ TEST_F(ImageVault, DISABLE_ON_WINDOWS_AND_MACOS(http_download_returns_expected_i
     EXPECT_THAT(image.release_date, Eq(default_last_modified.toString().toStdString()));
 }
 
-TEST_F(ImageVault, image_update_creates_new_dir_and_removes_old)
+TEST_F(ImageVault, image_update_moves_new_download_into_store_leaving_no_dirs)
 {
     mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{1}};
     vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
 
     auto original_file{url_downloader.downloaded_files[0]};
     auto original_absolute_path{QFileInfo(original_file).absolutePath()};
-    EXPECT_TRUE(QFileInfo::exists(original_file));
     EXPECT_TRUE(original_absolute_path.contains(mpt::default_version));
 
     // Mock an update to the image and don't verify because of hash mismatch
@@ -501,12 +891,12 @@ TEST_F(ImageVault, image_update_creates_new_dir_and_removes_old)
     vault.update_images(mp::FetchType::ImageOnly, stub_prepare, stub_monitor);
 
     auto updated_file{url_downloader.downloaded_files[1]};
-    EXPECT_TRUE(QFileInfo::exists(updated_file));
     EXPECT_TRUE(QFileInfo(updated_file).absolutePath().contains(new_date_string));
 
-    // Old image and directory should be removed
-    EXPECT_FALSE(QFileInfo::exists(original_file));
+    // Downloads move into the store, leaving no directories behind
     EXPECT_FALSE(QFileInfo::exists(original_absolute_path));
+    EXPECT_FALSE(QFileInfo::exists(QFileInfo(updated_file).absolutePath()));
+    EXPECT_THAT(stored_blobs(), ElementsAre(QString{mpt::default_id}));
 }
 
 TEST_F(ImageVault, aborted_download_throws)
@@ -535,6 +925,43 @@ TEST_F(ImageVault, minimum_image_size_returns_expected_size)
     EXPECT_EQ(image_size, size);
 }
 
+TEST_F(ImageVault, minimum_image_size_is_remembered)
+{
+    const mp::MemorySize image_size{"1048576"};
+    const mp::ProcessState qemuimg_exit_status{0, mp::nullopt};
+    const QByteArray qemuimg_output(fake_img_info(image_size));
+    auto mock_factory_scope = inject_fake_qemuimg_callback(qemuimg_exit_status, qemuimg_output);
+
+    mp::DefaultVMImageVault first_vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    auto vm_image = first_vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+    EXPECT_EQ(image_size, first_vault.minimum_image_size_for(vm_image.id));
+
+    mp::DefaultVMImageVault another_vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    EXPECT_EQ(image_size, another_vault.minimum_image_size_for(vm_image.id));
+
+    EXPECT_THAT(mock_factory_scope->process_list().size(), Eq(1u));
+}
+
+TEST_F(ImageVault, minimum_image_size_of_qcow2_image_is_read_from_its_header)
+{
+    auto mock_factory_scope = mpt::MockProcessFactory::Inject();
+    const mp::MemorySize image_size{"2147483648"};
+
+    auto prepare = [this, &image_size](const mp::VMImage& source_image) -> mp::VMImage {
+        const auto file_name = QDir{cache_dir.path()}.filePath("prepared-image.qcow2");
+        mpt::make_file_with_content(file_name, qcow2_header({}, image_size.in_bytes()));
+        return {file_name, "", "", source_image.id, "", "", "", {}};
+    };
+
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    auto prepared_query = default_query;
+    prepared_query.name = "";
+    vault.fetch_image(mp::FetchType::ImageOnly, prepared_query, prepare, stub_monitor);
+
+    EXPECT_EQ(image_size, vault.minimum_image_size_for(mpt::default_id));
+    EXPECT_THAT(mock_factory_scope->process_list(), IsEmpty());
+}
+
 TEST_F(ImageVault, DISABLE_ON_WINDOWS_AND_MACOS(file_based_minimum_size_returns_expected_size))
 {
     const mp::MemorySize image_size{"2097152"};
@@ -29,6 +29,12 @@
 
 #include <gmock/gmock.h>
 
+#include <yaml-cpp/yaml.h>
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
 #include <locale>
 
 namespace mp = multipass;
@@ -1079,6 +1085,116 @@ INSTANTIATE_TEST_SUITE_P(FindOutputFormatter, FormatterSuite, ValuesIn(find_form
 INSTANTIATE_TEST_SUITE_P(NonOrderableNetworksOutputFormatter, FormatterSuite,
                          ValuesIn(non_orderable_networks_formatter_outputs), print_param_name);
 
+namespace
+{
+auto construct_info_reply_with_mount_metrics()
+{
+    auto info_reply = construct_single_instance_info_reply();
+
+    auto metrics = info_reply.mutable_info(0)->mutable_mount_info()->mutable_mount_paths(0)->mutable_metrics();
+    metrics->set_bytes_read(2097152);
+    metrics->set_bytes_written(512);
+    metrics->set_attr_cache_hits(7);
+    metrics->set_attr_cache_misses(3);
+    metrics->add_latency_bucket_bounds_us(100);
+    metrics->add_latency_bucket_bounds_us(1000);
+
+    auto operation = metrics->add_operations();
+    operation->set_name("read");
+    operation->set_count(3);
+    operation->set_total_latency_us(300);
+    operation->add_latency_histogram(2);
+    operation->add_latency_histogram(1);
+    operation->add_latency_histogram(0);
+
+    operation = metrics->add_operations();
+    operation->set_name("write");
+    operation->set_count(1);
+    operation->set_total_latency_us(100);
+    operation->add_latency_histogram(0);
+    operation->add_latency_histogram(1);
+    operation->add_latency_histogram(0);
+
+    return info_reply;
+}
+} // namespace
+
+TEST(MountMetricsOutput, table_shows_io_summary_for_mounts_with_metrics)
+{
+    const auto output = mp::TableFormatter().format(construct_info_reply_with_mount_metrics());
+
+    EXPECT_THAT(output, HasSubstr("                        I/O: 2.0M read, 512B written, 4 requests (100us avg), "
+                                  "7 attribute cache hits, 3 misses\n"));
+}
+
+TEST(MountMetricsOutput, table_omits_cache_counts_when_there_were_no_lookups)
+{
+    auto reply = construct_info_reply_with_mount_metrics();
+    auto metrics = reply.mutable_info(0)->mutable_mount_info()->mutable_mount_paths(0)->mutable_metrics();
+    metrics->set_attr_cache_hits(0);
+    metrics->set_attr_cache_misses(0);
+
+    const auto output = mp::TableFormatter().format(reply);
+
+    EXPECT_THAT(output, HasSubstr("I/O: 2.0M read, 512B written, 4 requests (100us avg)\n"));
+    EXPECT_THAT(output, Not(HasSubstr("attribute cache")));
+}
+
+TEST(MountMetricsOutput, table_shows_no_io_line_without_metrics)
+{
+    const auto output = mp::TableFormatter().format(construct_single_instance_info_reply());
+
+    EXPECT_THAT(output, Not(HasSubstr("I/O:")));
+}
+
+TEST(MountMetricsOutput, json_includes_metrics_under_the_mount)
+{
+    const auto output = mp::JsonFormatter().format(construct_info_reply_with_mount_metrics());
+    const auto mounts = QJsonDocument::fromJson(QByteArray::fromStdString(output))
+                            .object()["info"]
+                            .toObject()["foo"]
+                            .toObject()["mounts"]
+                            .toObject();
+
+    ASSERT_TRUE(mounts["foo"].toObject().contains("metrics"));
+    EXPECT_FALSE(mounts["test_dir"].toObject().contains("metrics"));
+
+    const auto metrics = mounts["foo"].toObject()["metrics"].toObject();
+    EXPECT_EQ(metrics["bytes_read"].toDouble(), 2097152);
+    EXPECT_EQ(metrics["bytes_written"].toDouble(), 512);
+    EXPECT_EQ(metrics["attr_cache_hits"].toDouble(), 7);
+    EXPECT_EQ(metrics["attr_cache_misses"].toDouble(), 3);
+    EXPECT_EQ(metrics["latency_bucket_bounds_us"].toArray(), QJsonArray({100, 1000}));
+
+    const auto read = metrics["operations"].toObject()["read"].toObject();
+    EXPECT_EQ(read["count"].toDouble(), 3);
+    EXPECT_EQ(read["total_latency_us"].toDouble(), 300);
+    EXPECT_EQ(read["latency_histogram"].toArray(), QJsonArray({2, 1, 0}));
+    EXPECT_EQ(metrics["operations"].toObject()["write"].toObject()["count"].toDouble(), 1);
+}
+
+TEST(MountMetricsOutput, yaml_includes_metrics_under_the_mount)
+{
+    const auto output = mp::YamlFormatter().format(construct_info_reply_with_mount_metrics());
+    const auto mounts = YAML::Load(output)["foo"][0]["mounts"];
+
+    ASSERT_TRUE(mounts["foo"]["metrics"]);
+    EXPECT_FALSE(mounts["test_dir"]["metrics"]);
+
+    const auto metrics = mounts["foo"]["metrics"];
+    EXPECT_EQ(metrics["bytes_read"].as<uint64_t>(), 2097152u);
+    EXPECT_EQ(metrics["bytes_written"].as<uint64_t>(), 512u);
+    EXPECT_EQ(metrics["attr_cache_hits"].as<uint64_t>(), 7u);
+    EXPECT_EQ(metrics["attr_cache_misses"].as<uint64_t>(), 3u);
+    EXPECT_EQ(metrics["latency_bucket_bounds_us"].as<std::vector<uint64_t>>(), std::vector<uint64_t>({100, 1000}));
+
+    const auto read = metrics["operations"]["read"];
+    EXPECT_EQ(read["count"].as<uint64_t>(), 3u);
+    EXPECT_EQ(read["total_latency_us"].as<uint64_t>(), 300u);
+    EXPECT_EQ(read["latency_histogram"].as<std::vector<uint64_t>>(), std::vector<uint64_t>({2, 1, 0}));
+    EXPECT_EQ(metrics["operations"]["write"]["count"].as<uint64_t>(), 1u);
+}
+
 #if GTEST_HAS_POSIX_RE
 TEST_P(PetenvFormatterSuite, pet_env_first_in_output)
 {
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <src/sshfs_mount/sftp_attr_cache.h>
+
+#include "file_operations.h"
+#include "temp_dir.h"
+
+#include <gmock/gmock.h>
+
+#include <QDir>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+using namespace testing;
+
+namespace
+{
+struct SftpAttrCache : public Test
+{
+    SftpAttrCache() : root{temp_dir.path().toStdString()}, cache{mp::SftpAttrCache::make(root, 100)}
+    {
+        EXPECT_THAT(cache, NotNull());
+    }
+
+    void cache_entry(const std::string& path, bool exists, uint64_t size = 0u)
+    {
+        mp::SftpAttrCache::Entry entry;
+        ASSERT_FALSE(cache->lookup(path, false, entry));
+
+        entry.exists = exists;
+        entry.attr.size = size;
+        cache->insert(path, false, entry, cache->generation());
+    }
+
+    bool is_cached(const std::string& path)
+    {
+        mp::SftpAttrCache::Entry entry;
+        return cache->lookup(path, false, entry);
+    }
+
+    mpt::TempDir temp_dir;
+    std::string root;
+    std::unique_ptr<mp::SftpAttrCache> cache;
+};
+} // namespace
+
+TEST_F(SftpAttrCache, counts_hits_and_misses)
+{
+    const auto file_name = root + "/test-file";
+    mpt::make_file_with_content(QString::fromStdString(file_name));
+
+    cache_entry(file_name, true, 19u);
+
+    mp::SftpAttrCache::Entry entry;
+    ASSERT_TRUE(cache->lookup(file_name, false, entry));
+    EXPECT_TRUE(entry.exists);
+    EXPECT_THAT(entry.attr.size, Eq(19u));
+    EXPECT_FALSE(cache->lookup(file_name, true, entry));
+
+    EXPECT_THAT(cache->hits(), Eq(1u));
+    EXPECT_THAT(cache->misses(), Eq(2u));
+}
+
+TEST_F(SftpAttrCache, drops_entries_of_modified_files)
+{
+    const auto file_name = root + "/test-file";
+    mpt::make_file_with_content(QString::fromStdString(file_name));
+    cache_entry(file_name, true);
+
+    QFile file(QString::fromStdString(file_name));
+    ASSERT_TRUE(file.open(QFile::Append));
+    file.write("more");
+    file.close();
+
+    EXPECT_FALSE(is_cached(file_name));
+}
+
+TEST_F(SftpAttrCache, drops_missing_entries_once_created)
+{
+    const auto file_name = root + "/test-file";
+    cache_entry(file_name, false);
+    ASSERT_TRUE(is_cached(file_name));
+
+    mpt::make_file_with_content(QString::fromStdString(file_name));
+
+    EXPECT_FALSE(is_cached(file_name));
+}
+
+TEST_F(SftpAttrCache, drops_entries_below_renamed_directories)
+{
+    ASSERT_TRUE(QDir{temp_dir.path()}.mkpath("dir/subdir"));
+    const auto file_name = root + "/dir/subdir/test-file";
+    mpt::make_file_with_content(QString::fromStdString(file_name));
+    cache_entry(file_name, true);
+
+    ASSERT_TRUE(QDir{temp_dir.path()}.rename("dir", "other-dir"));
+
+    EXPECT_FALSE(is_cached(file_name));
+}
+
+TEST_F(SftpAttrCache, does_not_store_entries_changed_while_being_read)
+{
+    const auto file_name = root + "/test-file";
+    mpt::make_file_with_content(QString::fromStdString(file_name));
+
+    mp::SftpAttrCache::Entry entry;
+    ASSERT_FALSE(cache->lookup(file_name, false, entry));
+    const auto generation = cache->generation();
+
+    QFile file(QString::fromStdString(file_name));
+    ASSERT_TRUE(file.open(QFile::Append));
+    file.write("more");
+    file.close();
+    ASSERT_FALSE(cache->lookup(root + "/another-file", false, entry)); // picks up the change
+
+    cache->insert(file_name, false, entry, generation);
+
+    EXPECT_FALSE(is_cached(file_name));
+}
+
+TEST_F(SftpAttrCache, does_not_cache_paths_with_dot_components)
+{
+    const auto file_name = root + "/./test-file";
+    mpt::make_file_with_content(QString::fromStdString(file_name));
+    cache_entry(file_name, true);
+
+    EXPECT_FALSE(is_cached(file_name));
+}
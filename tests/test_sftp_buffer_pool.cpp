@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "file_operations.h"
+#include "temp_dir.h"
+
+#include <src/sshfs_mount/sftp_buffer_pool.h>
+
+#include <multipass/format.h>
+
+#include <QFile>
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+using namespace testing;
+
+TEST(SftpBufferPool, hands_out_buffers_of_the_given_size)
+{
+    mp::SftpBufferPool pool{4096, 2};
+
+    auto buffer = pool.acquire();
+    ASSERT_THAT(buffer, NotNull());
+    EXPECT_THAT(buffer->size(), Eq(4096u));
+    EXPECT_THAT(pool.buffer_size(), Eq(4096u));
+}
+
+TEST(SftpBufferPool, reuses_buffers_once_released)
+{
+    mp::SftpBufferPool pool{4096, 2};
+
+    auto data = pool.acquire()->data();
+    EXPECT_THAT(pool.acquire()->data(), Eq(data));
+}
+
+TEST(SftpBufferPool, does_not_hand_out_buffers_in_use)
+{
+    mp::SftpBufferPool pool{4096, 2};
+
+    auto first = pool.acquire();
+    auto second = pool.acquire();
+    EXPECT_THAT(second->data(), Ne(first->data()));
+
+    auto first_data = first->data();
+    first.reset();
+    EXPECT_THAT(pool.acquire()->data(), Eq(first_data));
+}
+
+TEST(SftpBufferPool, keeps_no_more_than_the_maximum)
+{
+    mp::SftpBufferPool pool{4096, 1};
+
+    auto pooled = pool.acquire();
+    auto pooled_data = pooled->data();
+    auto extra = pool.acquire();
+    extra.reset();
+    pooled.reset();
+
+    auto first = pool.acquire();
+    auto second = pool.acquire();
+    EXPECT_THAT(first->data(), Eq(pooled_data));
+    EXPECT_THAT(first.use_count(), Eq(2));
+    EXPECT_THAT(second.use_count(), Eq(1));
+}
+
+TEST(SftpBufferPool, buffers_outlive_the_pool)
+{
+    mp::SftpBufferPool::Buffer buffer;
+    {
+        mp::SftpBufferPool pool{4096, 2};
+        buffer = pool.acquire();
+    }
+
+    ASSERT_THAT(buffer, NotNull());
+    (*buffer)[0] = 'x';
+    EXPECT_THAT(buffer->size(), Eq(4096u));
+}
+
+// Not a pass/fail check: records how fast a file is read the way READ used to be served, seeking a QFile and reading
+// into a fresh buffer each time, against reading it with pread into pooled buffers the way it is served now
+TEST(SftpBufferPool, records_qfile_read_against_pread_into_pooled_buffers_throughput)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    const std::size_t file_size = 32u * 1024u * 1024u;
+    const std::size_t read_size = 256u * 1024u;
+    mpt::make_file_with_content(file_name, std::string(file_size, 'x'));
+
+    auto record = [this](const char* how, std::size_t bytes_read, std::chrono::steady_clock::time_point start) {
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        RecordProperty(fmt::format("{}_mb_per_s", how), static_cast<int>(bytes_read / elapsed / (1024 * 1024)));
+    };
+
+    {
+        QFile file{file_name};
+        ASSERT_TRUE(file.open(QIODevice::ReadOnly));
+
+        std::size_t bytes_read{0};
+        const auto start = std::chrono::steady_clock::now();
+        for (std::size_t offset = 0; offset < file_size; offset += read_size)
+        {
+            std::vector<char> data(read_size);
+            ASSERT_TRUE(file.seek(offset));
+            const auto r = file.read(data.data(), read_size);
+            ASSERT_THAT(r, Gt(0));
+            bytes_read += r;
+        }
+
+        EXPECT_THAT(bytes_read, Eq(file_size));
+        record("qfile_seek_and_read", bytes_read, start);
+    }
+
+    {
+        auto fd = ::open(file_name.toStdString().c_str(), O_RDONLY);
+        ASSERT_THAT(fd, Ge(0));
+        mp::SftpBufferPool pool{read_size, mp::max_outstanding_sftp_reads};
+
+        std::size_t bytes_read{0};
+        const auto start = std::chrono::steady_clock::now();
+        for (std::size_t offset = 0; offset < file_size; offset += read_size)
+        {
+            auto buffer = pool.acquire();
+            const auto r = ::pread(fd, buffer->data(), buffer->size(), offset);
+            ASSERT_THAT(r, Gt(0));
+            bytes_read += r;
+        }
+        ::close(fd);
+
+        EXPECT_THAT(bytes_read, Eq(file_size));
+        record("pread_into_pooled_buffers", bytes_read, start);
+    }
+}
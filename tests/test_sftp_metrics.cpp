@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <src/sshfs_mount/sftp_metrics.h>
+
+#include <gmock/gmock.h>
+
+#include <libssh/sftp.h>
+
+namespace mp = multipass;
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace
+{
+struct SftpMetrics : public Test
+{
+    mp::SftpMetrics metrics;
+};
+} // namespace
+
+TEST_F(SftpMetrics, groups_sftp_requests_by_operation)
+{
+    EXPECT_EQ(mp::SftpMetrics::operation_for(SFTP_READ), mp::SftpMetrics::Operation::read);
+    EXPECT_EQ(mp::SftpMetrics::operation_for(SFTP_LSTAT), mp::SftpMetrics::Operation::stat);
+    EXPECT_EQ(mp::SftpMetrics::operation_for(SFTP_FSTAT), mp::SftpMetrics::Operation::stat);
+    EXPECT_EQ(mp::SftpMetrics::operation_for(SFTP_READDIR), mp::SftpMetrics::Operation::readdir);
+    EXPECT_EQ(mp::SftpMetrics::operation_for(SFTP_RENAME), mp::SftpMetrics::Operation::other);
+}
+
+TEST_F(SftpMetrics, records_latencies_in_buckets)
+{
+    metrics.record(mp::SftpMetrics::Operation::read, 10us);
+    metrics.record(mp::SftpMetrics::Operation::read, 16us);
+    metrics.record(mp::SftpMetrics::Operation::read, 300us);
+    metrics.record(mp::SftpMetrics::Operation::read, 1s);
+
+    const auto snapshot = metrics.snapshot();
+    ASSERT_EQ(snapshot.operations.count("read"), 1u);
+
+    const auto& read = snapshot.operations.at("read");
+    EXPECT_EQ(read.count, 4u);
+    EXPECT_EQ(read.total_latency_us, 1000326u);
+    EXPECT_THAT(read.latency_histogram, ElementsAre(1u, 1u, 0u, 1u, 0u, 0u, 0u, 1u));
+}
+
+TEST_F(SftpMetrics, only_reports_operations_served)
+{
+    metrics.record(mp::SftpMetrics::Operation::write, 1ms);
+    metrics.record(mp::SftpMetrics::Operation::stat, 1ms);
+
+    EXPECT_EQ(metrics.requests(), 2u);
+    EXPECT_THAT(metrics.snapshot().operations, ElementsAre(Pair("stat", _), Pair("write", _)));
+}
+
+TEST_F(SftpMetrics, counts_bytes_transferred)
+{
+    metrics.add_bytes_read(4096);
+    metrics.add_bytes_read(100);
+    metrics.add_bytes_written(65536);
+
+    const auto snapshot = metrics.snapshot();
+    EXPECT_EQ(snapshot.bytes_read, 4196u);
+    EXPECT_EQ(snapshot.bytes_written, 65536u);
+}
+
+TEST_F(SftpMetrics, counts_attribute_cache_lookups)
+{
+    metrics.add_attr_cache_lookup(true);
+    metrics.add_attr_cache_lookup(true);
+    metrics.add_attr_cache_lookup(false);
+
+    const auto snapshot = metrics.snapshot();
+    EXPECT_EQ(snapshot.attr_cache_hits, 2u);
+    EXPECT_EQ(snapshot.attr_cache_misses, 1u);
+}
+
+TEST_F(SftpMetrics, snapshot_survives_json_round_trip)
+{
+    metrics.add_bytes_read(123456789);
+    metrics.add_bytes_written(42);
+    metrics.add_attr_cache_lookup(true);
+    metrics.add_attr_cache_lookup(false);
+    metrics.record(mp::SftpMetrics::Operation::open, 50us);
+    metrics.record(mp::SftpMetrics::Operation::readdir, 20ms);
+
+    const auto snapshot = metrics.snapshot();
+    const auto restored = mp::mount_metrics_from(mp::to_json(snapshot));
+
+    EXPECT_EQ(restored.bytes_read, snapshot.bytes_read);
+    EXPECT_EQ(restored.bytes_written, snapshot.bytes_written);
+    EXPECT_EQ(restored.attr_cache_hits, snapshot.attr_cache_hits);
+    EXPECT_EQ(restored.attr_cache_misses, snapshot.attr_cache_misses);
+    ASSERT_EQ(restored.operations.size(), 2u);
+    for (const auto& entry : snapshot.operations)
+    {
+        const auto& operation = restored.operations.at(entry.first);
+        EXPECT_EQ(operation.count, entry.second.count);
+        EXPECT_EQ(operation.total_latency_us, entry.second.total_latency_us);
+        EXPECT_EQ(operation.latency_histogram, entry.second.latency_histogram);
+    }
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <src/sshfs_mount/sftp_worker_pool.h>
+
+#include <gmock/gmock.h>
+
+#include <algorithm>
+#include <future>
+#include <vector>
+
+#include <poll.h>
+
+namespace mp = multipass;
+using namespace testing;
+
+namespace
+{
+bool finished_within(const mp::SftpWorkerPool& pool, int timeout_ms)
+{
+    pollfd fd{pool.finished_fd(), POLLIN, 0};
+    return ::poll(&fd, 1, timeout_ms) == 1;
+}
+
+void run_and_wait(mp::SftpWorkerPool& pool, std::size_t key)
+{
+    std::promise<void> done;
+    pool.submit(key, [&done] { done.set_value(); });
+    done.get_future().wait();
+}
+} // namespace
+
+TEST(SftpWorkerPool, runs_jobs_with_the_same_key_in_order)
+{
+    std::vector<int> order;
+    {
+        mp::SftpWorkerPool pool{4};
+        for (auto i = 0; i < 100; ++i)
+            pool.submit(7, [&order, i] { order.push_back(i); });
+    } // finishes what was queued before going away
+
+    ASSERT_THAT(order.size(), Eq(100u));
+    EXPECT_TRUE(std::is_sorted(order.begin(), order.end()));
+}
+
+TEST(SftpWorkerPool, signals_finished_jobs_until_cleared)
+{
+    mp::SftpWorkerPool pool{2};
+
+    run_and_wait(pool, 0);
+    EXPECT_TRUE(finished_within(pool, 1000));
+    EXPECT_TRUE(finished_within(pool, 0));
+
+    pool.clear_finished();
+    EXPECT_FALSE(finished_within(pool, 0));
+}
+
+TEST(SftpWorkerPool, signals_jobs_finishing_after_a_clear_that_raced_with_another)
+{
+    mp::SftpWorkerPool pool{2};
+
+    for (auto i = 0; i < 2000; ++i)
+    {
+        // The first job may finish while the pool is being cleared, which must not keep the next from signalling
+        std::promise<void> done;
+        pool.submit(0, [&done] { done.set_value(); });
+        pool.clear_finished();
+        done.get_future().wait();
+
+        run_and_wait(pool, 1);
+        ASSERT_TRUE(finished_within(pool, 1000)) << "after " << i << " rounds";
+        pool.clear_finished();
+    }
+}
@@ -29,7 +29,13 @@
 
 #include <gmock/gmock.h>
 
+#include <algorithm>
+#include <chrono>
+#include <map>
 #include <queue>
+#include <random>
+
+#include <sys/statvfs.h>
 
 namespace mp = multipass;
 namespace mpt = multipass::test;
@@ -47,10 +53,11 @@ struct SftpServer : public mp::test::SftpServerTest
         return make_sftpserver("");
     }
 
-    mp::SftpServer make_sftpserver(const std::string& path)
+    mp::SftpServer make_sftpserver(const std::string& path, int worker_threads = 0, bool cache_attributes = false)
     {
         mp::SSHSession session{"a", 42};
-        return {std::move(session), path, path, default_map, default_map, default_id, default_id, "sshfs"};
+        return {std::move(session), path, path, default_map, default_map, default_id, default_id, "sshfs",
+                worker_threads, cache_attributes};
     }
 
     auto make_msg(uint8_t type = SFTP_BAD_MESSAGE)
@@ -189,6 +196,87 @@ auto make_data(const std::string& in)
     return out;
 }
 
+// Raw request as kept by libssh, for the extensions whose arguments it does not parse
+struct ExtensionPayload
+{
+    ExtensionPayload(const std::string& extension)
+    {
+        add_u32(42); // request id
+        add_string(extension);
+    }
+
+    void add_u32(uint32_t value)
+    {
+        const unsigned char bytes[] = {static_cast<unsigned char>(value >> 24), static_cast<unsigned char>(value >> 16),
+                                       static_cast<unsigned char>(value >> 8), static_cast<unsigned char>(value)};
+        ssh_buffer_add_data(buffer.get(), bytes, sizeof(bytes));
+    }
+
+    void add_u64(uint64_t value)
+    {
+        add_u32(value >> 32);
+        add_u32(value & 0xffffffff);
+    }
+
+    void add_string(const std::string& value)
+    {
+        add_u32(value.size());
+        ssh_buffer_add_data(buffer.get(), value.data(), value.size());
+    }
+
+    std::unique_ptr<ssh_buffer_struct, void (*)(ssh_buffer)> buffer{ssh_buffer_new(), ssh_buffer_free};
+};
+
+// The values sent back in an SSH_FXP_EXTENDED_REPLY packet
+std::vector<uint64_t> extended_reply_values(const std::string& packet)
+{
+    auto u32_at = [&packet](std::size_t pos) {
+        uint32_t value{0};
+        for (auto i = 0u; i < 4u; ++i)
+            value = (value << 8) | static_cast<unsigned char>(packet[pos + i]);
+        return value;
+    };
+
+    EXPECT_THAT(packet.size(), Ge(9u));
+    EXPECT_THAT(u32_at(0), Eq(packet.size() - 4));
+    EXPECT_THAT(static_cast<unsigned char>(packet[4]), Eq(SSH_FXP_EXTENDED_REPLY));
+
+    std::vector<uint64_t> values;
+    for (auto pos = 9u; pos + 8 <= packet.size(); pos += 8)
+        values.push_back((uint64_t{u32_at(pos)} << 32) | u32_at(pos + 4));
+
+    return values;
+}
+
+// The extension names and versions listed in an SSH_FXP_VERSION packet
+std::map<std::string, std::string> version_reply_extensions(const std::string& packet)
+{
+    auto u32_at = [&packet](std::size_t pos) {
+        uint32_t value{0};
+        for (auto i = 0u; i < 4u; ++i)
+            value = (value << 8) | static_cast<unsigned char>(packet[pos + i]);
+        return value;
+    };
+    auto string_at = [&packet, &u32_at](std::size_t& pos) {
+        auto len = u32_at(pos);
+        auto value = packet.substr(pos + 4, len);
+        pos += 4 + len;
+        return value;
+    };
+
+    EXPECT_THAT(u32_at(0), Eq(packet.size() - 4));
+    EXPECT_THAT(u32_at(5), Eq(3u));
+
+    std::map<std::string, std::string> extensions;
+    for (std::size_t pos = 9u; pos + 8 <= packet.size();)
+    {
+        auto name = string_at(pos);
+        extensions[name] = string_at(pos);
+    }
+
+    return extensions;
+}
+
 bool content_match(const QString& path, const std::string& data)
 {
     auto content = mpt::load(path);
@@ -239,10 +327,39 @@ bool compare_permission(uint32_t ssh_permissions, const QFileInfo& file, Permiss
 
 TEST_F(SftpServer, throws_when_failed_to_init)
 {
-    REPLACE(sftp_server_init, [](auto...) { return SSH_ERROR; });
+    REPLACE(ssh_channel_read, [](auto...) { return SSH_ERROR; });
+    EXPECT_THROW(make_sftpserver(), std::runtime_error);
+}
+
+TEST_F(SftpServer, throws_when_client_does_not_start_with_init)
+{
+    REPLACE(ssh_channel_read, [](ssh_channel, void* dest, uint32_t count, int) {
+        std::fill_n(static_cast<unsigned char*>(dest), count, 0);
+        static_cast<unsigned char*>(dest)[count - 1] = count == 4 ? 5 : 0;
+        return static_cast<int>(count);
+    });
     EXPECT_THROW(make_sftpserver(), std::runtime_error);
 }
 
+TEST_F(SftpServer, version_reply_lists_extensions)
+{
+    std::string packet;
+    auto channel_write = [&packet](ssh_channel, const void* data, uint32_t len) {
+        packet.append(static_cast<const char*>(data), len);
+        return static_cast<int>(len);
+    };
+    REPLACE(ssh_channel_write, channel_write);
+
+    auto sftp = make_sftpserver();
+
+    ASSERT_THAT(packet.size(), Ge(9u));
+    EXPECT_THAT(static_cast<unsigned char>(packet[4]), Eq(SSH_FXP_VERSION));
+    EXPECT_THAT(version_reply_extensions(packet),
+                IsSupersetOf({Pair("posix-rename@openssh.com", "1"), Pair("hardlink@openssh.com", "1"),
+                              Pair("fsync@openssh.com", "1"), Pair("copy-data", "1"), Pair("statvfs@openssh.com", "2"),
+                              Pair("limits@openssh.com", "1")}));
+}
+
 TEST_F(SftpServer, throws_when_sshfs_errors_on_start)
 {
     bool invoked{false};
@@ -851,8 +968,69 @@ TEST_F(SftpServer, handles_readdir)
 
     EXPECT_THAT(eof_num_calls, Eq(1));
 
-    std::vector<std::string> expected_entries = {".", "..", "test-dir-entry", "test-file"};
-    EXPECT_THAT(entries, ContainerEq(expected_entries));
+    EXPECT_THAT(entries, UnorderedElementsAre(".", "..", "test-dir-entry", "test-file"));
+}
+
+TEST_F(SftpServer, handles_readdir_over_several_replies)
+{
+    mpt::TempDir temp_dir;
+
+    const auto num_files = 2000;
+    std::vector<std::string> expected_entries{".", ".."};
+    for (auto i = 0; i < num_files; ++i)
+    {
+        const auto file_name = fmt::format("a-rather-long-test-file-name-to-fill-replies-{}", i);
+        mpt::make_file_with_content(temp_dir.path() + "/" + QString::fromStdString(file_name));
+        expected_entries.push_back(file_name);
+    }
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    auto open_dir_msg = make_msg(SFTP_OPENDIR);
+    auto dir_name = name_as_char_array(temp_dir.path().toStdString());
+    open_dir_msg->filename = dir_name.data();
+
+    std::vector<std::unique_ptr<sftp_client_message_struct>> readdir_msgs;
+    for (auto i = 0; i < 10; ++i)
+        readdir_msgs.push_back(make_msg(SFTP_READDIR));
+
+    void* id{nullptr};
+    auto handle_alloc = [&id](sftp_session, void* info) {
+        id = info;
+        return nullptr;
+    };
+
+    int eof_num_calls{0};
+    auto reply_status = [&eof_num_calls](sftp_client_message, uint32_t status, const char*) {
+        EXPECT_THAT(status, Eq(SSH_FX_EOF));
+        ++eof_num_calls;
+        return SSH_OK;
+    };
+
+    std::vector<std::string> entries;
+    auto reply_names_add = [&entries](sftp_client_message, const char* file, const char*, sftp_attributes) {
+        entries.push_back(file);
+        return SSH_OK;
+    };
+
+    int num_replies{0};
+    auto reply_names = [&num_replies](auto...) {
+        ++num_replies;
+        return SSH_OK;
+    };
+
+    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_handle_alloc, handle_alloc);
+    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_get_client_message, make_msg_handler());
+    REPLACE(sftp_reply_status, reply_status);
+    REPLACE(sftp_reply_names_add, reply_names_add);
+    REPLACE(sftp_reply_names, reply_names);
+
+    sftp.run();
+
+    EXPECT_THAT(num_replies, Gt(1));
+    EXPECT_THAT(eof_num_calls, Gt(0));
+    EXPECT_THAT(entries, UnorderedElementsAreArray(expected_entries));
 }
 
 TEST_F(SftpServer, handles_readdir_attributes_preserved)
@@ -1184,6 +1362,621 @@ TEST_F(SftpServer, handles_reads)
     ASSERT_THAT(num_calls, Eq(1));
 }
 
+TEST_F(SftpServer, handles_reads_larger_than_64k)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    const std::string content(300 * 1024, 'x');
+    mpt::make_file_with_content(file_name, content);
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    auto open_msg = make_msg(SFTP_OPEN);
+    auto name = name_as_char_array(file_name.toStdString());
+    open_msg->filename = name.data();
+    open_msg->flags |= SSH_FXF_READ;
+
+    auto read_msg = make_msg(SFTP_READ);
+    read_msg->offset = 0;
+    read_msg->len = 100 * 1024;
+
+    auto capped_read_msg = make_msg(SFTP_READ);
+    capped_read_msg->offset = 0;
+    capped_read_msg->len = content.size();
+
+    void* id{nullptr};
+    auto handle_alloc = [&id](sftp_session, void* info) {
+        id = info;
+        return nullptr;
+    };
+
+    std::vector<int> lengths;
+    auto reply_data = [&lengths](sftp_client_message, const void*, int len) {
+        lengths.push_back(len);
+        return SSH_OK;
+    };
+
+    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_handle_alloc, handle_alloc);
+    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_get_client_message, make_msg_handler());
+    REPLACE(sftp_reply_data, reply_data);
+
+    sftp.run();
+
+    EXPECT_THAT(lengths, ElementsAre(100 * 1024, 256 * 1024));
+}
+
+TEST_F(SftpServer, handles_pipelined_reads)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    mpt::make_file_with_content(file_name);
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString(), 4);
+    auto open_msg = make_msg(SFTP_OPEN);
+    auto name = name_as_char_array(file_name.toStdString());
+    open_msg->filename = name.data();
+    open_msg->flags |= SSH_FXF_READ;
+
+    const std::vector<std::pair<uint64_t, std::string>> expected_reads{{0, "this"}, {5, "is"}, {10, "test"}};
+    std::vector<std::unique_ptr<sftp_client_message_struct>> read_msgs;
+    for (const auto& read : expected_reads)
+    {
+        auto read_msg = make_msg(SFTP_READ);
+        read_msg->offset = read.first;
+        read_msg->len = read.second.size();
+        read_msgs.push_back(std::move(read_msg));
+    }
+
+    void* id{nullptr};
+    auto handle_alloc = [&id](sftp_session, void* info) {
+        id = info;
+        return nullptr;
+    };
+
+    std::unordered_map<sftp_client_message, std::string> replies;
+    auto reply_data = [&replies](sftp_client_message msg, const void* data, int len) {
+        replies[msg] = std::string{reinterpret_cast<const char*>(data), static_cast<std::string::size_type>(len)};
+        return SSH_OK;
+    };
+
+    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_handle_alloc, handle_alloc);
+    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_get_client_message, make_msg_handler());
+    REPLACE(sftp_reply_data, reply_data);
+
+    sftp.run();
+
+    ASSERT_THAT(replies.size(), Eq(expected_reads.size()));
+    for (auto i = 0u; i < expected_reads.size(); ++i)
+        EXPECT_THAT(replies[read_msgs[i].get()], StrEq(expected_reads[i].second));
+}
+
+// Not a pass/fail check: records how fast reads are served inline and by workers, for comparing changes
+TEST_F(SftpServer, records_sequential_and_random_read_throughput)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    const std::size_t file_size = 32u * 1024u * 1024u;
+    mpt::make_file_with_content(file_name, std::string(file_size, 'x'));
+    auto name = name_as_char_array(file_name.toStdString());
+
+    std::mt19937 random{42};
+    std::uniform_int_distribution<uint64_t> random_offset{0, file_size - 4096};
+    std::vector<std::pair<uint64_t, uint32_t>> sequential_reads, random_reads;
+    for (uint64_t offset = 0; offset < file_size; offset += 256u * 1024u)
+        sequential_reads.emplace_back(offset, 256u * 1024u);
+    for (auto i = 0; i < 8192; ++i)
+        random_reads.emplace_back(random_offset(random), 4096u);
+
+    void* id{nullptr};
+    auto handle_alloc = [&id](sftp_session, void* info) {
+        id = info;
+        return nullptr;
+    };
+
+    uint64_t bytes_replied{0};
+    auto reply_data = [&bytes_replied](sftp_client_message, const void*, int len) {
+        bytes_replied += len;
+        return SSH_OK;
+    };
+
+    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_handle_alloc, handle_alloc);
+    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_get_client_message, make_msg_handler());
+    REPLACE(sftp_reply_data, reply_data);
+
+    for (const auto& pattern : {std::make_pair("sequential", &sequential_reads),
+                                std::make_pair("random", &random_reads)})
+    {
+        for (auto worker_threads : {0, 4})
+        {
+            auto sftp = make_sftpserver(temp_dir.path().toStdString(), worker_threads);
+            auto open_msg = make_msg(SFTP_OPEN);
+            open_msg->filename = name.data();
+            open_msg->flags |= SSH_FXF_READ;
+
+            std::vector<std::unique_ptr<sftp_client_message_struct>> read_msgs;
+            for (const auto& read : *pattern.second)
+            {
+                read_msgs.push_back(make_msg(SFTP_READ));
+                read_msgs.back()->offset = read.first;
+                read_msgs.back()->len = read.second;
+            }
+
+            bytes_replied = 0;
+            const auto start = std::chrono::steady_clock::now();
+            sftp.run();
+            const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            ASSERT_THAT(bytes_replied, Gt(0u));
+            RecordProperty(fmt::format("{}_reads_with_{}_workers_mb_per_s", pattern.first, worker_threads),
+                           static_cast<int>(bytes_replied / elapsed / (1024 * 1024)));
+        }
+    }
+}
+
+TEST_F(SftpServer, pipelined_writes_to_the_same_handle_keep_their_order)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString(), 4);
+    auto open_msg = make_msg(SFTP_OPEN);
+    auto name = name_as_char_array(file_name.toStdString());
+    sftp_attributes_struct attr{};
+    attr.permissions = 0777;
+
+    open_msg->filename = name.data();
+    open_msg->attr = &attr;
+    open_msg->flags |= SSH_FXF_WRITE | SSH_FXF_TRUNC;
+
+    auto write_msg1 = make_msg(SFTP_WRITE);
+    auto data1 = make_data("aaaa");
+    write_msg1->data = data1.get();
+    write_msg1->offset = 0;
+
+    auto write_msg2 = make_msg(SFTP_WRITE);
+    auto data2 = make_data("bb");
+    write_msg2->data = data2.get();
+    write_msg2->offset = 1;
+
+    void* id{nullptr};
+    auto handle_alloc = [&id](sftp_session, void* info) {
+        id = info;
+        return nullptr;
+    };
+
+    int num_calls{0};
+    auto reply_status = [&num_calls](sftp_client_message, uint32_t status, const char*) {
+        EXPECT_TRUE(status == SSH_FX_OK);
+        ++num_calls;
+        return SSH_OK;
+    };
+
+    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_handle_alloc, handle_alloc);
+    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_get_client_message, make_msg_handler());
+    REPLACE(sftp_reply_status, reply_status);
+
+    sftp.run();
+
+    ASSERT_THAT(num_calls, Eq(2));
+    EXPECT_TRUE(content_match(file_name, "abba"));
+}
+
+TEST_F(SftpServer, buffered_writes_are_flushed_on_close)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    auto open_msg = make_msg(SFTP_OPEN);
+    auto name = name_as_char_array(file_name.toStdString());
+    sftp_attributes_struct attr{};
+    attr.permissions = 0777;
+
+    open_msg->filename = name.data();
+    open_msg->attr = &attr;
+    open_msg->flags |= SSH_FXF_WRITE | SSH_FXF_TRUNC;
+
+    auto write_msg1 = make_msg(SFTP_WRITE);
+    auto data1 = make_data("The answer is ");
+    write_msg1->data = data1.get();
+    write_msg1->offset = 0;
+
+    auto write_msg2 = make_msg(SFTP_WRITE);
+    auto data2 = make_data("always 42");
+    write_msg2->data = data2.get();
+    write_msg2->offset = ssh_string_len(data1.get());
+
+    auto close_msg = make_msg(SFTP_CLOSE);
+
+    void* id{nullptr};
+    auto handle_alloc = [&id](sftp_session, void* info) {
+        id = info;
+        return nullptr;
+    };
+
+    int num_calls{0};
+    bool content_on_close_matched{false};
+    auto reply_status = [&](sftp_client_message msg, uint32_t status, const char*) {
+        EXPECT_TRUE(status == SSH_FX_OK);
+        if (msg == close_msg.get())
+            content_on_close_matched = content_match(file_name, "The answer is always 42");
+        ++num_calls;
+        return SSH_OK;
+    };
+
+    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_handle_alloc, handle_alloc);
+    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_handle_remove, [](auto...) {});
+    REPLACE(sftp_get_client_message, make_msg_handler());
+    REPLACE(sftp_reply_status, reply_status);
+
+    sftp.run();
+
+    ASSERT_THAT(num_calls, Eq(3));
+    EXPECT_TRUE(content_on_close_matched);
+}
+
+TEST_F(SftpServer, handle_extended_fsync)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    auto open_msg = make_msg(SFTP_OPEN);
+    auto name = name_as_char_array(file_name.toStdString());
+    sftp_attributes_struct attr{};
+    attr.permissions = 0777;
+
+    open_msg->filename = name.data();
+    open_msg->attr = &attr;
+    open_msg->flags |= SSH_FXF_WRITE | SSH_FXF_TRUNC;
+
+    auto write_msg = make_msg(SFTP_WRITE);
+    auto data = make_data("durable data");
+    write_msg->data = data.get();
+    write_msg->offset = 0;
+
+    auto fsync_msg = make_msg(SFTP_EXTENDED);
+    auto submessage = name_as_char_array("fsync@openssh.com");
+    fsync_msg->submessage = submessage.data();
+    ExtensionPayload payload{"fsync@openssh.com"};
+    payload.add_string("handle");
+    fsync_msg->complete_message = payload.buffer.get();
+
+    void* id{nullptr};
+    auto handle_alloc = [&id](sftp_session, void* info) {
+        id = info;
+        return nullptr;
+    };
+
+    int num_calls{0};
+    bool content_on_fsync_matched{false};
+    auto reply_status = [&](sftp_client_message msg, uint32_t status, const char*) {
+        EXPECT_TRUE(status == SSH_FX_OK);
+        if (msg == fsync_msg.get())
+            content_on_fsync_matched = content_match(file_name, "durable data");
+        ++num_calls;
+        return SSH_OK;
+    };
+
+    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_handle_alloc, handle_alloc);
+    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_get_client_message, make_msg_handler());
+    REPLACE(sftp_reply_status, reply_status);
+
+    sftp.run();
+
+    ASSERT_THAT(num_calls, Eq(2));
+    EXPECT_TRUE(content_on_fsync_matched);
+}
+
+TEST_F(SftpServer, stat_sees_writes_still_buffered_for_a_handle)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    auto name = name_as_char_array(file_name.toStdString());
+    auto handle_name = make_data("0");
+    auto data = make_data("not yet flushed");
+    sftp_attributes_struct attr{};
+    attr.permissions = 0777;
+
+    std::vector<void*> ids;
+    auto handle_alloc = [&ids](sftp_session, void* info) {
+        ids.push_back(info);
+        return nullptr;
+    };
+    auto handle = [&ids](auto...) { return ids.back(); };
+
+    uint64_t stat_size{0};
+    auto reply_attr = [&stat_size](sftp_client_message, sftp_attributes attr) {
+        stat_size = attr->size;
+        return SSH_OK;
+    };
+
+    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_handle_alloc, handle_alloc);
+    REPLACE(sftp_handle, handle);
+    REPLACE(sftp_get_client_message, make_msg_handler());
+    REPLACE(sftp_reply_attr, reply_attr);
+
+    // Inline as well as by workers, where the stat must also wait for the write
+    for (auto worker_threads : {0, 4})
+    {
+        auto sftp = make_sftpserver(temp_dir.path().toStdString(), worker_threads);
+
+        auto open_msg = make_msg(SFTP_OPEN);
+        open_msg->filename = name.data();
+        open_msg->attr = &attr;
+        open_msg->flags |= SSH_FXF_WRITE | SSH_FXF_TRUNC;
+
+        auto write_msg = make_msg(SFTP_WRITE);
+        write_msg->handle = handle_name.get();
+        write_msg->data = data.get();
+        write_msg->offset = 0;
+
+        auto stat_msg = make_msg(SFTP_STAT);
+        stat_msg->filename = name.data();
+
+        stat_size = 0;
+        sftp.run();
+
+        EXPECT_THAT(stat_size, Eq(ssh_string_len(data.get())));
+    }
+}
+
+TEST_F(SftpServer, read_through_another_handle_sees_buffered_writes)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    auto name = name_as_char_array(file_name.toStdString());
+    auto write_handle = make_data("0");
+    auto read_handle = make_data("1");
+    auto data = make_data("not yet flushed");
+    sftp_attributes_struct attr{};
+    attr.permissions = 0777;
+
+    std::vector<void*> ids;
+    auto handle_alloc = [&ids](sftp_session, void* info) {
+        ids.push_back(info);
+        return nullptr;
+    };
+    auto handle = [&ids](sftp_session, ssh_string handle) -> void* {
+        auto index = std::stoul(std::string(static_cast<char*>(ssh_string_data(handle)), ssh_string_len(handle)));
+        return index < ids.size() ? ids[index] : nullptr;
+    };
+
+    std::string data_read;
+    auto reply_data = [&data_read](sftp_client_message, const void* data, int len) {
+        data_read.assign(static_cast<const char*>(data), len);
+        return SSH_OK;
+    };
+
+    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_handle_alloc, handle_alloc);
+    REPLACE(sftp_handle, handle);
+    REPLACE(sftp_get_client_message, make_msg_handler());
+    REPLACE(sftp_reply_data, reply_data);
+
+    for (auto worker_threads : {0, 4})
+    {
+        auto sftp = make_sftpserver(temp_dir.path().toStdString(), worker_threads);
+        ids.clear();
+
+        auto open_write_msg = make_msg(SFTP_OPEN);
+        open_write_msg->filename = name.data();
+        open_write_msg->attr = &attr;
+        open_write_msg->flags |= SSH_FXF_WRITE | SSH_FXF_CREAT | SSH_FXF_TRUNC;
+
+        auto open_read_msg = make_msg(SFTP_OPEN);
+        open_read_msg->filename = name.data();
+        open_read_msg->flags |= SSH_FXF_READ;
+
+        auto write_msg = make_msg(SFTP_WRITE);
+        write_msg->handle = write_handle.get();
+        write_msg->data = data.get();
+        write_msg->offset = 0;
+
+        auto read_msg = make_msg(SFTP_READ);
+        read_msg->handle = read_handle.get();
+        read_msg->offset = 0;
+        read_msg->len = 100;
+
+        data_read.clear();
+        sftp.run();
+
+        EXPECT_THAT(data_read, StrEq("not yet flushed"));
+    }
+}
+
+TEST_F(SftpServer, handle_extended_copy_data)
+{
+    mpt::TempDir temp_dir;
+    auto source_name = temp_dir.path() + "/source-file";
+    auto destination_name = temp_dir.path() + "/destination-file";
+    mpt::make_file_with_content(source_name, "copied on the host");
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    sftp_attributes_struct attr{};
+    attr.permissions = 0777;
+
+    auto open_source_msg = make_msg(SFTP_OPEN);
+    auto source = name_as_char_array(source_name.toStdString());
+    open_source_msg->filename = source.data();
+    open_source_msg->attr = &attr;
+    open_source_msg->flags |= SSH_FXF_READ;
+
+    auto open_destination_msg = make_msg(SFTP_OPEN);
+    auto destination = name_as_char_array(destination_name.toStdString());
+    open_destination_msg->filename = destination.data();
+    open_destination_msg->attr = &attr;
+    open_destination_msg->flags |= SSH_FXF_WRITE | SSH_FXF_CREAT | SSH_FXF_TRUNC;
+
+    auto copy_msg = make_msg(SFTP_EXTENDED);
+    auto submessage = name_as_char_array("copy-data");
+    copy_msg->submessage = submessage.data();
+    ExtensionPayload payload{"copy-data"};
+    payload.add_string("0");
+    payload.add_u64(14);
+    payload.add_u64(4);
+    payload.add_string("1");
+    payload.add_u64(0);
+    copy_msg->complete_message = payload.buffer.get();
+
+    std::vector<void*> ids;
+    auto handle_alloc = [&ids](sftp_session, void* info) {
+        ids.push_back(info);
+        return nullptr;
+    };
+    auto handle = [&ids](sftp_session, ssh_string handle) -> void* {
+        auto index = std::stoul(std::string(static_cast<char*>(ssh_string_data(handle)), ssh_string_len(handle)));
+        return index < ids.size() ? ids[index] : nullptr;
+    };
+
+    int num_calls{0};
+    auto reply_status = make_reply_status(copy_msg.get(), SSH_FX_OK, num_calls);
+
+    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_handle_alloc, handle_alloc);
+    REPLACE(sftp_handle, handle);
+    REPLACE(sftp_get_client_message, make_msg_handler());
+    REPLACE(sftp_reply_status, reply_status);
+
+    sftp.run();
+
+    ASSERT_THAT(num_calls, Eq(1));
+    EXPECT_TRUE(content_match(destination_name, "host"));
+}
+
+TEST_F(SftpServer, handle_extended_copy_data_rejects_overlapping_ranges_in_one_file)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    mpt::make_file_with_content(file_name, "0123456789");
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    sftp_attributes_struct attr{};
+    attr.permissions = 0777;
+
+    auto open_msg = make_msg(SFTP_OPEN);
+    auto name = name_as_char_array(file_name.toStdString());
+    open_msg->filename = name.data();
+    open_msg->attr = &attr;
+    open_msg->flags |= SSH_FXF_READ | SSH_FXF_WRITE;
+
+    auto submessage = name_as_char_array("copy-data");
+    auto make_copy_msg = [this, &submessage](uint64_t read_offset, uint64_t length, uint64_t write_offset) {
+        auto copy_msg = make_msg(SFTP_EXTENDED);
+        copy_msg->submessage = submessage.data();
+        auto payload = std::make_unique<ExtensionPayload>("copy-data");
+        payload->add_string("0");
+        payload->add_u64(read_offset);
+        payload->add_u64(length);
+        payload->add_string("0");
+        payload->add_u64(write_offset);
+        copy_msg->complete_message = payload->buffer.get();
+        return std::make_pair(std::move(copy_msg), std::move(payload));
+    };
+
+    auto overlapping = make_copy_msg(0, 6, 4);
+    auto to_the_end = make_copy_msg(2, 0, 9);
+    auto apart = make_copy_msg(0, 2, 10);
+
+    void* id{nullptr};
+    auto handle_alloc = [&id](sftp_session, void* info) {
+        id = info;
+        return nullptr;
+    };
+
+    std::vector<std::pair<sftp_client_message, int>> statuses;
+    auto reply_status = [&statuses](sftp_client_message msg, uint32_t status, const char*) {
+        statuses.emplace_back(msg, static_cast<int>(status));
+        return SSH_OK;
+    };
+
+    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_handle_alloc, handle_alloc);
+    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_get_client_message, make_msg_handler());
+    REPLACE(sftp_reply_status, reply_status);
+
+    sftp.run();
+
+    EXPECT_THAT(statuses, ElementsAre(Pair(overlapping.first.get(), SSH_FX_FAILURE),
+                                      Pair(to_the_end.first.get(), SSH_FX_FAILURE), Pair(apart.first.get(), SSH_FX_OK)));
+    EXPECT_TRUE(content_match(file_name, "012345678901"));
+}
+
+TEST_F(SftpServer, handle_extended_statvfs)
+{
+    mpt::TempDir temp_dir;
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+
+    sftp_session_struct sftp_session{};
+    auto msg = make_msg(SFTP_EXTENDED);
+    msg->sftp = &sftp_session;
+    msg->id = 42;
+    auto submessage = name_as_char_array("statvfs@openssh.com");
+    msg->submessage = submessage.data();
+    ExtensionPayload payload{"statvfs@openssh.com"};
+    payload.add_string(temp_dir.path().toStdString());
+    msg->complete_message = payload.buffer.get();
+
+    std::string packet;
+    auto channel_write = [&packet](ssh_channel, const void* data, uint32_t len) {
+        packet.append(static_cast<const char*>(data), len);
+        return static_cast<int>(len);
+    };
+
+    REPLACE(sftp_get_client_message, make_msg_handler());
+    REPLACE(ssh_channel_write, channel_write);
+
+    sftp.run();
+
+    struct statvfs st;
+    ASSERT_THAT(::statvfs(temp_dir.path().toStdString().c_str(), &st), Eq(0));
+
+    auto values = extended_reply_values(packet);
+    ASSERT_THAT(values.size(), Eq(11u));
+    EXPECT_THAT(values[0], Eq(st.f_bsize));
+    EXPECT_THAT(values[10], Eq(st.f_namemax));
+}
+
+TEST_F(SftpServer, handle_extended_limits)
+{
+    auto sftp = make_sftpserver();
+
+    sftp_session_struct sftp_session{};
+    auto msg = make_msg(SFTP_EXTENDED);
+    msg->sftp = &sftp_session;
+    auto submessage = name_as_char_array("limits@openssh.com");
+    msg->submessage = submessage.data();
+
+    std::string packet;
+    auto channel_write = [&packet](ssh_channel, const void* data, uint32_t len) {
+        packet.append(static_cast<const char*>(data), len);
+        return static_cast<int>(len);
+    };
+
+    REPLACE(sftp_get_client_message, make_msg_handler());
+    REPLACE(ssh_channel_write, channel_write);
+
+    sftp.run();
+
+    auto values = extended_reply_values(packet);
+    ASSERT_THAT(values.size(), Eq(4u));
+    EXPECT_THAT(values[1], Eq(256u * 1024u));
+    EXPECT_THAT(values[2], Eq(256u * 1024u));
+}
+
 TEST_F(SftpServer, handle_extended_link)
 {
     mpt::TempDir temp_dir;
@@ -1349,6 +2142,40 @@ TEST_P(Stat, handles)
     EXPECT_THAT(num_calls, Eq(1));
 }
 
+TEST_F(SftpServer, cached_stat_sees_changes_made_on_the_host)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    mpt::make_file_with_content(file_name, "short");
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString(), 0, true);
+    auto first_msg = make_msg(SFTP_STAT);
+    auto second_msg = make_msg(SFTP_STAT);
+    auto third_msg = make_msg(SFTP_STAT);
+
+    auto name = name_as_char_array(file_name.toStdString());
+    first_msg->filename = second_msg->filename = third_msg->filename = name.data();
+
+    REPLACE(sftp_get_client_message, make_msg_handler());
+
+    std::vector<uint64_t> sizes;
+    auto reply_attr = [&sizes, &file_name](sftp_client_message, sftp_attributes attr) {
+        sizes.push_back(attr->size);
+        if (sizes.size() == 2)
+        {
+            QFile file(file_name);
+            EXPECT_TRUE(file.open(QFile::Append));
+            file.write(" and longer");
+        }
+        return SSH_OK;
+    };
+    REPLACE(sftp_reply_attr, reply_attr);
+
+    sftp.run();
+
+    EXPECT_THAT(sizes, ElementsAre(5u, 5u, 16u));
+}
+
 namespace
 {
 INSTANTIATE_TEST_SUITE_P(SftpServer, Stat, ::testing::Values(SFTP_LSTAT, SFTP_STAT), string_for_message);
@@ -52,7 +52,7 @@ TEST_F(TestSSHFSServerProcessSpec, program_correct)
 TEST_F(TestSSHFSServerProcessSpec, arguments_correct)
 {
     mp::SSHFSServerProcessSpec spec(config);
-    ASSERT_EQ(spec.arguments().size(), 7);
+    ASSERT_EQ(spec.arguments().size(), 10);
     EXPECT_EQ(spec.arguments()[0], "host");
     EXPECT_EQ(spec.arguments()[1], "42");
     EXPECT_EQ(spec.arguments()[2], "username");
@@ -61,6 +61,60 @@ TEST_F(TestSSHFSServerProcessSpec, arguments_correct)
     // Ordering of below options not guaranteed, hence the or-s.
     EXPECT_TRUE(spec.arguments()[5] == "6:10,5:-1," || spec.arguments()[5] == "5:-1,6:10,");
     EXPECT_TRUE(spec.arguments()[6] == "3:4,1:2," || spec.arguments()[6] == "1:2,3:4,");
+    EXPECT_EQ(spec.arguments()[7], "0");
+    EXPECT_EQ(spec.arguments()[8], "0");
+    EXPECT_EQ(spec.arguments()[9], "0");
+}
+
+TEST_F(TestSSHFSServerProcessSpec, additional_mounts_appended_to_arguments)
+{
+    config.additional_mounts.push_back(
+        {"other_source", "other_target", {{7, 8}}, {{9, 10}}, mp::VMMount::MountProfile::Strict});
+
+    mp::SSHFSServerProcessSpec spec(config);
+    ASSERT_EQ(spec.arguments().size(), 15);
+    EXPECT_EQ(spec.arguments()[10], "other_source");
+    EXPECT_EQ(spec.arguments()[11], "other_target");
+    EXPECT_EQ(spec.arguments()[12], "9:10,");
+    EXPECT_EQ(spec.arguments()[13], "7:8,");
+    EXPECT_EQ(spec.arguments()[14], "2");
+}
+
+TEST_F(TestSSHFSServerProcessSpec, mount_profile_passed_in_arguments)
+{
+    config.mount_profile = mp::VMMount::MountProfile::ReadonlyCached;
+
+    mp::SSHFSServerProcessSpec spec(config);
+    ASSERT_EQ(spec.arguments().size(), 10);
+    EXPECT_EQ(spec.arguments()[9], "1");
+}
+
+TEST_F(TestSSHFSServerProcessSpec, apparmor_profile_only_allows_reading_readonly_sources)
+{
+    config.additional_mounts.push_back(
+        {"other_source", "other_target", {}, {}, mp::VMMount::MountProfile::ReadonlyCached});
+
+    mpt::UnsetEnvScope env_scope("SNAP");
+    mpt::SetEnvScope env_scope2("SNAP_NAME", "multipass");
+    mp::SSHFSServerProcessSpec spec(config);
+    const auto apparmor_profile = spec.apparmor_profile();
+
+    EXPECT_TRUE(apparmor_profile.contains("source_path/** rwlk,"));
+    EXPECT_TRUE(apparmor_profile.contains("other_source/** r,"));
+    EXPECT_FALSE(apparmor_profile.contains("other_source/** rwlk,"));
+}
+
+TEST_F(TestSSHFSServerProcessSpec, apparmor_profile_allows_all_source_directories)
+{
+    config.additional_mounts.push_back({"other_source", "other_target", {}, {}});
+
+    mpt::UnsetEnvScope env_scope("SNAP");
+    mpt::SetEnvScope env_scope2("SNAP_NAME", "multipass");
+    mp::SSHFSServerProcessSpec spec(config);
+    const auto apparmor_profile = spec.apparmor_profile();
+
+    EXPECT_TRUE(apparmor_profile.contains("source_path/** rwlk,"));
+    EXPECT_TRUE(apparmor_profile.contains("other_source/** rwlk,"));
 }
 
 TEST_F(TestSSHFSServerProcessSpec, environment_correct)
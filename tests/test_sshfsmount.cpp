@@ -55,7 +55,10 @@ struct SshfsMount : public mp::test::SftpServerTest
     mp::SshfsMount make_sshfsmount(mp::optional<std::string> target = mp::nullopt)
     {
         mp::SSHSession session{"a", 42};
-        return {std::move(session), default_source, target.value_or(default_target), default_map, default_map};
+        return {std::move(session),
+                {{default_source, target.value_or(default_target), default_map, default_map, default_profile}},
+                0,
+                false};
     }
 
     auto make_exec_that_fails_for(const std::vector<std::string>& expected_cmds, bool& invoked)
@@ -186,6 +189,7 @@ struct SshfsMount : public mp::test::SftpServerTest
     std::string default_source{"source"};
     std::string default_target{"target"};
     std::unordered_map<int, int> default_map;
+    mp::VMMount::MountProfile default_profile{mp::VMMount::MountProfile::Default};
     int default_id{1000};
     mpt::MockLogger::Scope logger_scope = mpt::MockLogger::inject();
 
@@ -386,6 +390,29 @@ TEST_F(SshfsMount, throws_when_sshfs_does_not_exist)
     EXPECT_TRUE(invoked);
 }
 
+TEST_F(SshfsMount, readonly_cached_profile_mounts_read_only_and_caches_longer)
+{
+    default_profile = mp::VMMount::MountProfile::ReadonlyCached;
+    CommandVector commands = {
+        {"sudo env LD_LIBRARY_PATH=/foo/bar /baz/bin/sshfs -o slave -o transform_symlinks -o allow_other -o "
+         "Compression=no -o ro -o auto_cache -o max_read=131072 -o dcache_timeout=60 :\"source\" "
+         "\"/home/ubuntu/target\"",
+         "don't care\n"}};
+
+    test_command_execution(commands);
+}
+
+TEST_F(SshfsMount, strict_profile_disables_caching)
+{
+    default_profile = mp::VMMount::MountProfile::Strict;
+    CommandVector commands = {
+        {"sudo env LD_LIBRARY_PATH=/foo/bar /baz/bin/sshfs -o slave -o transform_symlinks -o allow_other -o "
+         "Compression=no -o cache=no -o entry_timeout=0 -o attr_timeout=0 :\"source\" \"/home/ubuntu/target\"",
+         "don't care\n"}};
+
+    test_command_execution(commands);
+}
+
 TEST_F(SshfsMount, unblocks_when_sftpserver_exits)
 {
     mpt::Signal client_message;
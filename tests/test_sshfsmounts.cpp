@@ -15,11 +15,13 @@
  *
  */
 
+#include <multipass/constants.h>
 #include <multipass/exceptions/sshfs_missing_error.h>
 #include <multipass/sshfs_mount/sshfs_mounts.h>
 
 #include "mock_environment_helpers.h"
 #include "mock_process_factory.h"
+#include "mock_settings.h"
 #include "mock_virtual_machine.h"
 #include "stub_ssh_key_provider.h"
 
@@ -78,7 +80,7 @@ TEST_F(SSHFSMountsTest, mount_creates_sshfs_process)
     auto sshfs_command = factory->process_list()[0];
     EXPECT_TRUE(sshfs_command.command.endsWith("sshfs_server"));
 
-    ASSERT_EQ(sshfs_command.arguments.size(), 7);
+    ASSERT_EQ(sshfs_command.arguments.size(), 9);
     EXPECT_EQ(sshfs_command.arguments[0], "localhost");
     EXPECT_EQ(sshfs_command.arguments[1], "42");
     EXPECT_EQ(sshfs_command.arguments[2], "ubuntu");
@@ -87,6 +89,27 @@ TEST_F(SSHFSMountsTest, mount_creates_sshfs_process)
     // Ordering of below options not guaranteed, hence the or-s.
     EXPECT_TRUE(sshfs_command.arguments[5] == "6:10,5:-1," || sshfs_command.arguments[5] == "5:-1,6:10,");
     EXPECT_TRUE(sshfs_command.arguments[6] == "3:4,1:2," || sshfs_command.arguments[6] == "1:2,3:4,");
+    EXPECT_EQ(sshfs_command.arguments[7], "4");
+    EXPECT_EQ(sshfs_command.arguments[8], "0");
+}
+
+TEST_F(SSHFSMountsTest, mount_caches_attributes_when_enabled_in_settings)
+{
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback(sshfs_prints_connected);
+
+    auto& mock_settings = mpt::MockSettings::mock_instance();
+    EXPECT_CALL(mock_settings, get(Eq(mp::mount_cache_attributes_key))).WillRepeatedly(Return("true"));
+
+    mp::SSHFSMounts sshfs_mounts(key_provider);
+    NiceMock<mpt::MockVirtualMachine> vm{"my_instance"};
+
+    sshfs_mounts.start_mount(&vm, source_path, target_path, gid_map, uid_map);
+
+    ASSERT_EQ(factory->process_list().size(), 1u);
+    const auto& arguments = factory->process_list()[0].arguments;
+    ASSERT_GE(arguments.size(), 9);
+    EXPECT_EQ(arguments[8], "1");
 }
 
 TEST_F(SSHFSMountsTest, sshfs_process_failing_with_return_code_9_causes_exception)
@@ -234,3 +257,74 @@ TEST_F(SSHFSMountsTest, has_instance_already_mounted_returns_false_when_no_such_
 
     EXPECT_FALSE(sshfs_mounts.has_instance_already_mounted("bad_vm_name", target_path));
 }
+
+TEST_F(SSHFSMountsTest, start_mounts_serves_all_targets_from_one_process)
+{
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback(sshfs_prints_connected);
+
+    mp::SSHFSMounts sshfs_mounts(key_provider);
+
+    NiceMock<mpt::MockVirtualMachine> vm{"my_instance"};
+
+    sshfs_mounts.start_mounts(&vm, {{"/target/one", {"/source/one", gid_map, uid_map}},
+                                    {"/target/two", {"/source/two", gid_map, uid_map}}});
+
+    ASSERT_EQ(factory->process_list().size(), 1u);
+    const auto& arguments = factory->process_list()[0].arguments;
+    ASSERT_EQ(arguments.size(), 13);
+    EXPECT_THAT(arguments, Contains("/target/one"));
+    EXPECT_THAT(arguments, Contains("/target/two"));
+
+    EXPECT_TRUE(sshfs_mounts.has_instance_already_mounted(vm.vm_name, "/target/one"));
+    EXPECT_TRUE(sshfs_mounts.has_instance_already_mounted(vm.vm_name, "/target/two"));
+}
+
+TEST_F(SSHFSMountsTest, stop_mount_of_shared_process_only_stops_that_target)
+{
+    auto factory = mpt::MockProcessFactory::Inject();
+    mpt::MockProcessFactory::Callback sshfs_stops_target = [this](mpt::MockProcess* process) {
+        sshfs_prints_connected(process);
+
+        if (process->program().contains("sshfs_server"))
+        {
+            EXPECT_CALL(*process, write(QByteArray("stop /target/one\n")));
+            EXPECT_CALL(*process, terminate).Times(0);
+        }
+    };
+    factory->register_callback(sshfs_stops_target);
+
+    mp::SSHFSMounts sshfs_mounts(key_provider);
+
+    NiceMock<mpt::MockVirtualMachine> vm{"my_instance"};
+
+    sshfs_mounts.start_mounts(&vm, {{"/target/one", {"/source/one", gid_map, uid_map}},
+                                    {"/target/two", {"/source/two", gid_map, uid_map}}});
+
+    EXPECT_TRUE(sshfs_mounts.stop_mount(vm.vm_name, "/target/one"));
+    EXPECT_FALSE(sshfs_mounts.has_instance_already_mounted(vm.vm_name, "/target/one"));
+    EXPECT_TRUE(sshfs_mounts.has_instance_already_mounted(vm.vm_name, "/target/two"));
+}
+
+TEST_F(SSHFSMountsTest, stop_all_mounts_terminates_shared_process_once)
+{
+    auto factory = mpt::MockProcessFactory::Inject();
+    mpt::MockProcessFactory::Callback sshfs_terminates = [this](mpt::MockProcess* process) {
+        sshfs_prints_connected(process);
+
+        if (process->program().contains("sshfs_server"))
+        {
+            EXPECT_CALL(*process, terminate).Times(1);
+        }
+    };
+    factory->register_callback(sshfs_terminates);
+
+    mp::SSHFSMounts sshfs_mounts(key_provider);
+
+    NiceMock<mpt::MockVirtualMachine> vm{"my_instance"};
+
+    sshfs_mounts.start_mounts(&vm, {{"/target/one", {"/source/one", gid_map, uid_map}},
+                                    {"/target/two", {"/source/two", gid_map, uid_map}}});
+
+    sshfs_mounts.stop_all_mounts_for_instance(vm.vm_name);
+}
@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "file_operations.h"
+#include "local_http_server.h"
+#include "temp_dir.h"
+
+#include <multipass/exceptions/aborted_download_exception.h>
+#include <multipass/exceptions/download_exception.h>
+#include <multipass/url_downloader.h>
+
+#include <QFile>
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QTimer>
+#include <QUrl>
+
+#include <chrono>
+#include <future>
+#include <thread>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+
+using namespace testing;
+
+namespace
+{
+struct URLDownloader : public Test
+{
+    mpt::TempDir cache_dir;
+    mpt::TempDir data_dir;
+    mp::URLDownloader url_downloader{cache_dir.path(), std::chrono::seconds(10)};
+    mp::ProgressMonitor stub_monitor{[](int, int) { return true; }};
+};
+
+// Bytes that differ from one position to the next, so that misplaced data shows
+QByteArray make_content(int size)
+{
+    QByteArray content(size, '\0');
+    for (auto i = 0; i < size; ++i)
+        content[i] = static_cast<char>(i % 251);
+
+    return content;
+}
+
+QString hash_of(const QByteArray& content)
+{
+    return QCryptographicHash::hash(content, QCryptographicHash::Sha256).toHex();
+}
+} // namespace
+
+TEST_F(URLDownloader, download_to_returns_hash_of_data_written)
+{
+    const std::string content(3 * 1024 * 1024 + 17, 'x');
+    const auto source_path = data_dir.path() + "/source.img";
+    const auto file_name = data_dir.path() + "/downloaded.img";
+    mpt::make_file_with_content(source_path, content);
+
+    const auto hash = url_downloader.download_to(QUrl::fromLocalFile(source_path), file_name,
+                                                 static_cast<int64_t>(content.size()), -1, stub_monitor);
+
+    EXPECT_EQ(mpt::load(file_name).toStdString(), content);
+    EXPECT_EQ(hash, QCryptographicHash::hash(QByteArray::fromStdString(content), QCryptographicHash::Sha256).toHex());
+}
+
+TEST_F(URLDownloader, download_to_resumes_after_dropped_connections)
+{
+    const auto content = make_content(1024 * 1024);
+    mpt::LocalHttpServer server{content};
+    server.cut_responses_short({100000, 100000});
+
+    const auto file_name = data_dir.path() + "/downloaded.img";
+    const auto hash = url_downloader.download_to(server.url(), file_name, content.size(), -1, stub_monitor);
+
+    EXPECT_EQ(mpt::load(file_name), content);
+    EXPECT_EQ(hash, hash_of(content));
+    EXPECT_THAT(server.requested_ranges(), ElementsAre("", "bytes=100000-", "bytes=200000-"));
+    EXPECT_FALSE(QFile::exists(file_name + ".part"));
+}
+
+TEST_F(URLDownloader, download_to_resumes_from_part_file)
+{
+    const auto content = make_content(1024 * 1024);
+    mpt::LocalHttpServer server{content};
+
+    const auto file_name = data_dir.path() + "/downloaded.img";
+    mpt::make_file_with_content(file_name + ".part", content.left(300000).toStdString());
+    mpt::make_file_with_content(file_name + ".part.validator", "\"1\"");
+
+    const auto hash = url_downloader.download_to(server.url(), file_name, content.size(), -1, stub_monitor);
+
+    EXPECT_EQ(mpt::load(file_name), content);
+    EXPECT_EQ(hash, hash_of(content));
+    EXPECT_THAT(server.requested_ranges(), ElementsAre("bytes=300000-"));
+    EXPECT_FALSE(QFile::exists(file_name + ".part.validator"));
+}
+
+TEST_F(URLDownloader, download_to_starts_over_when_part_file_has_no_validator)
+{
+    const auto content = make_content(1024 * 1024);
+    mpt::LocalHttpServer server{content};
+
+    const auto file_name = data_dir.path() + "/downloaded.img";
+    mpt::make_file_with_content(file_name + ".part", std::string(300000, 'x'));
+
+    const auto hash = url_downloader.download_to(server.url(), file_name, content.size(), -1, stub_monitor);
+
+    EXPECT_EQ(mpt::load(file_name), content);
+    EXPECT_EQ(hash, hash_of(content));
+    EXPECT_THAT(server.requested_ranges(), ElementsAre(""));
+}
+
+TEST_F(URLDownloader, download_to_starts_over_when_data_changed_since_part_file)
+{
+    const auto content = make_content(1024 * 1024);
+    mpt::LocalHttpServer server{content};
+    server.set_etag("\"2\"");
+
+    const auto file_name = data_dir.path() + "/downloaded.img";
+    mpt::make_file_with_content(file_name + ".part", std::string(300000, 'x'));
+    mpt::make_file_with_content(file_name + ".part.validator", "\"1\"");
+
+    const auto hash = url_downloader.download_to(server.url(), file_name, content.size(), -1, stub_monitor);
+
+    EXPECT_EQ(mpt::load(file_name), content);
+    EXPECT_EQ(hash, hash_of(content));
+    EXPECT_THAT(server.requested_ranges(), ElementsAre("bytes=300000-"));
+}
+
+TEST_F(URLDownloader, download_to_starts_over_when_server_ignores_range)
+{
+    const auto content = make_content(1024 * 1024);
+    mpt::LocalHttpServer server{content};
+    server.set_accepts_ranges(false);
+
+    const auto file_name = data_dir.path() + "/downloaded.img";
+    mpt::make_file_with_content(file_name + ".part", std::string(300000, 'x'));
+    mpt::make_file_with_content(file_name + ".part.validator", "\"1\"");
+
+    const auto hash = url_downloader.download_to(server.url(), file_name, content.size(), -1, stub_monitor);
+
+    EXPECT_EQ(mpt::load(file_name), content);
+    EXPECT_EQ(hash, hash_of(content));
+}
+
+TEST_F(URLDownloader, download_to_keeps_part_file_for_next_attempt)
+{
+    const auto content = make_content(1024 * 1024);
+    mpt::LocalHttpServer server{content};
+    server.cut_responses_short({100000, 0});
+
+    const auto file_name = data_dir.path() + "/downloaded.img";
+    EXPECT_THROW(url_downloader.download_to(server.url(), file_name, content.size(), -1, stub_monitor),
+                 mp::DownloadException);
+    EXPECT_EQ(mpt::load(file_name + ".part"), content.left(100000));
+    EXPECT_EQ(mpt::load(file_name + ".part.validator"), "\"1\"");
+
+    const auto hash = url_downloader.download_to(server.url(), file_name, content.size(), -1, stub_monitor);
+
+    EXPECT_EQ(mpt::load(file_name), content);
+    EXPECT_EQ(hash, hash_of(content));
+    EXPECT_EQ(server.requested_ranges().back(), "bytes=100000-");
+}
+
+TEST_F(URLDownloader, stream_to_resumes_after_dropped_connection)
+{
+    const auto content = make_content(1024 * 1024);
+    mpt::LocalHttpServer server{content};
+    server.cut_responses_short({100000});
+
+    QByteArray streamed;
+    const auto hash = url_downloader.stream_to(
+        server.url(), [&streamed](const QByteArray& data) { streamed += data; }, content.size(), -1, stub_monitor);
+
+    EXPECT_EQ(streamed, content);
+    EXPECT_EQ(hash, hash_of(content));
+    EXPECT_THAT(server.requested_ranges(), ElementsAre("", "bytes=100000-"));
+}
+
+TEST_F(URLDownloader, download_to_splits_large_download_into_ranges)
+{
+    const auto content = make_content(64 * 1024 * 1024);
+    mpt::LocalHttpServer server{content};
+    server.cut_responses_short({1000000});
+
+    mp::URLDownloader ranged_downloader{cache_dir.path(), std::chrono::seconds(10), 4};
+    const auto file_name = data_dir.path() + "/downloaded.img";
+    const auto hash = ranged_downloader.download_to(server.url(), file_name, content.size(), -1, stub_monitor);
+
+    EXPECT_EQ(mpt::load(file_name), content);
+    EXPECT_EQ(hash, hash_of(content));
+    EXPECT_THAT(server.requested_ranges(), IsSupersetOf({"bytes=0-16777215", "bytes=16777216-33554431",
+                                                         "bytes=33554432-50331647", "bytes=50331648-67108863"}));
+    EXPECT_EQ(server.requested_ranges().size(), 5u);
+}
+
+TEST_F(URLDownloader, download_to_downloads_whole_when_range_support_check_times_out)
+{
+    const auto content = make_content(64 * 1024 * 1024);
+    mpt::LocalHttpServer server{content};
+    server.set_answers_head_requests(false);
+
+    mp::URLDownloader ranged_downloader{cache_dir.path(), std::chrono::milliseconds(500), 4};
+    const auto file_name = data_dir.path() + "/downloaded.img";
+    const auto hash = ranged_downloader.download_to(server.url(), file_name, content.size(), -1, stub_monitor);
+
+    EXPECT_EQ(hash, hash_of(content));
+    EXPECT_THAT(server.requested_ranges(), ElementsAre(""));
+}
+
+TEST_F(URLDownloader, download_to_keeps_to_rate_limit)
+{
+    const auto content = make_content(256 * 1024);
+    mpt::LocalHttpServer server{content};
+    url_downloader.limit_rate(server.url(), 512 * 1024);
+
+    const auto file_name = data_dir.path() + "/downloaded.img";
+    const auto start = std::chrono::steady_clock::now();
+    const auto hash = url_downloader.download_to(server.url(), file_name, content.size(), -1, stub_monitor);
+
+    EXPECT_EQ(mpt::load(file_name), content);
+    EXPECT_EQ(hash, hash_of(content));
+    // Half a second at that rate, less what may be read in the last go
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(300));
+}
+
+TEST_F(URLDownloader, stream_to_keeps_to_rate_limit)
+{
+    const auto content = make_content(256 * 1024);
+    mpt::LocalHttpServer server{content};
+    url_downloader.limit_rate(server.url(), 512 * 1024);
+
+    QByteArray streamed;
+    const auto start = std::chrono::steady_clock::now();
+    const auto hash = url_downloader.stream_to(
+        server.url(), [&streamed](const QByteArray& data) { streamed += data; }, content.size(), -1, stub_monitor);
+
+    EXPECT_EQ(streamed, content);
+    EXPECT_EQ(hash, hash_of(content));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(300));
+}
+
+TEST_F(URLDownloader, waiting_on_rate_limit_does_not_time_out)
+{
+    const auto content = make_content(8 * 1024);
+    mpt::LocalHttpServer server{content};
+
+    mp::URLDownloader slow_downloader{cache_dir.path(), std::chrono::milliseconds(500)};
+    slow_downloader.limit_rate(server.url(), 4 * 1024);
+
+    const auto file_name = data_dir.path() + "/downloaded.img";
+    const auto hash = slow_downloader.download_to(server.url(), file_name, content.size(), -1, stub_monitor);
+
+    EXPECT_EQ(hash, hash_of(content));
+}
+
+TEST_F(URLDownloader, rate_limit_is_lifted_with_zero)
+{
+    const auto content = make_content(256 * 1024);
+    mpt::LocalHttpServer server{content};
+    url_downloader.limit_rate(server.url(), 1024);
+    url_downloader.limit_rate(server.url(), 0);
+
+    const auto file_name = data_dir.path() + "/downloaded.img";
+    const auto start = std::chrono::steady_clock::now();
+    const auto hash = url_downloader.download_to(server.url(), file_name, content.size(), -1, stub_monitor);
+
+    EXPECT_EQ(hash, hash_of(content));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5)); // rather than minutes
+}
+
+TEST_F(URLDownloader, rate_limit_lifted_during_download_takes_effect)
+{
+    const auto content = make_content(256 * 1024);
+    mpt::LocalHttpServer server{content};
+    url_downloader.limit_rate(server.url(), 16 * 1024);
+
+    auto lifted = std::async(std::launch::async, [this, &server] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        url_downloader.limit_rate(server.url(), 0);
+    });
+
+    const auto file_name = data_dir.path() + "/downloaded.img";
+    const auto start = std::chrono::steady_clock::now();
+    const auto hash = url_downloader.download_to(server.url(), file_name, content.size(), -1, stub_monitor);
+    lifted.wait();
+
+    EXPECT_EQ(hash, hash_of(content));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5)); // rather than 16 seconds
+}
+
+TEST_F(URLDownloader, download_to_does_not_split_rate_limited_download_into_ranges)
+{
+    const auto content = make_content(64 * 1024 * 1024);
+    mpt::LocalHttpServer server{content};
+
+    mp::URLDownloader ranged_downloader{cache_dir.path(), std::chrono::seconds(10), 4};
+    ranged_downloader.limit_rate(server.url(), 1024 * 1024 * 1024);
+    const auto file_name = data_dir.path() + "/downloaded.img";
+    const auto hash = ranged_downloader.download_to(server.url(), file_name, content.size(), -1, stub_monitor);
+
+    EXPECT_EQ(hash, hash_of(content));
+    EXPECT_THAT(server.requested_ranges(), ElementsAre(""));
+}
+
+TEST_F(URLDownloader, last_modified_gives_up_when_downloads_are_aborted)
+{
+    mpt::LocalHttpServer server{make_content(1024)};
+    server.set_answers_head_requests(false);
+
+    QTimer::singleShot(std::chrono::milliseconds(200), [this] { url_downloader.abort_all_downloads(); });
+
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_THROW(url_downloader.last_modified(server.url()), mp::AbortedDownloadException);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5)); // well before the timeout
+}
+
+TEST_F(URLDownloader, reuses_connection_across_requests)
+{
+    const auto content = make_content(1024);
+    mpt::LocalHttpServer server{content};
+    server.set_keeps_connections_alive(true);
+
+    url_downloader.last_modified(server.url());
+    EXPECT_EQ(url_downloader.download(server.url()), content);
+    EXPECT_EQ(url_downloader.download(server.url()), content);
+
+    EXPECT_EQ(server.connections_accepted(), 1);
+}
+
+TEST_F(URLDownloader, reuses_connection_across_threads)
+{
+    const auto content = make_content(1024);
+    mpt::LocalHttpServer server{content};
+    server.set_keeps_connections_alive(true);
+
+    url_downloader.last_modified(server.url());
+
+    // The server answers from this thread, so it keeps serving events while the other downloads
+    auto downloaded = std::async(std::launch::async, [this, &server] { return url_downloader.download(server.url()); });
+    while (downloaded.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+
+    EXPECT_EQ(downloaded.get(), content);
+    EXPECT_EQ(server.connections_accepted(), 1);
+}
@@ -89,6 +89,15 @@ TEST(Utils, path_root_foo_valid)
     EXPECT_FALSE(mp::utils::invalid_target_path(QString("//foo")));
 }
 
+TEST(Utils, native_mount_tag_fits_virtio_fs_and_ignores_redundant_separators)
+{
+    const auto tag = mp::utils::native_mount_tag("/home/ubuntu/src");
+
+    EXPECT_LE(tag.size(), 36u);
+    EXPECT_EQ(tag, mp::utils::native_mount_tag("/home//ubuntu/src/"));
+    EXPECT_NE(tag, mp::utils::native_mount_tag("/home/ubuntu/data"));
+}
+
 TEST(Utils, path_dev_invalid)
 {
     EXPECT_TRUE(mp::utils::invalid_target_path(QString("/dev")));
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "file_operations.h"
+#include "mock_logger.h"
+#include "path.h"
+#include "temp_dir.h"
+
+#include <multipass/xz_image_decoder.h>
+
+#include <gmock/gmock.h>
+
+#include <QCryptographicHash>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+namespace mpt = multipass::test;
+
+using namespace testing;
+
+namespace
+{
+struct XzImageDecoder : public Test
+{
+    // What sample.img.xz decodes to
+    static QByteArray expected_image()
+    {
+        QByteArray image;
+        for (auto i = 0; i < 20000; ++i)
+            image += QString("multipass xz test line %1\n").arg(i).toUtf8();
+
+        return image;
+    }
+
+    static QString expected_hash()
+    {
+        return QCryptographicHash::hash(expected_image(), QCryptographicHash::Sha256).toHex();
+    }
+
+    mpt::TempDir temp_dir;
+    const QString xz_image_path{mpt::test_data_path_for("sample.img.xz")};
+    // The same image, compressed in 64KiB blocks
+    const QString multi_block_xz_image_path{mpt::test_data_path_for("sample-multi-block.img.xz")};
+    const QString decoded_image_path{temp_dir.path() + "/sample.img"};
+    mp::ProgressMonitor stub_monitor{[](int, int) { return true; }};
+};
+} // namespace
+
+TEST_F(XzImageDecoder, decodes_file)
+{
+    mp::XzImageDecoder decoder{xz_image_path};
+    decoder.decode_to(decoded_image_path, stub_monitor);
+
+    EXPECT_EQ(mpt::load(decoded_image_path), expected_image());
+}
+
+TEST_F(XzImageDecoder, returns_hash_of_decoded_file)
+{
+    mp::XzImageDecoder decoder{xz_image_path};
+
+    EXPECT_EQ(decoder.decode_to(decoded_image_path, stub_monitor), expected_hash());
+}
+
+TEST_F(XzImageDecoder, returns_hash_of_decoded_file_when_decoding_in_parallel)
+{
+    mp::XzImageDecoder decoder{multi_block_xz_image_path, 4};
+
+    EXPECT_EQ(decoder.decode_to(decoded_image_path, stub_monitor), expected_hash());
+}
+
+TEST_F(XzImageDecoder, decodes_multi_block_file_in_parallel)
+{
+    auto logger_scope = mpt::MockLogger::inject();
+    logger_scope.mock_logger->screen_logs(mpl::Level::error);
+    logger_scope.mock_logger->expect_log(mpl::Level::debug, "on 4 threads");
+
+    mp::XzImageDecoder decoder{multi_block_xz_image_path, 4};
+    decoder.decode_to(decoded_image_path, stub_monitor);
+
+    EXPECT_EQ(mpt::load(decoded_image_path), expected_image());
+}
+
+TEST_F(XzImageDecoder, decodes_multi_block_file_with_one_thread)
+{
+    auto logger_scope = mpt::MockLogger::inject();
+    logger_scope.mock_logger->screen_logs(mpl::Level::error);
+    logger_scope.mock_logger->expect_log(mpl::Level::debug, "threads", Exactly(0));
+
+    mp::XzImageDecoder decoder{multi_block_xz_image_path, 1};
+    decoder.decode_to(decoded_image_path, stub_monitor);
+
+    EXPECT_EQ(mpt::load(decoded_image_path), expected_image());
+}
+
+TEST_F(XzImageDecoder, decodes_multi_block_file_with_more_threads_than_blocks)
+{
+    mp::XzImageDecoder decoder{multi_block_xz_image_path, 32};
+    decoder.decode_to(decoded_image_path, stub_monitor);
+
+    EXPECT_EQ(mpt::load(decoded_image_path), expected_image());
+}
+
+TEST_F(XzImageDecoder, throws_on_corrupt_block_when_decoding_in_parallel)
+{
+    auto xz_data = mpt::load(multi_block_xz_image_path);
+    xz_data[xz_data.size() / 2] = static_cast<char>(~xz_data[xz_data.size() / 2]);
+
+    const auto corrupt_xz_image_path = temp_dir.path() + "/corrupt.img.xz";
+    mpt::make_file_with_content(corrupt_xz_image_path, xz_data.toStdString());
+
+    mp::XzImageDecoder decoder{corrupt_xz_image_path, 4};
+    EXPECT_THROW(decoder.decode_to(decoded_image_path, stub_monitor), std::runtime_error);
+}
+
+TEST_F(XzImageDecoder, decodes_stream_in_chunks)
+{
+    const auto xz_data = mpt::load(xz_image_path);
+
+    mp::XzImageDecoder decoder;
+    decoder.start_decoding_to(decoded_image_path);
+    for (auto pos = 0; pos < xz_data.size(); pos += 100)
+        decoder.decode(xz_data.mid(pos, 100));
+
+    EXPECT_EQ(decoder.finish_decoding(), expected_hash());
+    EXPECT_EQ(mpt::load(decoded_image_path), expected_image());
+}
+
+TEST_F(XzImageDecoder, stops_at_end_of_stream)
+{
+    mp::XzImageDecoder decoder;
+    decoder.start_decoding_to(decoded_image_path);
+
+    EXPECT_FALSE(decoder.decode(mpt::load(xz_image_path) + "trailing garbage"));
+    EXPECT_NO_THROW(decoder.finish_decoding());
+}
+
+TEST_F(XzImageDecoder, throws_on_truncated_stream)
+{
+    const auto xz_data = mpt::load(xz_image_path);
+
+    mp::XzImageDecoder decoder;
+    decoder.start_decoding_to(decoded_image_path);
+    decoder.decode(xz_data.left(xz_data.size() / 2));
+
+    EXPECT_THROW(decoder.finish_decoding(), std::runtime_error);
+}
+
+TEST_F(XzImageDecoder, throws_on_data_that_is_not_xz)
+{
+    mp::XzImageDecoder decoder;
+    decoder.start_decoding_to(decoded_image_path);
+
+    EXPECT_THROW(decoder.decode("This is not an xz stream"), std::runtime_error);
+}
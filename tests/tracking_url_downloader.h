@@ -22,6 +22,8 @@
 
 #include <multipass/url_downloader.h>
 
+#include <QCryptographicHash>
+
 namespace multipass
 {
 namespace test
@@ -36,12 +38,27 @@ struct TrackingURLDownloader : public URLDownloader
     {
     }
 
-    void download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
-                     const ProgressMonitor&) override
+    QString download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
+                        const ProgressMonitor&) override
     {
         make_file_with_content(file_name, content);
         downloaded_urls << url.toString();
         downloaded_files << file_name;
+
+        return QCryptographicHash::hash(QByteArray::fromStdString(content), QCryptographicHash::Sha256).toHex();
+    }
+
+    QString stream_to(const QUrl& url, const DataConsumer& consumer, int64_t size, const int download_type,
+                      const ProgressMonitor&) override
+    {
+        const auto data = QByteArray::fromStdString(content);
+        for (auto pos = 0; pos < data.size(); pos += chunk_size)
+            consumer(data.mid(pos, chunk_size));
+
+        downloaded_urls << url.toString();
+        streamed_urls << url.toString();
+
+        return QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex();
     }
 
     QByteArray download(const QUrl& url) override
@@ -55,8 +72,10 @@ struct TrackingURLDownloader : public URLDownloader
     }
 
     const std::string content;
+    const int chunk_size{4096};
     QStringList downloaded_files;
     QStringList downloaded_urls;
+    QStringList streamed_urls;
 };
 } // namespace test
 } // namespace multipass